@@ -0,0 +1,174 @@
+#include "Diagnostics/ApduStats.h"
+
+#include "Utils/Hex.h"
+
+#include "XFS/Logger.h"
+
+#include <fstream>
+#include <sstream>
+
+#include <boost/thread/lock_guard.hpp>
+
+namespace bc = boost::chrono;
+
+namespace Diagnostics {
+    /// Выводит 16-ричное представление байта, например, `"a4"`.
+    static void writeByte(std::ostream& os, BYTE value) {
+        char buf[2];
+        os.write(buf, Hex::byte(value, buf) - buf);
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    CTString insName(BYTE ins) {
+        switch (ins) {
+            case 0x0E: return CTString("ERASE BINARY");
+            case 0x1E: return CTString("APPLICATION BLOCK");
+            case 0x20: return CTString("VERIFY");
+            case 0x24: return CTString("CHANGE REFERENCE DATA");
+            case 0x70: return CTString("MANAGE CHANNEL");
+            case 0x82: return CTString("EXTERNAL AUTHENTICATE");
+            case 0x84: return CTString("GET CHALLENGE");
+            case 0x88: return CTString("INTERNAL AUTHENTICATE");
+            case 0xA4: return CTString("SELECT");
+            case 0xA8: return CTString("GET PROCESSING OPTIONS");
+            case 0xAE: return CTString("GENERATE AC");
+            case 0xB0: return CTString("READ BINARY");
+            case 0xB2: return CTString("READ RECORD");
+            case 0xC0: return CTString("GET RESPONSE");
+            case 0xCA: return CTString("GET DATA");
+            case 0xD6: return CTString("UPDATE BINARY");
+            case 0xDA: return CTString("PUT DATA");
+            case 0xDC: return CTString("UPDATE RECORD");
+        }
+        return CTString();
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    const unsigned long* ApduStats::bounds() {
+        static const unsigned long bounds[bucketCount - 1] = {
+            250, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000
+        };
+        return bounds;
+    }
+    ApduStats::Entry::Entry()
+        : count(0), errors(0), totalUs(0), minUs(0), maxUs(0), totalBytes(0), maxBytes(0)
+    {
+        for (std::size_t i = 0; i < bucketCount; ++i) {
+            buckets[i] = 0;
+        }
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    const DWORD ApduStats::defaultPeriod;
+
+    ApduStats& ApduStats::instance() {
+        static ApduStats stats;
+        return stats;
+    }
+    ApduStats::ApduStats() : mPeriod(bc::seconds(defaultPeriod)), mDirty(false) {}
+    ApduStats::~ApduStats() {
+        dump();
+    }
+    void ApduStats::setDumpFile(const std::string& path, DWORD period) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        if (!mFile.empty()) {
+            return;
+        }
+        {XFS::Logger() << "ApduStats::setDumpFile(path=" << path << ", period=" << period << ')';}
+        mFile = path;
+        mPeriod = bc::seconds(period != 0 ? period : defaultPeriod);
+        mNextDump = bc::steady_clock::now() + mPeriod;
+    }
+    void ApduStats::record(const BYTE* command, std::size_t commandSize,
+                           const BYTE* response, std::size_t responseSize,
+                           bc::steady_clock::duration elapsed, PCSC::Status status) {
+        // Команда короче заголовка некорректна, но учитываем и ее, чтобы не терять время.
+        const WORD key = (WORD)((commandSize > 0 ? command[0] << 8 : 0) | (commandSize > 1 ? command[1] : 0));
+        const unsigned long us = (unsigned long)bc::duration_cast<bc::microseconds>(elapsed).count();
+        std::size_t bucket = 0;
+        while (bucket < bucketCount - 1 && us > bounds()[bucket]) {
+            ++bucket;
+        }
+
+        bc::steady_clock::time_point now = bc::steady_clock::now();
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        Entry& e = mEntries[key];
+        if (e.count == 0 || us < e.minUs) {
+            e.minUs = us;
+        }
+        if (us > e.maxUs) {
+            e.maxUs = us;
+        }
+        ++e.count;
+        e.totalUs += us;
+        ++e.buckets[bucket];
+        if (!status || responseSize < 2) {
+            ++e.errors;
+        } else {
+            const std::size_t bytes = responseSize - 2;
+            e.totalBytes += bytes;
+            if (bytes > e.maxBytes) {
+                e.maxBytes = (unsigned long)bytes;
+            }
+            ++e.sw[(WORD)(response[bytes] << 8 | response[bytes + 1])];
+        }
+        mDirty = true;
+        if (!mFile.empty() && now >= mNextDump) {
+            dumpLocked();
+            mNextDump = now + mPeriod;
+        }
+    }
+    std::string ApduStats::toJSONString() {
+        std::ostringstream ss;
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        writeLocked(ss);
+        return ss.str();
+    }
+    void ApduStats::dump() {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        dumpLocked();
+    }
+    void ApduStats::dumpLocked() {
+        if (mFile.empty() || !mDirty) {
+            return;
+        }
+        std::ofstream f(mFile.c_str(), std::ios_base::out | std::ios_base::trunc);
+        writeLocked(f);
+        mDirty = false;
+        if (!f) {
+            XFS::Logger() << "ApduStats::dump: Unable to write " << mFile;
+        }
+    }
+    void ApduStats::writeLocked(std::ostream& os) const {
+        os << "{\"bounds\":[";
+        for (std::size_t i = 0; i < bucketCount - 1; ++i) {
+            os << (i != 0 ? "," : "") << bounds()[i];
+        }
+        os << "],\"commands\":[";
+        for (EntryMap::const_iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+            const Entry& e = it->second;
+            os << (it != mEntries.begin() ? ",\n" : "\n");
+            os << "{\"cla\":\"";
+            writeByte(os, (BYTE)(it->first >> 8));
+            os << "\",\"ins\":\"";
+            writeByte(os, (BYTE)(it->first & 0xFF));
+            os << '"';
+            CTString name = insName((BYTE)(it->first & 0xFF));
+            if (name.isValid()) {
+                os << ",\"name\":\"" << name << '"';
+            }
+            os << ",\"count\":" << e.count << ",\"errors\":" << e.errors
+               << ",\"totalUs\":" << e.totalUs << ",\"minUs\":" << e.minUs << ",\"maxUs\":" << e.maxUs
+               << ",\"buckets\":[";
+            for (std::size_t i = 0; i < bucketCount; ++i) {
+                os << (i != 0 ? "," : "") << e.buckets[i];
+            }
+            os << "],\"totalBytes\":" << e.totalBytes << ",\"maxBytes\":" << e.maxBytes << ",\"sw\":{";
+            for (std::map<WORD, unsigned long>::const_iterator sw = e.sw.begin(); sw != e.sw.end(); ++sw) {
+                os << (sw != e.sw.begin() ? ",\"" : "\"");
+                writeByte(os, (BYTE)(sw->first >> 8));
+                writeByte(os, (BYTE)(sw->first & 0xFF));
+                os << "\":" << sw->second;
+            }
+            os << "}}";
+        }
+        os << "\n]}\n";
+    }
+} // namespace Diagnostics
@@ -0,0 +1,93 @@
+#include "PCSC/Backend.h"
+
+#include "XFS/Logger.h"
+
+#include <map>
+
+namespace PCSC {
+    /// Вызывает функции `SCard*` библиотеки PC/SC, с которой собран мост.
+    class NativeBackend : public Backend {
+    public:
+        virtual const char* name() const { return "native"; }
+
+        virtual LONG establishContext(LPSCARDCONTEXT phContext) {
+            return SCardEstablishContext(SCARD_SCOPE_USER, NULL, NULL, phContext);
+        }
+        virtual LONG releaseContext(SCARDCONTEXT hContext) {
+            return SCardReleaseContext(hContext);
+        }
+        virtual LONG listReaders(SCARDCONTEXT hContext, LPSTR mszReaders, LPDWORD pcchReaders) {
+            return SCardListReaders(hContext, NULL, mszReaders, pcchReaders);
+        }
+        virtual LONG getStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout,
+                                     SCARD_READERSTATE* rgReaderStates, DWORD cReaders) {
+            return SCardGetStatusChange(hContext, dwTimeout, rgReaderStates, cReaders);
+        }
+        virtual LONG cancel(SCARDCONTEXT hContext) {
+            return SCardCancel(hContext);
+        }
+
+        virtual LONG connect(SCARDCONTEXT hContext, LPCSTR szReader, DWORD dwShareMode,
+                             DWORD dwPreferredProtocols, LPSCARDHANDLE phCard, LPDWORD pdwActiveProtocol) {
+            return SCardConnect(hContext, szReader, dwShareMode, dwPreferredProtocols, phCard, pdwActiveProtocol);
+        }
+        virtual LONG reconnect(SCARDHANDLE hCard, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                               DWORD dwInitialization, LPDWORD pdwActiveProtocol) {
+            return SCardReconnect(hCard, dwShareMode, dwPreferredProtocols, dwInitialization, pdwActiveProtocol);
+        }
+        virtual LONG disconnect(SCARDHANDLE hCard, DWORD dwDisposition) {
+            return SCardDisconnect(hCard, dwDisposition);
+        }
+        virtual LONG beginTransaction(SCARDHANDLE hCard) {
+            return SCardBeginTransaction(hCard);
+        }
+        virtual LONG endTransaction(SCARDHANDLE hCard, DWORD dwDisposition) {
+            return SCardEndTransaction(hCard, dwDisposition);
+        }
+
+        virtual LONG status(SCARDHANDLE hCard, LPSTR szReaderName, LPDWORD pcchReaderLen,
+                            LPDWORD pdwState, LPDWORD pdwProtocol, LPBYTE pbAtr, LPDWORD pcbAtrLen) {
+            return SCardStatus(hCard, szReaderName, pcchReaderLen, pdwState, pdwProtocol, pbAtr, pcbAtrLen);
+        }
+        virtual LONG transmit(SCARDHANDLE hCard, const SCARD_IO_REQUEST* pioSendPci,
+                              LPCBYTE pbSendBuffer, DWORD cbSendLength,
+                              LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength) {
+            return SCardTransmit(hCard, pioSendPci, pbSendBuffer, cbSendLength, NULL, pbRecvBuffer, pcbRecvLength);
+        }
+        virtual LONG getAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen) {
+            return SCardGetAttrib(hCard, dwAttrId, pbAttr, pcbAttrLen);
+        }
+    };
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    typedef std::map<std::string, Backend::Factory> Factories;
+    /// Реестр создается при первом обращении, т.к. реализации регистрируются статическими объектами.
+    static Factories& factories() {
+        static Factories result;
+        return result;
+    }
+    static Backend* createNative(const std::string&) {
+        return &Backend::native();
+    }
+    static Backend::Registrar nativeRegistrar("native", &createNative);
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    Backend& Backend::native() {
+        static NativeBackend backend;
+        return backend;
+    }
+    void Backend::add(const char* name, Factory factory) {
+        factories()[name] = factory;
+    }
+    Backend* Backend::create(const std::string& name, const std::string& script) {
+        if (name.empty()) {
+            return &native();
+        }
+        Factories::const_iterator it = factories().find(name);
+        if (it == factories().end()) {
+            XFS::Logger() << "Backend::create: unknown PC/SC backend '" << name << "'";
+            return NULL;
+        }
+        Backend* backend = it->second(script);
+        {XFS::Logger() << "Backend::create(name=" << name << ", script=" << script << ") = " << (backend != NULL);}
+        return backend;
+    }
+} // namespace PCSC
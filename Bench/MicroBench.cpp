@@ -0,0 +1,394 @@
+/** @file
+    Микробенчмарк общих примитивов моста, через которые проходит каждый запрос и каждое событие:
+    перевод кодов PC/SC в коды XFS (`PCSC::Status::translate`), получение названий перечислений
+    (`Enum::name`), вывод флагов с названиями (`Flags`), вывод APDU в 16-ричном виде (`Hex`),
+    формирование строки журнала (`XFS::Logger`), а также создание и отправка результата (`XFS::Result`) и его составляющие:
+    выделение `WFSRESULT` и `GetSystemTime`.
+@par
+    Каждый примитив вызывается `--iterations` раз подряд в `--rounds` раундах, для каждого раунда
+    вычисляется среднее время одного вызова в наносекундах. Результат по каждому примитиву
+    выводится строкой JSON со сводкой по раундам, чтобы оптимизацию этих примитивов можно было
+    оценивать числами.
+*/
+#include "Harness/Client.h"
+
+#include "Settings.h"
+
+#include "Config/FileSource.h"
+
+#include "PCSC/ReaderState.h"
+#include "PCSC/Status.h"
+
+#include "Utils/Hex.h"
+
+#include "XFS/Logger.h"
+#include "XFS/Memory.h"
+#include "XFS/Result.h"
+#include "XFS/Status.h"
+
+#include <algorithm>
+// Для std::strtoul
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <xfsapi.h>
+// Для WFS_CFG_USER_DEFAULT_XFS_ROOT
+#include <xfsconf.h>
+#include <XFSIDC.h>
+
+namespace bc = boost::chrono;
+using Harness::Clock;
+using Harness::MessageQueue;
+using Harness::Samples;
+
+namespace {
+    struct Options {
+        unsigned long iterations;
+        unsigned int rounds;
+        /// Подстрока названия примитива, пустая строка -- все примитивы.
+        std::string filter;
+        bool trace;
+    public:
+        Options() : iterations(1000000), rounds(5), trace(false) {}
+    };
+
+    void usage() {
+        std::cerr <<
+            "Usage: pcsc-xfs-microbench [options]\n"
+            "  --iterations N     calls of each primitive per round (1000000)\n"
+            "  --rounds N         rounds per primitive (5)\n"
+            "  --filter TEXT      run only primitives whose name contains TEXT\n"
+            "  --trace            print XFS trace to stderr\n";
+    }
+    bool parse(int argc, char* argv[], Options& o) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--trace") {
+                o.trace = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg == "--iterations") { o.iterations = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--rounds")     { o.rounds = (unsigned int)std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--filter")     { o.filter = value; } else {
+                return false;
+            }
+        }
+        return o.iterations > 0 && o.rounds > 0;
+    }
+
+    /// Накопитель результатов, не дающий компилятору выбросить вызовы примитивов.
+    volatile unsigned long sink = 0;
+
+    /// Входные значения перебираются по кругу, размер таблиц -- степень двойки.
+    const std::size_t inputMask = 7;
+    /// Логический сервис, настройки провайдера которого читаются.
+    const char* const logicalName = "IDC";
+    const LONG pcscCodes[inputMask + 1] = {
+        SCARD_S_SUCCESS, SCARD_E_TIMEOUT, SCARD_E_NO_SMARTCARD, SCARD_W_REMOVED_CARD,
+        SCARD_E_SHARING_VIOLATION, SCARD_E_READER_UNAVAILABLE, SCARD_E_CANCELLED, SCARD_E_INVALID_HANDLE,
+    };
+    const HRESULT xfsCodes[inputMask + 1] = {
+        WFS_SUCCESS, WFS_ERR_TIMEOUT, WFS_ERR_CANCELED, WFS_ERR_HARDWARE_ERROR,
+        WFS_ERR_INTERNAL_ERROR, WFS_ERR_CONNECTION_LOST, WFS_ERR_LOCKED, WFS_ERR_UNSUPP_COMMAND,
+    };
+    const DWORD messageTypes[inputMask + 1] = {
+        WFS_OPEN_COMPLETE, WFS_GETINFO_COMPLETE, WFS_EXECUTE_COMPLETE, WFS_EXECUTE_EVENT,
+        WFS_SERVICE_EVENT, WFS_SYSTEM_EVENT, WFS_TIMER_EVENT, WFS_CLOSE_COMPLETE,
+    };
+    const DWORD readerStates[inputMask + 1] = {
+        SCARD_STATE_EMPTY, SCARD_STATE_PRESENT, SCARD_STATE_PRESENT | SCARD_STATE_INUSE,
+        SCARD_STATE_CHANGED | SCARD_STATE_PRESENT, SCARD_STATE_CHANGED | SCARD_STATE_EMPTY,
+        SCARD_STATE_UNAWARE, SCARD_STATE_UNKNOWN | SCARD_STATE_IGNORE | SCARD_STATE_CHANGED,
+        SCARD_STATE_PRESENT | SCARD_STATE_EXCLUSIVE | SCARD_STATE_MUTE,
+    };
+
+    /// Вызывает примитив `n` раз и возвращает затраченное время.
+    typedef Clock::duration (*Body)(unsigned long n);
+
+    Clock::duration statusTranslate(unsigned long n) {
+        unsigned long acc = 0;
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            acc += (unsigned long)PCSC::Status(pcscCodes[i & inputMask]).translate();
+        }
+        Clock::duration d = Clock::now() - start;
+        sink += acc;
+        return d;
+    }
+    Clock::duration pcscStatusName(unsigned long n) {
+        unsigned long acc = 0;
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            acc += PCSC::Status(pcscCodes[i & inputMask]).name().size();
+        }
+        Clock::duration d = Clock::now() - start;
+        sink += acc;
+        return d;
+    }
+    Clock::duration xfsStatusName(unsigned long n) {
+        unsigned long acc = 0;
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            acc += XFS::Status(xfsCodes[i & inputMask]).name().size();
+        }
+        Clock::duration d = Clock::now() - start;
+        sink += acc;
+        return d;
+    }
+    Clock::duration msgTypeName(unsigned long n) {
+        unsigned long acc = 0;
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            acc += XFS::MsgType(messageTypes[i & inputMask]).name().size();
+        }
+        Clock::duration d = Clock::now() - start;
+        sink += acc;
+        return d;
+    }
+    /// Вывод перечисления с названием и кодом, как при записи в журнал.
+    Clock::duration enumFormat(unsigned long n) {
+        std::ostringstream os;
+        unsigned long acc = 0;
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            os.seekp(0);
+            os << PCSC::Status(pcscCodes[i & inputMask]);
+            acc += (unsigned long)os.tellp();
+        }
+        Clock::duration d = Clock::now() - start;
+        sink += acc;
+        return d;
+    }
+    /// Разворачивание флагов в список названий, как при записи в журнал.
+    Clock::duration flagsFormat(unsigned long n) {
+        std::ostringstream os;
+        unsigned long acc = 0;
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            os.seekp(0);
+            os << PCSC::ReaderState(readerStates[i & inputMask]);
+            acc += (unsigned long)os.tellp();
+        }
+        Clock::duration d = Clock::now() - start;
+        sink += acc;
+        return d;
+    }
+    /// Вывод APDU максимальной короткой длины (256 байт данных и слово состояния), как при записи в журнал.
+    Clock::duration hexFormat(unsigned long n) {
+        unsigned char apdu[258];
+        for (std::size_t i = 0; i < sizeof(apdu); ++i) {
+            apdu[i] = (unsigned char)(i * 37);
+        }
+        std::ostringstream os;
+        unsigned long acc = 0;
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            os.seekp(0);
+            os << Hex(apdu, sizeof(apdu));
+            acc += (unsigned long)os.tellp();
+        }
+        Clock::duration d = Clock::now() - start;
+        sink += acc;
+        return d;
+    }
+    /// Типичная строка журнала вызова PC/SC. Строка формируется, даже если трасса отбрасывается.
+    Clock::duration loggerLine(unsigned long n) {
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            XFS::Logger() << "SCardTransmit(hCard=" << i << ", ...) = " << PCSC::Status(pcscCodes[i & inputMask]);
+        }
+        return Clock::now() - start;
+    }
+    Clock::duration systemTime(unsigned long n) {
+        unsigned long acc = 0;
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            SYSTEMTIME st;
+            GetSystemTime(&st);
+            acc += st.wMilliseconds;
+        }
+        Clock::duration d = Clock::now() - start;
+        sink += acc;
+        return d;
+    }
+    Clock::duration resultAlloc(unsigned long n) {
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            WFMFreeBuffer(XFS::allocResult());
+        }
+        return Clock::now() - start;
+    }
+    /// Результат чтения чипа с данными одним блоком, как в `Service::wrap`, и его освобождение.
+    Clock::duration resultGraph(unsigned long n) {
+        static const BYTE atr[] = {0x3B, 0x8F, 0x80, 0x01, 0x80, 0x4F, 0x0C, 0xA0, 0x00, 0x00, 0x03, 0x06};
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            WFSRESULT* result = XFS::allocResult();
+            XFS::Block block(result, XFS::Layout()
+                .add<WFSIDCCARDDATA*>(2)
+                .add<WFSIDCCARDDATA>()
+                .add<BYTE>(sizeof(atr)), "microbench"
+            );
+            WFSIDCCARDDATA** list = block.take<WFSIDCCARDDATA*>(2);
+            list[0] = block.take<WFSIDCCARDDATA>();
+            list[0]->wDataSource = WFS_IDC_CHIP;
+            list[0]->ulDataLength = sizeof(atr);
+            list[0]->lpbData = block.copy(atr, sizeof(atr));
+            result->lpBuffer = list;
+            WFSFreeResult(result);
+        }
+        return Clock::now() - start;
+    }
+    /** Создание результата и его отправка окну, как при завершении запроса. Результаты отправляются
+        пачками, очередь разбирается и результаты освобождаются вне замера.
+    */
+    Clock::duration resultSend(unsigned long n) {
+        static const HWND hWnd = MessageQueue::instance().create();
+        static const unsigned long batch = 1024;
+        Clock::duration total = Clock::duration::zero();
+        for (unsigned long done = 0; done < n;) {
+            const unsigned long count = std::min(batch, n - done);
+            Clock::time_point start = Clock::now();
+            for (unsigned long i = 0; i < count; ++i) {
+                XFS::Result((REQUESTID)(done + i), (HSERVICE)1, (HRESULT)WFS_SUCCESS).send(hWnd, WFS_EXECUTE_COMPLETE);
+            }
+            total += Clock::now() - start;
+            done += count;
+
+            MessageQueue::Message m;
+            while (MessageQueue::instance().get(hWnd, m, Clock::duration::zero())) {
+                WFSFreeResult((LPWFSRESULT)m.lParam);
+            }
+        }
+        return total;
+    }
+    /// То же для копий одного события, как при рассылке события подписчикам (`EventNotifier::notify`).
+    Clock::duration resultClone(unsigned long n) {
+        static const HWND hWnd = MessageQueue::instance().create();
+        static const unsigned long batch = 1024;
+        XFS::Result event((REQUESTID)0, (HSERVICE)1, (HRESULT)WFS_SUCCESS);
+        event.cardInserted();
+        Clock::duration total = Clock::duration::zero();
+        for (unsigned long done = 0; done < n;) {
+            const unsigned long count = std::min(batch, n - done);
+            Clock::time_point start = Clock::now();
+            for (unsigned long i = 0; i < count; ++i) {
+                event.clone().send(hWnd, WFS_EXECUTE_EVENT);
+            }
+            total += Clock::now() - start;
+            done += count;
+
+            MessageQueue::Message m;
+            while (MessageQueue::instance().get(hWnd, m, Clock::duration::zero())) {
+                WFSFreeResult((LPWFSRESULT)m.lParam);
+            }
+        }
+        event.send(hWnd, WFS_EXECUTE_EVENT);
+        MessageQueue::Message m;
+        while (MessageQueue::instance().get(hWnd, m, Clock::duration::zero())) {
+            WFSFreeResult((LPWFSRESULT)m.lParam);
+        }
+        return total;
+    }
+    /// Чтение настроек провайдера из конфигурации, как при каждом `WFPOpen` без кэша.
+    Clock::duration settingsRead(unsigned long n) {
+        unsigned long acc = 0;
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            acc += Settings(logicalName, 0).readerName.size();
+        }
+        Clock::duration d = Clock::now() - start;
+        sink += acc;
+        return d;
+    }
+    /// То же из конфигурации, разобранной из `.reg` файла (`Config::FileSource`).
+    Clock::duration settingsReadFile(unsigned long n) {
+        static const char reg[] =
+            "Windows Registry Editor Version 5.00\n"
+            "[HKEY_USERS\\.DEFAULT\\XFS\\LOGICAL_SERVICES\\IDC]\n"
+            "\"Provider\"=\"PC/SC-TO-CEN/XFS-BRIDGE\"\n"
+            "[HKEY_LOCAL_MACHINE\\SOFTWARE\\XFS\\SERVICE_PROVIDERS\\PC/SC-TO-CEN/XFS-BRIDGE]\n"
+            "\"ReaderName\"=\"Virtual Reader 0\"\n"
+            "[HKEY_LOCAL_MACHINE\\SOFTWARE\\XFS\\SERVICE_PROVIDERS\\PC/SC-TO-CEN/XFS-BRIDGE\\Workarounds]\n"
+            "\"CorrectChipIO\"=dword:00000001\n";
+        std::istringstream is(reg);
+        std::string error;
+        Config::Source::use(Config::Source::Ptr(Config::FileSource::load(is, "microbench", error)));
+        Clock::duration d = settingsRead(n);
+        Config::Source::use(Config::Source::Ptr());
+        return d;
+    }
+    Clock::duration settingsCached(unsigned long n) {
+        unsigned long acc = 0;
+        Clock::time_point start = Clock::now();
+        for (unsigned long i = 0; i < n; ++i) {
+            acc += SettingsCache::instance().get(logicalName)->readerName.size();
+        }
+        Clock::duration d = Clock::now() - start;
+        sink += acc;
+        return d;
+    }
+
+    struct Case {
+        const char* name;
+        Body body;
+        /// Во сколько раз меньше `--iterations` вызывается примитив, для медленных примитивов.
+        unsigned long divisor;
+    };
+    const Case cases[] = {
+        {"PCSC::Status::translate", &statusTranslate, 1},
+        {"PCSC::Status::name",      &pcscStatusName,  1},
+        {"XFS::Status::name",       &xfsStatusName,   1},
+        {"XFS::MsgType::name",      &msgTypeName,     1},
+        {"Enum::operator<<",        &enumFormat,      1},
+        {"Flags::operator<<",       &flagsFormat,     1},
+        {"Hex::operator<<",         &hexFormat,       1},
+        {"XFS::Logger",             &loggerLine,      1},
+        {"GetSystemTime",           &systemTime,      1},
+        {"XFS::allocResult",        &resultAlloc,     1},
+        {"XFS::Block",              &resultGraph,     1},
+        {"XFS::Result::send",       &resultSend,      1},
+        {"XFS::Result::clone",      &resultClone,     1},
+        {"Settings::Settings",      &settingsRead,    100},
+        {"Settings::Settings[file]",&settingsReadFile,1},
+        {"SettingsCache::get",      &settingsCached,  1},
+    };
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options o;
+    if (!parse(argc, argv, o)) {
+        usage();
+        return 2;
+    }
+    if (o.trace) {
+        Harness::setTrace(&std::cerr);
+    }
+    Harness::Registry::instance().set(WFS_CFG_USER_DEFAULT_XFS_ROOT,
+        std::string("LOGICAL_SERVICES\\") + logicalName, "Provider", "PC/SC-TO-CEN/XFS-BRIDGE");
+    for (std::size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        const Case& test = cases[c];
+        if (!o.filter.empty() && std::string(test.name).find(o.filter) == std::string::npos) {
+            continue;
+        }
+        const unsigned long iterations = std::max(o.iterations / test.divisor, 1UL);
+        // Прогрев: статические таблицы, синглтоны и кэши.
+        test.body(std::min(iterations, 1000UL));
+        Samples ns;
+        for (unsigned int r = 0; r < o.rounds; ++r) {
+            Clock::duration d = test.body(iterations);
+            ns.add(bc::duration<double, boost::nano>(d).count() / iterations);
+        }
+        std::cout << "{\"primitive\":\"" << test.name << "\",\"iterations\":" << iterations
+                  << ",\"rounds\":" << o.rounds << ",\"nsPerCall\":";
+        ns.json(std::cout);
+        std::cout << '}' << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,509 @@
+/** @file
+    Набор воспроизводимых нагрузочных сценариев сервис-провайдера на симуляторе PC/SC:
+    - `insert` -- задержка от вставки карты до события `WFS_EXEE_IDC_MEDIAINSERTED` и до завершения
+      ожидающего ее `WFS_CMD_IDC_READ_RAW_DATA`;
+    - `status` -- задержка `WFS_INF_IDC_STATUS` без карты и с картой;
+    - `chipio` -- количество `WFS_CMD_IDC_CHIP_IO` в секунду на считыватель.
+@par
+    Каждый сценарий выполняется для всех сочетаний количества считывателей и открытых сервисов
+    (сервисов не меньше, чем считывателей). Сервис `i` привязан к считывателю `i % readers`.
+    Результат каждого прогона выводится отдельной строкой JSON.
+*/
+#include "Harness/Client.h"
+#include "Simulator/Simulator.h"
+
+#include <algorithm>
+// Для std::strtoul
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <xfsspi.h>
+#include <XFSIDC.h>
+
+namespace bc = boost::chrono;
+using Harness::Clock;
+using Harness::MessageQueue;
+using Harness::Samples;
+
+namespace {
+    struct Options {
+        std::vector<unsigned long> readers;
+        std::vector<unsigned long> services;
+        std::vector<std::string> scenarios;
+        /// Количество вставок карты в сценарии `insert`.
+        unsigned long iterations;
+        /// Количество запросов на сервис в сценариях `status` и `chipio`.
+        unsigned long requests;
+        std::vector<BYTE> apdu;
+        std::string script;
+        unsigned long seed;
+        DWORD timeout;
+        bool trace;
+    public:
+        Options() : iterations(10), requests(100), seed(1), timeout(10000), trace(false) {
+            static const unsigned long r[] = {1, 4, 16, 64};
+            static const unsigned long s[] = {1, 16, 64, 256};
+            readers.assign(r, r + sizeof(r) / sizeof(r[0]));
+            services.assign(s, s + sizeof(s) / sizeof(s[0]));
+            scenarios.push_back("insert");
+            scenarios.push_back("status");
+            scenarios.push_back("chipio");
+            // SELECT PSE 1PAY.SYS.DDF01
+            static const BYTE select[] = {0x00,0xA4,0x04,0x00,0x0E,'1','P','A','Y','.','S','Y','S','.','D','D','F','0','1',0x00};
+            apdu.assign(select, select + sizeof(select));
+        }
+        bool has(const std::string& scenario) const {
+            for (std::vector<std::string>::const_iterator it = scenarios.begin(); it != scenarios.end(); ++it) {
+                if (*it == scenario) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    void usage() {
+        std::cerr <<
+            "Usage: pcsc-xfs-bench [options]\n"
+            "  --readers LIST     numbers of simulated readers (1,4,16,64)\n"
+            "  --services LIST    numbers of open services (1,16,64,256)\n"
+            "  --scenarios LIST   insert,status,chipio (all)\n"
+            "  --iterations N     card insertions in the insert scenario (10)\n"
+            "  --requests N       requests per service in status and chipio scenarios (100)\n"
+            "  --apdu HEX         APDU for the chipio scenario (SELECT 1PAY.SYS.DDF01)\n"
+            "  --script FILE      simulator script with latencies and answers of the 'bench' card\n"
+            "  --seed N           seed of the simulator latencies (1)\n"
+            "  --timeout MS       timeout of each request and wait (10000)\n"
+            "  --trace            print XFS trace to stderr\n";
+    }
+    bool parseHex(const std::string& text, std::vector<BYTE>& out) {
+        if (text.size() % 2 != 0) {
+            return false;
+        }
+        out.clear();
+        for (std::size_t i = 0; i < text.size(); i += 2) {
+            char* end;
+            std::string byte = text.substr(i, 2);
+            out.push_back((BYTE)std::strtoul(byte.c_str(), &end, 16));
+            if (*end != '\0') {
+                return false;
+            }
+        }
+        return true;
+    }
+    template<class T>
+    bool parseList(const std::string& text, std::vector<T>& out) {
+        out.clear();
+        std::istringstream is(text);
+        std::string item;
+        while (std::getline(is, item, ',')) {
+            T value;
+            std::istringstream vs(item);
+            if (!(vs >> value)) {
+                return false;
+            }
+            out.push_back(value);
+        }
+        return !out.empty();
+    }
+    bool parse(int argc, char* argv[], Options& o) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--trace") {
+                o.trace = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg == "--readers")    { if (!parseList(value, o.readers)) return false; } else
+            if (arg == "--services")   { if (!parseList(value, o.services)) return false; } else
+            if (arg == "--scenarios")  { if (!parseList(value, o.scenarios)) return false; } else
+            if (arg == "--iterations") { o.iterations = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--requests")   { o.requests = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--apdu")       { if (!parseHex(value, o.apdu)) return false; } else
+            if (arg == "--script")     { o.script = value; } else
+            if (arg == "--seed")       { o.seed = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--timeout")    { o.timeout = std::strtoul(value.c_str(), NULL, 10); } else {
+                return false;
+            }
+        }
+        return true;
+    }
+    std::string readerName(std::size_t i) {
+        std::ostringstream ss;
+        ss << "Bench Reader " << i;
+        return ss.str();
+    }
+    std::string logicalName(std::size_t i) {
+        std::ostringstream ss;
+        ss << "BENCH" << i;
+        return ss.str();
+    }
+
+    /// Состояние одного открытого сервиса.
+    struct Session {
+        HSERVICE hService;
+        HWND hWnd;
+        /// Индекс считывателя, к которому привязан сервис.
+        std::size_t reader;
+        /// Идентификатор текущего запроса, 0, если запроса нет.
+        REQUESTID pending;
+        Clock::time_point issued;
+        unsigned long completed;
+        /// Получено ли ожидаемое событие о вставке или извлечении карты.
+        bool notified;
+    };
+
+    /** Прогоны сценариев для одного сочетания количества считывателей и сервисов. */
+    class Bench {
+        const Options& o;
+        const std::size_t mReaders;
+        std::vector<Session> mSessions;
+        /// Моменты последней вставки карты в каждый считыватель.
+        std::vector<Clock::time_point> mInserted;
+        REQUESTID& mLastReqID;
+        HSERVICE& mLastService;
+    public:
+        Bench(const Options& o, std::size_t readers, REQUESTID& lastReqID, HSERVICE& lastService)
+            : o(o), mReaders(readers), mInserted(readers), mLastReqID(lastReqID), mLastService(lastService) {}
+
+        bool open(std::size_t services) {
+            mSessions.resize(services);
+            for (std::size_t i = 0; i < services; ++i) {
+                Session& s = mSessions[i];
+                s.hService = ++mLastService;
+                s.hWnd = MessageQueue::instance().create();
+                s.reader = i % mReaders;
+                s.pending = 0;
+                s.completed = 0;
+                s.notified = false;
+                HRESULT r = Harness::open(s.hService, logicalName(s.reader), s.hWnd, mLastReqID, o.timeout);
+                if (r != WFS_SUCCESS) {
+                    std::cerr << "Cannot open service " << s.hService << ": " << r << std::endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+        void close() {
+            for (std::vector<Session>::const_iterator s = mSessions.begin(); s != mSessions.end(); ++s) {
+                Harness::close(s->hService, s->hWnd, mLastReqID, o.timeout);
+                MessageQueue::instance().destroy(s->hWnd);
+            }
+            mSessions.clear();
+        }
+
+        /** Вставляет карты во все считыватели и ждет события о вставке на каждом сервисе.
+        @param read
+            Если `true`, то перед вставкой на каждом сервисе запускается чтение чипа, и
+            ожидается также и его завершение.
+        @param inserted, complete
+            Задержки от вставки до события и до завершения чтения.
+        */
+        bool insert(bool read, Samples& inserted, Samples& complete, unsigned long& errors) {
+            WORD readData = WFS_IDC_CHIP;
+            unsigned long active = 0;
+            for (std::vector<Session>::iterator s = mSessions.begin(); s != mSessions.end(); ++s) {
+                s->notified = false;
+                if (!read) {
+                    continue;
+                }
+                s->pending = ++mLastReqID;
+                if (WFPExecute(s->hService, WFS_CMD_IDC_READ_RAW_DATA, &readData, o.timeout, s->hWnd, s->pending) != WFS_SUCCESS) {
+                    ++errors;
+                    s->pending = 0;
+                    continue;
+                }
+                ++active;
+            }
+            Simulator::Engine& engine = Simulator::Engine::instance();
+            for (std::size_t i = 0; i < mReaders; ++i) {
+                mInserted[i] = Clock::now();
+                engine.insert(readerName(i), "bench");
+            }
+            unsigned long waiting = mSessions.size();
+            while (waiting != 0 || active != 0) {
+                MessageQueue::Message m;
+                if (!MessageQueue::instance().get(NULL, m, bc::milliseconds(o.timeout))) {
+                    std::cerr << "Timeout waiting for card insertion" << std::endl;
+                    return false;
+                }
+                LPWFSRESULT r = (LPWFSRESULT)m.lParam;
+                Session* s = find(m.hWnd);
+                if (s != NULL) {
+                    if (m.msg == WFS_EXECUTE_EVENT && r->u.dwEventID == WFS_EXEE_IDC_MEDIAINSERTED && !s->notified) {
+                        inserted.add(m.posted - mInserted[s->reader]);
+                        s->notified = true;
+                        --waiting;
+                    } else
+                    if (m.msg < WFS_EXECUTE_EVENT && s->pending != 0 && r->RequestID == s->pending) {
+                        complete.add(m.posted - mInserted[s->reader]);
+                        if (r->hResult != WFS_SUCCESS) {
+                            ++errors;
+                        }
+                        s->pending = 0;
+                        --active;
+                    }
+                }
+                WFSFreeResult(r);
+            }
+            return true;
+        }
+        /** Вынимает карты из всех считывателей и ждет, пока об этом узнают все сервисы. */
+        bool remove() {
+            for (std::vector<Session>::iterator s = mSessions.begin(); s != mSessions.end(); ++s) {
+                s->notified = false;
+            }
+            Simulator::Engine& engine = Simulator::Engine::instance();
+            for (std::size_t i = 0; i < mReaders; ++i) {
+                engine.remove(readerName(i));
+            }
+            unsigned long waiting = mSessions.size();
+            while (waiting != 0) {
+                MessageQueue::Message m;
+                if (!MessageQueue::instance().get(NULL, m, bc::milliseconds(o.timeout))) {
+                    std::cerr << "Timeout waiting for card removal" << std::endl;
+                    return false;
+                }
+                LPWFSRESULT r = (LPWFSRESULT)m.lParam;
+                Session* s = find(m.hWnd);
+                if (s != NULL && m.msg == WFS_SERVICE_EVENT && r->u.dwEventID == WFS_SRVE_IDC_MEDIAREMOVED && !s->notified) {
+                    s->notified = true;
+                    --waiting;
+                }
+                WFSFreeResult(r);
+            }
+            return true;
+        }
+        /** Выполняет `o.requests` запросов на каждом сервисе, последовательно на сервисе и
+            параллельно на всех сервисах.
+        @param command
+            `WFS_INF_IDC_STATUS` или `WFS_CMD_IDC_CHIP_IO`.
+        */
+        bool requests(DWORD command, Samples& latencies, unsigned long& errors, double& seconds) {
+            WFSIDCCHIPIO chipIO;
+            chipIO.wChipProtocol = WFS_IDC_CHIPT0;
+            chipIO.ulChipDataLength = (ULONG)o.apdu.size();
+            chipIO.lpbChipData = const_cast<BYTE*>(&o.apdu[0]);
+
+            for (std::vector<Session>::iterator s = mSessions.begin(); s != mSessions.end(); ++s) {
+                s->completed = 0;
+            }
+            unsigned long active = 0;
+            const Clock::time_point start = Clock::now();
+            for (;;) {
+                for (std::vector<Session>::iterator s = mSessions.begin(); s != mSessions.end(); ++s) {
+                    if (s->pending != 0 || s->completed >= o.requests) {
+                        continue;
+                    }
+                    s->pending = ++mLastReqID;
+                    s->issued = Clock::now();
+                    HRESULT r = command == WFS_CMD_IDC_CHIP_IO
+                        ? WFPExecute(s->hService, WFS_CMD_IDC_CHIP_IO, &chipIO, o.timeout, s->hWnd, s->pending)
+                        : WFPGetInfo(s->hService, command, NULL, o.timeout, s->hWnd, s->pending);
+                    if (r != WFS_SUCCESS) {
+                        ++errors;
+                        s->pending = 0;
+                        ++s->completed;
+                    } else {
+                        ++active;
+                    }
+                }
+                if (active == 0) {
+                    break;
+                }
+                MessageQueue::Message m;
+                if (!MessageQueue::instance().get(NULL, m, bc::milliseconds(o.timeout))) {
+                    std::cerr << "Timeout waiting for " << active << " requests" << std::endl;
+                    return false;
+                }
+                LPWFSRESULT r = (LPWFSRESULT)m.lParam;
+                Session* s = find(m.hWnd);
+                if (s != NULL && m.msg < WFS_EXECUTE_EVENT && r->RequestID == s->pending) {
+                    latencies.add(m.posted - s->issued);
+                    if (r->hResult != WFS_SUCCESS) {
+                        ++errors;
+                    }
+                    s->pending = 0;
+                    ++s->completed;
+                    --active;
+                }
+                WFSFreeResult(r);
+            }
+            seconds = bc::duration<double>(Clock::now() - start).count();
+            return true;
+        }
+    public:// Сценарии
+        bool runInsert() {
+            Samples inserted;
+            Samples complete;
+            unsigned long errors = 0;
+            for (unsigned long i = 0; i < o.iterations; ++i) {
+                if (!insert(true, inserted, complete, errors) || !remove()) {
+                    return false;
+                }
+            }
+            std::ostringstream ss;
+            header(ss, "insert");
+            ss << ",\"iterations\":" << o.iterations << ",\"mediaInsertedUs\":";
+            inserted.json(ss);
+            ss << ",\"completeUs\":";
+            complete.json(ss);
+            ss << ",\"errors\":" << errors << '}';
+            std::cout << ss.str() << std::endl;
+            return errors == 0;
+        }
+        bool runStatus() {
+            bool ok = status(false);
+            Samples inserted;
+            Samples complete;
+            unsigned long errors = 0;
+            if (!ok || !insert(false, inserted, complete, errors)) {
+                return false;
+            }
+            ok = status(true);
+            return remove() && ok;
+        }
+        bool runChipIO() {
+            Samples inserted;
+            Samples complete;
+            unsigned long errors = 0;
+            if (!insert(false, inserted, complete, errors)) {
+                return false;
+            }
+            Samples latencies;
+            double seconds = 0;
+            if (!requests(WFS_CMD_IDC_CHIP_IO, latencies, errors, seconds)) {
+                return false;
+            }
+            const double rate = seconds > 0 ? latencies.size() / seconds : 0;
+            std::ostringstream ss;
+            header(ss, "chipio");
+            ss << ",\"apdus\":" << latencies.size() << ",\"seconds\":" << seconds
+               << ",\"apdusPerSecond\":" << rate << ",\"apdusPerSecondPerReader\":" << rate / mReaders
+               << ",\"latencyUs\":";
+            latencies.json(ss);
+            ss << ",\"errors\":" << errors << '}';
+            std::cout << ss.str() << std::endl;
+            return remove() && errors == 0;
+        }
+    private:
+        bool status(bool card) {
+            Samples latencies;
+            unsigned long errors = 0;
+            double seconds = 0;
+            if (!requests(WFS_INF_IDC_STATUS, latencies, errors, seconds)) {
+                return false;
+            }
+            std::ostringstream ss;
+            header(ss, "status");
+            ss << ",\"card\":" << (card ? "true" : "false")
+               << ",\"requests\":" << latencies.size() << ",\"seconds\":" << seconds
+               << ",\"throughput\":" << (seconds > 0 ? latencies.size() / seconds : 0) << ",\"latencyUs\":";
+            latencies.json(ss);
+            ss << ",\"errors\":" << errors << '}';
+            std::cout << ss.str() << std::endl;
+            return errors == 0;
+        }
+        void header(std::ostream& os, const char* scenario) const {
+            os << "{\"scenario\":\"" << scenario << "\",\"readers\":" << mReaders << ",\"services\":" << mSessions.size();
+        }
+        Session* find(HWND hWnd) {
+            for (std::vector<Session>::iterator s = mSessions.begin(); s != mSessions.end(); ++s) {
+                if (s->hWnd == hWnd) {
+                    return &*s;
+                }
+            }
+            return NULL;
+        }
+    };
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options o;
+    if (!parse(argc, argv, o)) {
+        usage();
+        return 2;
+    }
+    if (o.trace) {
+        Harness::setTrace(&std::cerr);
+    }
+    // Симулятор: одна карта, отвечающая `9000` на любую команду. Сценарий может задать
+    // задержки и переопределить ответы карты `bench`.
+    Simulator::Engine& engine = Simulator::Engine::instance();
+    engine.reset();
+    engine.seed((unsigned int)o.seed);
+    Simulator::Card card;
+    static const BYTE atr[] = {0x3B, 0x68, 0x00, 0x00, 0x00, 0x73, 0xC8, 0x40, 0x13, 0x00, 0x90, 0x00};
+    card.atr.assign(atr, atr + sizeof(atr));
+    card.protocols = SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1;
+    Simulator::Response success;
+    success.prefix = true;
+    success.data.push_back(0x90);
+    success.data.push_back(0x00);
+    card.responses.push_back(success);
+    engine.defineCard("bench", card);
+    if (!o.script.empty()) {
+        std::string error;
+        if (!engine.load(o.script, error)) {
+            std::cerr << o.script << ": " << error << std::endl;
+            return 2;
+        }
+    }
+
+    // Конфигурация: логический сервис `BENCH<i>` привязан к считывателю `i`.
+    std::size_t maxReaders = 0;
+    for (std::vector<unsigned long>::const_iterator it = o.readers.begin(); it != o.readers.end(); ++it) {
+        maxReaders = std::max(maxReaders, (std::size_t)*it);
+    }
+    Harness::Registry& registry = Harness::Registry::instance();
+    for (std::size_t i = 0; i < maxReaders; ++i) {
+        const std::string provider = "PC/SC-BENCH-" + logicalName(i);
+        registry.set(WFS_CFG_USER_DEFAULT_XFS_ROOT, "LOGICAL_SERVICES\\" + logicalName(i), "Provider", provider);
+        registry.set(WFS_CFG_USER_DEFAULT_XFS_ROOT, "SERVICE_PROVIDERS\\" + provider, "ReaderName", readerName(i));
+    }
+
+    bool ok = true;
+    REQUESTID lastReqID = 0;
+    HSERVICE lastService = 0;
+    for (std::vector<unsigned long>::const_iterator r = o.readers.begin(); r != o.readers.end() && ok; ++r) {
+        // Подключаем нужное количество считывателей, лишние отключаем.
+        for (std::size_t i = 0; i < maxReaders; ++i) {
+            if (i < *r) {
+                engine.attach(readerName(i));
+            } else {
+                engine.detach(readerName(i));
+            }
+        }
+        for (std::vector<unsigned long>::const_iterator s = o.services.begin(); s != o.services.end() && ok; ++s) {
+            if (*s < *r) {
+                continue;
+            }
+            Bench bench(o, *r, lastReqID, lastService);
+            ok = bench.open(*s);
+            if (ok && o.has("insert")) {
+                ok = bench.runInsert();
+            }
+            if (ok && o.has("status")) {
+                ok = bench.runStatus();
+            }
+            if (ok && o.has("chipio")) {
+                ok = bench.runChipIO();
+            }
+            bench.close();
+        }
+    }
+    Harness::unload();
+
+    std::ostringstream ss;
+    ss << "{\"scenario\":\"summary\",\"ok\":" << (ok ? "true" : "false") << ",\"heap\":";
+    Harness::heapJson(ss);
+    ss << ",\"undelivered\":" << MessageQueue::instance().undelivered() << '}';
+    std::cout << ss.str() << std::endl;
+    return ok ? 0 : 1;
+}
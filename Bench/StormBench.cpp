@@ -0,0 +1,493 @@
+/** @file
+    Генератор "штормов" событий считывателей на симуляторе PC/SC, воспроизводящий плохо сидящие
+    в разъеме USB считыватели и дребезг карт:
+    - `plug`  -- случайные считыватели подключаются и отключаются с заданной частотой;
+    - `flap`  -- карты в случайных считывателях вставляются и вынимаются с интервалом в доли миллисекунды;
+    - `burst` -- карты во всех считывателях вставляются и вынимаются одновременно.
+@par
+    К каждому "горячему" считывателю привязан свой сервис, который получает события о вставке и
+    извлечении карты через `ReaderChangesMonitor` и `ServiceContainer::notifyChanges`. Во время шторма
+    еще один сервис на спокойном считывателе периодически выполняет `WFS_INF_IDC_STATUS`, показывая,
+    отвечает ли сервис-провайдер. Измеряются:
+    - задержка доставки события -- от последнего изменения считывателя в то же состояние, о котором
+      сообщает событие, до отправки события;
+    - потерянные события -- после шторма и паузы последнее событие сервиса не соответствует состоянию
+      считывателя;
+    - нарушения порядка -- два события о вставке подряд без извлечения между ними или сообщения окну,
+      отправленные раньше уже доставленных;
+    - прирост памяти XFS-менеджера и процесса за шторм.
+@par
+    Быстрые вставка и извлечение между двумя опросами `SCardGetStatusChange` законно сливаются
+    в одно событие или исчезают, поэтому пропуском считается только неверное итоговое состояние.
+    Повторные события об извлечении (например, при подключении пустого считывателя) не являются
+    ошибкой и подсчитываются отдельно. Результат каждого шторма выводится строкой JSON, при потерях
+    или нарушениях порядка программа завершается с кодом 1.
+*/
+#include "Harness/Client.h"
+#include "Simulator/Simulator.h"
+
+#include <algorithm>
+// Для std::strtoul
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/thread/thread.hpp>
+
+// Для sysconf
+#include <unistd.h>
+
+#include <xfsspi.h>
+#include <XFSIDC.h>
+
+namespace bc = boost::chrono;
+using Harness::Clock;
+using Harness::MessageQueue;
+using Harness::Samples;
+
+namespace {
+    struct Options {
+        std::vector<std::string> storms;
+        /// Количество "горячих" считывателей.
+        unsigned long readers;
+        /// Длительность каждого шторма.
+        unsigned long seconds;
+        /// Количество подключений и отключений считывателей в секунду в шторме `plug`.
+        unsigned long plugRate;
+        /// Средний интервал между вставкой и извлечением карты в шторме `flap`.
+        unsigned long flapUs;
+        /// Период одновременного изменения всех считывателей в шторме `burst`.
+        unsigned long burstMs;
+        /// Пауза после шторма, за которую все события должны быть доставлены.
+        unsigned long settleMs;
+        /// Период запросов состояния спокойного считывателя во время шторма.
+        unsigned long probeUs;
+        unsigned long seed;
+        DWORD timeout;
+        bool trace;
+    public:
+        Options()
+            : readers(16), seconds(2), plugRate(2000), flapUs(200), burstMs(5)
+            , settleMs(1000), probeUs(1000), seed(1), timeout(10000), trace(false)
+        {
+            storms.push_back("plug");
+            storms.push_back("flap");
+            storms.push_back("burst");
+        }
+    };
+
+    void usage() {
+        std::cerr <<
+            "Usage: pcsc-xfs-stormbench [options]\n"
+            "  --storms LIST      plug,flap,burst (all)\n"
+            "  --readers N        readers under the storm, one service each (16)\n"
+            "  --seconds N        duration of each storm (2)\n"
+            "  --plug-rate N      reader attaches and detaches per second in the plug storm (2000)\n"
+            "  --flap-us N        mean interval between card changes in the flap storm (200)\n"
+            "  --burst-ms N       period of simultaneous changes in the burst storm (5)\n"
+            "  --settle MS        pause after the storm to deliver all events (1000)\n"
+            "  --probe-us N       period of status requests to a quiet reader during the storm (1000)\n"
+            "  --seed N           seed of the storm generator (1)\n"
+            "  --timeout MS       timeout of each request (10000)\n"
+            "  --trace            print XFS trace to stderr\n";
+    }
+    bool parseList(const std::string& text, std::vector<std::string>& out) {
+        out.clear();
+        std::istringstream is(text);
+        std::string item;
+        while (std::getline(is, item, ',')) {
+            if (item != "plug" && item != "flap" && item != "burst") {
+                return false;
+            }
+            out.push_back(item);
+        }
+        return !out.empty();
+    }
+    bool parse(int argc, char* argv[], Options& o) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--trace") {
+                o.trace = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg == "--storms")    { if (!parseList(value, o.storms)) return false; } else
+            if (arg == "--readers")   { o.readers = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--seconds")   { o.seconds = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--plug-rate") { o.plugRate = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--flap-us")   { o.flapUs = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--burst-ms")  { o.burstMs = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--settle")    { o.settleMs = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--probe-us")  { o.probeUs = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--seed")      { o.seed = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--timeout")   { o.timeout = std::strtoul(value.c_str(), NULL, 10); } else {
+                return false;
+            }
+        }
+        return o.readers > 0 && o.plugRate > 0 && o.burstMs > 0;
+    }
+    std::string readerName(std::size_t i) {
+        std::ostringstream ss;
+        ss << "Storm Reader " << i;
+        return ss.str();
+    }
+    std::string logicalName(std::size_t i) {
+        std::ostringstream ss;
+        ss << "STORM" << i;
+        return ss.str();
+    }
+    const char* probeReader() { return "Storm Probe Reader"; }
+    const char* probeService() { return "STORMPROBE"; }
+
+    /// @return Размер резидентной памяти процесса в байтах или 0, если он неизвестен.
+    unsigned long long residentBytes() {
+        std::ifstream f("/proc/self/statm");
+        unsigned long long size = 0;
+        unsigned long long resident = 0;
+        if (!(f >> size >> resident)) {
+            return 0;
+        }
+        return resident * (unsigned long long)sysconf(_SC_PAGESIZE);
+    }
+
+    /// Изменение наличия карты в считывателе, сделанное генератором.
+    struct Change {
+        Clock::time_point at;
+        bool present;
+    };
+    /// Событие о вставке или извлечении карты, полученное сервисом.
+    struct Delivery {
+        Clock::time_point posted;
+        bool present;
+    };
+    /// Горячий считыватель и привязанный к нему сервис.
+    struct Lane {
+        HSERVICE hService;
+        HWND hWnd;
+        /// Изменения считывателя, пишутся только генератором, читаются после его остановки.
+        std::vector<Change> changes;
+        bool attached;
+        bool present;
+        /// События сервиса, пишутся только потребителем.
+        std::vector<Delivery> deliveries;
+        Clock::time_point lastPosted;
+    };
+
+    /** Шторм одного вида: генератор изменений в отдельном потоке и потребитель событий
+        и запросов-проб в вызывающем потоке.
+    */
+    class Storm {
+        const Options& o;
+        const std::string mKind;
+        std::vector<Lane>& mLanes;
+        boost::random::mt19937 mRng;
+        boost::atomic<bool> mStop;
+        /// Количество изменений, выполненных генератором.
+        unsigned long mOperations;
+    public:
+        Storm(const Options& o, const std::string& kind, std::vector<Lane>& lanes)
+            : o(o), mKind(kind), mLanes(lanes), mRng((unsigned int)o.seed), mStop(false), mOperations(0) {}
+
+        /// Генератор: выполняет изменения до запроса остановки.
+        void generate() {
+            Simulator::Engine& engine = Simulator::Engine::instance();
+            boost::random::uniform_int_distribution<std::size_t> lane(0, mLanes.size() - 1);
+            boost::random::uniform_int_distribution<unsigned long> flap(0, 2 * o.flapUs);
+            bool burstPresent = false;
+            while (!mStop) {
+                if (mKind == "plug") {
+                    const std::size_t i = lane(mRng);
+                    Lane& l = mLanes[i];
+                    // Отключение считывателя вынимает карту, подключенный считыватель в половине
+                    // случаев сразу получает карту.
+                    if (l.attached) {
+                        engine.detach(readerName(i));
+                        record(l, false);
+                        l.attached = false;
+                    } else {
+                        engine.attach(readerName(i));
+                        l.attached = true;
+                        record(l, false);
+                        if (mRng() & 1) {
+                            engine.insert(readerName(i), "storm");
+                            record(l, true);
+                        }
+                    }
+                    boost::this_thread::sleep_for(bc::microseconds(1000000 / o.plugRate));
+                } else
+                if (mKind == "flap") {
+                    const std::size_t i = lane(mRng);
+                    toggle(engine, i, !mLanes[i].present);
+                    boost::this_thread::sleep_for(bc::microseconds(flap(mRng)));
+                } else {
+                    burstPresent = !burstPresent;
+                    for (std::size_t i = 0; i < mLanes.size(); ++i) {
+                        toggle(engine, i, burstPresent);
+                    }
+                    boost::this_thread::sleep_for(bc::milliseconds(o.burstMs));
+                }
+                ++mOperations;
+            }
+        }
+        /** Выполняет шторм и выводит его результат.
+        @return `true`, если не было потерь и нарушений порядка.
+        */
+        bool run(HSERVICE hProbe, HWND hProbeWnd, REQUESTID& lastReqID) {
+            const Harness::Heap::Stats heapBefore = Harness::Heap::instance().stats();
+            const unsigned long long rssBefore = residentBytes();
+            for (std::vector<Lane>::iterator l = mLanes.begin(); l != mLanes.end(); ++l) {
+                l->changes.clear();
+                l->deliveries.clear();
+            }
+            Samples probe;
+            unsigned long errors = 0;
+            unsigned long outOfOrder = 0;
+
+            const Clock::time_point start = Clock::now();
+            boost::thread generator(&Storm::generate, this);
+            // Во время шторма периодически опрашиваем состояние спокойного считывателя.
+            REQUESTID pending = 0;
+            Clock::time_point issued;
+            Clock::time_point nextProbe = start;
+            const Clock::time_point stormEnd = start + bc::seconds(o.seconds);
+            Clock::time_point settleEnd = Clock::time_point::max();
+            for (;;) {
+                const Clock::time_point now = Clock::now();
+                if (settleEnd == Clock::time_point::max() && now >= stormEnd) {
+                    mStop = true;
+                    generator.join();
+                    settleEnd = Clock::now() + bc::milliseconds(o.settleMs);
+                }
+                if (now >= settleEnd && pending == 0) {
+                    break;
+                }
+                if (pending == 0 && settleEnd == Clock::time_point::max() && now >= nextProbe) {
+                    pending = ++lastReqID;
+                    issued = Clock::now();
+                    nextProbe = issued + bc::microseconds(o.probeUs);
+                    if (WFPGetInfo(hProbe, WFS_INF_IDC_STATUS, NULL, o.timeout, hProbeWnd, pending) != WFS_SUCCESS) {
+                        ++errors;
+                        pending = 0;
+                    }
+                }
+                MessageQueue::Message m;
+                const Clock::duration wait = pending == 0 && nextProbe > now
+                    ? std::min<Clock::duration>(nextProbe - now, bc::milliseconds(10))
+                    : Clock::duration(bc::milliseconds(10));
+                if (!MessageQueue::instance().get(NULL, m, wait)) {
+                    continue;
+                }
+                LPWFSRESULT r = (LPWFSRESULT)m.lParam;
+                if (m.hWnd == hProbeWnd) {
+                    if (m.msg < WFS_EXECUTE_EVENT && r->RequestID == pending) {
+                        probe.add(m.posted - issued);
+                        if (r->hResult != WFS_SUCCESS) {
+                            ++errors;
+                        }
+                        pending = 0;
+                    }
+                } else {
+                    Lane* l = find(m.hWnd);
+                    if (l != NULL) {
+                        if (!l->deliveries.empty() && m.posted < l->lastPosted) {
+                            ++outOfOrder;
+                        }
+                        l->lastPosted = m.posted;
+                        if (m.msg == WFS_EXECUTE_EVENT && r->u.dwEventID == WFS_EXEE_IDC_MEDIAINSERTED) {
+                            Delivery d = {m.posted, true};
+                            l->deliveries.push_back(d);
+                        } else
+                        if (m.msg == WFS_SERVICE_EVENT && r->u.dwEventID == WFS_SRVE_IDC_MEDIAREMOVED) {
+                            Delivery d = {m.posted, false};
+                            l->deliveries.push_back(d);
+                        }
+                    }
+                }
+                WFSFreeResult(r);
+            }
+            const double seconds = bc::duration<double>(stormEnd - start).count();
+            const Harness::Heap::Stats heapAfter = Harness::Heap::instance().stats();
+            const unsigned long long rssAfter = residentBytes();
+
+            // Разбор доставленных событий.
+            Samples lag;
+            unsigned long changes = 0;
+            unsigned long events = 0;
+            unsigned long dropped = 0;
+            unsigned long duplicateInserts = 0;
+            unsigned long repeatedRemovals = 0;
+            for (std::vector<Lane>::const_iterator l = mLanes.begin(); l != mLanes.end(); ++l) {
+                changes += l->changes.size();
+                events += l->deliveries.size();
+                bool present = false;
+                std::vector<Change>::const_iterator c = l->changes.begin();
+                const Change* lastSame[2] = {NULL, NULL};
+                for (std::vector<Delivery>::const_iterator d = l->deliveries.begin(); d != l->deliveries.end(); ++d) {
+                    if (d->present && present) {
+                        ++duplicateInserts;
+                    }
+                    if (!d->present && !present && d != l->deliveries.begin()) {
+                        ++repeatedRemovals;
+                    }
+                    present = d->present;
+                    // Последнее изменение в сообщенное состояние до отправки события.
+                    for (; c != l->changes.end() && c->at <= d->posted; ++c) {
+                        lastSame[c->present] = &*c;
+                    }
+                    if (lastSame[d->present] != NULL) {
+                        lag.add(d->posted - lastSame[d->present]->at);
+                    }
+                }
+                if (present != l->present) {
+                    ++dropped;
+                }
+            }
+            const bool ok = dropped == 0 && duplicateInserts == 0 && outOfOrder == 0 && errors == 0;
+
+            std::ostringstream ss;
+            ss << "{\"storm\":\"" << mKind << "\",\"readers\":" << mLanes.size() << ",\"seconds\":" << seconds
+               << ",\"operations\":" << mOperations << ",\"operationsPerSecond\":" << mOperations / seconds
+               << ",\"changes\":" << changes << ",\"events\":" << events
+               << ",\"lagUs\":";
+            lag.json(ss);
+            ss << ",\"probeStatusUs\":";
+            probe.json(ss);
+            ss << ",\"probeErrors\":" << errors
+               << ",\"dropped\":" << dropped << ",\"duplicateInserts\":" << duplicateInserts
+               << ",\"outOfOrder\":" << outOfOrder << ",\"repeatedRemovals\":" << repeatedRemovals
+               << ",\"heapGrowthBytes\":" << (long long)(heapAfter.bytes - heapBefore.bytes)
+               << ",\"heapGrowthBlocks\":" << (long long)(heapAfter.blocks - heapBefore.blocks)
+               << ",\"rssGrowthBytes\":" << (long long)(rssAfter - rssBefore)
+               << ",\"ok\":" << (ok ? "true" : "false") << '}';
+            std::cout << ss.str() << std::endl;
+            return ok;
+        }
+    private:
+        void record(Lane& l, bool present) {
+            Change c = {Clock::now(), present};
+            l.changes.push_back(c);
+            l.present = present;
+        }
+        void toggle(Simulator::Engine& engine, std::size_t i, bool present) {
+            Lane& l = mLanes[i];
+            if (present == l.present) {
+                return;
+            }
+            if (present) {
+                engine.insert(readerName(i), "storm");
+            } else {
+                engine.remove(readerName(i));
+            }
+            record(l, present);
+        }
+        Lane* find(HWND hWnd) {
+            for (std::vector<Lane>::iterator l = mLanes.begin(); l != mLanes.end(); ++l) {
+                if (l->hWnd == hWnd) {
+                    return &*l;
+                }
+            }
+            return NULL;
+        }
+    };
+
+    /// Подключает все считыватели без карт и ждет, пока события об этом будут доставлены.
+    void calm(const Options& o, std::vector<Lane>& lanes) {
+        Simulator::Engine& engine = Simulator::Engine::instance();
+        for (std::size_t i = 0; i < lanes.size(); ++i) {
+            engine.attach(readerName(i));
+            engine.remove(readerName(i));
+            lanes[i].attached = true;
+            lanes[i].present = false;
+        }
+        const Clock::time_point end = Clock::now() + bc::milliseconds(o.settleMs);
+        MessageQueue::Message m;
+        while (MessageQueue::instance().get(NULL, m, end - Clock::now())) {
+            WFSFreeResult((LPWFSRESULT)m.lParam);
+        }
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options o;
+    if (!parse(argc, argv, o)) {
+        usage();
+        return 2;
+    }
+    if (o.trace) {
+        Harness::setTrace(&std::cerr);
+    }
+    Simulator::Engine& engine = Simulator::Engine::instance();
+    engine.reset();
+    engine.seed((unsigned int)o.seed);
+    Simulator::Card card;
+    static const BYTE atr[] = {0x3B, 0x68, 0x00, 0x00, 0x00, 0x73, 0xC8, 0x40, 0x13, 0x00, 0x90, 0x00};
+    card.atr.assign(atr, atr + sizeof(atr));
+    card.protocols = SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1;
+    engine.defineCard("storm", card);
+    engine.attach(probeReader());
+    engine.insert(probeReader(), "storm");
+
+    // Конфигурация: логический сервис `STORM<i>` привязан к считывателю `i`.
+    Harness::Registry& registry = Harness::Registry::instance();
+    for (std::size_t i = 0; i <= o.readers; ++i) {
+        const std::string logical = i < o.readers ? logicalName(i) : probeService();
+        const std::string reader = i < o.readers ? readerName(i) : probeReader();
+        const std::string provider = "PC/SC-STORM-" + logical;
+        registry.set(WFS_CFG_USER_DEFAULT_XFS_ROOT, "LOGICAL_SERVICES\\" + logical, "Provider", provider);
+        registry.set(WFS_CFG_USER_DEFAULT_XFS_ROOT, "SERVICE_PROVIDERS\\" + provider, "ReaderName", reader);
+    }
+
+    REQUESTID lastReqID = 0;
+    HSERVICE lastService = 0;
+    std::vector<Lane> lanes(o.readers);
+    for (std::size_t i = 0; i < lanes.size(); ++i) {
+        engine.attach(readerName(i));
+    }
+    bool ok = true;
+    for (std::size_t i = 0; i < lanes.size() && ok; ++i) {
+        Lane& l = lanes[i];
+        l.hService = ++lastService;
+        l.hWnd = MessageQueue::instance().create();
+        ok = Harness::open(l.hService, logicalName(i), l.hWnd, lastReqID, o.timeout) == WFS_SUCCESS;
+    }
+    const HSERVICE hProbe = ++lastService;
+    const HWND hProbeWnd = MessageQueue::instance().create();
+    if (ok) {
+        ok = Harness::open(hProbe, probeService(), hProbeWnd, lastReqID, o.timeout) == WFS_SUCCESS;
+    }
+    if (!ok) {
+        std::cerr << "Cannot open services" << std::endl;
+        return 1;
+    }
+
+    for (std::vector<std::string>::const_iterator it = o.storms.begin(); it != o.storms.end(); ++it) {
+        calm(o, lanes);
+        Storm storm(o, *it, lanes);
+        ok = storm.run(hProbe, hProbeWnd, lastReqID) && ok;
+    }
+
+    for (std::vector<Lane>::const_iterator l = lanes.begin(); l != lanes.end(); ++l) {
+        Harness::close(l->hService, l->hWnd, lastReqID, o.timeout);
+        MessageQueue::instance().destroy(l->hWnd);
+    }
+    Harness::close(hProbe, hProbeWnd, lastReqID, o.timeout);
+    MessageQueue::instance().destroy(hProbeWnd);
+    Harness::unload();
+
+    std::ostringstream ss;
+    ss << "{\"storm\":\"summary\",\"ok\":" << (ok ? "true" : "false") << ",\"heap\":";
+    Harness::heapJson(ss);
+    ss << ",\"undelivered\":" << MessageQueue::instance().undelivered() << '}';
+    std::cout << ss.str() << std::endl;
+    return ok ? 0 : 1;
+}
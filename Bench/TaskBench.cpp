@@ -0,0 +1,417 @@
+/** @file
+    Нагрузочный тест `TaskContainer` с десятками тысяч ожидающих задач. Несколько потоков
+    добавляют задачи со случайными дедлайнами и случайно отменяют их, поток-монитор, как и
+    `ReaderChangesMonitor`, обрабатывает таймауты и рассылает изменения считывателей, а основной
+    поток получает уведомления о завершении задач.
+@par
+    После прогона проверяются инварианты: каждая задача завершена ровно один раз с кодом
+    `WFS_SUCCESS`, `WFS_ERR_TIMEOUT` или `WFS_ERR_CANCELED`, и ни одна не завершена раньше
+    вызвавшего это события: вставки карты в ее считыватель, наступления дедлайна или отмены.
+    Результаты, включая длительность операций контейнера, выводятся одной строкой JSON.
+*/
+#include "Harness/Client.h"
+
+#include "Manager.h"
+#include "Service.h"
+#include "Settings.h"
+#include "Task.h"
+
+#include <algorithm>
+// Для std::strtoul и std::strtod
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <xfsapi.h>
+
+/// Глобальный менеджер сервис-провайдера (см. `PCSCspi.cpp`).
+extern Manager pcsc;
+
+using Harness::MessageQueue;
+using Harness::Samples;
+
+namespace {
+    /// Реальное время для измерения длительностей, в отличие от часов дедлайнов задач.
+    typedef Harness::Clock RealClock;
+
+    struct Options {
+        unsigned long tasks;
+        unsigned int threads;
+        unsigned int services;
+        unsigned int readers;
+        /// Диапазон дедлайнов задач от момента добавления, в миллисекундах.
+        unsigned long minDeadline;
+        unsigned long maxDeadline;
+        /// Вероятность отмены одной из ранее добавленных задач после добавления очередной.
+        double cancel;
+        /// Период вставки карты в случайный считыватель, в миллисекундах.
+        unsigned long notifyPeriod;
+        unsigned long seed;
+        /// Отсчитывать дедлайны и период вставки карт по `VirtualClock`, переводя его сразу
+        /// к ближайшему событию, вместо ожидания в реальном времени.
+        bool virtualClock;
+    public:
+        Options()
+            : tasks(50000), threads(8), services(64), readers(16)
+            , minDeadline(50), maxDeadline(2000), cancel(0.2), notifyPeriod(5), seed(1), virtualClock(false) {}
+    };
+
+    void usage() {
+        std::cerr <<
+            "Usage: pcsc-xfs-taskbench [options]\n"
+            "  --tasks N          total number of tasks (50000)\n"
+            "  --threads N        threads adding and cancelling tasks (8)\n"
+            "  --services N       services the tasks belong to (64)\n"
+            "  --readers N        readers the tasks wait on (16)\n"
+            "  --min-deadline MS  minimal task timeout (50)\n"
+            "  --max-deadline MS  maximal task timeout (2000)\n"
+            "  --cancel P         probability to cancel an earlier task after each add (0.2)\n"
+            "  --notify-period MS period of card insertions into a random reader (5)\n"
+            "  --seed N           seed of the random generators (1)\n"
+            "  --virtual-clock    run deadlines and insertions on a virtual clock, without waiting\n";
+    }
+    bool parse(int argc, char* argv[], Options& o) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--virtual-clock") {
+                o.virtualClock = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg == "--tasks")         { o.tasks = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--threads")       { o.threads = (unsigned int)std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--services")      { o.services = (unsigned int)std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--readers")       { o.readers = (unsigned int)std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--min-deadline")  { o.minDeadline = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--max-deadline")  { o.maxDeadline = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--cancel")        { o.cancel = std::strtod(value.c_str(), NULL); } else
+            if (arg == "--notify-period") { o.notifyPeriod = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--seed")          { o.seed = std::strtoul(value.c_str(), NULL, 10); } else {
+                return false;
+            }
+        }
+        return o.threads > 0 && o.services > 0 && o.readers > 0 && o.minDeadline <= o.maxDeadline;
+    }
+
+    /// Задача, ожидающая вставки карты в конкретный считыватель.
+    class WaitTask : public Task {
+        const std::string& mReader;
+    public:
+        WaitTask(Clock::time_point deadline, Service& service, HWND hWnd, REQUESTID ReqID, const std::string& reader)
+            : Task(deadline, service, hWnd, ReqID), mReader(reader) {}
+        virtual bool match(const SCARD_READERSTATE& state, bool deviceChange) const {
+            if (deviceChange || mReader != state.szReader) {
+                return false;
+            }
+            complete(WFS_SUCCESS);
+            return true;
+        }
+    };
+
+    /// Сведения о задаче. Поля до `cancelled` заполняет добавивший ее поток, остальные -- основной.
+    struct TaskInfo {
+        HSERVICE hService;
+        std::size_t reader;
+        Clock::time_point added;
+        Clock::time_point deadline;
+        /// Момент последнего вызова `cancelTask`, вернувшего `true`.
+        Clock::time_point cancelRequested;
+        bool cancelled;
+
+        unsigned int completions;
+        HRESULT result;
+        Clock::time_point completed;
+    public:
+        TaskInfo() : hService(0), reader(0), cancelled(false), completions(0), result(WFS_SUCCESS) {}
+    };
+
+    /// Сравнивает отметки монитора по реальному времени.
+    struct TickBefore {
+        typedef std::pair<Clock::time_point, Clock::time_point> Tick;
+        bool operator()(const Tick& tick, Clock::time_point real) const { return tick.first < real; }
+    };
+
+    /** Общее состояние прогона. */
+    class Bench {
+        const Options& o;
+        VirtualClock mVirtual;
+        /// Часы дедлайнов задач: `mVirtual` или монотонные часы системы.
+        const Clock& mClock;
+        /// Время начала прогона по часам дедлайнов.
+        const Clock::time_point mStart;
+        TaskContainer mTasks;
+        /// Сервисы, которым принадлежат задачи, принадлежат менеджеру.
+        std::vector<Service*> mServices;
+        std::vector<std::string> mReaders;
+        std::vector<TaskInfo> mInfo;
+        HWND hWnd;
+
+        /// Следующий идентификатор задачи для добавления.
+        boost::atomic<unsigned long> mNext;
+        /// Количество добавленных и завершенных задач.
+        boost::atomic<unsigned long> mAdded;
+        boost::atomic<unsigned long> mCompleted;
+        /// Количество потоков, еще добавляющих задачи.
+        boost::atomic<unsigned int> mProducers;
+        boost::atomic<bool> mStop;
+
+        /// Длительности операций по потокам.
+        std::vector<Samples> mAddTask;
+        std::vector<Samples> mCancelTask;
+        Samples mProcessTimeouts;
+        Samples mNotifyChanges;
+        /// Моменты уведомлений о вставке карты по считывателям, заполняются монитором.
+        std::vector<std::vector<Clock::time_point> > mNotified;
+        /// Отметки монитора после каждой обработки таймаутов: реальное время и время часов
+        /// дедлайнов. По ним для уведомления о таймауте находится время часов, при котором оно
+        /// было отправлено.
+        std::vector<TickBefore::Tick> mTicks;
+        unsigned long mPeakPending;
+    public:
+        Bench(const Options& o, Manager& manager)
+            : o(o), mClock(o.virtualClock ? static_cast<const Clock&>(mVirtual) : Clock::steady())
+            , mStart(mClock.now())
+            , mInfo(o.tasks), hWnd(MessageQueue::instance().create())
+            , mNext(0), mAdded(0), mCompleted(0), mProducers(o.threads), mStop(false)
+            , mAddTask(o.threads), mCancelTask(o.threads), mNotified(o.readers), mPeakPending(0)
+        {
+            Settings::Ptr settings(new Settings("BENCH", 0));
+            for (unsigned int i = 0; i < o.services; ++i) {
+                mServices.push_back(&manager.create((HSERVICE)(i + 1), settings));
+            }
+            for (unsigned int i = 0; i < o.readers; ++i) {
+                std::ostringstream ss;
+                ss << "Bench Reader " << i;
+                mReaders.push_back(ss.str());
+            }
+        }
+        /// @return `true`, если все задачи завершились до истечения отведенного времени.
+        bool run() {
+            std::vector<boost::shared_ptr<boost::thread> > producers;
+            for (unsigned int i = 0; i < o.threads; ++i) {
+                producers.push_back(boost::shared_ptr<boost::thread>(new boost::thread(&Bench::produce, this, i)));
+            }
+            boost::thread monitor(&Bench::monitor, this);
+            bool finished = consume();
+            mStop = true;
+            monitor.join();
+            for (std::size_t i = 0; i < producers.size(); ++i) {
+                producers[i]->join();
+            }
+            return finished;
+        }
+        /// Проверяет инварианты и выводит результаты. @return `true`, если нарушений нет.
+        bool report(double seconds, bool finished) {
+            unsigned long success = 0, timeout = 0, canceled = 0;
+            unsigned long missing = 0, duplicate = 0, badResult = 0, early = 0, badCancel = 0;
+            Samples lateness;
+            const unsigned long added = mAdded;
+            for (unsigned long id = 0; id < added; ++id) {
+                const TaskInfo& t = mInfo[id];
+                if (t.completions == 0) { ++missing; continue; }
+                if (t.completions > 1) { ++duplicate; }
+                if (t.cancelled != (t.result == WFS_ERR_CANCELED)) { ++badCancel; }
+                switch (t.result) {
+                    case WFS_SUCCESS: {
+                        ++success;
+                        // Должна быть вставка карты в считыватель задачи после ее добавления и до завершения.
+                        const std::vector<Clock::time_point>& n = mNotified[t.reader];
+                        std::vector<Clock::time_point>::const_iterator it = std::lower_bound(n.begin(), n.end(), t.added);
+                        if (it == n.end() || *it > t.completed) { ++early; }
+                        break;
+                    }
+                    case WFS_ERR_TIMEOUT: {
+                        ++timeout;
+                        // Таймауты отправляются только монитором, внутри обработки, закончившейся
+                        // первой отметкой после отправки уведомления.
+                        std::vector<TickBefore::Tick>::const_iterator it = std::lower_bound(
+                            mTicks.begin(), mTicks.end(), t.completed, TickBefore()
+                        );
+                        if (it == mTicks.end() || it->second < t.deadline) {
+                            ++early;
+                        } else {
+                            lateness.add(it->second - t.deadline);
+                        }
+                        break;
+                    }
+                    case WFS_ERR_CANCELED: {
+                        ++canceled;
+                        if (t.completed < t.cancelRequested) { ++early; }
+                        break;
+                    }
+                    default: ++badResult;
+                }
+            }
+            Samples addTask, cancelTask;
+            for (unsigned int i = 0; i < o.threads; ++i) {
+                addTask.add(mAddTask[i]);
+                cancelTask.add(mCancelTask[i]);
+            }
+            std::ostringstream ss;
+            ss << "{\"clock\":\"" << (o.virtualClock ? "virtual" : "steady") << '"'
+               << ",\"tasks\":" << added << ",\"threads\":" << o.threads << ",\"services\":" << o.services
+               << ",\"readers\":" << o.readers << ",\"seconds\":" << seconds
+               << ",\"clockSeconds\":" << boost::chrono::duration<double>(mClock.now() - mStart).count()
+               << ",\"finished\":" << (finished ? "true" : "false") << ",\"peakPending\":" << mPeakPending
+               << ",\"completed\":{\"success\":" << success << ",\"timeout\":" << timeout << ",\"canceled\":" << canceled
+               << "},\"addTaskUs\":";
+            addTask.json(ss);
+            ss << ",\"cancelTaskUs\":";
+            cancelTask.json(ss);
+            ss << ",\"processTimeoutsUs\":";
+            mProcessTimeouts.json(ss);
+            ss << ",\"notifyChangesUs\":";
+            mNotifyChanges.json(ss);
+            ss << ",\"timeoutLatenessUs\":";
+            lateness.json(ss);
+            ss << ",\"violations\":{\"missing\":" << missing << ",\"duplicate\":" << duplicate
+               << ",\"result\":" << badResult << ",\"early\":" << early << ",\"cancel\":" << badCancel
+               << "},\"heap\":";
+            Harness::heapJson(ss);
+            ss << '}';
+            std::cout << ss.str() << std::endl;
+            return missing + duplicate + badResult + early + badCancel == 0;
+        }
+    private:
+        void produce(unsigned int index) {
+            boost::random::mt19937 rng((boost::uint32_t)(o.seed * 7919 + index));
+            boost::random::uniform_int_distribution<unsigned long> deadline(o.minDeadline * 1000, o.maxDeadline * 1000);
+            boost::random::uniform_int_distribution<unsigned int> service(0, o.services - 1);
+            boost::random::uniform_int_distribution<unsigned int> reader(0, o.readers - 1);
+            boost::random::uniform_real_distribution<double> chance(0, 1);
+            std::vector<unsigned long> own;
+            for (;;) {
+                const unsigned long id = mNext++;
+                if (id >= o.tasks) {
+                    break;
+                }
+                TaskInfo& t = mInfo[id];
+                t.reader = reader(rng);
+                t.added = RealClock::now();
+                t.deadline = mClock.now() + boost::chrono::microseconds(deadline(rng));
+                Service& s = *mServices[service(rng)];
+                t.hService = s.handle();
+                Task::Ptr task(new WaitTask(t.deadline, s, hWnd, (REQUESTID)(id + 1), mReaders[t.reader]));
+
+                const Clock::time_point start = RealClock::now();
+                mTasks.addTask(task);
+                mAddTask[index].add(RealClock::now() - start);
+                ++mAdded;
+                own.push_back(id);
+
+                if (chance(rng) < o.cancel) {
+                    boost::random::uniform_int_distribution<std::size_t> pick(0, own.size() - 1);
+                    const unsigned long cid = own[pick(rng)];
+                    TaskInfo& c = mInfo[cid];
+                    const Clock::time_point requested = RealClock::now();
+                    const bool cancelled = mTasks.cancelTask(c.hService, (REQUESTID)(cid + 1));
+                    mCancelTask[index].add(RealClock::now() - requested);
+                    if (cancelled) {
+                        c.cancelRequested = requested;
+                        c.cancelled = true;
+                    }
+                }
+            }
+            --mProducers;
+        }
+        void monitor() {
+            boost::random::mt19937 rng((boost::uint32_t)o.seed);
+            boost::random::uniform_int_distribution<unsigned int> reader(0, o.readers - 1);
+            const Clock::duration period = boost::chrono::milliseconds(o.notifyPeriod);
+            Clock::time_point nextNotify = mClock.now() + period;
+            while (!mStop) {
+                const Clock::time_point now = mClock.now();
+                Clock::time_point start = RealClock::now();
+                mTasks.processTimeouts(now);
+                const Clock::time_point end = RealClock::now();
+                mProcessTimeouts.add(end - start);
+                mTicks.push_back(std::make_pair(end, now));
+
+                if (o.notifyPeriod != 0 && now >= nextNotify) {
+                    const unsigned int r = reader(rng);
+                    SCARD_READERSTATE state = SCARD_READERSTATE();
+                    state.szReader = mReaders[r].c_str();
+                    state.dwCurrentState = SCARD_STATE_EMPTY;
+                    state.dwEventState = SCARD_STATE_PRESENT | SCARD_STATE_CHANGED;
+                    start = RealClock::now();
+                    mNotified[r].push_back(start);
+                    mTasks.notifyChanges(state, false);
+                    mNotifyChanges.add(RealClock::now() - start);
+                    nextNotify = now + period;
+                }
+                const unsigned long pending = mAdded - mCompleted;
+                mPeakPending = std::max(mPeakPending, pending);
+
+                const DWORD timeout = mTasks.getTimeout(mClock.now());
+                if (o.virtualClock) {
+                    // Переводим часы сразу к ближайшему дедлайну или вставке карты.
+                    Clock::duration step = o.notifyPeriod != 0
+                        ? nextNotify - mClock.now()
+                        : Clock::duration(boost::chrono::milliseconds(1));
+                    if (timeout != INFINITE) {
+                        step = std::min(step, Clock::duration(boost::chrono::milliseconds(timeout)));
+                    }
+                    mVirtual.advance(step);
+                    boost::this_thread::yield();
+                } else {
+                    // Как и монитор считывателей, спим до ближайшего дедлайна, но не дольше 1 мс,
+                    // так как о новых задачах с более ранним дедлайном здесь никто не сообщает.
+                    boost::this_thread::sleep_for(boost::chrono::milliseconds(std::min<DWORD>(timeout, 1)));
+                }
+            }
+        }
+        /// @return `true`, если все задачи завершены, `false`, если завершения перестали поступать.
+        bool consume() {
+            const Clock::duration idle = boost::chrono::milliseconds(o.maxDeadline + 10000);
+            for (;;) {
+                if (mProducers == 0 && mCompleted == mAdded) {
+                    return true;
+                }
+                MessageQueue::Message m;
+                if (!MessageQueue::instance().get(hWnd, m, mProducers == 0 ? idle : boost::chrono::milliseconds(100))) {
+                    if (mProducers == 0) {
+                        return false;
+                    }
+                    continue;
+                }
+                LPWFSRESULT r = (LPWFSRESULT)m.lParam;
+                if (m.msg == WFS_EXECUTE_COMPLETE && r->RequestID >= 1 && r->RequestID <= o.tasks) {
+                    TaskInfo& t = mInfo[r->RequestID - 1];
+                    ++t.completions;
+                    t.result = r->hResult;
+                    t.completed = m.posted;
+                    ++mCompleted;
+                }
+                WFSFreeResult(r);
+            }
+        }
+    };
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options o;
+    if (!parse(argc, argv, o)) {
+        usage();
+        return 2;
+    }
+    // Менеджер нужен только как владелец сервисов, сами задачи хранятся в собственном контейнере.
+    Manager& manager = pcsc;
+    Bench bench(o, manager);
+    const Clock::time_point start = RealClock::now();
+    const bool finished = bench.run();
+    const bool ok = bench.report(boost::chrono::duration<double>(RealClock::now() - start).count(), finished);
+    return finished && ok ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#include "Clock.h"
+
+#include <boost/thread/lock_guard.hpp>
+
+namespace bc = boost::chrono;
+
+namespace {
+    class SteadyClock : public Clock {
+    public:
+        virtual time_point now() const { return bc::steady_clock::now(); }
+    };
+} // namespace
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Clock& Clock::steady() {
+    static SteadyClock clock;
+    return clock;
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+VirtualClock::VirtualClock() : mNow(bc::steady_clock::now()) {}
+Clock::time_point VirtualClock::now() const {
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    return mNow;
+}
+void VirtualClock::advance(duration d) {
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    if (d > duration::zero()) {
+        mNow += d;
+    }
+}
+void VirtualClock::set(time_point t) {
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    if (t > mNow) {
+        mNow = t;
+    }
+}
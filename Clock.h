@@ -0,0 +1,40 @@
+#ifndef PCSC_CENXFS_BRIDGE_Clock_H
+#define PCSC_CENXFS_BRIDGE_Clock_H
+
+#pragma once
+
+#include <boost/chrono/chrono.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Источник времени, по которому отсчитываются дедлайны задач. По умолчанию это монотонные
+    часы системы (`Clock::steady()`). Тесты и нагрузочные программы могут подставить менеджеру
+    `VirtualClock` и проверять таймауты, не дожидаясь их в реальном времени.
+*/
+class Clock : private boost::noncopyable {
+public:
+    typedef boost::chrono::steady_clock::duration duration;
+    typedef boost::chrono::steady_clock::time_point time_point;
+public:
+    virtual ~Clock() {}
+    virtual time_point now() const = 0;
+    /// Монотонные часы системы, используемые по умолчанию.
+    static Clock& steady();
+};
+/** Часы, время которых меняется только явно. Время никогда не идет назад. Все методы потокобезопасны.
+*/
+class VirtualClock : public Clock {
+    time_point mNow;
+    mutable boost::mutex mMutex;
+public:
+    /// Начинает отсчет с текущего времени монотонных часов, чтобы дедлайны, посчитанные
+    /// по разным часам, оставались сравнимыми.
+    VirtualClock();
+    virtual time_point now() const;
+    /// Переводит часы вперед на указанное время. Отрицательное значение игнорируется.
+    void advance(duration d);
+    /// Переводит часы на указанный момент, если он не раньше текущего.
+    void set(time_point t);
+};
+
+#endif // PCSC_CENXFS_BRIDGE_Clock_H
@@ -0,0 +1,77 @@
+#ifndef PCSC_CENXFS_BRIDGE_Config_FileSource_H
+#define PCSC_CENXFS_BRIDGE_Config_FileSource_H
+
+#pragma once
+
+#include "Config/Source.h"
+
+// Для std::time_t
+#include <ctime>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace Config {
+    /** Конфигурация из `.reg` файла в формате "Windows Registry Editor Version 5.00" (в кодировке
+        ASCII/UTF-8), например, `reg/provider.reg`. Поддерживаются строковые значения и значения
+        `dword:`.
+    @par
+        Пути ключей отсчитываются от корня конфигурации XFS: префиксы
+        `HKEY_LOCAL_MACHINE\SOFTWARE\XFS\`, `HKEY_USERS\.DEFAULT\XFS\` и
+        `HKEY_CLASSES_ROOT\WOSA/XFS_ROOT\` отбрасываются, ключи без них используются как есть.
+        Так один файл описывает и логические сервисы, и провайдеров, как их видит мост на Windows.
+    @par
+        Файл разбирается один раз при загрузке в отсортированный массив значений, поиск по
+        которому не обращается ни к файлу, ни к XFS менеджеру. Пути и имена, как и в реестре,
+        не зависят от регистра.
+    */
+    class FileSource : public Source {
+        struct Entry {
+            /// Путь ключа и имя значения в нижнем регистре, разделенные `\n`.
+            std::string id;
+            /// Строковое значение, для `dword:` -- число в десятичном виде.
+            std::string data;
+            /// Числовое значение, для строки -- результат ее разбора как числа.
+            DWORD number;
+        public:
+            inline bool operator<(const Entry& other) const { return id < other.id; }
+        };
+        typedef std::vector<Entry> Entries;
+    private:
+        /// Путь к файлу, из которого загружена конфигурация.
+        std::string mPath;
+        /// Время изменения и размер файла на момент загрузки, по ним определяется его изменение.
+        std::time_t mModified;
+        unsigned long long mSize;
+        /// Значения, отсортированные по `Entry::id`.
+        Entries mEntries;
+    public:
+        /** Загружает конфигурацию из файла.
+        @param error
+            Описание ошибки, если загрузка не удалась.
+        @return
+            Источник или `NULL`, если файл не удалось открыть или разобрать.
+        */
+        static FileSource* load(const std::string& path, std::string& error);
+        /// Загружает конфигурацию из потока. `path` используется только в названии источника.
+        static FileSource* load(std::istream& is, const std::string& path, std::string& error);
+
+        inline const std::string& path() const { return mPath; }
+        /// Количество значений в конфигурации.
+        inline std::size_t size() const { return mEntries.size(); }
+
+        virtual std::string name() const { return "file:" + mPath; }
+        virtual std::string value(const std::string& key, const char* name) const;
+        /// Для строкового значения возвращает его числовое значение (`0x` -- 16-ричное).
+        virtual DWORD dwValue(const std::string& key, const char* name) const;
+        /** Сравнивает время изменения и размер файла с запомненными при загрузке. Если файл
+            недоступен, считается, что он не изменился, и используется прежняя конфигурация.
+        */
+        virtual bool changed() const;
+        virtual Source* reload() const;
+    private:
+        FileSource(const std::string& path) : mPath(path), mModified(0), mSize(0) {}
+        const Entry* find(const std::string& key, const char* name) const;
+    };
+} // namespace Config
+#endif // PCSC_CENXFS_BRIDGE_Config_FileSource_H
@@ -0,0 +1,73 @@
+#ifndef PCSC_CENXFS_BRIDGE_Config_Source_H
+#define PCSC_CENXFS_BRIDGE_Config_Source_H
+
+#pragma once
+
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+// Для DWORD
+#include <windows.h>
+
+namespace Config {
+    /** Источник конфигурации, из которого читаются настройки сервис-провайдера (см. `Settings`).
+        Ключи адресуются путями относительно корня конфигурации XFS (`HKEY_USERS\.DEFAULT\XFS`),
+        разделенными `\`, например, `SERVICE_PROVIDERS\<провайдер>\Workarounds`.
+    @par
+        Источник выбирается один раз на процесс (см. `current`): по умолчанию это конфигурация XFS
+        (функции `WFM*`), а если в переменной окружения `PCSC_CENXFS_BRIDGE_CONFIG` задан путь к
+        `.reg` файлу -- этот файл (см. `FileSource`). Последнее позволяет запускать мост без XFS
+        менеджера и реестра.
+    */
+    class Source : private boost::noncopyable {
+    public:
+        typedef boost::shared_ptr<const Source> Ptr;
+    public:
+        /// Конфигурация XFS, читаемая через `WFMOpenKey`/`WFMQueryValue`.
+        static Ptr xfs();
+        /** Возвращает текущий источник. При первом вызове выбирает его по переменной окружения
+            `PCSC_CENXFS_BRIDGE_CONFIG`, если источник не был задан через `use`. Если файл не
+            удалось загрузить, ошибка записывается в журнал и используется конфигурация XFS.
+        */
+        static Ptr current();
+        /// Заменяет текущий источник. Настройки, прочитанные ранее, не перечитываются.
+        static void use(const Ptr& source);
+        /** Проверяет, не изменилась ли конфигурация текущего источника, и при необходимости
+            загружает ее заново (см. `changed` и `reload`).
+        @return
+            `true`, если конфигурация могла измениться и настройки нужно перечитать.
+        */
+        static bool refresh();
+
+        virtual ~Source() {}
+        /// Название источника для журнала.
+        virtual std::string name() const = 0;
+        /** Получает строковое значение.
+        @param key
+            Путь ключа относительно корня конфигурации XFS.
+        @param name
+            Имя значения в ключе. `NULL` означает значение ключа по умолчанию.
+        @return
+            Значение или пустая строка, если ключа или значения не существует.
+        */
+        virtual std::string value(const std::string& key, const char* name) const = 0;
+        /** Получает числовое (`DWORD`) значение.
+        @return
+            Значение или 0, если ключа или значения не существует.
+        */
+        virtual DWORD dwValue(const std::string& key, const char* name) const = 0;
+        /** Проверяет, могла ли конфигурация измениться с момента загрузки источника. Источник,
+            которому это неизвестно, всегда возвращает `true`.
+        */
+        virtual bool changed() const = 0;
+        /** Загружает конфигурацию заново.
+        @return
+            Новый источник или `NULL`, если источник читает конфигурацию при каждом обращении
+            или ее не удалось загрузить (причина записывается в журнал).
+        */
+        virtual Source* reload() const = 0;
+    };
+} // namespace Config
+#endif // PCSC_CENXFS_BRIDGE_Config_Source_H
@@ -0,0 +1,192 @@
+#include "Config/Source.h"
+
+#include "Config/FileSource.h"
+
+#include "XFS/Logger.h"
+
+// Для std::getenv
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+// XFS API для функций доступа к реестру.
+#include <xfsconf.h>
+
+namespace Config {
+    /// Класс для автоматического закрытия открытых ключей реестра, когда они более не нужны.
+    class RegKey {
+        HKEY hKey;
+    public:
+        inline RegKey(HKEY root, const char* name) {
+            HRESULT r = WFMOpenKey(root, (LPSTR)name, &hKey);
+
+            XFS::Logger() << "RegKey::RegKey(root=" << root << ", name=" << name << ", hKey=&" << hKey << ") = "  << r;
+        }
+        inline ~RegKey() {
+            HRESULT r = WFMCloseKey(hKey);
+
+            XFS::Logger() << "WFMCloseKey(hKey=" << hKey << ") = " << r;
+        }
+
+        inline RegKey child(const char* name) const {
+            return RegKey(hKey, name);
+        }
+        /** Получает значение из ключа реестра с указанным именем.
+        @param name
+            Имя значения в ключе реестра, которое требуется получить. Значение по умолчанию (`NULL`)
+            означает, что необходимо получить значение ключа по умолчанию.
+
+        @return
+            Строка со значением ключа. Если значения не существует, возвращает пустую строку.
+        */
+        inline std::string value(const char* name = NULL) const {
+            // Узнаем размер значения ключа.
+            DWORD dwSize = 0;
+            HRESULT r = WFMQueryValue(hKey, (LPSTR)name, NULL, &dwSize);
+
+            {XFS::Logger() << "RegKey::value[size](name=" << name << ", size=&" << dwSize << ") = " << r;}
+            // Используем вектор, т.к. он гарантирует непрерывность памяти под данные,
+            // чего нельзя сказать в случае со string.
+            // dwSize содержит длину строки без завершающего NULL, но он записывается в выходное значение.
+            std::vector<char> value(dwSize+1);
+            if (dwSize > 0) {
+                dwSize = value.capacity();
+                r = WFMQueryValue(hKey, (LPSTR)name, &value[0], &dwSize);
+                {XFS::Logger() << "RegKey::value[value](name=" << name << ", value=&" << &value[0] << ", size=&" << dwSize << ") = " << r;}
+            }
+            std::string result = std::string(value.begin(), value.end()-1);
+
+            XFS::Logger() << "RegKey::value(name=" << name << ") = " << result;
+            return result;
+        }
+        inline DWORD dwValue(const char* name) const {
+            // Узнаем размер значения ключа.
+            DWORD result = 0;
+            DWORD dwSize = sizeof(DWORD);
+            HRESULT r = WFMQueryValue(hKey, (LPSTR)name, (LPSTR)&result, &dwSize);
+
+            XFS::Logger() << "RegKey::value(name=" << name << ") = " << result;
+            return result;
+        }
+        /// Отладочная функция для вывода в трассу всех дочерных ключей.
+        void keys() const {
+            {XFS::Logger() << "keys";}
+            std::vector<char> keyName(256);
+            for (DWORD i = 0; ; ++i) {
+                DWORD size = keyName.capacity();
+                HRESULT r = WFMEnumKey(hKey, i, &keyName[0], &size, NULL);
+                if (r == WFS_ERR_CFG_NO_MORE_ITEMS) {
+                    break;
+                }
+                keyName[size] = '\0';
+
+                XFS::Logger() << &keyName[0];
+            }
+        }
+        /// Отладочная функция для вывода в трассу всех дочерных значений ключа.
+        /// Значение ключа -- это пара (имя=значение).
+        void values() const {
+            {XFS::Logger() << "values";}
+            // К сожалению, узнать конкретные длины заранее невозможно.
+            std::vector<char> name(256);
+            std::vector<char> value(256);
+            for (DWORD i = 0; ; ++i) {
+                DWORD szName = name.capacity();
+                DWORD szValue = value.capacity();
+                HRESULT r = WFMEnumValue(hKey, i, &name[0], &szName, &value[0], &szValue);
+                if (r == WFS_ERR_CFG_NO_MORE_ITEMS) {
+                    break;
+                }
+                name[szName] = '\0';
+                value[szValue] = '\0';
+
+                XFS::Logger()
+                    << i << ": " << '('<<szName<<','<<szValue<<')' << std::string(name.begin(), name.begin()+szName) << "="
+                    << std::string(value.begin(), value.begin()+szValue);
+            }
+        }
+    };
+
+    /// Конфигурация XFS. Каждое значение читается открытием ключа по полному пути.
+    class XfsSource : public Source {
+    public:
+        virtual std::string name() const { return "xfs"; }
+        virtual std::string value(const std::string& key, const char* name) const {
+            return RegKey(root(), key.c_str()).value(name);
+        }
+        virtual DWORD dwValue(const std::string& key, const char* name) const {
+            return RegKey(root(), key.c_str()).dwValue(name);
+        }
+        /// Конфигурация XFS не имеет отметки версии, поэтому может измениться в любой момент.
+        virtual bool changed() const { return true; }
+        /// Значения читаются при каждом обращении, загружать нечего.
+        virtual Source* reload() const { return NULL; }
+    private:
+        static HKEY root() {
+            // У Калигнайта под данным корнем не появляется провайдера, если он в
+            // HKEY_LOCAL_MACHINE\SOFTWARE\XFS\SERVICE_PROVIDERS\
+            // return WFS_CFG_HKEY_XFS_ROOT;
+            return WFS_CFG_USER_DEFAULT_XFS_ROOT;// HKEY_USERS\.DEFAULT\XFS
+        }
+    };
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    /// Текущий источник. Никогда не разрушается, т.к. потоки менеджера, в том числе поток
+    /// проверки изменений, останавливаются при разрушении статических объектов.
+    struct State {
+        const Source::Ptr xfs;
+        /// Защищает выбор текущего источника.
+        boost::mutex mutex;
+        Source::Ptr source;
+    public:
+        State() : xfs(new XfsSource()) {}
+    };
+    static State& state = *new State();
+
+    static Source::Ptr choose() {
+        const char* path = std::getenv("PCSC_CENXFS_BRIDGE_CONFIG");
+        if (path == NULL || *path == '\0') {
+            return state.xfs;
+        }
+        std::string error;
+        FileSource* source = FileSource::load(path, error);
+        if (source == NULL) {
+            XFS::Logger() << "Config::Source: " << path << ": " << error << ", XFS configuration is used";
+            return state.xfs;
+        }
+        XFS::Logger() << "Config::Source: " << source->size() << " value(s) loaded from " << path;
+        return Source::Ptr(source);
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    Source::Ptr Source::xfs() {
+        return state.xfs;
+    }
+    Source::Ptr Source::current() {
+        boost::lock_guard<boost::mutex> lock(state.mutex);
+        if (!state.source) {
+            state.source = choose();
+        }
+        return state.source;
+    }
+    bool Source::refresh() {
+        boost::lock_guard<boost::mutex> lock(state.mutex);
+        if (!state.source) {
+            state.source = choose();
+        }
+        if (!state.source->changed()) {
+            return false;
+        }
+        Source* reloaded = state.source->reload();
+        if (reloaded != NULL) {
+            {XFS::Logger() << "Config::Source::refresh: " << reloaded->name() << " reloaded";}
+            state.source.reset(reloaded);
+        }
+        return true;
+    }
+    void Source::use(const Ptr& source) {
+        boost::lock_guard<boost::mutex> lock(state.mutex);
+        {XFS::Logger() << "Config::Source::use: " << (source ? source->name() : std::string("(default)"));}
+        state.source = source;
+    }
+} // namespace Config
@@ -1,17 +1,31 @@
 #include "PCSC/Context.h"
 
+#include "Diagnostics/FlightRecorder.h"
+
 #include "PCSC/Status.h"
 
 #include "XFS/Logger.h"
 
 namespace PCSC {
-    Context::Context() {
+    Context::Context(Backend& backend) : mBackend(&backend), hContext(0), mEstablished(false) {}
+    Context::~Context() {
+        if (mEstablished) {
+            release();
+        }
+    }
+    void Context::establish(Backend& backend) {
+        mBackend = &backend;
         // Создаем контекст.
-        Status st = SCardEstablishContext(SCARD_SCOPE_USER, NULL, NULL, &hContext);
-        XFS::Logger() << "SCardEstablishContext: " << st;
+        Status st = mBackend->establishContext(&hContext);
+        Diagnostics::flightPCSC("SCardEstablishContext", (unsigned long)hContext, st.value());
+        XFS::Logger() << "SCardEstablishContext[" << mBackend->name() << "]: " << st;
+        mEstablished = true;
     }
-    Context::~Context() {
-        Status st = SCardReleaseContext(hContext);
-        XFS::Logger() << "SCardReleaseContext: " << st;
+    void Context::release() {
+        Status st = mBackend->releaseContext(hContext);
+        Diagnostics::flightPCSC("SCardReleaseContext", (unsigned long)hContext, st.value());
+        XFS::Logger() << "SCardReleaseContext[" << mBackend->name() << "]: " << st;
+        hContext = 0;
+        mEstablished = false;
     }
 }
\ No newline at end of file
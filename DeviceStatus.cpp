@@ -0,0 +1,47 @@
+#include "PCSC/DeviceStatus.h"
+
+#include "XFS/Memory.h"
+#include "XFS/Result.h"
+
+// Для std::memcpy
+#include <cstring>
+
+// Для GetComputerNameEx
+#include <winbase.h>
+
+namespace PCSC {
+    std::string DeviceStatus::workstationName() {
+        DWORD len = 0;
+        // Сначала получаем размер буфера (включает размер для завершающего 0)
+        GetComputerNameEx(ComputerNameNetBIOS, NULL, &len);
+        std::vector<CHAR> name(len + 1);
+        if (!GetComputerNameEx(ComputerNameNetBIOS, &name[0], &len)) {
+            return std::string();
+        }
+        return std::string(&name[0], len);
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    DeviceStatus::DeviceStatus(const std::string& physicalName, const std::string& workstationName) {
+        XFS::Layout layout;
+        layout.add<WFSDEVSTATUS>();
+        mPhysicalName = layout.size();
+        layout.add<CHAR>(physicalName.size() + 1);
+        mWorkstationName = layout.size();
+        layout.add<CHAR>(workstationName.size() + 1);
+
+        mImage.resize(layout.size());
+        std::memcpy(&mImage[mPhysicalName], physicalName.c_str(), physicalName.size() + 1);
+        std::memcpy(&mImage[mWorkstationName], workstationName.c_str(), workstationName.size() + 1);
+    }
+    void DeviceStatus::attach(XFS::Result& result, DWORD dwState) const {
+        XFS::Block block = result.allocate(XFS::Layout().add<char>(mImage.size()), "DeviceStatus");
+        char* data = block.copy(&mImage[0], mImage.size());
+        WFSDEVSTATUS* status = (WFSDEVSTATUS*)data;
+        // Имя физичеcкого устройства, чье состояние изменилось
+        status->lpszPhysicalName = data + mPhysicalName;
+        // Рабочая станция, на которой запущен сервис.
+        status->lpszWorkstationName = data + mWorkstationName;
+        status->dwState = dwState;
+        result.attach(status);
+    }
+} // namespace PCSC
@@ -0,0 +1,124 @@
+#ifndef PCSC_CENXFS_BRIDGE_Diagnostics_ApduStats_H
+#define PCSC_CENXFS_BRIDGE_Diagnostics_ApduStats_H
+
+#pragma once
+
+#include "Utils/CTString.h"
+
+#include "PCSC/Status.h"
+
+// Для std::size_t
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+
+#include <boost/chrono/chrono.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+// Для BYTE, WORD и DWORD
+#include <windef.h>
+
+namespace Diagnostics {
+    /** Собирает статистику обмена с чипом через `SCardTransmit`, сгруппированную по паре байт
+        CLA/INS команды: количество команд, распределение времени выполнения, размер ответов и
+        частоту кодов ответа SW1/SW2. Позволяет увидеть, какие команды чипа занимают основное
+        время транзакции, не разбирая 16-ричные трассировки.
+    @par
+        Статистика общая на весь процесс и собирается всегда. Ее можно получить в виде JSON
+        через вендорскую категорию `WFPGetInfo` и, если в настройках задан файл, периодически
+        сбрасывается на диск.
+    */
+    class ApduStats : private boost::noncopyable {
+    public:
+        /// Количество интервалов гистограммы времени выполнения команд.
+        static const std::size_t bucketCount = 12;
+        /// Верхние границы интервалов гистограммы в микросекундах, последний интервал не ограничен.
+        static const unsigned long* bounds();
+
+        /// Накопленная статистика по одной паре CLA/INS.
+        struct Entry {
+            /// Количество выполненных команд.
+            unsigned long count;
+            /// Количество команд, для которых `SCardTransmit` вернула ошибку.
+            unsigned long errors;
+            /// Суммарное, минимальное и максимальное время выполнения в микросекундах.
+            unsigned long long totalUs;
+            unsigned long minUs;
+            unsigned long maxUs;
+            /// Гистограмма времени выполнения, по интервалам из `bounds()`.
+            unsigned long buckets[bucketCount];
+            /// Суммарный и максимальный размер ответов без учета SW1/SW2.
+            unsigned long long totalBytes;
+            unsigned long maxBytes;
+            /// Частота кодов ответа, ключ -- `SW1 << 8 | SW2`.
+            std::map<WORD, unsigned long> sw;
+        public:
+            Entry();
+        };
+    private:
+        /// Ключ -- `CLA << 8 | INS`.
+        typedef std::map<WORD, Entry> EntryMap;
+        EntryMap mEntries;
+        /// Файл для периодического сброса статистики, если пуст, статистика не сбрасывается.
+        std::string mFile;
+        /// Период сброса статистики в файл.
+        boost::chrono::steady_clock::duration mPeriod;
+        /// Момент, после которого при очередной записи статистика будет сброшена в файл.
+        boost::chrono::steady_clock::time_point mNextDump;
+        /// `true`, если с последнего сброса в файл статистика изменилась.
+        bool mDirty;
+        boost::mutex mMutex;
+    public:
+        /// Период сброса статистики в файл по умолчанию, если в настройках он не указан.
+        static const DWORD defaultPeriod = 60;
+    public:
+        /// Возвращает единственный экземпляр статистики.
+        static ApduStats& instance();
+        /// Сбрасывает накопленную статистику в файл, если он задан.
+        ~ApduStats();
+
+        /** Задает файл, в который периодически сбрасывается статистика. Если файл уже задан,
+            ничего не делает.
+        @param path
+            Путь к файлу. Файл перезаписывается при каждом сбросе.
+        @param period
+            Период сброса в секундах. `0` означает период по умолчанию.
+        */
+        void setDumpFile(const std::string& path, DWORD period);
+        /** Учитывает одну команду, переданную чипу.
+        @param command
+            Переданная чипу команда, начинается с заголовка CLA INS P1 P2.
+        @param commandSize
+            Размер команды в байтах.
+        @param response
+            Ответ чипа, заканчивается байтами SW1 SW2.
+        @param responseSize
+            Размер ответа в байтах.
+        @param elapsed
+            Время выполнения `SCardTransmit`.
+        @param status
+            Код возврата `SCardTransmit`. В случае ошибки ответ не анализируется.
+        */
+        void record(const BYTE* command, std::size_t commandSize,
+                    const BYTE* response, std::size_t responseSize,
+                    boost::chrono::steady_clock::duration elapsed, PCSC::Status status);
+        /// Возвращает накопленную статистику в виде JSON-объекта.
+        std::string toJSONString();
+        /// Немедленно сбрасывает накопленную статистику в файл, если он задан.
+        void dump();
+    private:
+        ApduStats();
+        /// Выводит статистику в поток. Мьютекс должен быть захвачен.
+        void writeLocked(std::ostream& os) const;
+        /// Сбрасывает статистику в файл. Мьютекс должен быть захвачен.
+        void dumpLocked();
+    };
+
+    /** Возвращает название команды по байту INS для наиболее частых команд ISO 7816-4 и EMV.
+    @return Название команды или невалидную строку, если команда неизвестна.
+    */
+    CTString insName(BYTE ins);
+} // namespace Diagnostics
+#endif // PCSC_CENXFS_BRIDGE_Diagnostics_ApduStats_H
@@ -0,0 +1,158 @@
+#ifndef PCSC_CENXFS_BRIDGE_Diagnostics_FlightRecorder_H
+#define PCSC_CENXFS_BRIDGE_Diagnostics_FlightRecorder_H
+
+#pragma once
+
+// Для std::size_t
+#include <cstddef>
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+// Для DWORD
+#include <windef.h>
+
+namespace Diagnostics {
+    /** "Бортовой самописец": кольцевой буфер фиксированного размера с компактными записями
+        о последних событиях сервис-провайдера -- вызовах SPI-функций, кодах возврата функций
+        PC/SC, изменениях состояния считывателей и отправленных XFS-сообщениях.
+    @par
+        Запись ведется всегда. Добавление записи не захватывает блокировок и не выделяет память:
+        это атомарное приращение счетчика и заполнение одного элемента буфера. Строки в записях
+        не копируются, поэтому в качестве названий допускаются только строковые литералы.
+        Форматирование выполняется только при сбросе буфера в файл, который происходит при
+        отправке результата с кодом `WFS_ERR_INTERNAL_ERROR` или `WFS_ERR_HARDWARE_ERROR`, при
+        срабатывании `assert` (через обработчик `SIGABRT`) и по вендорской команде.
+    @par
+        Обработчик `SIGABRT` не захватывает блокировок и не выделяет память: записи форматируются
+        в заранее выделенный буфер без расшифровки кодов и пишутся в файл функциями `CreateFile`/`WriteFile`,
+        после чего вызывается обработчик, установленный до самописца.
+    */
+    class FlightRecorder : private boost::noncopyable {
+    public:
+        /// Вид записи.
+        enum Kind {
+            /// Вызов SPI-функции: `a` -- хендл сервиса, `b` -- `ReqID`, `c` -- категория или команда.
+            Call,
+            /// Код возврата функции PC/SC: `a` -- хендл контекста или карты, `c` -- код возврата.
+            PCSC,
+            /// Изменение состояния считывателя: `a` -- номер считывателя в списке ожидания
+            /// (0 -- псевдо-считыватель изменения списка), `b` -- старое состояние, `c` -- новое.
+            State,
+            /// Отправка XFS-сообщения: `a` -- хендл сервиса, `b` -- `ReqID`, `c` -- код результата.
+            Post,
+        };
+        /// Одна запись буфера.
+        struct Record {
+            /// Порядковый номер записи плюс 1, 0 -- запись пуста или заполняется в данный момент.
+            unsigned long seq;
+            /// Время от создания буфера в микросекундах.
+            long long ts;
+            DWORD tid;
+            Kind kind;
+            /// Название события, строковый литерал.
+            const char* name;
+            unsigned long a;
+            unsigned long b;
+            long c;
+        };
+        /// Количество записей в буфере, степень двойки.
+        static const std::size_t capacity = 4096;
+    private:
+        Record mRing[capacity];
+        /// Номер следующей записи.
+        boost::atomic<unsigned long> mNext;
+        /// Момент создания буфера, от которого отсчитываются временные метки.
+        boost::chrono::steady_clock::time_point mOrigin;
+        /// Момент последнего автоматического сброса в файл.
+        boost::chrono::steady_clock::time_point mLastDump;
+        /// Файл, в который сбрасывается буфер.
+        std::string mFile;
+        /// Защищает файл и настройки от одновременного изменения.
+        boost::mutex mMutex;
+        /// Обработчик сигнала.
+        typedef void (*SignalHandler)(int);
+        /// Обработчик `SIGABRT`, установленный до самописца. Вызывается после сброса буфера
+        /// и восстанавливается при разрушении самописца.
+        SignalHandler mPreviousAbort;
+        /// Копия пути к файлу для обработчика `SIGABRT`, которому нельзя обращаться к `mFile`.
+        char mAbortFile[260];
+        /// Буфер для форматирования одной записи в обработчике `SIGABRT`.
+        char mAbortLine[256];
+    public:
+        /** Возвращает единственный экземпляр буфера. Впервые должен вызываться до запуска
+            потока отслеживания изменений, чтобы объект был разрушен после его остановки.
+        */
+        static FlightRecorder& instance();
+
+        /** Добавляет запись в буфер.
+        @param kind Вид записи, определяет смысл остальных параметров.
+        @param name Название события. Должно быть строковым литералом.
+        */
+        inline void record(Kind kind, const char* name, unsigned long a, unsigned long b, long c) {
+            const unsigned long seq = mNext.fetch_add(1, boost::memory_order_relaxed);
+            Record& r = mRing[seq & (capacity - 1)];
+            r.seq  = 0;
+            // Читатель, увидевший новые данные, должен увидеть и обнуленный номер, см. `read`.
+            boost::atomic_thread_fence(boost::memory_order_release);
+            r.ts   = boost::chrono::duration_cast<boost::chrono::microseconds>(
+                boost::chrono::steady_clock::now() - mOrigin
+            ).count();
+            r.tid  = currentThread();
+            r.kind = kind;
+            r.name = name;
+            r.a = a;
+            r.b = b;
+            r.c = c;
+            boost::atomic_thread_fence(boost::memory_order_release);
+            r.seq  = seq + 1;
+        }
+        /** Задает файл, в который сбрасывается буфер. Если файл уже задан, ничего не делает.
+        @param path
+            Путь к файлу. Если пустой, используется файл `pcsc-cenxfs-bridge.flight.log`
+            во временном каталоге.
+        */
+        void setFile(const std::string& path);
+        /** Сбрасывает содержимое буфера в файл, дописывая его в конец файла.
+        @param reason
+            Причина сброса, записывается в заголовок.
+        @param force
+            Если `false`, то сброс не выполняется, если с предыдущего автоматического сброса
+            прошло меньше секунды. Защищает от лавины сбросов при повторяющихся ошибках.
+        @return
+            `true`, если буфер был записан в файл.
+        */
+        bool dump(const char* reason, bool force = false);
+    private:
+        FlightRecorder();
+        ~FlightRecorder();
+        static DWORD currentThread();
+        /** Копирует запись с указанным номером, если она не была перезаписана или изменена
+            во время копирования.
+        @return
+            `true`, если копия согласована и имеет номер `seq`.
+        */
+        bool read(unsigned long seq, Record& copy) const;
+        /// Записывает буфер в файл. Мьютекс должен быть захвачен.
+        bool dumpLocked(const char* reason);
+        /// Записывает буфер в файл, пользуясь только функциями, допустимыми в обработчике сигнала.
+        void dumpRaw(const char* reason);
+        /// Запоминает путь к файлу для `dumpRaw`. Мьютекс должен быть захвачен.
+        void setAbortFile(const std::string& path);
+        /// Обработчик `SIGABRT`, в который попадает сработавший `assert`.
+        static void onAbort(int sig);
+    };
+
+    /// Добавляет в бортовой самописец запись о вызове SPI-функции.
+    inline void flightCall(const char* name, DWORD hService, DWORD ReqID, DWORD arg = 0) {
+        FlightRecorder::instance().record(FlightRecorder::Call, name, hService, ReqID, (long)arg);
+    }
+    /// Добавляет в бортовой самописец запись о коде возврата функции PC/SC.
+    inline void flightPCSC(const char* name, unsigned long handle, long status) {
+        FlightRecorder::instance().record(FlightRecorder::PCSC, name, handle, 0, status);
+    }
+} // namespace Diagnostics
+#endif // PCSC_CENXFS_BRIDGE_Diagnostics_FlightRecorder_H
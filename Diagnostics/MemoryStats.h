@@ -0,0 +1,96 @@
+#ifndef PCSC_CENXFS_BRIDGE_Diagnostics_MemoryStats_H
+#define PCSC_CENXFS_BRIDGE_Diagnostics_MemoryStats_H
+
+#pragma once
+
+// Для std::size_t
+#include <cstddef>
+// Для std::strcmp
+#include <cstring>
+#include <map>
+#include <ostream>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Diagnostics {
+    /** Учет памяти, выделяемой через менеджер памяти XFS (`WFMAllocateBuffer`), по местам
+        выделения.
+    @par
+        Приложение освобождает результат вызовом `WFSFreeResult`, который освобождает сам
+        `WFSRESULT` и только те буферы, что были привязаны к нему через `WFMAllocateMore`.
+        Все остальные буферы, выделенные через `WFMAllocateBuffer` и лишь сохраненные в полях
+        результата, не будут освобождены никогда. Поэтому учет различает корневые буферы
+        (сами `WFSRESULT`), привязанные к ним и отдельные. Последние недостижимы из
+        освобождаемого `WFSRESULT` и являются утечками.
+    @par
+        Учет необязателен и по умолчанию выключен. Пока он выключен, каждое выделение стоит
+        одной проверки флага.
+    */
+    class MemoryStats : private boost::noncopyable {
+    public:
+        /// Вид выделенного буфера.
+        enum Kind {
+            /// Корневой `WFSRESULT`, освобождается приложением через `WFSFreeResult`.
+            Root,
+            /// Буфер, привязанный к корневому через `WFMAllocateMore` и освобождаемый вместе с ним.
+            Linked,
+            /// Отдельный буфер, недостижимый для `WFSFreeResult`.
+            Detached,
+        };
+        /// Счетчики для одного места выделения.
+        struct Counters {
+            Kind kind;
+            /// Количество выделений.
+            unsigned long count;
+            /// Суммарный размер выделений в байтах.
+            unsigned long long bytes;
+        public:
+            Counters() : kind(Detached), count(0), bytes(0) {}
+        };
+    private:
+        struct Less {
+            inline bool operator()(const char* l, const char* r) const { return std::strcmp(l, r) < 0; }
+        };
+        /// Ключ -- название места выделения, строковый литерал.
+        typedef std::map<const char*, Counters, Less> SiteMap;
+        SiteMap mSites;
+        /// Флаг, позволяющий без захвата мьютекса проверить, ведется ли учет.
+        volatile bool mEnabled;
+        boost::mutex mMutex;
+    public:
+        /** Возвращает единственный экземпляр учета. Впервые должен вызываться до запуска
+            потока отслеживания изменений, чтобы объект был разрушен после его остановки.
+        */
+        static MemoryStats& instance();
+        /// Выводит в журнал отчет о буферах, которые никогда не будут освобождены.
+        ~MemoryStats();
+
+        /// Включает учет. Выделения, сделанные до включения, не учитываются.
+        inline void enable() { mEnabled = true; }
+        /// @return `true`, если в данный момент ведется учет.
+        inline bool enabled() const { return mEnabled; }
+        /** Учитывает выделение буфера.
+        @param site
+            Место выделения, строковый литерал. `NULL` означает неизвестное место.
+        @param size
+            Размер выделенного буфера в байтах.
+        @param kind
+            Вид буфера.
+        */
+        inline void allocated(const char* site, std::size_t size, Kind kind) {
+            if (mEnabled) {
+                account(site, size, kind);
+            }
+        }
+        /// Возвращает счетчики всех мест выделения в виде JSON-объекта.
+        std::string toJSONString();
+    private:
+        MemoryStats();
+        void account(const char* site, std::size_t size, Kind kind);
+        /// Выводит счетчики в поток. Мьютекс должен быть захвачен.
+        void writeLocked(std::ostream& os) const;
+    };
+} // namespace Diagnostics
+#endif // PCSC_CENXFS_BRIDGE_Diagnostics_MemoryStats_H
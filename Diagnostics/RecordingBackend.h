@@ -0,0 +1,59 @@
+#ifndef PCSC_CENXFS_BRIDGE_Diagnostics_RecordingBackend_H
+#define PCSC_CENXFS_BRIDGE_Diagnostics_RecordingBackend_H
+
+#pragma once
+
+#include "PCSC/Backend.h"
+
+namespace Diagnostics {
+    /** Обертка над реализацией PC/SC, передающая ее вызовы в запись сеанса (см. `SessionRecorder`).
+        Пока запись не начата, только переадресует вызовы.
+    @par
+        Ожидается, что первый считыватель, передаваемый в `getStatusChange`, -- псевдо-считыватель
+        изменения списка считывателей, как это делает `ReaderChangesMonitor`.
+    */
+    class RecordingBackend : public PCSC::Backend {
+        /// Реализация, вызовы которой записываются.
+        PCSC::Backend* mBackend;
+    public:
+        /** Возвращает единственный экземпляр обертки. Он никогда не разрушается, т.к. через
+            него закрывается контекст PC/SC в деструкторе менеджера.
+        */
+        static RecordingBackend& instance();
+        /** Задает реализацию, вызовы которой записываются. Можно вызывать только тогда,
+            когда через обертку не открыто ни контекстов, ни соединений.
+        */
+        inline void wrap(PCSC::Backend& backend) { mBackend = &backend; }
+        inline PCSC::Backend& wrapped() const { return *mBackend; }
+
+        virtual const char* name() const { return "recording"; }
+    public:// Контекст и считыватели
+        virtual LONG establishContext(LPSCARDCONTEXT phContext);
+        virtual LONG releaseContext(SCARDCONTEXT hContext);
+        virtual LONG listReaders(SCARDCONTEXT hContext, LPSTR mszReaders, LPDWORD pcchReaders);
+        /// Записывает список считывателей и изменения их состояния.
+        virtual LONG getStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout,
+                                     SCARD_READERSTATE* rgReaderStates, DWORD cReaders);
+        virtual LONG cancel(SCARDCONTEXT hContext);
+    public:// Соединение с картой
+        /// Записывает вставленную карту с активным протоколом.
+        virtual LONG connect(SCARDCONTEXT hContext, LPCSTR szReader, DWORD dwShareMode,
+                             DWORD dwPreferredProtocols, LPSCARDHANDLE phCard, LPDWORD pdwActiveProtocol);
+        virtual LONG reconnect(SCARDHANDLE hCard, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                               DWORD dwInitialization, LPDWORD pdwActiveProtocol);
+        virtual LONG disconnect(SCARDHANDLE hCard, DWORD dwDisposition);
+        virtual LONG beginTransaction(SCARDHANDLE hCard);
+        virtual LONG endTransaction(SCARDHANDLE hCard, DWORD dwDisposition);
+    public:// Обмен с картой
+        virtual LONG status(SCARDHANDLE hCard, LPSTR szReaderName, LPDWORD pcchReaderLen,
+                            LPDWORD pdwState, LPDWORD pdwProtocol, LPBYTE pbAtr, LPDWORD pcbAtrLen);
+        /// Записывает команду, ответ на нее и время ее выполнения.
+        virtual LONG transmit(SCARDHANDLE hCard, const SCARD_IO_REQUEST* pioSendPci,
+                              LPCBYTE pbSendBuffer, DWORD cbSendLength,
+                              LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength);
+        virtual LONG getAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen);
+    private:
+        RecordingBackend();
+    };
+} // namespace Diagnostics
+#endif // PCSC_CENXFS_BRIDGE_Diagnostics_RecordingBackend_H
@@ -0,0 +1,115 @@
+#ifndef PCSC_CENXFS_BRIDGE_Diagnostics_SessionRecorder_H
+#define PCSC_CENXFS_BRIDGE_Diagnostics_SessionRecorder_H
+
+#pragma once
+
+// Для std::size_t
+#include <cstddef>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+// PC/SC API
+#include <winscard.h>
+
+namespace Diagnostics {
+    /** Запись сеанса работы с реальными считывателями в виде сценария симулятора PC/SC
+        (см. `Simulator/Simulator.h`), по которому сеанс затем воспроизводится без оборудования.
+    @par
+        Записываются подключение и отключение считывателей, вставка и извлечение карт с их ATR
+        и активным протоколом, а также каждая успешная команда чипу с ответом и временем
+        выполнения. Каждая вставка карты становится отдельной картой сценария (`c1`, `c2`, ...),
+        а ее команды -- одноразовыми правилами (`once`), поэтому при воспроизведении одинаковые
+        команды получают ответы в записанном порядке. Время событий отсчитывается от начала записи.
+    @par
+        Описание карты и событие ее вставки записываются при первом соединении с ней, когда
+        становится известен протокол, или при ее извлечении. Если карта была вынута и вставлена
+        между двумя опросами `SCardGetStatusChange`, такая пара событий не записывается.
+    @par
+        По умолчанию секретные данные в файл не попадают. Поле данных команд, передающих PIN
+        (`VERIFY`, `CHANGE REFERENCE DATA`, `RESET RETRY COUNTER`), записывается шаблоном `??`,
+        поэтому при воспроизведении правило подходит для любого PIN той же длины. Данные ответов
+        на команды, возвращающие PAN, имя держателя и данные дорожек (`READ BINARY`, `READ RECORD`,
+        `GET PROCESSING OPTIONS` и продолжающий их `GET RESPONSE`), заменяются нулями, слово
+        состояния сохраняется.
+    */
+    class SessionRecorder : private boost::noncopyable {
+        typedef boost::chrono::steady_clock Clock;
+
+        /// Состояние считывателя с точки зрения записи.
+        struct Reader {
+            /// Название карты в сценарии или пустая строка, если карты нет.
+            std::string card;
+            std::vector<BYTE> atr;
+            /// Время вставки карты от начала записи в микросекундах.
+            long long insertedAt;
+            /// Если `true`, то считыватель был подключен с начала записи и его состояние еще не получено.
+            bool fresh;
+            /// Если `true`, то карта была в считывателе с начала записи.
+            bool initial;
+            /// Если `true`, то описание карты и ее вставка уже записаны.
+            bool written;
+        public:
+            Reader() : insertedAt(0), fresh(false), initial(false), written(false) {}
+        };
+    private:
+        std::ofstream mFile;
+        /// Если `false`, то все методы записи сразу возвращаются, не захватывая мьютекс.
+        boost::atomic<bool> mEnabled;
+        /// Если `true`, то секретные данные команд и ответов скрываются.
+        bool mRedact;
+        /// Начало записи, от которого отсчитывается время событий.
+        Clock::time_point mOrigin;
+        /// Известные считыватели, ключ -- название считывателя.
+        std::map<std::string, Reader> mReaders;
+        /// Если `true`, то список считывателей уже получен хотя бы раз.
+        bool mListed;
+        /// Считыватели, с картами которых установлены соединения.
+        std::map<SCARDHANDLE, std::string> mConnections;
+        /// Количество записанных карт, из него формируются их названия.
+        unsigned long mCards;
+        boost::mutex mMutex;
+    public:
+        /** Возвращает единственный экземпляр записи. Впервые должен вызываться до запуска
+            потока отслеживания изменений, чтобы объект был разрушен после его остановки.
+        */
+        static SessionRecorder& instance();
+        ~SessionRecorder();
+
+        /** Начинает запись в файл, перезаписывая его. Если запись уже ведется, ничего не делает.
+        @param redact Скрывать ли секретные данные команд и ответов.
+        @return `true`, если запись ведется.
+        */
+        bool open(const std::string& path, bool redact = true);
+        inline bool enabled() const { return mEnabled.load(boost::memory_order_relaxed); }
+
+        /** Запоминает список считывателей, состояние которых ожидается от `SCardGetStatusChange`.
+            Первый элемент -- псевдо-считыватель изменения списка, он пропускается.
+        */
+        void readers(const SCARD_READERSTATE* states, std::size_t count);
+        /// Запоминает новое состояние считывателя (`dwEventState`), полученное от `SCardGetStatusChange`.
+        void state(const SCARD_READERSTATE& state);
+        /// Запоминает соединение с картой в указанном считывателе.
+        void connect(const char* reader, SCARDHANDLE hCard, DWORD protocol);
+        void disconnect(SCARDHANDLE hCard);
+        /// Запоминает команду чипу и ответ на нее. Неуспешные команды не записываются.
+        void transmit(SCARDHANDLE hCard, const BYTE* command, std::size_t commandSize,
+                      const BYTE* response, std::size_t responseSize,
+                      Clock::duration duration, LONG status);
+    private:
+        SessionRecorder();
+        /// @return Время от начала записи в микросекундах.
+        long long elapsed() const;
+        /// Записывает описание и вставку карты, если это еще не сделано. Мьютекс должен быть захвачен.
+        void writeCardLocked(const std::string& name, Reader& reader, DWORD protocol);
+        /// Записывает извлечение карты, если она есть. Мьютекс должен быть захвачен.
+        void removeLocked(const std::string& name, Reader& reader, long long at);
+    };
+} // namespace Diagnostics
+#endif // PCSC_CENXFS_BRIDGE_Diagnostics_SessionRecorder_H
@@ -0,0 +1,117 @@
+#ifndef PCSC_CENXFS_BRIDGE_Diagnostics_Timeline_H
+#define PCSC_CENXFS_BRIDGE_Diagnostics_Timeline_H
+
+#pragma once
+
+#include "Utils/CTString.h"
+
+// Для std::FILE
+#include <cstdio>
+// Для std::size_t
+#include <cstddef>
+#include <string>
+
+#include <boost/chrono/chrono.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Diagnostics {
+    /** Записывает временную шкалу активности сервис-провайдера в файл в формате Chrome Trace Event
+        (JSON Array Format), который открывается в `chrome://tracing` и в Perfetto UI.
+    @par
+        Запись необязательна и по умолчанию выключена. Пока файл не открыт, каждое событие
+        стоит одной проверки флага. Размер файла ограничен: при достижении лимита в файл
+        дописывается событие об усечении, файл закрывается, и запись прекращается.
+    */
+    class Timeline : private boost::noncopyable {
+        /// Файл, в который пишутся события, или `NULL`, если запись не ведется.
+        std::FILE* mFile;
+        /// Количество байт, уже записанных в файл.
+        std::size_t mWritten;
+        /// Максимальный размер файла в байтах.
+        std::size_t mLimit;
+        /// `true`, пока в файл не записано ни одного события.
+        bool mEmpty;
+        /// Момент открытия файла, от которого отсчитываются временные метки событий.
+        boost::chrono::steady_clock::time_point mOrigin;
+        /// Флаг, позволяющий без захвата мьютекса проверить, ведется ли запись.
+        volatile bool mEnabled;
+        /// Мьютекс для защиты файла от одновременной записи из разных потоков.
+        boost::mutex mMutex;
+    public:
+        /// Размер файла по умолчанию, если в настройках он не указан.
+        static const std::size_t defaultLimit = 16 * 1024 * 1024;
+    public:
+        /** Возвращает единственный экземпляр записи. Впервые должен вызываться до запуска
+            потока отслеживания изменений, чтобы объект был разрушен после его остановки.
+        */
+        static Timeline& instance();
+        /// Закрывает файл, если запись велась.
+        ~Timeline();
+
+        /// @return `true`, если в данный момент ведется запись событий.
+        inline bool enabled() const { return mEnabled; }
+        /** Начинает запись событий в указанный файл. Если запись уже ведется, ничего не делает.
+        @param path
+            Путь к файлу. Существующий файл перезаписывается.
+        @param limit
+            Максимальный размер файла в байтах. `0` означает размер по умолчанию.
+        */
+        void open(const std::string& path, std::size_t limit);
+        /// Завершает запись событий и закрывает файл.
+        void close();
+        /** Записывает одно событие.
+        @param phase
+            Тип события в терминах формата Trace Event: `B` -- начало интервала, `E` -- его конец,
+            `i` -- мгновенное событие.
+        @param name
+            Название события.
+        @param category
+            Категория события, по которой события можно фильтровать при просмотре.
+        @param args
+            Тело JSON-объекта с аргументами события (без фигурных скобок), может быть пустым.
+        */
+        void write(char phase, const char* name, const char* category, const std::string& args);
+    private:
+        Timeline();
+        /// Закрывает файл. Мьютекс должен быть захвачен.
+        void closeLocked();
+    };
+
+    /** Мгновенное событие временной шкалы. Аналогично `XFS::Logger`, событие записывается
+        в деструкторе, поэтому удобно создавать временный объект и заполнять его аргументы
+        цепочкой вызовов `arg`. Если запись не ведется, все методы ничего не делают.
+    */
+    class TimelineEvent {
+        const char* mName;
+        const char* mCategory;
+        char mPhase;
+        bool mEnabled;
+        /// Аргументы события в виде тела JSON-объекта.
+        std::string mArgs;
+    public:
+        TimelineEvent(const char* name, const char* category, char phase = 'i');
+        ~TimelineEvent();
+
+        TimelineEvent& arg(const char* name, const char* value);
+        TimelineEvent& arg(const char* name, const std::string& value) { return arg(name, value.c_str()); }
+        TimelineEvent& arg(const char* name, const CTString& value) { return arg(name, value.begin()); }
+        template<typename T>
+        TimelineEvent& arg(const char* name, T value) { return number(name, static_cast<long>(value)); }
+    private:
+        TimelineEvent& number(const char* name, long value);
+    };
+
+    /** Интервал на временной шкале, начинающийся в конструкторе и заканчивающийся в деструкторе.
+        Аргументы, добавленные через `arg`, записываются вместе с событием окончания интервала.
+    */
+    class TimelineSpan : private boost::noncopyable {
+        TimelineEvent mEnd;
+    public:
+        TimelineSpan(const char* name, const char* category);
+
+        template<typename T>
+        TimelineSpan& arg(const char* name, T value) { mEnd.arg(name, value); return *this; }
+    };
+} // namespace Diagnostics
+#endif // PCSC_CENXFS_BRIDGE_Diagnostics_Timeline_H
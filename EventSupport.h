@@ -54,8 +54,10 @@ public:
         mask &= ~event;
         return mask == 0;
     }
+    /// @return `true`, если подписчик получает события указанного класса.
+    inline bool wants(DWORD event) const { return (mask & event) != 0; }
     void notify(DWORD event, XFS::Result result) const {
-        if (mask & event) {
+        if (wants(event)) {
             result.send(hWnd, event);
         }
     }
@@ -108,15 +110,30 @@ public:
     void clear() {
         subscribers.clear();
     }
+    /// @return `true`, если есть хоть один подписчик.
+    inline bool hasSubscribers() const { return !subscribers.empty(); }
     /** Уведомляет всех подписчиков об указанном событии.
     @param resultGenerator Функция, которая должна вернуть результат типа XFS::Result.
-           Данная функция вызывается для каждого подписчика на событие. 
+           Данная функция вызывается один раз и только если на событие кто-то подписан.
+           Последний подписчик получает сам результат, остальные -- его копии (см.
+           `XFS::Result::clone`), сделанные до его отправки.
     */
     template<class F>
     void notify(DWORD event, F resultGenerator) const {
-        SubscriberList::const_iterator end = subscribers.end();
+        std::size_t count = 0;
         for (SubscriberList::const_iterator it = subscribers.begin(); it != subscribers.end(); ++it) {
-            it->notify(event, resultGenerator());
+            if (it->wants(event)) {
+                ++count;
+            }
+        }
+        if (count == 0) {
+            return;
+        }
+        XFS::Result result = resultGenerator();
+        for (SubscriberList::const_iterator it = subscribers.begin(); it != subscribers.end(); ++it) {
+            if (it->wants(event)) {
+                it->notify(event, --count == 0 ? result : result.clone());
+            }
         }
     }
 };
@@ -0,0 +1,201 @@
+#include "Config/FileSource.h"
+
+#include "XFS/Logger.h"
+
+#include <algorithm>
+#include <cctype>
+// Для std::strtoul
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+// Для stat
+#include <sys/stat.h>
+
+namespace Config {
+    static std::string lower(const std::string& s) {
+        std::string result = s;
+        for (std::string::iterator it = result.begin(); it != result.end(); ++it) {
+            *it = (char)std::tolower((unsigned char)*it);
+        }
+        return result;
+    }
+    /// Отбрасывает корень конфигурации XFS и разделители по краям пути, приводит путь к нижнему регистру.
+    static std::string relative(const std::string& path) {
+        static const char* roots[] = {
+            "hkey_local_machine\\software\\xfs",
+            "hkey_users\\.default\\xfs",
+            "hkey_classes_root\\wosa/xfs_root",
+        };
+        std::string result = lower(path);
+        for (std::size_t i = 0; i < sizeof(roots)/sizeof(roots[0]); ++i) {
+            const std::string root = roots[i];
+            if (result.compare(0, root.size(), root) == 0
+             && (result.size() == root.size() || result[root.size()] == '\\')
+            ) {
+                result.erase(0, root.size());
+                break;
+            }
+        }
+        std::string::size_type b = result.find_first_not_of('\\');
+        std::string::size_type e = result.find_last_not_of('\\');
+        return b == std::string::npos ? std::string() : result.substr(b, e - b + 1);
+    }
+    static std::string makeId(const std::string& key, const char* name) {
+        return relative(key) + '\n' + lower(name != NULL ? name : "");
+    }
+    /// Получает время изменения и размер файла.
+    static bool stamp(const std::string& path, std::time_t& modified, unsigned long long& size) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        modified = st.st_mtime;
+        size = (unsigned long long)st.st_size;
+        return true;
+    }
+    static bool parseQuoted(const std::string& line, std::string::size_type& i, std::string& out) {
+        if (i >= line.size() || line[i] != '"') {
+            return false;
+        }
+        for (++i; i < line.size(); ++i) {
+            if (line[i] == '"') {
+                ++i;
+                return true;
+            }
+            if (line[i] == '\\' && i + 1 < line.size()) {
+                ++i;
+            }
+            out += line[i];
+        }
+        return false;
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    FileSource* FileSource::load(const std::string& path, std::string& error) {
+        // Отметка снимается до чтения, чтобы запись в файл во время разбора была замечена.
+        std::time_t modified = 0;
+        unsigned long long size = 0;
+        stamp(path, modified, size);
+        std::ifstream f(path.c_str());
+        if (!f) {
+            error = "cannot open file";
+            return NULL;
+        }
+        FileSource* result = load(f, path, error);
+        if (result != NULL) {
+            result->mModified = modified;
+            result->mSize = size;
+        }
+        return result;
+    }
+    FileSource* FileSource::load(std::istream& is, const std::string& path, std::string& error) {
+        std::auto_ptr<FileSource> result(new FileSource(path));
+        std::string key;
+        bool inKey = false;
+        std::string line;
+        for (std::size_t n = 1; std::getline(is, line); ++n) {
+            std::ostringstream where;
+            where << "line " << n << ": ";
+            // Файлы из Windows содержат BOM и CRLF.
+            if (n == 1 && line.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+                line.erase(0, 3);
+            }
+            if (!line.empty() && line[line.size() - 1] == '\r') {
+                line.erase(line.size() - 1);
+            }
+            if (n == 1 && line.compare(0, 2, "\xFF\xFE") == 0) {
+                error = where.str() + "UTF-16 files are not supported, convert the file to UTF-8";
+                return NULL;
+            }
+            if (line.empty() || line[0] == ';' || line == "REGEDIT4" || line == "Windows Registry Editor Version 5.00") {
+                continue;
+            }
+            if (line[0] == '[') {
+                if (line[line.size() - 1] != ']' || line.compare(0, 2, "[-") == 0) {
+                    error = where.str() + "malformed or unsupported key '" + line + "'";
+                    return NULL;
+                }
+                key = line.substr(1, line.size() - 2);
+                inKey = true;
+                continue;
+            }
+            if (!inKey) {
+                error = where.str() + "value outside of a key";
+                return NULL;
+            }
+            std::string name;
+            std::string::size_type i = 0;
+            if (line[0] == '@') {
+                i = 1;
+            } else
+            if (!parseQuoted(line, i, name)) {
+                error = where.str() + "malformed value name";
+                return NULL;
+            }
+            if (i >= line.size() || line[i] != '=') {
+                error = where.str() + "'=' expected";
+                return NULL;
+            }
+            ++i;
+            Entry e;
+            e.id = makeId(key, name.c_str());
+            if (line.compare(i, 6, "dword:") == 0) {
+                e.number = (DWORD)std::strtoul(line.c_str() + i + 6, NULL, 16);
+                std::ostringstream ss;
+                ss << e.number;
+                e.data = ss.str();
+            } else {
+                if (!parseQuoted(line, i, e.data)) {
+                    error = where.str() + "only string and dword values are supported";
+                    return NULL;
+                }
+                e.number = (DWORD)std::strtoul(e.data.c_str(), NULL, 0);
+            }
+            result->mEntries.push_back(e);
+        }
+        // Как и в реестре, повторно заданное значение заменяет прежнее: после устойчивой
+        // сортировки из одинаковых значений оставляем последнее.
+        Entries& entries = result->mEntries;
+        std::stable_sort(entries.begin(), entries.end());
+        Entries unique;
+        unique.reserve(entries.size());
+        for (Entries::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+            if (!unique.empty() && unique.back().id == it->id) {
+                unique.back() = *it;
+            } else {
+                unique.push_back(*it);
+            }
+        }
+        entries.swap(unique);
+        return result.release();
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    const FileSource::Entry* FileSource::find(const std::string& key, const char* name) const {
+        Entry e;
+        e.id = makeId(key, name);
+        Entries::const_iterator it = std::lower_bound(mEntries.begin(), mEntries.end(), e);
+        return it != mEntries.end() && it->id == e.id ? &*it : NULL;
+    }
+    std::string FileSource::value(const std::string& key, const char* name) const {
+        const Entry* e = find(key, name);
+        return e != NULL ? e->data : std::string();
+    }
+    DWORD FileSource::dwValue(const std::string& key, const char* name) const {
+        const Entry* e = find(key, name);
+        return e != NULL ? e->number : 0;
+    }
+    bool FileSource::changed() const {
+        std::time_t modified;
+        unsigned long long size;
+        return stamp(mPath, modified, size) && (modified != mModified || size != mSize);
+    }
+    Source* FileSource::reload() const {
+        std::string error;
+        FileSource* result = load(mPath, error);
+        if (result == NULL) {
+            XFS::Logger() << "FileSource::reload: " << mPath << ": " << error << ", previous configuration is kept";
+        }
+        return result;
+    }
+} // namespace Config
@@ -0,0 +1,253 @@
+#include "Diagnostics/FlightRecorder.h"
+
+#include "PCSC/ReaderState.h"
+#include "PCSC/Status.h"
+
+#include "XFS/Logger.h"
+#include "XFS/Status.h"
+
+// Для std::min
+#include <algorithm>
+// Для std::signal и SIGABRT
+#include <csignal>
+#include <cstdio>
+// Для std::getenv
+#include <cstdlib>
+// Для std::memcpy
+#include <cstring>
+#include <sstream>
+
+#include <boost/thread/lock_guard.hpp>
+
+// Для GetCurrentThreadId, CreateFile и WriteFile
+#include <windows.h>
+
+namespace bc = boost::chrono;
+
+namespace Diagnostics {
+    /// Размер файла, по достижении которого он перезаписывается с начала.
+    static const long maxFileSize = 16 * 1024 * 1024;
+    /// Самописец, буфер которого сбрасывается обработчиком `SIGABRT`. Обнуляется при его разрушении.
+    static FlightRecorder* volatile abortRecorder = NULL;
+
+    static std::string defaultFile() {
+        const char* tmp = std::getenv("TEMP");
+        return std::string(tmp != NULL ? tmp : ".") + "/pcsc-cenxfs-bridge.flight.log";
+    }
+    static const char* kindName(FlightRecorder::Kind kind) {
+        switch (kind) {
+            case FlightRecorder::Call:  return "call";
+            case FlightRecorder::PCSC:  return "pcsc";
+            case FlightRecorder::State: return "state";
+            case FlightRecorder::Post:  return "post";
+        }
+        return "?";
+    }
+    // Функции форматирования для обработчика сигнала: пишут в буфер `[p, end)`, отбрасывая
+    // то, что не поместилось, и возвращают позицию после записанного.
+    static char* put(char* p, char* end, const char* s) {
+        while (*s != '\0' && p != end) {
+            *p++ = *s++;
+        }
+        return p;
+    }
+    static char* putNumber(char* p, char* end, unsigned long long value) {
+        char digits[20];
+        std::size_t n = 0;
+        do {
+            digits[n++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (n != 0 && p != end) {
+            *p++ = digits[--n];
+        }
+        return p;
+    }
+    static char* putSigned(char* p, char* end, long long value) {
+        if (value >= 0) {
+            return putNumber(p, end, (unsigned long long)value);
+        }
+        p = put(p, end, "-");
+        return putNumber(p, end, (unsigned long long)(-(value + 1)) + 1);
+    }
+    static void writeRaw(HANDLE f, const char* begin, const char* end) {
+        DWORD written = 0;
+        WriteFile(f, begin, (DWORD)(end - begin), &written, NULL);
+    }
+
+    static void writeRecord(std::ostream& os, const FlightRecorder::Record& r) {
+        os << r.seq - 1 << '\t' << r.ts << '\t' << r.tid << '\t';
+        const char* name = r.name != NULL ? r.name : "<unknown>";
+        switch (r.kind) {
+            case FlightRecorder::Call: {
+                os << "call\t" << name << "(hService=" << r.a << ", ReqID=" << r.b << ", arg=" << r.c << ')';
+                break;
+            }
+            case FlightRecorder::PCSC: {
+                os << "pcsc\t" << name << "(handle=" << r.a << ") = " << PCSC::Status(r.c);
+                break;
+            }
+            case FlightRecorder::State: {
+                os << "state\t" << name << '[' << r.a << "]: " << PCSC::ReaderState(r.b)
+                   << " -> " << PCSC::ReaderState((DWORD)r.c);
+                break;
+            }
+            case FlightRecorder::Post: {
+                os << "post\t" << name << "(hService=" << r.a << ", ReqID=" << r.b << ") with " << XFS::Status(r.c);
+                break;
+            }
+        }
+        os << '\n';
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    const std::size_t FlightRecorder::capacity;
+
+    FlightRecorder& FlightRecorder::instance() {
+        static FlightRecorder recorder;
+        return recorder;
+    }
+    FlightRecorder::FlightRecorder() : mNext(0), mOrigin(bc::steady_clock::now()) {
+        for (std::size_t i = 0; i < capacity; ++i) {
+            mRing[i].seq = 0;
+        }
+        // Ограничиваем частоту автоматических сбросов, начиная с момента создания.
+        mLastDump = mOrigin - bc::seconds(1);
+        setAbortFile(defaultFile());
+        abortRecorder = this;
+        mPreviousAbort = std::signal(SIGABRT, &FlightRecorder::onAbort);
+        if (mPreviousAbort == SIG_ERR) {
+            mPreviousAbort = SIG_DFL;
+        }
+    }
+    FlightRecorder::~FlightRecorder() {
+        abortRecorder = NULL;
+        // Обработчик, установленный кем-то после нас, оставляем на месте.
+        SignalHandler current = std::signal(SIGABRT, mPreviousAbort);
+        if (current != &FlightRecorder::onAbort && current != SIG_ERR) {
+            std::signal(SIGABRT, current);
+        }
+    }
+    DWORD FlightRecorder::currentThread() {
+        return GetCurrentThreadId();
+    }
+    void FlightRecorder::setFile(const std::string& path) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        if (!mFile.empty()) {
+            return;
+        }
+        mFile = path;
+        setAbortFile(mFile.empty() ? defaultFile() : mFile);
+        {XFS::Logger() << "FlightRecorder::setFile(path=" << path << ')';}
+    }
+    void FlightRecorder::setAbortFile(const std::string& path) {
+        const std::size_t len = std::min(path.size(), sizeof(mAbortFile) - 1);
+        std::memcpy(mAbortFile, path.data(), len);
+        mAbortFile[len] = '\0';
+    }
+    bool FlightRecorder::dump(const char* reason, bool force) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        bc::steady_clock::time_point now = bc::steady_clock::now();
+        if (!force) {
+            if (now - mLastDump < bc::seconds(1)) {
+                return false;
+            }
+            mLastDump = now;
+        }
+        return dumpLocked(reason);
+    }
+    bool FlightRecorder::dumpLocked(const char* reason) {
+        if (mFile.empty()) {
+            mFile = defaultFile();
+        }
+        // Форматируем заранее, чтобы держать файл открытым как можно меньше.
+        std::ostringstream ss;
+        const unsigned long next = mNext.load(boost::memory_order_relaxed);
+        const unsigned long first = next > capacity ? next - capacity : 0;
+        ss << "=== Flight recorder dump: " << reason << ", records " << first << ".." << next << " ===\n"
+           << "seq\tts(us)\ttid\tkind\tevent\n";
+        for (unsigned long seq = first; seq < next; ++seq) {
+            Record r;
+            if (read(seq, r)) {
+                writeRecord(ss, r);
+            }
+        }
+        const std::string data = ss.str();
+
+        std::FILE* f = std::fopen(mFile.c_str(), "ab");
+        if (f != NULL && std::fseek(f, 0, SEEK_END) == 0 && std::ftell(f) > maxFileSize) {
+            f = std::freopen(mFile.c_str(), "wb", f);
+        }
+        const bool ok = f != NULL && std::fwrite(data.data(), 1, data.size(), f) == data.size();
+        if (f != NULL) {
+            std::fclose(f);
+        }
+        XFS::Logger() << "FlightRecorder::dump(reason=" << reason << ", file=" << mFile << ") = " << ok;
+        return ok;
+    }
+    bool FlightRecorder::read(unsigned long seq, Record& copy) const {
+        const Record& r = mRing[seq & (capacity - 1)];
+        const unsigned long before = r.seq;
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        copy = r;
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        // Запись уже перезаписана более новой, еще заполняется или была изменена во время
+        // копирования -- пропускаем.
+        return before == seq + 1 && r.seq == before;
+    }
+    void FlightRecorder::dumpRaw(const char* reason) {
+        HANDLE f = CreateFileA(mAbortFile, FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (f == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        // Последний символ строки оставляем под перевод строки.
+        char* const end = mAbortLine + sizeof(mAbortLine) - 1;
+        const unsigned long next = mNext.load(boost::memory_order_relaxed);
+        const unsigned long first = next > capacity ? next - capacity : 0;
+        char* p = put(mAbortLine, end, "=== Flight recorder dump: ");
+        p = put(p, end, reason);
+        p = put(p, end, " (raw codes), records ");
+        p = putNumber(p, end, first);
+        p = put(p, end, "..");
+        p = putNumber(p, end, next);
+        p = put(p, end, " ===\nseq\tts(us)\ttid\tkind\tevent");
+        *p++ = '\n';
+        writeRaw(f, mAbortLine, p);
+        for (unsigned long seq = first; seq < next; ++seq) {
+            Record r;
+            if (!read(seq, r)) {
+                continue;
+            }
+            p = putNumber(mAbortLine, end, r.seq - 1);
+            p = put(p, end, "\t");
+            p = putSigned(p, end, r.ts);
+            p = put(p, end, "\t");
+            p = putNumber(p, end, r.tid);
+            p = put(p, end, "\t");
+            p = put(p, end, kindName(r.kind));
+            p = put(p, end, "\t");
+            p = put(p, end, r.name != NULL ? r.name : "<unknown>");
+            p = put(p, end, "(");
+            p = putNumber(p, end, r.a);
+            p = put(p, end, ", ");
+            p = putNumber(p, end, r.b);
+            p = put(p, end, ") = ");
+            p = putSigned(p, end, r.c);
+            *p++ = '\n';
+            writeRaw(f, mAbortLine, p);
+        }
+        CloseHandle(f);
+    }
+    void FlightRecorder::onAbort(int sig) {
+        // Процесс уже завершается, а прерванный поток может держать любую блокировку,
+        // поэтому буфер пишется без мьютекса и без выделения памяти.
+        FlightRecorder* self = abortRecorder;
+        if (self == NULL) {
+            return;
+        }
+        self->dumpRaw("abort");
+        const SignalHandler previous = self->mPreviousAbort;
+        if (previous != SIG_DFL && previous != SIG_IGN) {
+            previous(sig);
+        }
+    }
+} // namespace Diagnostics
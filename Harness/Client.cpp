@@ -0,0 +1,112 @@
+#include "Client.h"
+
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
+
+#include <xfsspi.h>
+
+namespace bc = boost::chrono;
+
+namespace Harness {
+    void Samples::add(double us) {
+        mValues.push_back(us);
+        mSorted = false;
+    }
+    void Samples::add(Clock::duration d) {
+        add(bc::duration<double, boost::micro>(d).count());
+    }
+    void Samples::add(const Samples& other) {
+        mValues.insert(mValues.end(), other.mValues.begin(), other.mValues.end());
+        mSorted = false;
+    }
+    double Samples::percentile(double p) {
+        if (mValues.empty()) {
+            return 0;
+        }
+        sort();
+        std::size_t i = (std::size_t)(p * (mValues.size() - 1) + 0.5);
+        return mValues[std::min(i, mValues.size() - 1)];
+    }
+    void Samples::json(std::ostream& os) {
+        sort();
+        double sum = 0;
+        for (std::vector<double>::const_iterator it = mValues.begin(); it != mValues.end(); ++it) {
+            sum += *it;
+        }
+        os << "{\"min\":" << (mValues.empty() ? 0 : mValues.front())
+           << ",\"mean\":" << (mValues.empty() ? 0 : sum / mValues.size())
+           << ",\"p50\":" << percentile(0.50)
+           << ",\"p90\":" << percentile(0.90)
+           << ",\"p99\":" << percentile(0.99)
+           << ",\"max\":" << (mValues.empty() ? 0 : mValues.back()) << '}';
+    }
+    void Samples::sort() {
+        if (!mSorted) {
+            std::sort(mValues.begin(), mValues.end());
+            mSorted = true;
+        }
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    HRESULT waitFor(HWND hWnd, REQUESTID ReqID, DWORD timeout, LPWFSRESULT* result) {
+        const Clock::time_point deadline = Clock::now() + bc::milliseconds(timeout);
+        MessageQueue::Message m;
+        while (MessageQueue::instance().get(hWnd, m, deadline - Clock::now())) {
+            LPWFSRESULT r = (LPWFSRESULT)m.lParam;
+            if (m.msg < WFS_EXECUTE_EVENT && r->RequestID == ReqID) {
+                HRESULT hResult = r->hResult;
+                if (result != NULL) {
+                    *result = r;
+                } else {
+                    WFSFreeResult(r);
+                }
+                return hResult;
+            }
+            WFSFreeResult(r);
+        }
+        return WFS_ERR_TIMEOUT;
+    }
+    HRESULT open(HSERVICE hService, const std::string& logicalName, HWND hWnd,
+                 REQUESTID& lastReqID, DWORD timeout
+    ) {
+        WFSVERSION spiVersion;
+        WFSVERSION srvcVersion;
+        HRESULT r = WFPOpen(hService, (LPSTR)logicalName.c_str(), (HAPP)1, (LPSTR)"pcsc-xfs-harness",
+            0, timeout, hWnd, ++lastReqID, NULL, 0x00030003, &spiVersion, 0x00030003, &srvcVersion
+        );
+        if (r == WFS_SUCCESS) {
+            r = waitFor(hWnd, lastReqID, timeout);
+        }
+        if (r == WFS_SUCCESS) {
+            r = WFPRegister(hService, SERVICE_EVENTS | USER_EVENTS | SYSTEM_EVENTS | EXECUTE_EVENTS, hWnd, hWnd, ++lastReqID);
+        }
+        if (r == WFS_SUCCESS) {
+            r = waitFor(hWnd, lastReqID, timeout);
+        }
+        return r;
+    }
+    HRESULT close(HSERVICE hService, HWND hWnd, REQUESTID& lastReqID, DWORD timeout) {
+        HRESULT r = WFPClose(hService, hWnd, ++lastReqID);
+        if (r == WFS_SUCCESS) {
+            r = waitFor(hWnd, lastReqID, timeout);
+        }
+        return r;
+    }
+    void unload() {
+        while (WFPUnloadService() != WFS_SUCCESS) {
+            boost::this_thread::sleep_for(bc::milliseconds(10));
+        }
+        // Все, что осталось в очереди, принадлежит приложению и должно быть им освобождено.
+        MessageQueue::Message m;
+        while (MessageQueue::instance().get(NULL, m, Clock::duration::zero())) {
+            WFSFreeResult((LPWFSRESULT)m.lParam);
+        }
+    }
+    void heapJson(std::ostream& os) {
+        const Heap::Stats heap = Heap::instance().stats();
+        os << "{\"allocations\":" << heap.allocations << ",\"linked\":" << heap.linked
+           << ",\"frees\":" << heap.frees << ",\"invalidFrees\":" << heap.invalidFrees
+           << ",\"leakedBlocks\":" << heap.blocks << ",\"leakedBytes\":" << heap.bytes
+           << ",\"peakBytes\":" << heap.peakBytes << '}';
+    }
+} // namespace Harness
@@ -0,0 +1,58 @@
+#ifndef PCSC_CENXFS_BRIDGE_Harness_Client_H
+#define PCSC_CENXFS_BRIDGE_Harness_Client_H
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Harness.h"
+
+/** Общие для нагрузочных программ действия XFS приложения: открытие и закрытие сервисов,
+    ожидание завершения запросов и сбор задержек.
+*/
+namespace Harness {
+    /** Выборка задержек в микросекундах. */
+    class Samples {
+        std::vector<double> mValues;
+        bool mSorted;
+    public:
+        Samples() : mSorted(true) {}
+
+        void add(double us);
+        void add(Clock::duration d);
+        /// Добавляет все значения другой выборки, например, собранной другим потоком.
+        void add(const Samples& other);
+        inline std::size_t size() const { return mValues.size(); }
+        /// @return Значение перцентиля `p` (от 0 до 1) или 0 для пустой выборки.
+        double percentile(double p);
+        /** Записывает сводку как объект JSON с полями `min`, `mean`, `p50`, `p90`, `p99` и `max`. */
+        void json(std::ostream& os);
+    private:
+        void sort();
+    };
+
+    /** Ждет сообщение о завершении запроса `ReqID` для окна, освобождая все прочие сообщения.
+    @param result
+        Если не `NULL`, то сюда записывается результат запроса, который должен быть освобожден
+        вызывающим через `WFSFreeResult`. Иначе результат освобождается сразу.
+    @return Код завершения запроса или `WFS_ERR_TIMEOUT`.
+    */
+    HRESULT waitFor(HWND hWnd, REQUESTID ReqID, DWORD timeout, LPWFSRESULT* result = NULL);
+    /** Синхронно открывает сервис и подписывает окно `hWnd` на все классы событий.
+    @param lastReqID
+        Последний использованный идентификатор запроса, увеличивается на каждый запрос.
+    */
+    HRESULT open(HSERVICE hService, const std::string& logicalName, HWND hWnd,
+                 REQUESTID& lastReqID, DWORD timeout);
+    /// Синхронно закрывает сервис.
+    HRESULT close(HSERVICE hService, HWND hWnd, REQUESTID& lastReqID, DWORD timeout);
+    /** Выгружает сервис-провайдер, повторяя `WFPUnloadService`, пока он не согласится, и освобождает
+        все оставшиеся в очереди сообщения.
+    */
+    void unload();
+    /** Записывает статистику памяти как объект JSON. */
+    void heapJson(std::ostream& os);
+} // namespace Harness
+#endif // PCSC_CENXFS_BRIDGE_Harness_Client_H
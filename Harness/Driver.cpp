@@ -0,0 +1,295 @@
+/** @file
+    Замена XFS менеджера для измерения задержек и пропускной способности сервис-провайдера.
+    Вызывает функции `WFP*` так же, как это делает XFS менеджер: открывает сервисы, подписывается
+    на события, выполняет запросы и ждет сообщений об их завершении, освобождая результаты
+    через `WFSFreeResult`. Результаты выводятся одной строкой JSON.
+@par
+    Сервис-провайдер и PC/SC (pcsc-lite или симулятор, см. `Simulator/`) линкуются в тот же
+    исполняемый файл.
+*/
+#include "Client.h"
+
+// Для std::strtoul
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <xfsspi.h>
+#include <XFSIDC.h>
+
+namespace bc = boost::chrono;
+using Harness::Clock;
+using Harness::MessageQueue;
+
+namespace {
+    struct Options {
+        unsigned int services;
+        unsigned long requests;
+        std::string command;
+        std::vector<BYTE> apdu;
+        std::string logicalName;
+        std::string provider;
+        std::string reader;
+        std::vector<std::string> regFiles;
+        DWORD timeout;
+        bool trace;
+    public:
+        Options()
+            : services(1), requests(1000), command("status")
+            , logicalName("IDC"), provider("PC/SC-TO-CEN/XFS-BRIDGE")
+            , timeout(10000), trace(false)
+        {
+            // SELECT PSE 1PAY.SYS.DDF01
+            static const BYTE select[] = {0x00,0xA4,0x04,0x00,0x0E,'1','P','A','Y','.','S','Y','S','.','D','D','F','0','1',0x00};
+            apdu.assign(select, select + sizeof(select));
+        }
+    };
+    /// Состояние одного открытого сервиса.
+    struct Session {
+        HSERVICE hService;
+        HWND hWnd;
+        /// Идентификатор текущего запроса, 0, если запроса нет.
+        REQUESTID pending;
+        Clock::time_point issued;
+        unsigned long completed;
+    };
+
+    void usage() {
+        std::cerr <<
+            "Usage: pcsc-xfs-driver [options]\n"
+            "  --services N       number of services opened in parallel (1)\n"
+            "  --requests N       requests per service (1000)\n"
+            "  --command NAME     status | caps | chipio | read | lock (status)\n"
+            "  --apdu HEX         APDU for the chipio command (SELECT 1PAY.SYS.DDF01)\n"
+            "  --logical NAME     logical service name (IDC)\n"
+            "  --provider NAME    service provider key name (PC/SC-TO-CEN/XFS-BRIDGE)\n"
+            "  --reader NAME      ReaderName setting of the provider\n"
+            "  --reg FILE         load registry file into the configuration, may be repeated\n"
+            "  --timeout MS       timeout of each request (10000)\n"
+            "  --trace            print XFS trace to stderr\n";
+    }
+    bool parseHex(const std::string& text, std::vector<BYTE>& out) {
+        if (text.size() % 2 != 0) {
+            return false;
+        }
+        out.clear();
+        for (std::size_t i = 0; i < text.size(); i += 2) {
+            char* end;
+            std::string byte = text.substr(i, 2);
+            out.push_back((BYTE)std::strtoul(byte.c_str(), &end, 16));
+            if (*end != '\0') {
+                return false;
+            }
+        }
+        return true;
+    }
+    bool parse(int argc, char* argv[], Options& o) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--trace") {
+                o.trace = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg == "--services") { o.services = (unsigned int)std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--requests") { o.requests = std::strtoul(value.c_str(), NULL, 10); } else
+            if (arg == "--command")  { o.command = value; } else
+            if (arg == "--apdu")     { if (!parseHex(value, o.apdu)) return false; } else
+            if (arg == "--logical")  { o.logicalName = value; } else
+            if (arg == "--provider") { o.provider = value; } else
+            if (arg == "--reader")   { o.reader = value; } else
+            if (arg == "--reg")      { o.regFiles.push_back(value); } else
+            if (arg == "--timeout")  { o.timeout = std::strtoul(value.c_str(), NULL, 10); } else {
+                return false;
+            }
+        }
+        return o.services > 0 && o.services < 0xFFFF
+            && (o.command == "status" || o.command == "caps" || o.command == "chipio" || o.command == "read"
+             || o.command == "lock");
+    }
+    const char* messageName(UINT msg) {
+        switch (msg) {
+            case WFS_EXECUTE_EVENT: return "execute";
+            case WFS_SERVICE_EVENT: return "service";
+            case WFS_USER_EVENT:    return "user";
+            case WFS_SYSTEM_EVENT:  return "system";
+            default:                return "other";
+        }
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options o;
+    if (!parse(argc, argv, o)) {
+        usage();
+        return 2;
+    }
+    if (o.trace) {
+        Harness::setTrace(&std::cerr);
+    }
+    // Конфигурация: логический сервис указывает на провайдера, настройки которого мост читает
+    // из того же корня. Файлы реестра могут переопределить и дополнить ее.
+    Harness::Registry& registry = Harness::Registry::instance();
+    registry.set(WFS_CFG_USER_DEFAULT_XFS_ROOT, "LOGICAL_SERVICES\\" + o.logicalName, "Provider", o.provider);
+    registry.set(WFS_CFG_USER_DEFAULT_XFS_ROOT, "SERVICE_PROVIDERS\\" + o.provider, "ReaderName", o.reader);
+    for (std::vector<std::string>::const_iterator it = o.regFiles.begin(); it != o.regFiles.end(); ++it) {
+        std::string error;
+        if (!registry.load(*it, error)) {
+            std::cerr << *it << ": " << error << std::endl;
+            return 2;
+        }
+    }
+
+    REQUESTID lastReqID = 0;
+    std::vector<Session> sessions(o.services);
+    for (unsigned int i = 0; i < o.services; ++i) {
+        Session& s = sessions[i];
+        s.hService = (HSERVICE)(i + 1);
+        s.hWnd = MessageQueue::instance().create();
+        s.pending = 0;
+        s.completed = 0;
+
+        HRESULT r = Harness::open(s.hService, o.logicalName, s.hWnd, lastReqID, o.timeout);
+        if (r != WFS_SUCCESS) {
+            std::cerr << "Cannot open service " << s.hService << ": " << r << std::endl;
+            return 1;
+        }
+    }
+    // Для обмена с чипом и блокировки карта должна быть вставлена и мостом к ней должно быть
+    // установлено соединение.
+    if (o.command == "chipio" || o.command == "lock") {
+        for (std::vector<Session>::const_iterator s = sessions.begin(); s != sessions.end(); ++s) {
+            const Clock::time_point deadline = Clock::now() + bc::milliseconds(o.timeout);
+            WORD media = WFS_IDC_MEDIANOTPRESENT;
+            while (media != WFS_IDC_MEDIAPRESENT && Clock::now() < deadline) {
+                LPWFSRESULT r = NULL;
+                if (WFPGetInfo(s->hService, WFS_INF_IDC_STATUS, NULL, o.timeout, s->hWnd, ++lastReqID) == WFS_SUCCESS
+                 && Harness::waitFor(s->hWnd, lastReqID, o.timeout, &r) == WFS_SUCCESS
+                ) {
+                    media = ((LPWFSIDCSTATUS)r->lpBuffer)->fwMedia;
+                }
+                if (r != NULL) {
+                    WFSFreeResult(r);
+                }
+            }
+            if (media != WFS_IDC_MEDIAPRESENT) {
+                std::cerr << "No card in the reader of service " << s->hService << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    WORD readData = WFS_IDC_CHIP;
+    WFSIDCCHIPIO chipIO;
+    chipIO.wChipProtocol = WFS_IDC_CHIPT0;
+    chipIO.ulChipDataLength = (ULONG)o.apdu.size();
+    chipIO.lpbChipData = &o.apdu[0];
+
+    Harness::Samples latencies;
+    std::map<std::string, unsigned long> events;
+    unsigned long errors = 0;
+    unsigned long rejected = 0;
+    unsigned long active = 0;
+    std::map<HWND, Session*> byWindow;
+    for (std::vector<Session>::iterator s = sessions.begin(); s != sessions.end(); ++s) {
+        byWindow[s->hWnd] = &*s;
+    }
+    // Каждый сервис выполняет запросы последовательно, все сервисы -- параллельно.
+    const Clock::time_point start = Clock::now();
+    for (;;) {
+        // Выдаем следующие запросы всем освободившимся сервисам.
+        for (std::vector<Session>::iterator s = sessions.begin(); s != sessions.end(); ++s) {
+            if (s->pending != 0 || s->completed >= o.requests) {
+                continue;
+            }
+            s->pending = ++lastReqID;
+            s->issued = Clock::now();
+            HRESULT r;
+            if (o.command == "status") {
+                r = WFPGetInfo(s->hService, WFS_INF_IDC_STATUS, NULL, o.timeout, s->hWnd, s->pending);
+            } else
+            if (o.command == "caps") {
+                r = WFPGetInfo(s->hService, WFS_INF_IDC_CAPABILITIES, NULL, o.timeout, s->hWnd, s->pending);
+            } else
+            if (o.command == "chipio") {
+                r = WFPExecute(s->hService, WFS_CMD_IDC_CHIP_IO, &chipIO, o.timeout, s->hWnd, s->pending);
+            } else
+            if (o.command == "lock") {
+                r = WFPLock(s->hService, o.timeout, s->hWnd, s->pending);
+            } else {
+                r = WFPExecute(s->hService, WFS_CMD_IDC_READ_RAW_DATA, &readData, o.timeout, s->hWnd, s->pending);
+            }
+            if (r != WFS_SUCCESS) {
+                // Синхронная ошибка: сообщения о завершении не будет.
+                ++rejected;
+                s->pending = 0;
+                ++s->completed;
+            } else {
+                ++active;
+            }
+        }
+        if (active == 0) {
+            break;
+        }
+        MessageQueue::Message m;
+        if (!MessageQueue::instance().get(NULL, m, bc::milliseconds(o.timeout))) {
+            std::cerr << "Timeout waiting for " << active << " requests" << std::endl;
+            return 1;
+        }
+        LPWFSRESULT r = (LPWFSRESULT)m.lParam;
+        Session* session = byWindow[m.hWnd];
+        if (m.msg >= WFS_EXECUTE_EVENT) {
+            ++events[messageName(m.msg)];
+        } else
+        if (session != NULL && r->RequestID == session->pending) {
+            // Для блокировки замеряется время получения доступа, а запрос завершается после
+            // снятия блокировки, чтобы доступ получили остальные сервисы.
+            if (m.msg != WFS_UNLOCK_COMPLETE) {
+                latencies.add(m.posted - session->issued);
+            }
+            if (r->hResult != WFS_SUCCESS) {
+                ++errors;
+            } else
+            if (m.msg == WFS_LOCK_COMPLETE) {
+                session->pending = ++lastReqID;
+                if (WFPUnlock(session->hService, session->hWnd, session->pending) == WFS_SUCCESS) {
+                    WFSFreeResult(r);
+                    continue;
+                }
+                ++rejected;
+            }
+            session->pending = 0;
+            ++session->completed;
+            --active;
+        }
+        WFSFreeResult(r);
+    }
+    const double seconds = bc::duration<double>(Clock::now() - start).count();
+
+    for (std::vector<Session>::const_iterator s = sessions.begin(); s != sessions.end(); ++s) {
+        Harness::close(s->hService, s->hWnd, lastReqID, o.timeout);
+    }
+    Harness::unload();
+
+    std::ostringstream ss;
+    ss << "{\"command\":\"" << o.command << "\",\"services\":" << o.services
+       << ",\"completed\":" << latencies.size() << ",\"errors\":" << errors << ",\"rejected\":" << rejected
+       << ",\"seconds\":" << seconds << ",\"throughput\":" << (seconds > 0 ? latencies.size() / seconds : 0)
+       << ",\"latencyUs\":";
+    latencies.json(ss);
+    ss << ",\"events\":{";
+    for (std::map<std::string, unsigned long>::const_iterator it = events.begin(); it != events.end(); ++it) {
+        ss << (it != events.begin() ? "," : "") << '"' << it->first << "\":" << it->second;
+    }
+    ss << "},\"heap\":";
+    Harness::heapJson(ss);
+    ss << ",\"undelivered\":" << MessageQueue::instance().undelivered() << '}';
+    std::cout << ss.str() << std::endl;
+    return errors == 0 && rejected == 0 ? 0 : 1;
+}
@@ -0,0 +1,444 @@
+#include "Harness.h"
+
+#include <algorithm>
+#include <cctype>
+// Для std::malloc, std::calloc, std::free и std::strtoul
+#include <cstdlib>
+// Для std::memcpy
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/lock_types.hpp>
+
+#include <xfsconf.h>
+
+namespace Harness {
+    static std::string lower(const std::string& s) {
+        std::string result(s);
+        for (std::string::iterator it = result.begin(); it != result.end(); ++it) {
+            *it = (char)std::tolower((unsigned char)*it);
+        }
+        return result;
+    }
+    /// Убирает разделители в начале и в конце пути.
+    static std::string trim(const std::string& path) {
+        std::string::size_type b = path.find_first_not_of('\\');
+        if (b == std::string::npos) {
+            return std::string();
+        }
+        return path.substr(b, path.find_last_not_of('\\') - b + 1);
+    }
+    static std::string join(const std::string& parent, const std::string& child) {
+        std::string c = trim(child);
+        return c.empty() ? parent : parent + '\\' + c;
+    }
+    /// Путь в реестре, на который XFS менеджер отображает корень конфигурации.
+    static const char* rootPath(HKEY hKey) {
+        if (hKey == WFS_CFG_HKEY_XFS_ROOT)         return "HKEY_CLASSES_ROOT\\WOSA/XFS_ROOT";
+        if (hKey == WFS_CFG_HKEY_MACHINE_XFS_ROOT) return "HKEY_LOCAL_MACHINE\\SOFTWARE\\XFS";
+        if (hKey == WFS_CFG_USER_DEFAULT_XFS_ROOT) return "HKEY_USERS\\.DEFAULT\\XFS";
+        return NULL;
+    }
+    /** Разбирает строку в кавычках, начинающуюся с позиции `i`, с экранированием `\\` и `\"`.
+        После разбора `i` указывает на символ за закрывающей кавычкой.
+    */
+    static bool parseQuoted(const std::string& line, std::string::size_type& i, std::string& out) {
+        if (i >= line.size() || line[i] != '"') {
+            return false;
+        }
+        for (++i; i < line.size(); ++i) {
+            if (line[i] == '"') {
+                ++i;
+                return true;
+            }
+            if (line[i] == '\\' && i + 1 < line.size()) {
+                ++i;
+            }
+            out += line[i];
+        }
+        return false;
+    }
+    /// Копирует строку с завершающим нулем, если она помещается в буфер размером `*lpcch`.
+    static HRESULT copyString(const std::string& s, LPSTR buffer, LPDWORD lpcch, HRESULT tooLong) {
+        if (buffer == NULL || *lpcch <= s.size()) {
+            *lpcch = (DWORD)s.size();
+            return buffer == NULL ? WFS_SUCCESS : tooLong;
+        }
+        std::memcpy(buffer, s.c_str(), s.size() + 1);
+        *lpcch = (DWORD)s.size();
+        return WFS_SUCCESS;
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    Heap& Heap::instance() {
+        static Heap* heap = new Heap();
+        return *heap;
+    }
+    HRESULT Heap::allocate(ULONG ulSize, ULONG ulFlags, LPVOID* lppvData) {
+        if (lppvData == NULL) {
+            return WFS_ERR_INVALID_POINTER;
+        }
+        // Как и настоящий менеджер, возвращаем уникальный указатель и для пустого буфера.
+        const std::size_t size = ulSize != 0 ? ulSize : 1;
+        LPVOID p = (ulFlags & WFS_MEM_ZEROINIT) ? std::calloc(1, size) : std::malloc(size);
+        if (p == NULL) {
+            *lppvData = NULL;
+            return WFS_ERR_OUT_OF_MEMORY;
+        }
+        Block b;
+        b.size = ulSize;
+        b.root = NULL;
+
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        mBlocks[p] = b;
+        ++mStats.allocations;
+        ++mStats.blocks;
+        mStats.bytes += ulSize;
+        mStats.peakBytes = std::max(mStats.peakBytes, mStats.bytes);
+        *lppvData = p;
+        return WFS_SUCCESS;
+    }
+    HRESULT Heap::allocateMore(ULONG ulSize, LPVOID lpvOriginal, LPVOID* lppvData) {
+        if (lppvData == NULL) {
+            return WFS_ERR_INVALID_POINTER;
+        }
+        // Присоединенные буферы всегда обнуляются, как это делает XFS менеджер.
+        const std::size_t size = ulSize != 0 ? ulSize : 1;
+        LPVOID p = std::calloc(1, size);
+        if (p == NULL) {
+            *lppvData = NULL;
+            return WFS_ERR_OUT_OF_MEMORY;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        std::map<LPVOID, Block>::iterator original = mBlocks.find(lpvOriginal);
+        if (original == mBlocks.end()) {
+            std::free(p);
+            *lppvData = NULL;
+            return WFS_ERR_INVALID_BUFFER;
+        }
+        // Присоединение к присоединенному буферу означает присоединение к его исходному.
+        LPVOID root = original->second.root != NULL ? original->second.root : lpvOriginal;
+        mBlocks[root].linked.push_back(p);
+
+        Block b;
+        b.size = ulSize;
+        b.root = root;
+        mBlocks[p] = b;
+        ++mStats.allocations;
+        ++mStats.linked;
+        ++mStats.blocks;
+        mStats.bytes += ulSize;
+        mStats.peakBytes = std::max(mStats.peakBytes, mStats.bytes);
+        *lppvData = p;
+        return WFS_SUCCESS;
+    }
+    HRESULT Heap::free(LPVOID lpvData) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        std::map<LPVOID, Block>::iterator it = mBlocks.find(lpvData);
+        if (it == mBlocks.end() || it->second.root != NULL) {
+            ++mStats.invalidFrees;
+            return WFS_ERR_INVALID_BUFFER;
+        }
+        const std::vector<LPVOID> linked = it->second.linked;
+        for (std::vector<LPVOID>::const_iterator l = linked.begin(); l != linked.end(); ++l) {
+            std::map<LPVOID, Block>::iterator b = mBlocks.find(*l);
+            --mStats.blocks;
+            mStats.bytes -= b->second.size;
+            mBlocks.erase(b);
+            std::free(*l);
+        }
+        --mStats.blocks;
+        mStats.bytes -= it->second.size;
+        mBlocks.erase(it);
+        std::free(lpvData);
+        ++mStats.frees;
+        return WFS_SUCCESS;
+    }
+    Heap::Stats Heap::stats() {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        return mStats;
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    Registry& Registry::instance() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+    bool Registry::load(const std::string& path, std::string& error) {
+        std::ifstream f(path.c_str());
+        if (!f) {
+            error = "cannot open file";
+            return false;
+        }
+        return load(f, error);
+    }
+    bool Registry::load(std::istream& is, std::string& error) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        std::string key;
+        std::string line;
+        for (std::size_t n = 1; std::getline(is, line); ++n) {
+            std::ostringstream where;
+            where << "line " << n << ": ";
+            // Файлы из Windows содержат BOM и CRLF.
+            if (n == 1 && line.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+                line.erase(0, 3);
+            }
+            if (!line.empty() && line[line.size() - 1] == '\r') {
+                line.erase(line.size() - 1);
+            }
+            if (n == 1 && line.compare(0, 2, "\xFF\xFE") == 0) {
+                error = where.str() + "UTF-16 files are not supported, convert the file to UTF-8";
+                return false;
+            }
+            if (line.empty() || line[0] == ';' || line == "REGEDIT4" || line == "Windows Registry Editor Version 5.00") {
+                continue;
+            }
+            if (line[0] == '[') {
+                if (line[line.size() - 1] != ']' || line.compare(0, 2, "[-") == 0) {
+                    error = where.str() + "malformed or unsupported key '" + line + "'";
+                    return false;
+                }
+                key = trim(line.substr(1, line.size() - 2));
+                createLocked(key);
+                continue;
+            }
+            if (key.empty()) {
+                error = where.str() + "value outside of a key";
+                return false;
+            }
+            std::string name;
+            std::string::size_type i = 0;
+            if (line[0] == '@') {
+                i = 1;
+            } else
+            if (!parseQuoted(line, i, name)) {
+                error = where.str() + "malformed value name";
+                return false;
+            }
+            if (i >= line.size() || line[i] != '=') {
+                error = where.str() + "'=' expected";
+                return false;
+            }
+            ++i;
+            if (line.compare(i, 6, "dword:") == 0) {
+                Value& v = valueLocked(key, name);
+                v.dword = true;
+                v.number = (DWORD)std::strtoul(line.c_str() + i + 6, NULL, 16);
+                continue;
+            }
+            std::string data;
+            if (!parseQuoted(line, i, data)) {
+                error = where.str() + "only string and dword values are supported";
+                return false;
+            }
+            Value& v = valueLocked(key, name);
+            v.dword = false;
+            v.data = data;
+        }
+        return true;
+    }
+    void Registry::set(HKEY root, const std::string& path, const std::string& name, const std::string& value) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        Value& v = valueLocked(join(rootPath(root), path), name);
+        v.dword = false;
+        v.data = value;
+    }
+    void Registry::set(HKEY root, const std::string& path, const std::string& name, DWORD value) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        Value& v = valueLocked(join(rootPath(root), path), name);
+        v.dword = true;
+        v.number = value;
+    }
+    const std::string* Registry::pathLocked(HKEY hKey) const {
+        static const std::string roots[] = {
+            rootPath(WFS_CFG_HKEY_XFS_ROOT),
+            rootPath(WFS_CFG_HKEY_MACHINE_XFS_ROOT),
+            rootPath(WFS_CFG_USER_DEFAULT_XFS_ROOT),
+        };
+        if (hKey == WFS_CFG_HKEY_XFS_ROOT)         return &roots[0];
+        if (hKey == WFS_CFG_HKEY_MACHINE_XFS_ROOT) return &roots[1];
+        if (hKey == WFS_CFG_USER_DEFAULT_XFS_ROOT) return &roots[2];
+        std::map<HKEY, std::string>::const_iterator it = mOpened.find(hKey);
+        return it != mOpened.end() ? &it->second : NULL;
+    }
+    Registry::Key& Registry::createLocked(const std::string& path) {
+        std::map<std::string, Key>::iterator it = mKeys.find(lower(path));
+        if (it != mKeys.end()) {
+            return it->second;
+        }
+        std::string::size_type sep = path.rfind('\\');
+        if (sep != std::string::npos) {
+            createLocked(path.substr(0, sep)).children.push_back(path.substr(sep + 1));
+        }
+        return mKeys[lower(path)];
+    }
+    Registry::Value& Registry::valueLocked(const std::string& path, const std::string& name) {
+        Key& key = createLocked(path);
+        const std::string n = lower(name);
+        for (std::vector<Value>::iterator it = key.values.begin(); it != key.values.end(); ++it) {
+            if (lower(it->name) == n) {
+                return *it;
+            }
+        }
+        Value v;
+        v.name = name;
+        v.dword = false;
+        v.number = 0;
+        key.values.push_back(v);
+        return key.values.back();
+    }
+    HRESULT Registry::open(HKEY hKey, LPCSTR lpszSubKey, PHKEY phkResult) {
+        if (phkResult == NULL) {
+            return WFS_ERR_INVALID_POINTER;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        const std::string* base = pathLocked(hKey);
+        if (base == NULL) {
+            return WFS_ERR_CFG_INVALID_HKEY;
+        }
+        const std::string path = join(*base, lpszSubKey != NULL ? lpszSubKey : "");
+        if (mKeys.find(lower(path)) == mKeys.end()) {
+            return WFS_ERR_CFG_INVALID_SUBKEY;
+        }
+        *phkResult = reinterpret_cast<HKEY>(static_cast<uintptr_t>(++mLastHandle));
+        mOpened[*phkResult] = path;
+        return WFS_SUCCESS;
+    }
+    HRESULT Registry::close(HKEY hKey) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        if (rootPath(hKey) != NULL) {
+            return WFS_SUCCESS;
+        }
+        return mOpened.erase(hKey) != 0 ? WFS_SUCCESS : WFS_ERR_CFG_INVALID_HKEY;
+    }
+    HRESULT Registry::query(HKEY hKey, LPCSTR lpszValueName, LPSTR lpszData, LPDWORD lpcchData) {
+        if (lpcchData == NULL) {
+            return WFS_ERR_INVALID_POINTER;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        const std::string* path = pathLocked(hKey);
+        if (path == NULL) {
+            return WFS_ERR_CFG_INVALID_HKEY;
+        }
+        const Key& key = mKeys[lower(*path)];
+        const std::string n = lower(lpszValueName != NULL ? lpszValueName : "");
+        for (std::vector<Value>::const_iterator it = key.values.begin(); it != key.values.end(); ++it) {
+            if (lower(it->name) != n) {
+                continue;
+            }
+            if (!it->dword) {
+                // Длина строки возвращается без завершающего нуля, хотя он и записывается в буфер.
+                return copyString(it->data, lpszData, lpcchData, WFS_ERR_CFG_VALUE_TOO_LONG);
+            }
+            if (lpszData != NULL) {
+                if (*lpcchData < sizeof(DWORD)) {
+                    *lpcchData = sizeof(DWORD);
+                    return WFS_ERR_CFG_VALUE_TOO_LONG;
+                }
+                std::memcpy(lpszData, &it->number, sizeof(DWORD));
+            }
+            *lpcchData = sizeof(DWORD);
+            return WFS_SUCCESS;
+        }
+        return WFS_ERR_CFG_INVALID_NAME;
+    }
+    HRESULT Registry::enumKey(HKEY hKey, DWORD iSubKey, LPSTR lpszName, LPDWORD lpcchName) {
+        if (lpcchName == NULL) {
+            return WFS_ERR_INVALID_POINTER;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        const std::string* path = pathLocked(hKey);
+        if (path == NULL) {
+            return WFS_ERR_CFG_INVALID_HKEY;
+        }
+        const Key& key = mKeys[lower(*path)];
+        if (iSubKey >= key.children.size()) {
+            return WFS_ERR_CFG_NO_MORE_ITEMS;
+        }
+        return copyString(key.children[iSubKey], lpszName, lpcchName, WFS_ERR_CFG_NAME_TOO_LONG);
+    }
+    HRESULT Registry::enumValue(HKEY hKey, DWORD iValue, LPSTR lpszValue, LPDWORD lpcchValue, LPSTR lpszData, LPDWORD lpcchData) {
+        if (lpcchValue == NULL || lpcchData == NULL) {
+            return WFS_ERR_INVALID_POINTER;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        const std::string* path = pathLocked(hKey);
+        if (path == NULL) {
+            return WFS_ERR_CFG_INVALID_HKEY;
+        }
+        const Key& key = mKeys[lower(*path)];
+        if (iValue >= key.values.size()) {
+            return WFS_ERR_CFG_NO_MORE_ITEMS;
+        }
+        const Value& v = key.values[iValue];
+        HRESULT r = copyString(v.name, lpszValue, lpcchValue, WFS_ERR_CFG_NAME_TOO_LONG);
+        if (r != WFS_SUCCESS) {
+            return r;
+        }
+        if (!v.dword) {
+            return copyString(v.data, lpszData, lpcchData, WFS_ERR_CFG_VALUE_TOO_LONG);
+        }
+        if (lpszData != NULL && *lpcchData < sizeof(DWORD)) {
+            *lpcchData = sizeof(DWORD);
+            return WFS_ERR_CFG_VALUE_TOO_LONG;
+        }
+        if (lpszData != NULL) {
+            std::memcpy(lpszData, &v.number, sizeof(DWORD));
+        }
+        *lpcchData = sizeof(DWORD);
+        return WFS_SUCCESS;
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    MessageQueue& MessageQueue::instance() {
+        static MessageQueue* queue = new MessageQueue();
+        return *queue;
+    }
+    HWND MessageQueue::create() {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        HWND hWnd = reinterpret_cast<HWND>(static_cast<uintptr_t>(++mLastHandle));
+        mWindows.insert(hWnd);
+        return hWnd;
+    }
+    void MessageQueue::destroy(HWND hWnd) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        mWindows.erase(hWnd);
+    }
+    BOOL MessageQueue::post(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+        Message m;
+        m.hWnd = hWnd;
+        m.msg = msg;
+        m.wParam = wParam;
+        m.lParam = lParam;
+        m.posted = Clock::now();
+
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        if (mWindows.find(hWnd) == mWindows.end()) {
+            ++mUndelivered;
+            return FALSE;
+        }
+        mQueue.push_back(m);
+        mPosted.notify_all();
+        return TRUE;
+    }
+    bool MessageQueue::get(HWND hWnd, Message& msg, Clock::duration timeout) {
+        const Clock::time_point deadline = Clock::now() + timeout;
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        for (;;) {
+            for (std::deque<Message>::iterator it = mQueue.begin(); it != mQueue.end(); ++it) {
+                if (hWnd == NULL || it->hWnd == hWnd) {
+                    msg = *it;
+                    mQueue.erase(it);
+                    return true;
+                }
+            }
+            if (Clock::now() >= deadline) {
+                return false;
+            }
+            mPosted.wait_until(lock, deadline);
+        }
+    }
+    unsigned long long MessageQueue::undelivered() {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        return mUndelivered;
+    }
+} // namespace Harness
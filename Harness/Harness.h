@@ -0,0 +1,191 @@
+#ifndef PCSC_CENXFS_BRIDGE_Harness_Harness_H
+#define PCSC_CENXFS_BRIDGE_Harness_Harness_H
+
+#pragma once
+
+// Для std::size_t
+#include <cstddef>
+#include <deque>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/chrono/chrono.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <xfsapi.h>
+
+/** Замена XFS менеджера и Win32 для запуска сервис-провайдера вне Windows (см. `Harness/xfs.cpp`
+    и `Harness/Driver.cpp`). Содержит менеджер памяти с семантикой `WFSFreeResult`, конфигурацию
+    в памяти и очереди сообщений вместо окон.
+@par
+    Как и настоящий XFS менеджер, все объекты живут до завершения процесса и не разрушаются,
+    поэтому ими можно пользоваться из деструкторов глобальных объектов сервис-провайдера.
+*/
+namespace Harness {
+    typedef boost::chrono::steady_clock Clock;
+
+    /** Менеджер памяти XFS: `WFMAllocateBuffer`, `WFMAllocateMore`, `WFMFreeBuffer` и `WFSFreeResult`.
+        Буферы, выделенные через `WFMAllocateMore`, освобождаются вместе с исходным, поэтому буферы,
+        выделенные отдельно и не освобожденные, остаются в статистике живыми.
+    */
+    class Heap : private boost::noncopyable {
+        /// Выделенный блок.
+        struct Block {
+            std::size_t size;
+            /// Исходный блок для присоединенных через `WFMAllocateMore`, иначе `NULL`.
+            LPVOID root;
+            /// Блоки, присоединенные к данному.
+            std::vector<LPVOID> linked;
+        };
+    public:
+        struct Stats {
+            /// Количество выделений, всего.
+            unsigned long long allocations;
+            /// Количество выделений через `WFMAllocateMore`, всего.
+            unsigned long long linked;
+            /// Количество освобождений через `WFMFreeBuffer` и `WFSFreeResult`.
+            unsigned long long frees;
+            /// Количество попыток освободить неизвестный или присоединенный буфер.
+            unsigned long long invalidFrees;
+            /// Текущее количество живых блоков.
+            unsigned long long blocks;
+            /// Текущий и максимальный объем живых блоков.
+            unsigned long long bytes;
+            unsigned long long peakBytes;
+        public:
+            Stats() : allocations(0), linked(0), frees(0), invalidFrees(0), blocks(0), bytes(0), peakBytes(0) {}
+        };
+    private:
+        std::map<LPVOID, Block> mBlocks;
+        Stats mStats;
+        boost::mutex mMutex;
+    public:
+        static Heap& instance();
+
+        HRESULT allocate(ULONG ulSize, ULONG ulFlags, LPVOID* lppvData);
+        HRESULT allocateMore(ULONG ulSize, LPVOID lpvOriginal, LPVOID* lppvData);
+        /** Освобождает исходный буфер вместе со всеми присоединенными.
+        @return `WFS_ERR_INVALID_BUFFER`, если буфер неизвестен или является присоединенным.
+        */
+        HRESULT free(LPVOID lpvData);
+        Stats stats();
+    private:
+        Heap() {}
+    };
+
+    /** Конфигурация XFS в памяти, заменяющая реестр Windows. Ключи адресуются полными путями
+        реестра без учета регистра, корни XFS отображаются так же, как это делает XFS менеджер:
+        - `WFS_CFG_HKEY_XFS_ROOT`         -- `HKEY_CLASSES_ROOT\WOSA/XFS_ROOT`;
+        - `WFS_CFG_HKEY_MACHINE_XFS_ROOT` -- `HKEY_LOCAL_MACHINE\SOFTWARE\XFS`;
+        - `WFS_CFG_USER_DEFAULT_XFS_ROOT` -- `HKEY_USERS\.DEFAULT\XFS`.
+    */
+    class Registry : private boost::noncopyable {
+        struct Value {
+            /// Имя в исходном регистре, пустое для значения по умолчанию.
+            std::string name;
+            bool dword;
+            std::string data;
+            DWORD number;
+        };
+        struct Key {
+            /// Имена дочерних ключей в исходном регистре, в порядке создания.
+            std::vector<std::string> children;
+            std::vector<Value> values;
+        };
+        /// Ключи по полному пути в нижнем регистре.
+        std::map<std::string, Key> mKeys;
+        /// Открытые ключи и их полные пути.
+        std::map<HKEY, std::string> mOpened;
+        ULONG mLastHandle;
+        boost::mutex mMutex;
+    public:
+        static Registry& instance();
+
+        /** Загружает файл `.reg` в формате "Windows Registry Editor Version 5.00" (в кодировке
+            ASCII/UTF-8). Поддерживаются строковые значения и значения `dword:`.
+        @param error
+            Описание ошибки, если загрузка не удалась.
+        */
+        bool load(const std::string& path, std::string& error);
+        bool load(std::istream& is, std::string& error);
+        /** Устанавливает строковое значение, создавая ключ при необходимости.
+        @param root
+            Один из корней `WFS_CFG_*`.
+        @param path
+            Путь ключа относительно корня, разделенный `\`.
+        @param name
+            Имя значения, пустое для значения по умолчанию.
+        */
+        void set(HKEY root, const std::string& path, const std::string& name, const std::string& value);
+        void set(HKEY root, const std::string& path, const std::string& name, DWORD value);
+    public:// Реализация функций WFM*Key/WFM*Value
+        HRESULT open(HKEY hKey, LPCSTR lpszSubKey, PHKEY phkResult);
+        HRESULT close(HKEY hKey);
+        HRESULT query(HKEY hKey, LPCSTR lpszValueName, LPSTR lpszData, LPDWORD lpcchData);
+        HRESULT enumKey(HKEY hKey, DWORD iSubKey, LPSTR lpszName, LPDWORD lpcchName);
+        HRESULT enumValue(HKEY hKey, DWORD iValue, LPSTR lpszValue, LPDWORD lpcchValue, LPSTR lpszData, LPDWORD lpcchData);
+    private:
+        Registry() : mLastHandle(0x1000) {}
+        /// @return Полный путь ключа `hKey` или `NULL`, если хендл неизвестен.
+        const std::string* pathLocked(HKEY hKey) const;
+        /// Создает ключ и всех его предков.
+        Key& createLocked(const std::string& path);
+        Value& valueLocked(const std::string& path, const std::string& name);
+    };
+
+    /** Очередь оконных сообщений. Окна -- это просто хендлы, сообщения, отправленные на них
+        через `PostMessage`, ставятся в общую очередь с отметкой времени отправки.
+    */
+    class MessageQueue : private boost::noncopyable {
+    public:
+        struct Message {
+            HWND hWnd;
+            UINT msg;
+            WPARAM wParam;
+            LPARAM lParam;
+            /// Момент вызова `PostMessage`.
+            Clock::time_point posted;
+        };
+    private:
+        std::deque<Message> mQueue;
+        /// Созданные окна.
+        std::set<HWND> mWindows;
+        ULONG mLastHandle;
+        /// Количество сообщений, отправленных несуществующим окнам.
+        unsigned long long mUndelivered;
+        boost::mutex mMutex;
+        boost::condition_variable mPosted;
+    public:
+        static MessageQueue& instance();
+
+        HWND create();
+        /// Уничтожает окно, неполученные сообщения для него остаются в очереди.
+        void destroy(HWND hWnd);
+        /// @return `FALSE`, если окно не существует, в этом случае сообщение теряется.
+        BOOL post(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
+        /** Извлекает первое сообщение для указанного окна.
+        @param hWnd
+            Окно, для которого нужно получить сообщение, или `NULL`, если подходит любое окно.
+        @param timeout
+            Сколько ждать сообщения.
+        @return `true`, если сообщение получено, `false` при таймауте.
+        */
+        bool get(HWND hWnd, Message& msg, Clock::duration timeout);
+        unsigned long long undelivered();
+    private:
+        MessageQueue() : mLastHandle(0), mUndelivered(0) {}
+    };
+
+    /** Перенаправляет трассу `WFMOutputTraceData` в указанный поток.
+    @param os
+        Поток для трассы или `NULL`, чтобы отбрасывать ее (по умолчанию).
+    */
+    void setTrace(std::ostream* os);
+} // namespace Harness
+#endif // PCSC_CENXFS_BRIDGE_Harness_Harness_H
@@ -0,0 +1,4 @@
+/** @file
+    Windows не различает регистр в именах файлов, а мост включает этот заголовок под обоими именами.
+*/
+#include "winbase.h"
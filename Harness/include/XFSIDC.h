@@ -0,0 +1,233 @@
+#ifndef PCSC_CENXFS_BRIDGE_Harness_XFSIDC_H
+#define PCSC_CENXFS_BRIDGE_Harness_XFSIDC_H
+
+#pragma once
+
+/** @file
+    Определения для считывателей карт (Identification card unit (IDC)) версии 3.00. Значения
+    совпадают с `XFSIDC.H` из XFS SDK.
+*/
+
+#include <xfsapi.h>
+
+/****** Общие значения *******************************************************/
+#define WFS_SERVICE_CLASS_IDC         (2)
+#define WFS_SERVICE_CLASS_VERSION_IDC (0x0003)
+#define WFS_SERVICE_CLASS_NAME_IDC    "IDC"
+
+#define IDC_SERVICE_OFFSET (WFS_SERVICE_CLASS_IDC * 100)
+
+/****** Категории WFSGetInfo *************************************************/
+#define WFS_INF_IDC_STATUS       (IDC_SERVICE_OFFSET + 1)
+#define WFS_INF_IDC_CAPABILITIES (IDC_SERVICE_OFFSET + 2)
+#define WFS_INF_IDC_FORM_LIST    (IDC_SERVICE_OFFSET + 3)
+#define WFS_INF_IDC_QUERY_FORM   (IDC_SERVICE_OFFSET + 4)
+
+/****** Команды WFSExecute ***************************************************/
+#define WFS_CMD_IDC_READ_TRACK     (IDC_SERVICE_OFFSET + 1)
+#define WFS_CMD_IDC_WRITE_TRACK    (IDC_SERVICE_OFFSET + 2)
+#define WFS_CMD_IDC_EJECT_CARD     (IDC_SERVICE_OFFSET + 3)
+#define WFS_CMD_IDC_RETAIN_CARD    (IDC_SERVICE_OFFSET + 4)
+#define WFS_CMD_IDC_RESET_COUNT    (IDC_SERVICE_OFFSET + 5)
+#define WFS_CMD_IDC_SETKEY         (IDC_SERVICE_OFFSET + 6)
+#define WFS_CMD_IDC_READ_RAW_DATA  (IDC_SERVICE_OFFSET + 7)
+#define WFS_CMD_IDC_WRITE_RAW_DATA (IDC_SERVICE_OFFSET + 8)
+#define WFS_CMD_IDC_CHIP_IO        (IDC_SERVICE_OFFSET + 9)
+#define WFS_CMD_IDC_RESET          (IDC_SERVICE_OFFSET + 10)
+#define WFS_CMD_IDC_CHIP_POWER     (IDC_SERVICE_OFFSET + 11)
+#define WFS_CMD_IDC_PARSE_DATA     (IDC_SERVICE_OFFSET + 12)
+
+/****** События **************************************************************/
+#define WFS_EXEE_IDC_INVALIDTRACKDATA   (IDC_SERVICE_OFFSET + 1)
+#define WFS_EXEE_IDC_MEDIAINSERTED      (IDC_SERVICE_OFFSET + 3)
+#define WFS_SRVE_IDC_MEDIAREMOVED       (IDC_SERVICE_OFFSET + 4)
+#define WFS_SRVE_IDC_CARDACTION         (IDC_SERVICE_OFFSET + 5)
+#define WFS_USRE_IDC_RETAINBINTHRESHOLD (IDC_SERVICE_OFFSET + 6)
+#define WFS_EXEE_IDC_INVALIDMEDIA       (IDC_SERVICE_OFFSET + 7)
+#define WFS_EXEE_IDC_MEDIARETAINED      (IDC_SERVICE_OFFSET + 8)
+#define WFS_SRVE_IDC_MEDIADETECTED      (IDC_SERVICE_OFFSET + 9)
+
+/****** WFSIDCSTATUS.fwDevice ************************************************/
+#define WFS_IDC_DEVONLINE    WFS_STAT_DEVONLINE
+#define WFS_IDC_DEVOFFLINE   WFS_STAT_DEVOFFLINE
+#define WFS_IDC_DEVPOWEROFF  WFS_STAT_DEVPOWEROFF
+#define WFS_IDC_DEVNODEVICE  WFS_STAT_DEVNODEVICE
+#define WFS_IDC_DEVHWERROR   WFS_STAT_DEVHWERROR
+#define WFS_IDC_DEVUSERERROR WFS_STAT_DEVUSERERROR
+#define WFS_IDC_DEVBUSY      WFS_STAT_DEVBUSY
+
+/****** WFSIDCSTATUS.fwMedia, WFSIDCRETAINCARD.fwPosition ********************/
+#define WFS_IDC_MEDIAPRESENT    (1)
+#define WFS_IDC_MEDIANOTPRESENT (2)
+#define WFS_IDC_MEDIAJAMMED     (3)
+#define WFS_IDC_MEDIANOTSUPP    (4)
+#define WFS_IDC_MEDIAUNKNOWN    (5)
+#define WFS_IDC_MEDIAENTERING   (6)
+#define WFS_IDC_MEDIALATCHED    (7)
+
+/****** WFSIDCSTATUS.fwRetainBin *********************************************/
+#define WFS_IDC_RETAINBINOK   (1)
+#define WFS_IDC_RETAINNOTSUPP (2)
+#define WFS_IDC_RETAINBINFULL (3)
+#define WFS_IDC_RETAINBINHIGH (4)
+
+/****** WFSIDCSTATUS.fwSecurity **********************************************/
+#define WFS_IDC_SECNOTSUPP  (1)
+#define WFS_IDC_SECNOTREADY (2)
+#define WFS_IDC_SECOPEN     (3)
+
+/****** WFSIDCSTATUS.fwChipPower *********************************************/
+#define WFS_IDC_CHIPONLINE     (0)
+#define WFS_IDC_CHIPPOWEREDOFF (1)
+#define WFS_IDC_CHIPBUSY       (2)
+#define WFS_IDC_CHIPNODEVICE   (3)
+#define WFS_IDC_CHIPHWERROR    (4)
+#define WFS_IDC_CHIPNOCARD     (5)
+#define WFS_IDC_CHIPNOTSUPP    (6)
+#define WFS_IDC_CHIPUNKNOWN    (7)
+
+/****** WFSIDCCAPS.fwType ****************************************************/
+#define WFS_IDC_TYPEMOTOR        (1)
+#define WFS_IDC_TYPESWIPE        (2)
+#define WFS_IDC_TYPEDIP          (3)
+#define WFS_IDC_TYPECONTACTLESS  (4)
+#define WFS_IDC_TYPELATCHEDDIP   (5)
+#define WFS_IDC_TYPEPERMANENT    (6)
+
+/****** WFSIDCCAPS.fwReadTracks, fwWriteTracks, WFSIDCCARDDATA.wDataSource ***/
+#define WFS_IDC_NOTSUPP      0x0000
+#define WFS_IDC_TRACK1       0x0001
+#define WFS_IDC_TRACK2       0x0002
+#define WFS_IDC_TRACK3       0x0004
+#define WFS_IDC_CHIP         0x0008
+#define WFS_IDC_SECURITY     0x0010
+#define WFS_IDC_FLUXINACTIVE 0x0020
+#define WFS_IDC_TRACK_WM     0x8000
+
+/****** WFSIDCCAPS.fwChipProtocols *******************************************/
+#define WFS_IDC_CHIPT0 0x0001
+#define WFS_IDC_CHIPT1 0x0002
+
+/****** WFSIDCCAPS.fwSecType *************************************************/
+#define WFS_IDC_SECMMBOX (2)
+#define WFS_IDC_SECCIM86 (3)
+
+/****** WFSIDCCAPS.fwPowerOnOption, fwPowerOffOption, WFS_CMD_IDC_RESET ******/
+#define WFS_IDC_NOACTION        (1)
+#define WFS_IDC_EJECT           (2)
+#define WFS_IDC_RETAIN          (3)
+#define WFS_IDC_EJECTTHENRETAIN (4)
+#define WFS_IDC_READPOSITION    (5)
+
+/****** WFSIDCCAPS.fwWriteMode, WFSIDCCARDDATA.fwWriteMethod *****************/
+#define WFS_IDC_UNKNOWN 0x0001
+#define WFS_IDC_LOCO    0x0002
+#define WFS_IDC_HICO    0x0004
+#define WFS_IDC_AUTO    0x0008
+
+/****** WFSIDCCAPS.fwChipPower, WFS_CMD_IDC_CHIP_POWER ***********************/
+#define WFS_IDC_CHIPPOWERCOLD 0x0002
+#define WFS_IDC_CHIPPOWERWARM 0x0004
+#define WFS_IDC_CHIPPOWEROFF  0x0008
+
+/****** WFSIDCCARDDATA.wStatus ***********************************************/
+#define WFS_IDC_DATAOK         (0)
+#define WFS_IDC_DATAMISSING    (1)
+#define WFS_IDC_DATAINVALID    (2)
+#define WFS_IDC_DATATOOLONG    (3)
+#define WFS_IDC_DATATOOSHORT   (4)
+#define WFS_IDC_DATASRCNOTSUPP (5)
+#define WFS_IDC_DATASRCMISSING (6)
+
+/****** WFS_SRVE_IDC_CARDACTION **********************************************/
+#define WFS_IDC_CARDRETAINED     (1)
+#define WFS_IDC_CARDEJECTED      (2)
+#define WFS_IDC_CARDREADPOSITION (3)
+#define WFS_IDC_CARDJAMMED       (4)
+
+/****** Коды ошибок **********************************************************/
+#define WFS_ERR_IDC_MEDIAJAM          (-(IDC_SERVICE_OFFSET + 0))
+#define WFS_ERR_IDC_NOMEDIA           (-(IDC_SERVICE_OFFSET + 1))
+#define WFS_ERR_IDC_MEDIARETAINED     (-(IDC_SERVICE_OFFSET + 2))
+#define WFS_ERR_IDC_RETAINBINFULL     (-(IDC_SERVICE_OFFSET + 3))
+#define WFS_ERR_IDC_INVALIDDATA       (-(IDC_SERVICE_OFFSET + 4))
+#define WFS_ERR_IDC_INVALIDMEDIA      (-(IDC_SERVICE_OFFSET + 5))
+#define WFS_ERR_IDC_FORMNOTFOUND      (-(IDC_SERVICE_OFFSET + 6))
+#define WFS_ERR_IDC_FORMINVALID       (-(IDC_SERVICE_OFFSET + 7))
+#define WFS_ERR_IDC_DATASYNTAX        (-(IDC_SERVICE_OFFSET + 8))
+#define WFS_ERR_IDC_SHUTTERFAIL       (-(IDC_SERVICE_OFFSET + 9))
+#define WFS_ERR_IDC_SECURITYFAIL      (-(IDC_SERVICE_OFFSET + 10))
+#define WFS_ERR_IDC_PROTOCOLNOTSUPP   (-(IDC_SERVICE_OFFSET + 11))
+#define WFS_ERR_IDC_ATRNOTOBTAINED    (-(IDC_SERVICE_OFFSET + 12))
+#define WFS_ERR_IDC_INVALIDKEY        (-(IDC_SERVICE_OFFSET + 13))
+#define WFS_ERR_IDC_WRITE_METHOD      (-(IDC_SERVICE_OFFSET + 14))
+#define WFS_ERR_IDC_CHIPPOWERNOTSUPP  (-(IDC_SERVICE_OFFSET + 15))
+#define WFS_ERR_IDC_CARDTOOSHORT      (-(IDC_SERVICE_OFFSET + 16))
+#define WFS_ERR_IDC_CARDTOOLONG       (-(IDC_SERVICE_OFFSET + 17))
+
+/****** Структуры ************************************************************/
+#pragma pack(push, 1)
+
+typedef struct _wfs_idc_status {
+    WORD fwDevice;
+    WORD fwMedia;
+    WORD fwRetainBin;
+    WORD fwSecurity;
+    USHORT usCards;
+    WORD fwChipPower;
+    LPSTR lpszExtra;
+} WFSIDCSTATUS, *LPWFSIDCSTATUS;
+
+typedef struct _wfs_idc_caps {
+    WORD wClass;
+    WORD fwType;
+    BOOL bCompound;
+    WORD fwReadTracks;
+    WORD fwWriteTracks;
+    WORD fwChipProtocols;
+    USHORT usCards;
+    WORD fwSecType;
+    WORD fwPowerOnOption;
+    WORD fwPowerOffOption;
+    BOOL bFluxSensorProgrammable;
+    BOOL bReadWriteAccessFollowingEject;
+    WORD fwWriteMode;
+    WORD fwChipPower;
+    LPSTR lpszExtra;
+} WFSIDCCAPS, *LPWFSIDCCAPS;
+
+typedef struct _wfs_idc_form {
+    LPSTR lpszFormName;
+    CHAR cFieldSeparatorTrack1;
+    CHAR cFieldSeparatorTrack2;
+    CHAR cFieldSeparatorTrack3;
+    WORD fwAction;
+    LPSTR lpszTracks;
+    BOOL bSecure;
+    LPSTR lpszTrack1Fields;
+    LPSTR lpszTrack2Fields;
+    LPSTR lpszTrack3Fields;
+} WFSIDCFORM, *LPWFSIDCFORM;
+
+typedef struct _wfs_idc_card_data {
+    WORD wDataSource;
+    WORD wStatus;
+    ULONG ulDataLength;
+    LPBYTE lpbData;
+    WORD fwWriteMethod;
+} WFSIDCCARDDATA, *LPWFSIDCCARDDATA;
+
+typedef struct _wfs_idc_chip_io {
+    WORD wChipProtocol;
+    ULONG ulChipDataLength;
+    LPBYTE lpbChipData;
+} WFSIDCCHIPIO, *LPWFSIDCCHIPIO;
+
+typedef struct _wfs_idc_chip_power_out {
+    ULONG ulChipDataLength;
+    LPBYTE lpbChipData;
+} WFSIDCCHIPPOWEROUT, *LPWFSIDCCHIPPOWEROUT;
+
+#pragma pack(pop)
+
+#endif // PCSC_CENXFS_BRIDGE_Harness_XFSIDC_H
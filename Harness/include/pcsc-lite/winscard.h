@@ -0,0 +1,24 @@
+#ifndef PCSC_CENXFS_BRIDGE_Harness_pcsc_lite_winscard_H
+#define PCSC_CENXFS_BRIDGE_Harness_pcsc_lite_winscard_H
+
+#pragma once
+
+/** @file
+    Обертка над `winscard.h` pcsc-lite для сборки моста с реальными считывателями под Linux.
+    Добавляет определения Windows SDK, которых нет в pcsc-lite, но которые использует мост.
+    Каталог pcsc-lite (`PCSC`) должен быть в путях поиска заголовков, т.к. его заголовки
+    включают друг друга без префикса.
+*/
+
+#include <PCSC/winscard.h>
+
+/// Заголовок команды протокола T0, определен в Windows SDK.
+typedef struct {
+    BYTE bCla;
+    BYTE bIns;
+    BYTE bP1;
+    BYTE bP2;
+    BYTE bP3;
+} SCARD_T0_COMMAND, *LPSCARD_T0_COMMAND;
+
+#endif // PCSC_CENXFS_BRIDGE_Harness_pcsc_lite_winscard_H
@@ -0,0 +1,62 @@
+#ifndef PCSC_CENXFS_BRIDGE_Harness_winbase_H
+#define PCSC_CENXFS_BRIDGE_Harness_winbase_H
+
+#pragma once
+
+/** @file
+    Функции Win32 для работы со временем, процессами, именем компьютера и файлами, используемые мостом.
+    Реализованы в `Harness/xfs.cpp`.
+*/
+
+#include "windef.h"
+
+typedef struct _SYSTEMTIME {
+    WORD wYear;
+    WORD wMonth;
+    WORD wDayOfWeek;
+    WORD wDay;
+    WORD wHour;
+    WORD wMinute;
+    WORD wSecond;
+    WORD wMilliseconds;
+} SYSTEMTIME, *PSYSTEMTIME, *LPSYSTEMTIME;
+
+typedef enum _COMPUTER_NAME_FORMAT {
+    ComputerNameNetBIOS,
+    ComputerNameDnsHostname,
+    ComputerNameDnsDomain,
+    ComputerNameDnsFullyQualified,
+    ComputerNamePhysicalNetBIOS,
+    ComputerNamePhysicalDnsHostname,
+    ComputerNamePhysicalDnsDomain,
+    ComputerNamePhysicalDnsFullyQualified,
+    ComputerNameMax
+} COMPUTER_NAME_FORMAT;
+
+#define INVALID_HANDLE_VALUE  ((HANDLE)(intptr_t)-1)
+#define FILE_APPEND_DATA      (0x0004)
+#define FILE_SHARE_READ       (0x00000001)
+#define OPEN_ALWAYS           (4)
+#define FILE_ATTRIBUTE_NORMAL (0x00000080)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void  WINAPI GetSystemTime(LPSYSTEMTIME lpSystemTime);
+BOOL  WINAPI GetComputerNameExA(COMPUTER_NAME_FORMAT NameType, LPSTR lpBuffer, LPDWORD nSize);
+DWORD WINAPI GetCurrentThreadId();
+DWORD WINAPI GetCurrentProcessId();
+/// Поддерживается только открытие на дозапись (`FILE_APPEND_DATA`, `OPEN_ALWAYS`).
+HANDLE WINAPI CreateFileA(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
+                          LPVOID lpSecurityAttributes, DWORD dwCreationDisposition,
+                          DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+BOOL  WINAPI WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite,
+                       LPDWORD lpNumberOfBytesWritten, LPVOID lpOverlapped);
+BOOL  WINAPI CloseHandle(HANDLE hObject);
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#define GetComputerNameEx GetComputerNameExA
+
+#endif // PCSC_CENXFS_BRIDGE_Harness_winbase_H
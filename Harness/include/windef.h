@@ -0,0 +1,43 @@
+#ifndef PCSC_CENXFS_BRIDGE_Harness_windef_H
+#define PCSC_CENXFS_BRIDGE_Harness_windef_H
+
+#pragma once
+
+/** @file
+    Базовые типы Win32, необходимые мосту и заголовкам XFS SDK при сборке под Linux.
+    Типы, общие с PC/SC, берутся из `wintypes.h` pcsc-lite (или симулятора, см. `Simulator/include`),
+    чтобы определения не конфликтовали при включении `winscard.h`.
+*/
+
+#include <wintypes.h>
+
+// Для intptr_t и uintptr_t
+#include <stdint.h>
+
+typedef char           CHAR;
+typedef unsigned int   UINT;
+typedef long           HRESULT;
+typedef void*          HANDLE;
+typedef intptr_t       LPARAM;
+typedef uintptr_t      WPARAM;
+typedef intptr_t       LRESULT;
+
+/// Окно -- непрозрачный хендл, см. `Harness::MessageQueue`.
+typedef struct HWND__* HWND;
+/// Ключ конфигурации -- непрозрачный хендл, см. `Harness::Registry`.
+typedef struct HKEY__* HKEY;
+typedef HKEY* PHKEY;
+
+typedef struct _FILETIME {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME, *PFILETIME, *LPFILETIME;
+
+#define WINAPI
+#define APIENTRY
+#define __declspec(x)
+
+#define LOWORD(l) ((WORD)((DWORD)(l) & 0xFFFF))
+#define HIWORD(l) ((WORD)(((DWORD)(l) >> 16) & 0xFFFF))
+
+#endif // PCSC_CENXFS_BRIDGE_Harness_windef_H
@@ -0,0 +1,14 @@
+#ifndef PCSC_CENXFS_BRIDGE_Harness_windows_H
+#define PCSC_CENXFS_BRIDGE_Harness_windows_H
+
+#pragma once
+
+/** @file
+    Подмножество Win32, необходимое мосту и XFS SDK. См. `Harness/Harness.h`.
+*/
+
+#include "windef.h"
+#include "winbase.h"
+#include "winuser.h"
+
+#endif // PCSC_CENXFS_BRIDGE_Harness_windows_H
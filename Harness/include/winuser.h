@@ -0,0 +1,24 @@
+#ifndef PCSC_CENXFS_BRIDGE_Harness_winuser_H
+#define PCSC_CENXFS_BRIDGE_Harness_winuser_H
+
+#pragma once
+
+/** @file
+    Отправка оконных сообщений. Вместо окон используются очереди `Harness::MessageQueue`.
+*/
+
+#include "windef.h"
+
+#define WM_USER 0x0400
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+BOOL WINAPI PostMessageA(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#define PostMessage PostMessageA
+
+#endif // PCSC_CENXFS_BRIDGE_Harness_winuser_H
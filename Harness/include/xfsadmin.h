@@ -0,0 +1,24 @@
+#ifndef PCSC_CENXFS_BRIDGE_Harness_xfsadmin_H
+#define PCSC_CENXFS_BRIDGE_Harness_xfsadmin_H
+
+#pragma once
+
+/** @file
+    Функции поддержки сервис-провайдеров из `XFSADMIN.H`: менеджер памяти и трассировка.
+    Реализованы в `Harness/xfs.cpp`.
+*/
+
+#include <xfsapi.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+HRESULT WINAPI WFMAllocateBuffer(ULONG ulSize, ULONG ulFlags, LPVOID* lppvData);
+HRESULT WINAPI WFMAllocateMore(ULONG ulSize, LPVOID lpvOriginal, LPVOID* lppvData);
+HRESULT WINAPI WFMFreeBuffer(LPVOID lpvData);
+HRESULT WINAPI WFMOutputTraceData(LPSTR lpszData);
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PCSC_CENXFS_BRIDGE_Harness_xfsadmin_H
@@ -0,0 +1,29 @@
+#ifndef PCSC_CENXFS_BRIDGE_Harness_xfsconf_H
+#define PCSC_CENXFS_BRIDGE_Harness_xfsconf_H
+
+#pragma once
+
+/** @file
+    Функции доступа к конфигурации XFS из `XFSCONF.H`. Конфигурация хранится в памяти,
+    см. `Harness::Registry`, реализация в `Harness/xfs.cpp`.
+*/
+
+#include <xfsapi.h>
+
+#define WFS_CFG_HKEY_XFS_ROOT         ((HKEY)1)
+#define WFS_CFG_HKEY_MACHINE_XFS_ROOT ((HKEY)2)
+#define WFS_CFG_USER_DEFAULT_XFS_ROOT ((HKEY)3)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+HRESULT WINAPI WFMOpenKey(HKEY hKey, LPSTR lpszSubKey, PHKEY phkResult);
+HRESULT WINAPI WFMCloseKey(HKEY hKey);
+HRESULT WINAPI WFMQueryValue(HKEY hKey, LPSTR lpszValueName, LPSTR lpszData, LPDWORD lpcchData);
+HRESULT WINAPI WFMEnumKey(HKEY hKey, DWORD iSubKey, LPSTR lpszName, LPDWORD lpcchName, PFILETIME lpftLastWrite);
+HRESULT WINAPI WFMEnumValue(HKEY hKey, DWORD iValue, LPSTR lpszValue, LPDWORD lpcchValue, LPSTR lpszData, LPDWORD lpcchData);
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PCSC_CENXFS_BRIDGE_Harness_xfsconf_H
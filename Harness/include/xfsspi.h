@@ -0,0 +1,4 @@
+/** @file
+    Мост включает `xfsspi.h`, а в репозитории он лежит как `xfsspi.H`, что в Windows одно и то же.
+*/
+#include "../../xfsspi.H"
@@ -0,0 +1,155 @@
+/** @file
+    Функции XFS менеджера и Win32, вызываемые мостом, реализованные поверх `Harness`.
+*/
+#include "Harness.h"
+
+// Для std::strlen и std::memcpy
+#include <cstring>
+// Для gmtime_r
+#include <ctime>
+
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+
+// Для open
+#include <fcntl.h>
+// Для gettimeofday
+#include <sys/time.h>
+// Для syscall(SYS_gettid)
+#include <sys/syscall.h>
+// Для getpid, gethostname, write, close
+#include <unistd.h>
+
+#include <windows.h>
+#include <xfsadmin.h>
+#include <xfsconf.h>
+
+using Harness::Heap;
+using Harness::MessageQueue;
+using Harness::Registry;
+
+namespace Harness {
+    static std::ostream* trace = NULL;
+
+    /// Трасса пишется и из деструктора глобального менеджера PC/SC, поэтому мьютекс не разрушается.
+    static boost::mutex& traceMutex() {
+        static boost::mutex* mutex = new boost::mutex();
+        return *mutex;
+    }
+    void setTrace(std::ostream* os) {
+        boost::lock_guard<boost::mutex> lock(traceMutex());
+        trace = os;
+    }
+} // namespace Harness
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+HRESULT WINAPI WFMAllocateBuffer(ULONG ulSize, ULONG ulFlags, LPVOID* lppvData) {
+    return Heap::instance().allocate(ulSize, ulFlags, lppvData);
+}
+HRESULT WINAPI WFMAllocateMore(ULONG ulSize, LPVOID lpvOriginal, LPVOID* lppvData) {
+    return Heap::instance().allocateMore(ulSize, lpvOriginal, lppvData);
+}
+HRESULT WINAPI WFMFreeBuffer(LPVOID lpvData) {
+    return Heap::instance().free(lpvData);
+}
+HRESULT WINAPI WFSFreeResult(LPWFSRESULT lpResult) {
+    if (lpResult == NULL) {
+        return WFS_ERR_INVALID_POINTER;
+    }
+    return Heap::instance().free(lpResult) == WFS_SUCCESS ? WFS_SUCCESS : WFS_ERR_INVALID_RESULT;
+}
+HRESULT WINAPI WFMOutputTraceData(LPSTR lpszData) {
+    boost::lock_guard<boost::mutex> lock(Harness::traceMutex());
+    if (Harness::trace != NULL && lpszData != NULL) {
+        *Harness::trace << lpszData << '\n';
+    }
+    return WFS_SUCCESS;
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+HRESULT WINAPI WFMOpenKey(HKEY hKey, LPSTR lpszSubKey, PHKEY phkResult) {
+    return Registry::instance().open(hKey, lpszSubKey, phkResult);
+}
+HRESULT WINAPI WFMCloseKey(HKEY hKey) {
+    return Registry::instance().close(hKey);
+}
+HRESULT WINAPI WFMQueryValue(HKEY hKey, LPSTR lpszValueName, LPSTR lpszData, LPDWORD lpcchData) {
+    return Registry::instance().query(hKey, lpszValueName, lpszData, lpcchData);
+}
+HRESULT WINAPI WFMEnumKey(HKEY hKey, DWORD iSubKey, LPSTR lpszName, LPDWORD lpcchName, PFILETIME lpftLastWrite) {
+    if (lpftLastWrite != NULL) {
+        lpftLastWrite->dwLowDateTime = 0;
+        lpftLastWrite->dwHighDateTime = 0;
+    }
+    return Registry::instance().enumKey(hKey, iSubKey, lpszName, lpcchName);
+}
+HRESULT WINAPI WFMEnumValue(HKEY hKey, DWORD iValue, LPSTR lpszValue, LPDWORD lpcchValue, LPSTR lpszData, LPDWORD lpcchData) {
+    return Registry::instance().enumValue(hKey, iValue, lpszValue, lpcchValue, lpszData, lpcchData);
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+BOOL WINAPI PostMessageA(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
+    return MessageQueue::instance().post(hWnd, Msg, wParam, lParam);
+}
+void WINAPI GetSystemTime(LPSYSTEMTIME lpSystemTime) {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    std::tm tm;
+    gmtime_r(&tv.tv_sec, &tm);
+    lpSystemTime->wYear         = (WORD)(tm.tm_year + 1900);
+    lpSystemTime->wMonth        = (WORD)(tm.tm_mon + 1);
+    lpSystemTime->wDayOfWeek    = (WORD)tm.tm_wday;
+    lpSystemTime->wDay          = (WORD)tm.tm_mday;
+    lpSystemTime->wHour         = (WORD)tm.tm_hour;
+    lpSystemTime->wMinute       = (WORD)tm.tm_min;
+    lpSystemTime->wSecond       = (WORD)tm.tm_sec;
+    lpSystemTime->wMilliseconds = (WORD)(tv.tv_usec / 1000);
+}
+BOOL WINAPI GetComputerNameExA(COMPUTER_NAME_FORMAT NameType, LPSTR lpBuffer, LPDWORD nSize) {
+    char name[256] = {0};
+    gethostname(name, sizeof(name) - 1);
+    // NetBIOS имя не содержит домена.
+    if (NameType == ComputerNameNetBIOS || NameType == ComputerNamePhysicalNetBIOS) {
+        char* dot = std::strchr(name, '.');
+        if (dot != NULL) {
+            *dot = '\0';
+        }
+    }
+    const DWORD len = (DWORD)std::strlen(name);
+    // Как и в Windows, при недостаточном буфере возвращается размер с завершающим нулем,
+    // а при успехе -- без него.
+    if (lpBuffer == NULL || *nSize <= len) {
+        *nSize = len + 1;
+        return FALSE;
+    }
+    std::memcpy(lpBuffer, name, len + 1);
+    *nSize = len;
+    return TRUE;
+}
+DWORD WINAPI GetCurrentThreadId() {
+    return (DWORD)syscall(SYS_gettid);
+}
+DWORD WINAPI GetCurrentProcessId() {
+    return (DWORD)getpid();
+}
+// Файловые функции вызываются из обработчиков сигналов, поэтому используют только open/write/close.
+HANDLE WINAPI CreateFileA(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
+                          LPVOID lpSecurityAttributes, DWORD dwCreationDisposition,
+                          DWORD dwFlagsAndAttributes, HANDLE hTemplateFile) {
+    (void)dwShareMode; (void)lpSecurityAttributes; (void)dwFlagsAndAttributes; (void)hTemplateFile;
+    if (dwDesiredAccess != FILE_APPEND_DATA || dwCreationDisposition != OPEN_ALWAYS) {
+        return INVALID_HANDLE_VALUE;
+    }
+    const int fd = open(lpFileName, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    return fd < 0 ? INVALID_HANDLE_VALUE : (HANDLE)(intptr_t)fd;
+}
+BOOL WINAPI WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite,
+                      LPDWORD lpNumberOfBytesWritten, LPVOID lpOverlapped) {
+    (void)lpOverlapped;
+    const ssize_t written = write((int)(intptr_t)hFile, lpBuffer, nNumberOfBytesToWrite);
+    if (lpNumberOfBytesWritten != NULL) {
+        *lpNumberOfBytesWritten = written < 0 ? 0 : (DWORD)written;
+    }
+    return written >= 0;
+}
+BOOL WINAPI CloseHandle(HANDLE hObject) {
+    return close((int)(intptr_t)hObject) == 0;
+}
@@ -0,0 +1,156 @@
+#include "LockQueue.h"
+
+#include "Manager.h"
+
+#include "Diagnostics/FlightRecorder.h"
+#include "Diagnostics/Timeline.h"
+
+#include "PCSC/Status.h"
+
+#include "XFS/Logger.h"
+#include "XFS/Result.h"
+
+#include <boost/bind.hpp>
+
+void LockTask::complete(HRESULT result) const {
+    XFS::Result(ReqID, serviceHandle(), result).send(hWnd, WFS_LOCK_COMPLETE);
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+LockQueue::LockQueue(Manager& manager) : manager(manager), mState(new State()) {}
+LockQueue::~LockQueue() {
+    // Поток может не вернуться из SCardBeginTransaction, например, если контекст PC/SC так и не
+    // был закрыт. Ждем столько же, сколько закрытие последнего сервиса, см. Manager::shutdown.
+    stop();
+    const std::size_t left = join(bc::steady_clock::now() + bc::milliseconds(2000));
+    if (left == 0) {
+        return;
+    }
+    boost::lock_guard<boost::mutex> lock(mState->mutex);
+    mState->abandoned = true;
+    for (std::map<std::string, Queue>::iterator it = mState->queues.begin(); it != mState->queues.end(); ++it) {
+        if (it->second.thread) {
+            it->second.thread->detach();
+            it->second.thread.reset();
+        }
+    }
+    XFS::Logger() << "LockQueue::~LockQueue: " << left << " thread(s) still in SCardBeginTransaction, detached";
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void LockQueue::push(const LockTask::Ptr& task) {
+    {
+        boost::lock_guard<boost::mutex> lock(mState->mutex);
+        Queue& queue = mState->queues[task->reader];
+        queue.tasks.push_back(task);
+        if (!queue.running) {
+            // Прежний поток очереди уже вышел из run и не держит мьютекс, присоединение не ждет.
+            if (queue.thread) {
+                queue.thread->join();
+            }
+            queue.running = true;
+            queue.thread.reset(new boost::thread(boost::bind(&LockQueue::run, boost::ref(manager), mState, task->reader)));
+        }
+        Diagnostics::TimelineEvent("Lock::queue", "locks")
+            .arg("hService", task->serviceHandle()).arg("ReqID", task->ReqID)
+            .arg("reader", task->reader.c_str()).arg("queued", queue.tasks.size());
+    }
+    mState->changed.notify_all();
+}
+void LockQueue::start() {
+    boost::lock_guard<boost::mutex> lock(mState->mutex);
+    mState->stopRequested = false;
+}
+std::size_t LockQueue::stop() {
+    std::size_t dropped = 0;
+    {
+        boost::lock_guard<boost::mutex> lock(mState->mutex);
+        mState->stopRequested = true;
+        for (std::map<std::string, Queue>::iterator it = mState->queues.begin(); it != mState->queues.end(); ++it) {
+            dropped += it->second.tasks.size();
+            it->second.tasks.clear();
+        }
+    }
+    mState->changed.notify_all();
+    return dropped;
+}
+std::size_t LockQueue::join(bc::steady_clock::time_point deadline) {
+    std::vector<boost::shared_ptr<boost::thread> > finished;
+    std::size_t running = 0;
+    {
+        boost::unique_lock<boost::mutex> lock(mState->mutex);
+        for (;;) {
+            running = 0;
+            for (std::map<std::string, Queue>::iterator it = mState->queues.begin(); it != mState->queues.end(); ++it) {
+                if (it->second.running) {
+                    ++running;
+                } else
+                if (it->second.thread) {
+                    finished.push_back(it->second.thread);
+                    it->second.thread.reset();
+                }
+            }
+            if (running == 0 || mState->changed.wait_until(lock, deadline) == boost::cv_status::timeout) {
+                break;
+            }
+        }
+    }
+    for (std::vector<boost::shared_ptr<boost::thread> >::const_iterator it = finished.begin(); it != finished.end(); ++it) {
+        (*it)->join();
+    }
+    return running;
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void LockQueue::run(Manager& manager, StatePtr state, std::string reader) {
+    {XFS::Logger() << "Lock queue thread for reader '" << reader << "' runned";}
+    boost::unique_lock<boost::mutex> lock(state->mutex);
+    // Элементы std::map не перемещаются и не удаляются, ссылка остается действительной.
+    Queue& queue = state->queues[reader];
+    for (;;) {
+        while (!state->stopRequested && queue.tasks.empty()) {
+            state->changed.wait(lock);
+        }
+        if (state->stopRequested) {
+            break;
+        }
+        LockTask::Ptr task = queue.tasks.front();
+        queue.tasks.pop_front();
+        if (!process(manager, *state, lock, *task)) {
+            // Очередь и менеджер могут быть уже разрушены, в журнал не пишем.
+            queue.running = false;
+            return;
+        }
+    }
+    {XFS::Logger() << "Lock queue thread for reader '" << reader << "' stopped";}
+    // После этого поток мьютекс больше не захватывает, и его можно присоединять под мьютексом.
+    queue.running = false;
+    state->changed.notify_all();
+}
+bool LockQueue::process(Manager& manager, State& state, boost::unique_lock<boost::mutex>& lock, const LockTask& task) {
+    // Задача могла завершиться по таймауту или быть отменена, пока ждала своей очереди.
+    if (!manager.hasTask(task)) {
+        return true;
+    }
+    // Соединение берется из задачи, т.к. сервис может быть закрыт, пока идет ожидание.
+    PCSC::Backend& backend = manager.backend();
+    lock.unlock();
+    PCSC::Status st = backend.beginTransaction(task.hCard);
+    lock.lock();
+    if (state.abandoned) {
+        return false;
+    }
+    Diagnostics::flightPCSC("SCardBeginTransaction", (unsigned long)task.hCard, st.value());
+    {XFS::Logger() << "SCardBeginTransaction(hCard=" << task.hCard << ") = " << st; }
+
+    if (manager.removeTask(task)) {
+        Diagnostics::TimelineEvent("Lock::complete", "locks")
+            .arg("hService", task.serviceHandle()).arg("ReqID", task.ReqID).arg("status", st.value());
+        XFS::Result(task.ReqID, task.serviceHandle(), st).send(task.hWnd, WFS_LOCK_COMPLETE);
+        return true;
+    }
+    if (st) {
+        // Доступ получен уже после таймаута или отмены, приложение о нем не знает.
+        st = backend.endTransaction(task.hCard, SCARD_LEAVE_CARD);
+        Diagnostics::flightPCSC("SCardEndTransaction", (unsigned long)task.hCard, st.value());
+        {XFS::Logger() << "SCardEndTransaction(hCard=" << task.hCard << ", SCARD_LEAVE_CARD) = " << st << " (late lock)"; }
+    }
+    return true;
+}
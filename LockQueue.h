@@ -0,0 +1,126 @@
+#ifndef PCSC_CENXFS_BRIDGE_LockQueue_H
+#define PCSC_CENXFS_BRIDGE_LockQueue_H
+
+#pragma once
+
+#include "Task.h"
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/chrono/chrono.hpp>
+
+// PC/CS API
+#include <winscard.h>
+
+class Manager;
+/** Задача получения эксклюзивного доступа к карте (`WFPLock`). Дедлайн и отмену задачи
+    обрабатывает контейнер задач, как и для прочих задач, а саму транзакцию начинает
+    очередь `LockQueue`.
+*/
+class LockTask : public Task {
+public:
+    /// Соединение с картой, для которого начинается транзакция.
+    SCARDHANDLE hCard;
+    /// Считыватель, в очереди которого стоит задача.
+    std::string reader;
+public:
+    typedef boost::shared_ptr<LockTask> Ptr;
+public:
+    LockTask(bc::steady_clock::time_point deadline, Service& service, HWND hWnd, REQUESTID ReqID,
+             SCARDHANDLE hCard, const std::string& reader
+    ) : Task(deadline, service, hWnd, ReqID), hCard(hCard), reader(reader) {}
+    /// Изменения в считывателях задачу не завершают, ее завершает очередь `LockQueue`.
+    virtual bool match(const SCARD_READERSTATE&, bool) const { return false; }
+    /// Уведомляет XFS-слушателя о завершении сообщением `WFS_LOCK_COMPLETE`.
+    virtual void complete(HRESULT result) const;
+};
+/** Очередь запросов на эксклюзивный доступ к картам. `SCardBeginTransaction` ждет, пока
+    транзакцию не завершат другие соединения, в том числе соединения других процессов, поэтому
+    вызывается не в потоке XFS менеджера, а в отдельном потоке, своем для каждого считывателя.
+@par
+    Запросы к одному считывателю выполняются строго по очереди, в порядке поступления, поэтому
+    сервис, запросивший доступ раньше, получит его раньше, независимо от того, какой из сервисов
+    ждет дольше на уровне PC/SC. Запрос, завершенный таймаутом или отменой до того, как до него
+    дошла очередь, пропускается. Если же доступ был получен уже после таймаута или отмены,
+    транзакция сразу завершается, т.к. приложение о ней не знает.
+@par
+    Состояние очередей разделяется с их потоками. Поток, который к разрушению очереди так и не
+    вернулся из `SCardBeginTransaction`, отсоединяется, а вернувшись, завершается, не обращаясь
+    ни к менеджеру, ни к задаче.
+*/
+class LockQueue : private boost::noncopyable {
+    /// Очередь запросов к одному считывателю и обслуживающий ее поток.
+    struct Queue {
+        std::deque<LockTask::Ptr> tasks;
+        /// Поток, начинающий транзакции. Завершившийся поток присоединяется `join` или
+        /// при запуске нового потока для той же очереди.
+        boost::shared_ptr<boost::thread> thread;
+        /// Поток еще обслуживает очередь: ждет запросов или находится в `SCardBeginTransaction`.
+        bool running;
+    public:
+        Queue() : running(false) {}
+    };
+    /// Состояние, разделяемое с потоками очередей.
+    struct State {
+        /// Защищает очереди и флаги.
+        boost::mutex mutex;
+        /// Сигнализирует о новых запросах, об остановке и о завершении потоков.
+        boost::condition_variable changed;
+        /// Очереди запросов по именам считывателей. Поток считывателя создается с первым запросом к нему.
+        std::map<std::string, Queue> queues;
+        bool stopRequested;
+        /// Очередь разрушена, не дождавшись потоков: вернувшийся поток сразу завершается.
+        bool abandoned;
+    public:
+        State() : stopRequested(false), abandoned(false) {}
+    };
+    typedef boost::shared_ptr<State> StatePtr;
+private:
+    Manager& manager;
+    StatePtr mState;
+public:
+    LockQueue(Manager& manager);
+    /** Останавливает потоки очереди и ждет их завершения, см. `stop`, но не дольше 2 секунд.
+        Оставшиеся потоки отсоединяются.
+    */
+    ~LockQueue();
+    /** Ставит запрос в конец очереди считывателя задачи. Задача уже должна быть добавлена
+        в контейнер задач, чтобы ее можно было отменить и завершить по таймауту.
+    */
+    void push(const LockTask::Ptr& task);
+    /// Разрешает потокам снова обслуживать запросы после `stop`.
+    void start();
+    /** Запрашивает останов потоков и выбрасывает запросы, оставшиеся в очередях: к этому моменту
+        их уже должен отменить контейнер задач. Поток, ожидающий в `SCardBeginTransaction`,
+        завершится, как только вызов вернет управление, например, после закрытия соединения
+        с картой или контекста PC/SC.
+    @return
+        Количество выброшенных запросов.
+    */
+    std::size_t stop();
+    /** Ждет завершения потоков после `stop`, но не дольше указанного момента.
+    @return
+        Количество потоков, которые еще не завершились.
+    */
+    std::size_t join(bc::steady_clock::time_point deadline);
+private:
+    /** Функция потока, обрабатывающего запросы к указанному считывателю. Не обращается к объекту
+        очереди, т.к. может пережить его.
+    */
+    static void run(Manager& manager, StatePtr state, std::string reader);
+    /** Начинает транзакцию для задачи и сообщает о результате, если задача еще не завершена.
+        Вызывается под мьютексом состояния, который отпускается на время `SCardBeginTransaction`.
+    @return
+        `false`, если очередь была разрушена, пока шло ожидание, и поток должен завершиться.
+    */
+    static bool process(Manager& manager, State& state, boost::unique_lock<boost::mutex>& lock, const LockTask& task);
+};
+
+#endif // PCSC_CENXFS_BRIDGE_LockQueue_H
@@ -3,17 +3,174 @@
 #include "Service.h"
 #include "Settings.h"
 
+#include "Diagnostics/ApduStats.h"
+#include "Diagnostics/FlightRecorder.h"
+#include "Diagnostics/MemoryStats.h"
+#include "Diagnostics/RecordingBackend.h"
+#include "Diagnostics/SessionRecorder.h"
+#include "Diagnostics/Timeline.h"
+
 #include "XFS/Logger.h"
 
-Manager::Manager() : readerChangesMonitor(*this) {}
+#include <algorithm>
+
+Manager::Manager()
+    : PCSC::Context(PCSC::Backend::native())
+    , locks(*this)
+    , mClock(&Clock::steady())
+    , readerChangesMonitor(*this)
+    , settingsWatcher(*this) {}
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-Service& Manager::create(HSERVICE hService, const Settings& settings) {
-    Service& result = services.create(*this, hService, settings);
+Service& Manager::create(HSERVICE hService, const Settings::Ptr& snapshot) {
+    const Settings& settings = *snapshot;
+
+    // Закрытие последнего сервиса в другом потоке останавливает поток отслеживания изменений
+    // и проверку настроек, поэтому они настраиваются и запускаются под тем же мьютексом.
+    boost::lock_guard<boost::mutex> lock(mBackendMutex);
+    // Реализацию PC/SC можно заменить только тогда, когда нет соединений с картами.
+    if (services.isEmpty()) {
+        selectBackend(settings);
+        startup();
+    } else
+    if (!settings.backend.name.empty() && settings.backend.name != backend().name()) {
+        XFS::Logger() << "Manager::create: PC/SC backend '" << settings.backend.name
+                      << "' ignored, services already use '" << backend().name() << "'";
+    }
+    configure(settings);
+    settingsWatcher.start(settings.reloadPeriod);
+    Service& result = services.create(*this, hService, snapshot);
     // Прерываем ожидание потока на SCardGetStatusChange, т.к. необходимо доставить
     // новому сервису информацию о всех существующих в данный момент считывателях.
-    readerChangesMonitor.cancel("Manager::create");
+    readerChangesMonitor.resync("Manager::create");
     return result;
 }
+void Manager::configure(const Settings& settings) {
+    // Запись временной шкалы общая на весь процесс, начинаем ее, как только
+    // она потребуется хоть одному сервису.
+    if (!settings.timeline.file.empty()) {
+        Diagnostics::Timeline::instance().open(settings.timeline.file, settings.timeline.maxSize);
+    }
+    if (!settings.apduStats.file.empty()) {
+        Diagnostics::ApduStats::instance().setDumpFile(settings.apduStats.file, settings.apduStats.period);
+    }
+    if (!settings.flightRecorderFile.empty()) {
+        Diagnostics::FlightRecorder::instance().setFile(settings.flightRecorderFile);
+    }
+    if (settings.memoryStats) {
+        Diagnostics::MemoryStats::instance().enable();
+    }
+    readerChangesMonitor.setIdleTimeout(settings.idleTimeout);
+}
+void Manager::selectBackend(const Settings& settings) {
+    PCSC::Backend* backend = PCSC::Backend::create(settings.backend.name, settings.backend.script);
+    if (backend == NULL) {
+        // Причина уже в журнале, остаемся на текущей реализации.
+        return;
+    }
+    const bool record = !settings.sessionRecordFile.empty()
+                     && Diagnostics::SessionRecorder::instance().open(settings.sessionRecordFile, !settings.sessionRecordPlaintext);
+    if (!record) {
+        setBackend(*backend);
+        return;
+    }
+    Diagnostics::RecordingBackend& recording = Diagnostics::RecordingBackend::instance();
+    if (&this->backend() == &recording) {
+        if (&recording.wrapped() == backend) {
+            return;
+        }
+        // Обертку нельзя перенастраивать, пока через нее открыт контекст.
+        setBackend(*backend);
+    }
+    recording.wrap(*backend);
+    setBackend(recording);
+}
+void Manager::setBackend(PCSC::Backend& backend) {
+    if (&backend == &this->backend()) {
+        return;
+    }
+    {XFS::Logger() << "Manager::setBackend: " << this->backend().name() << " -> " << backend.name();}
+    if (!established()) {
+        assign(backend);
+        return;
+    }
+    readerChangesMonitor.stop("Manager::setBackend");
+    release();
+    establish(backend);
+    readerChangesMonitor.start();
+}
+void Manager::startup() {
+    if (established()) {
+        return;
+    }
+    {XFS::Logger() << "Manager::startup: first service opened";}
+    if (mWorkstationName.empty()) {
+        mWorkstationName = PCSC::DeviceStatus::workstationName();
+    }
+    establish(backend());
+    locks.start();
+    readerChangesMonitor.start();
+}
+void Manager::shutdown(const char* reason) {
+    // Сколько закрытие последнего сервиса ждет потоки, застрявшие в вызовах PC/SC. Остальное
+    // дожидается WFPUnloadService, см. `unload`.
+    static const bc::milliseconds timeout(2000);
+    const bc::steady_clock::time_point start = bc::steady_clock::now();
+    Diagnostics::TimelineSpan span("Manager::shutdown", "manager");
+    {XFS::Logger() << "Manager::shutdown: " << reason;}
+
+    // 1. Новые запросы не принимаются: сервисов нет, а открытие нового ждет mBackendMutex.
+    //    Все оставшиеся задачи завершаются с WFS_ERR_CANCELED.
+    const std::size_t canceled = tasks.cancelAll();
+    const std::size_t dropped = locks.stop();
+    {XFS::Logger() << "Manager::shutdown: " << canceled << " task(s) canceled, " << dropped << " lock request(s) dropped";}
+
+    // 2. Потоки, которые ждут только сигнала остановки. Поток отслеживания изменений, не
+    //    успевший завершиться, отсоединяется и завершится после закрытия контекста.
+    settingsWatcher.stop();
+    const bool monitorStopped = readerChangesMonitor.stop(reason, start + timeout);
+
+    // 3. Прерываем ввод-вывод: соединения с картами закрыты вместе с сервисами, а с закрытием
+    //    контекста вернут управление и вызовы SCardBeginTransaction в потоках очереди блокировок.
+    if (established()) {
+        release();
+    }
+
+    // 4. Ждем потоки очереди блокировок, но не дольше отведенного времени.
+    const std::size_t left = locks.join(start + timeout);
+    const bc::milliseconds elapsed = bc::duration_cast<bc::milliseconds>(bc::steady_clock::now() - start);
+    span.arg("canceled", canceled).arg("left", left).arg("monitorStopped", monitorStopped)
+        .arg("ms", (unsigned long)elapsed.count());
+    XFS::Logger() << "Manager::shutdown: done in " << elapsed.count() << " ms, "
+                  << left << " lock thread(s) still running, reader monitor "
+                  << (monitorStopped ? "stopped" : "detached");
+}
+bool Manager::unload() {
+    boost::lock_guard<boost::mutex> lock(mBackendMutex);
+    if (!services.isEmpty()) {
+        return false;
+    }
+    // Потоки очереди блокировок, не успевшие завершиться при закрытии последнего сервиса.
+    const std::size_t left = locks.join(bc::steady_clock::now());
+    if (left != 0) {
+        XFS::Logger() << "Manager::unload: " << left << " lock thread(s) still running";
+    }
+    // Поток отслеживания изменений, отсоединенный при закрытии последнего сервиса.
+    const bool monitor = readerChangesMonitor.running();
+    if (monitor) {
+        XFS::Logger() << "Manager::unload: reader monitor thread still running";
+    }
+    return left == 0 && !monitor;
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Manager::setClock(Clock& clock) {
+    mClock = &clock;
+    clockChanged();
+}
+void Manager::clockChanged() {
+    // Прерываем ожидание потока на SCardGetStatusChange, т.к. ожидать теперь нужно
+    // до нового таймаута, а наступившие таймауты нужно обработать.
+    readerChangesMonitor.cancel("Manager::clockChanged");
+}
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 void Manager::notifyChanges(const SCARD_READERSTATE& state, bool deviceChange) {
     // Сначала уведомляем подписанных слушателей об изменениях, и только затем
@@ -21,6 +178,29 @@ void Manager::notifyChanges(const SCARD_READERSTATE& state, bool deviceChange) {
     services.notifyChanges(state, deviceChange);
     tasks.notifyChanges(state, deviceChange);
 }
+void Manager::notifySnapshot(const std::vector<SCARD_READERSTATE>& states) {
+    services.notifySnapshot(states);
+    for (std::vector<SCARD_READERSTATE>::const_iterator it = states.begin(); it != states.end(); ++it) {
+        tasks.notifyChanges(*it, false);
+    }
+}
+const PCSC::DeviceStatus& Manager::deviceStatus(const char* reader) {
+    std::map<std::string, PCSC::DeviceStatus>::iterator it = mDeviceStatuses.find(reader);
+    if (it == mDeviceStatuses.end()) {
+        it = mDeviceStatuses.insert(std::make_pair(std::string(reader), PCSC::DeviceStatus(reader, mWorkstationName))).first;
+    }
+    return it->second;
+}
+void Manager::forgetReaders(const std::vector<const char*>& names) {
+    std::map<std::string, PCSC::DeviceStatus>::iterator it = mDeviceStatuses.begin();
+    while (it != mDeviceStatuses.end()) {
+        if (std::find(names.begin(), names.end(), it->first) == names.end()) {
+            mDeviceStatuses.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 void Manager::addTask(const Task::Ptr& task) {
     if (tasks.addTask(task)) {
@@ -29,6 +209,23 @@ void Manager::addTask(const Task::Ptr& task) {
         readerChangesMonitor.cancel("Manager::addTask");
     }
 }
+void Manager::remove(HSERVICE hService) {
+    // Задачи ссылаются на сервис, поэтому завершаем их до его удаления.
+    if (tasks.cancelTasks(hService) > 0) {
+        readerChangesMonitor.cancel("Manager::remove");
+    }
+    boost::lock_guard<boost::mutex> lock(mBackendMutex);
+    services.remove(hService);
+    // Простаивающему сервис-провайдеру не нужны ни контекст PC/SC, ни опрос считывателей,
+    // к тому же без них WFPUnloadService завершается сразу.
+    if (services.isEmpty()) {
+        shutdown("last service closed");
+    }
+}
+void Manager::lock(const LockTask::Ptr& task) {
+    addTask(task);
+    locks.push(task);
+}
 bool Manager::cancelTask(HSERVICE hService, REQUESTID ReqID) {
     if (tasks.cancelTask(hService, ReqID)) {
         // Прерываем ожидание потока на SCardGetStatusChange, т.к. ожидать теперь нужно
@@ -3,18 +3,27 @@
 
 #pragma once
 
+#include "Clock.h"
+#include "LockQueue.h"
 #include "ReaderChangesMonitor.h"
 #include "ServiceContainer.h"
+#include "Settings.h"
+#include "SettingsWatcher.h"
 #include "Task.h"
 
 #include "PCSC/Context.h"
+#include "PCSC/DeviceStatus.h"
 #include "PCSC/Status.h"
 
 #include "XFS/Result.h"
 
+#include <map>
+#include <string>
 #include <vector>
 
+#include <boost/atomic.hpp>
 #include <boost/chrono/chrono.hpp>
+#include <boost/thread/mutex.hpp>
 
 // PC/CS API
 #include <winscard.h>
@@ -25,11 +34,11 @@
 #pragma comment(lib, "winscard.lib")
 
 class Service;
-class Settings;
-/** Класс, в конструкторе инициализирующий подсистему PC/SC, а в деструкторе закрывающий ее.
-    Необходимо Создать ровно один экземпляр данного класса при загрузке DLL и уничтожить его
-    при выгрузке. Наиболее просто это делается, путем объявления глобальной переменной данного
-    класса.
+/** Класс, управляющий подсистемой PC/SC и открытыми сервисами. Конструктор ничего не открывает:
+    контекст PC/SC и поток отслеживания изменений запускаются в `startup` при открытии первого
+    сервиса (`WFPOpen`), а останавливаются в `shutdown` при закрытии последнего. Необходимо создать
+    ровно один экземпляр данного класса при загрузке DLL и уничтожить его при выгрузке. Наиболее
+    просто это делается, путем объявления глобальной переменной данного класса.
 */
 class Manager : public PCSC::Context {
 private:
@@ -42,31 +51,105 @@ private:
     ServiceContainer services;
     /// Контейнер, управляющий асинхронными задачами на получение данных с карточки.
     TaskContainer tasks;
+    /// Очередь запросов на эксклюзивный доступ к картам. Разрушается раньше контейнера
+    /// задач, т.к. ее потоки завершают задачи из него.
+    LockQueue locks;
+    /// Часы, по которым отсчитываются дедлайны задач. Используются потоком опроса изменений,
+    /// поэтому должны быть заданы раньше его запуска.
+    boost::atomic<Clock*> mClock;
+    /// Защищает выбор реализации PC/SC, открытие и закрытие контекста PC/SC вместе с созданием
+    /// и удалением сервисов, для которых это делается.
+    boost::mutex mBackendMutex;
+    /// Имя рабочей станции для событий `WFS_SYSE_DEVICE_STATUS`, получается при первом открытии
+    /// контекста PC/SC.
+    std::string mWorkstationName;
+    /// Заготовки данных событий `WFS_SYSE_DEVICE_STATUS` по именам считывателей. Используются
+    /// только потоком отслеживания изменений, поэтому объявлены раньше него.
+    std::map<std::string, PCSC::DeviceStatus> mDeviceStatuses;
     /// Объект для слежения за состоянием считывателей и рассылки уведомлений,
     /// когда состояние меняется. При разрушении прекращает ожидание изменений.
     ReaderChangesMonitor readerChangesMonitor;
+    /// Поток проверки изменений конфигурации. Останавливается первым, т.к. применяет
+    /// настройки через менеджер.
+    SettingsWatcher settingsWatcher;
 public:
-    /// Открывает соединение к менеджеру подсистемы PC/SC.
+    /** Создает менеджер без соединения с подсистемой PC/SC. Менеджер создается при загрузке
+        DLL, в том числе тогда, когда XFS менеджер лишь опрашивает сервис-провайдер, поэтому
+        контекст PC/SC открывается, а поток отслеживания изменений запускается только при
+        открытии первого сервиса (см. `create`) и закрываются вместе с последним (см. `remove`).
+    */
     Manager();
 public:// Управление сервисами
     /** Проверяет, что указаный хендл сервиса является корректным хендлом карточки. */
     inline bool isValid(HSERVICE hService) const { return services.isValid(hService); }
     /** @return true, если в менеджере не зарегистрировано ни одного сервиса. */
     inline bool isEmpty() const { return services.isEmpty(); }
+    /** Проверяет, можно ли выгрузить сервис-провайдер (`WFPUnloadService`): нет открытых сервисов
+        и завершились все потоки, в том числе не успевшие завершиться при закрытии последнего
+        сервиса (см. `shutdown`). Не ждет, поэтому XFS менеджер может опрашивать ее повторно.
+    */
+    bool unload();
 
-    Service& create(HSERVICE hService, const Settings& settings);
+    /** Создает сервис с указанным снимком настроек. Снимок разделяется со всеми сервисами того
+        же провайдера (см. `SettingsCache`).
+    */
+    Service& create(HSERVICE hService, const Settings::Ptr& settings);
     inline Service& get(HSERVICE hService) { return services.get(hService); }
-    inline void remove(HSERVICE hService) { services.remove(hService); }
+    /** Отменяет незавершенные задачи сервиса и закрывает его. Вместе с последним сервисом
+        останавливает поток отслеживания изменений и проверки настроек и закрывает контекст PC/SC.
+    */
+    void remove(HSERVICE hService);
+    /** Применяет настройки, общие на весь процесс: запись временной шкалы и статистики обмена
+        с чипом, файл бортового самописца и учет памяти. Каждая из них включается первыми
+        настройками, в которых задана, и далее не меняется.
+    */
+    void configure(const Settings& settings);
+public:// Реализация PC/SC
+    /** Заменяет реализацию PC/SC: останавливает поток опроса изменений, закрывает контекст,
+        открывает его через новую реализацию и снова запускает поток. Если контекст еще не
+        открыт, только запоминает реализацию. Можно вызывать только тогда, когда нет открытых
+        сервисов, т.к. их соединения с картами принадлежат старому контексту. Если реализация
+        не меняется, ничего не делает.
+    @param backend
+        Новая реализация. Должна жить, пока менеджер ей пользуется.
+    */
+    void setBackend(PCSC::Backend& backend);
+public:// Источник времени
+    /// Часы, по которым отсчитываются дедлайны задач.
+    inline const Clock& clock() const { return *mClock; }
+    /** Заменяет источник времени, например, на `VirtualClock`. Задачи, уже стоящие в очереди,
+        сохраняют свои дедлайны, поэтому часы стоит менять до их появления.
+    @param clock
+        Новые часы. Должны жить, пока менеджер ими пользуется.
+    */
+    void setClock(Clock& clock);
+    /** Сообщает, что часы переведены (например, `VirtualClock::advance`), чтобы поток опроса
+        изменений пересчитал таймаут ожидания и завершил задачи, чей дедлайн наступил.
+    */
+    void clockChanged();
 public:// Подписка на события и генерация событий
     /** Добавляет указанное окно к подписчикам на указанные события от указанного сервиса.
     @return `false`, если указанный `hService` не зарегистрирован в объекте, иначе `true`.
     */
     inline bool addSubscriber(HSERVICE hService, HWND hWndReg, DWORD dwEventClass) {
-        return services.addSubscriber(hService, hWndReg, dwEventClass);
+        if (!services.addSubscriber(hService, hWndReg, dwEventClass)) {
+            return false;
+        }
+        // Простаивающий поток должен снова следить за считывателями ради нового подписчика.
+        readerChangesMonitor.wake("Manager::addSubscriber");
+        return true;
     }
     inline bool removeSubscriber(HSERVICE hService, HWND hWndReg, DWORD dwEventClass) {
         return services.removeSubscriber(hService, hWndReg, dwEventClass);
     }
+    /// Нужны ли кому-то изменения в считывателях: есть ли задачи или подписчики на события.
+    inline bool hasListeners() const { return !tasks.isEmpty() || services.hasSubscribers(); }
+    /// @copydoc ReaderChangesMonitor::sync
+    inline void syncReaders(Service& service, const char* reason) { readerChangesMonitor.sync(service, reason); }
+    /** Возвращает заготовку данных события `WFS_SYSE_DEVICE_STATUS` для считывателя, создавая ее
+        при первом обращении. Вызывается только из потока отслеживания изменений (см. `Service::notify`).
+    */
+    const PCSC::DeviceStatus& deviceStatus(const char* reader);
 public:// Управление задачами
     void addTask(const Task::Ptr& task);
     /** Отменяет задачу с указанный трекинговым номером, возвращает `true`, если задача с таким
@@ -81,14 +164,45 @@ public:// Управление задачами
         `true`, если задача с таким номером имелась в списке, иначе `false`.
     */
     bool cancelTask(HSERVICE hService, REQUESTID ReqID);
+    /** Ставит запрос на эксклюзивный доступ к карте в очередь его считывателя. Запрос завершается
+        сообщением `WFS_LOCK_COMPLETE`, когда доступ получен, наступил дедлайн задачи или она отменена.
+    */
+    void lock(const LockTask::Ptr& task);
+private:
+    /// Выбирает реализацию PC/SC и запись сеанса по настройкам сервиса. См. `setBackend`.
+    void selectBackend(const Settings& settings);
+    /// Открывает контекст PC/SC и запускает поток отслеживания изменений, если они не запущены.
+    void startup();
+    /** Останавливает работу после закрытия последнего сервиса по этапам: отменяет оставшиеся
+        задачи (`WFS_ERR_CANCELED`) и запросы блокировок, останавливает потоки отслеживания
+        изменений и проверки настроек, закрывает контекст PC/SC, прерывая ожидающие вызовы,
+        и ждет потоки очереди блокировок. Поток отслеживания изменений и потоки очереди вместе
+        ждутся не дольше 2 секунд, не завершившиеся отсоединяются (см. `unload`).
+    */
+    void shutdown(const char* reason);
+private:// Функции для использования LockQueue
+    friend class LockQueue;
+    inline bool hasTask(const Task& task) const { return tasks.hasTask(task.serviceHandle(), task.ReqID); }
+    /// @copydoc TaskContainer::removeTask
+    inline bool removeTask(const Task& task) { return tasks.removeTask(task.serviceHandle(), task.ReqID); }
 private:// Функции для использования ReaderChangesMonitor
     friend class ReaderChangesMonitor;
     /// @copydoc TaskContainer::getTimeout
-    inline DWORD getTimeout() const { return tasks.getTimeout(); }
-    /// @copydoc TaskContainer::processTimeouts
-    inline void processTimeouts(boost::chrono::steady_clock::time_point now) { tasks.processTimeouts(now); }
+    inline DWORD getTimeout() const { return tasks.getTimeout(clock().now()); }
+    /// Завершает задачи, чей дедлайн по часам менеджера наступил. См. TaskContainer::processTimeouts
+    inline void processTimeouts() { tasks.processTimeouts(clock().now()); }
     /// @copydoc TaskContainer::notifyChanges
     void notifyChanges(const SCARD_READERSTATE& state, bool deviceChange);
+    /** Сообщает известное состояние считывателей только что открытым сервисам (см.
+        `ServiceContainer::notifySnapshot`), а затем задачам, чтобы ожидание вставки карты,
+        начатое до этого, увидело уже вставленную карту.
+    */
+    void notifySnapshot(const std::vector<SCARD_READERSTATE>& states);
+    /** Удаляет заготовки событий `WFS_SYSE_DEVICE_STATUS` считывателей, которых больше нет в системе,
+        чтобы список не рос при переподключении считывателей под новыми именами.
+    @param names Имена считывателей, доступных в данный момент.
+    */
+    void forgetReaders(const std::vector<const char*>& names);
 };
 
 #endif // PCSC_CENXFS_BRIDGE_Manager_H
\ No newline at end of file
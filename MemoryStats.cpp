@@ -0,0 +1,64 @@
+#include "Diagnostics/MemoryStats.h"
+
+#include "XFS/Logger.h"
+
+#include <sstream>
+
+#include <boost/thread/lock_guard.hpp>
+
+namespace Diagnostics {
+    static const char* kindName(MemoryStats::Kind kind) {
+        switch (kind) {
+            case MemoryStats::Root:   return "root";
+            case MemoryStats::Linked: return "linked";
+            default:                  return "detached";
+        }
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    MemoryStats& MemoryStats::instance() {
+        static MemoryStats stats;
+        return stats;
+    }
+    MemoryStats::MemoryStats() : mEnabled(false) {}
+    MemoryStats::~MemoryStats() {
+        if (!mEnabled) {
+            return;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        unsigned long count = 0;
+        unsigned long long bytes = 0;
+        XFS::Logger l;
+        l << "MemoryStats: Buffers unreachable from freed WFSRESULT:";
+        for (SiteMap::const_iterator it = mSites.begin(); it != mSites.end(); ++it) {
+            if (it->second.kind != Detached) {
+                continue;
+            }
+            l << "\n\t" << it->first << ": count=" << it->second.count << ", bytes=" << it->second.bytes;
+            count += it->second.count;
+            bytes += it->second.bytes;
+        }
+        l << "\n\tTotal: count=" << count << ", bytes=" << bytes;
+    }
+    void MemoryStats::account(const char* site, std::size_t size, Kind kind) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        Counters& c = mSites[site != NULL ? site : "<unknown>"];
+        c.kind = kind;
+        ++c.count;
+        c.bytes += size;
+    }
+    std::string MemoryStats::toJSONString() {
+        std::ostringstream ss;
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        writeLocked(ss);
+        return ss.str();
+    }
+    void MemoryStats::writeLocked(std::ostream& os) const {
+        os << "{\"enabled\":" << (mEnabled ? "true" : "false") << ",\"sites\":[";
+        for (SiteMap::const_iterator it = mSites.begin(); it != mSites.end(); ++it) {
+            os << (it != mSites.begin() ? ",\n" : "\n");
+            os << "{\"site\":\"" << it->first << "\",\"kind\":\"" << kindName(it->second.kind)
+               << "\",\"count\":" << it->second.count << ",\"bytes\":" << it->second.bytes << '}';
+        }
+        os << "\n]}\n";
+    }
+} // namespace Diagnostics
@@ -0,0 +1,76 @@
+#ifndef PCSC_CENXFS_BRIDGE_PCSC_Backend_H
+#define PCSC_CENXFS_BRIDGE_PCSC_Backend_H
+
+#pragma once
+
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+// PC/SC API
+#include <winscard.h>
+
+namespace PCSC {
+    /** Реализация подсистемы PC/SC, через которую мост общается со считывателями. Методы
+        повторяют функции `SCard*`, которые использует мост, с теми же параметрами и кодами
+        возврата, за исключением не используемых мостом групп считывателей и PCI ответа.
+    @par
+        Реализации регистрируются под своими названиями (см. `add`) и выбираются настройкой
+        `Backend` первого открытого сервиса (см. `Manager::create`). Встроенная реализация
+        `native` вызывает функции `SCard*` библиотеки, с которой собран мост.
+    */
+    class Backend : private boost::noncopyable {
+    public:
+        /** Создает или находит реализацию.
+        @param script
+            Дополнительный параметр реализации из настроек, например, сценарий симулятора.
+        @return
+            Реализацию, живущую до конца процесса, или `NULL`, если ее не удалось подготовить.
+        */
+        typedef Backend* (*Factory)(const std::string& script);
+        /// Регистрирует реализацию при инициализации статических объектов.
+        struct Registrar {
+            Registrar(const char* name, Factory factory) { add(name, factory); }
+        };
+    public:
+        /// Реализация, вызывающая функции `SCard*` библиотеки PC/SC, с которой собран мост.
+        static Backend& native();
+        /// Регистрирует реализацию под указанным названием, заменяя прежнюю с таким же названием.
+        static void add(const char* name, Factory factory);
+        /** Создает зарегистрированную реализацию.
+        @param name
+            Название реализации. Пустая строка означает `native`.
+        @return
+            Реализацию или `NULL`, если реализация с таким названием не зарегистрирована
+            или ее не удалось подготовить.
+        */
+        static Backend* create(const std::string& name, const std::string& script);
+
+        virtual ~Backend() {}
+        /// Название реализации для журнала.
+        virtual const char* name() const = 0;
+    public:// Контекст и считыватели
+        virtual LONG establishContext(LPSCARDCONTEXT phContext) = 0;
+        virtual LONG releaseContext(SCARDCONTEXT hContext) = 0;
+        virtual LONG listReaders(SCARDCONTEXT hContext, LPSTR mszReaders, LPDWORD pcchReaders) = 0;
+        virtual LONG getStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout,
+                                     SCARD_READERSTATE* rgReaderStates, DWORD cReaders) = 0;
+        virtual LONG cancel(SCARDCONTEXT hContext) = 0;
+    public:// Соединение с картой
+        virtual LONG connect(SCARDCONTEXT hContext, LPCSTR szReader, DWORD dwShareMode,
+                             DWORD dwPreferredProtocols, LPSCARDHANDLE phCard, LPDWORD pdwActiveProtocol) = 0;
+        virtual LONG reconnect(SCARDHANDLE hCard, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                               DWORD dwInitialization, LPDWORD pdwActiveProtocol) = 0;
+        virtual LONG disconnect(SCARDHANDLE hCard, DWORD dwDisposition) = 0;
+        virtual LONG beginTransaction(SCARDHANDLE hCard) = 0;
+        virtual LONG endTransaction(SCARDHANDLE hCard, DWORD dwDisposition) = 0;
+    public:// Обмен с картой
+        virtual LONG status(SCARDHANDLE hCard, LPSTR szReaderName, LPDWORD pcchReaderLen,
+                            LPDWORD pdwState, LPDWORD pdwProtocol, LPBYTE pbAtr, LPDWORD pcbAtrLen) = 0;
+        virtual LONG transmit(SCARDHANDLE hCard, const SCARD_IO_REQUEST* pioSendPci,
+                              LPCBYTE pbSendBuffer, DWORD cbSendLength,
+                              LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength) = 0;
+        virtual LONG getAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen) = 0;
+    };
+} // namespace PCSC
+#endif // PCSC_CENXFS_BRIDGE_PCSC_Backend_H
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include "PCSC/Backend.h"
+
 #include <boost/noncopyable.hpp>
 
 // PC/SC API
@@ -13,16 +15,36 @@ namespace PCSC {
         главным образом по соображениям того, чтобы его деструктор закрывал контекст PC/SC
         в самый последний момент, когда все остальные объекты, зависящие от контекста, уже
         будут разрушены. Таким образом, предназначен для наследования от него класса менеджера.
+    @par
+        Соединение не открывается при создании объекта: менеджер создается при загрузке DLL,
+        а открывает соединение только тогда, когда оно требуется первому сервису (см. `establish`).
     */
     class Context : private boost::noncopyable {
+        /// Реализация PC/SC, через которую открыт контекст.
+        Backend* mBackend;
         /// Контекст подсистемы PC/SC.
         SCARDCONTEXT hContext;
+        /// Открыто ли соединение. Хранится отдельно, т.к. 0 может быть корректным контекстом.
+        bool mEstablished;
     public:
-        /// Открывает соединение к подсистеме PC/SC.
-        Context();
-        /// Закрывает соединение к подсистеме PC/SC.
+        /// Запоминает реализацию PC/SC, через которую будет открыто соединение.
+        Context(Backend& backend);
+        /// Закрывает соединение к подсистеме PC/SC, если оно открыто.
         ~Context();
+    protected:
+        /// Открывает соединение к подсистеме PC/SC через указанную реализацию. Предыдущее
+        /// соединение должно быть закрыто `release`.
+        void establish(Backend& backend);
+        /// Закрывает соединение к подсистеме PC/SC.
+        void release();
+        /// Заменяет реализацию, через которую будет открыто следующее соединение. Можно
+        /// вызывать только тогда, когда соединение закрыто.
+        inline void assign(Backend& backend) { mBackend = &backend; }
     public:// Доступ к внутренностям
+        /// Открыто ли соединение к подсистеме PC/SC.
+        inline bool established() const { return mEstablished; }
+        /// Реализация PC/SC, через которую должны выполняться все операции с контекстом.
+        inline Backend& backend() const { return *mBackend; }
         inline SCARDCONTEXT context() const { return hContext; }
     };
 } // namespace PCSC
@@ -0,0 +1,46 @@
+#ifndef PCSC_CENXFS_BRIDGE_PCSC_DeviceStatus_H
+#define PCSC_CENXFS_BRIDGE_PCSC_DeviceStatus_H
+
+#pragma once
+
+// Для std::size_t
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Для DWORD
+#include <windef.h>
+
+namespace XFS {
+    class Result;
+}
+namespace PCSC {
+    /** Заготовка данных события `WFS_SYSE_DEVICE_STATUS` для одного считывателя: структура
+        `WFSDEVSTATUS` и ее строки в том виде, в каком они лежат в блоке данных результата.
+        Строится один раз на считыватель, после чего данные каждого события -- одно копирование
+        заготовки, в котором меняется только состояние устройства.
+    @par
+        Заготовка хранит копии строк, поэтому событие можно послать и после того, как считыватель
+        пропал из списка PC/SC.
+    */
+    class DeviceStatus {
+        /// Образ блока данных: `WFSDEVSTATUS` без указателей, имя считывателя, имя рабочей станции.
+        std::vector<char> mImage;
+        /// Смещения строк в образе.
+        std::size_t mPhysicalName;
+        std::size_t mWorkstationName;
+    public:
+        /** Получает NetBIOS имя компьютера, на котором запущен сервис-провайдер. Имя не меняется
+            до перезагрузки, поэтому его достаточно получить один раз.
+        */
+        static std::string workstationName();
+
+        DeviceStatus(const std::string& physicalName, const std::string& workstationName);
+        /** Прикрепляет к результату копию заготовки.
+        @param dwState
+            Состояние устройства, одна из констант `WFS_STAT_DEV*`.
+        */
+        void attach(XFS::Result& result, DWORD dwState) const;
+    };
+} // namespace PCSC
+#endif // PCSC_CENXFS_BRIDGE_PCSC_DeviceStatus_H
@@ -5,18 +5,11 @@
 
 #include "Service.h"
 
-#include "PCSC/ReaderState.h"
+#include "PCSC/DeviceStatus.h"
 
 #include "XFS/Logger.h"
-// Для XFS::Str
-#include "XFS/Memory.h"
 #include "XFS/Result.h"
 
-// PC/CS API -- для SCARD_READERSTATE
-#include <winscard.h>
-// Для GetComputerNameEx
-#include <winbase.h>
-
 namespace PCSC {
     /// Базовый класс для всех событий, генерируемых подсистемой PC/SC и транслируемых в XFS.
     class Event {
@@ -49,28 +42,20 @@ namespace PCSC {
             return success().cardRemoved();
         }
     };
-    /// Функтор, создающий результат уведомления о появлении нового устройства каждому заинтересованному слушателю.
+    /// Функтор, создающий результат уведомления об изменении состояния считывателя каждому заинтересованному слушателю.
     class DeviceDetected : public Event {
-        /// Состояние вновь подключившигося устройства.
-        /// TODO: Сделать копию объекта? Вдруг считыватель исчезнет прежде, чем успеем послать сообщение?
-        const SCARD_READERSTATE& state;
+        /// Заготовка данных события для изменившегося считывателя.
+        const DeviceStatus& mStatus;
+        /// Новое состояние считывателя, одна из констант `WFS_STAT_DEV*`.
+        DWORD mState;
     public:
-        DeviceDetected(const Service& service, const SCARD_READERSTATE& state) : Event(service), state(state) {}
+        DeviceDetected(const Service& service, const DeviceStatus& status, DWORD state)
+            : Event(service), mStatus(status), mState(state) {}
         XFS::Result operator()() const {
             XFS::Logger() << "Create DeviceDetected event";
-            //TODO: Возможно, необходимо выделять память через WFSAllocateMore
-            WFSDEVSTATUS* status = XFS::alloc<WFSDEVSTATUS>();
-            // Имя физичеcкого устройства, чье состояние изменилось
-            status->lpszPhysicalName = (LPSTR)XFS::Str(state.szReader).begin();
-
-            DWORD len = 0;
-            // Сначала получаем размер буфера (включает размер для завершающего 0)
-            GetComputerNameEx(ComputerNameNetBIOS, NULL, &len);
-            // Рабочая станция, на которой запущен сервис.
-            status->lpszWorkstationName = XFS::allocArr<CHAR>(len);
-            GetComputerNameEx(ComputerNameNetBIOS, status->lpszWorkstationName, &len);
-            status->dwState = PCSC::ReaderState(state.dwEventState).translate();
-            return success().attach(status);
+            XFS::Result result = success();
+            mStatus.attach(result, mState);
+            return result;
         }
     };
 } // namespace PCSC
@@ -6,7 +6,6 @@
 #include "Utils/CTString.h"
 #include "Utils/Flags.h"
 
-#include <vector>
 // Для DWORD
 #include <windef.h>
 // PC/CS API
@@ -30,13 +29,13 @@ namespace PCSC {
             }
             return result;
         }
-        const std::vector<CTString> flagNames() const {
-            static CTString names[] = {
+        static FlagNames flagNames() {
+            static const CTString names[] = {
                 CTString("<none>"           ),
                 CTString("SCARD_PROTOCOL_T0"),
                 CTString("SCARD_PROTOCOL_T1"),
             };
-            return _Base::flagNames(names);
+            return names;
         }
     };
 } // namespace PCSC
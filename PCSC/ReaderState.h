@@ -8,7 +8,6 @@
 
 // Для std::size_t
 #include <cstddef>
-#include <vector>
 // Для DWORD
 #include <windef.h>
 // PC/CS API
@@ -24,8 +23,9 @@ namespace PCSC {
         typedef Flags<DWORD, ReaderState> _Base;
     public:
         ReaderState(DWORD value) : _Base(value) {}
+        /// Преобразует состояние в состояние устройства XFS (`WFS_STAT_DEV*`) для `WFS_SYSE_DEVICE_STATUS`.
         DWORD translate() const {
-            DWORD result = 0;
+            DWORD result = WFS_STAT_DEVONLINE;
             // Считыватель должен быть проигнорирован
             if (mValue & SCARD_STATE_IGNORE) {
             }
@@ -35,9 +35,11 @@ namespace PCSC {
             // Данный считыватель не распознался менеджером ресурсов. Также в этом случае стоят флаги
             // SCARD_STATE_CHANGED и SCARD_STATE_IGNORE
             if (mValue & SCARD_STATE_UNKNOWN) {
+                return WFS_STAT_DEVNODEVICE;
             }
             // Актуальное состояние считывателя получить нет возможности. Если флаг стоит, все последующие флаги сброшены.
             if (mValue & SCARD_STATE_UNAVAILABLE) {
+                return WFS_STAT_DEVHWERROR;
             }
             // В считывателе нет карточки. Если флаг стоит, все последующие флаги сброшены.
             if (mValue & SCARD_STATE_EMPTY) {
@@ -65,8 +67,8 @@ namespace PCSC {
             return result;
         }
 
-        const std::vector<CTString> flagNames() const {
-            static CTString names[] = {
+        static FlagNames flagNames() {
+            static const CTString names[] = {
                 CTString("SCARD_STATE_UNAWARE"    ),// 0x0000    Приложение не знает статус и хочет его узнать
                 CTString("SCARD_STATE_IGNORE"     ),// 0x0001    Не получать уведомления об этом считывателе
                 CTString("SCARD_STATE_CHANGED"    ),// 0x0002    В состоянии что-то изменилось
@@ -80,7 +82,7 @@ namespace PCSC {
                 CTString("SCARD_STATE_MUTE"       ),// 0x0200    Unresponsive card.
                 CTString("SCARD_STATE_UNPOWERED"  ),// 0x0400    Unpowered card.
             };
-            return _Base::flagNames(names);
+            return names;
         }
     };
 } // namespace PCSC
@@ -4,7 +4,13 @@
 
 #include "PCSC/Status.h"
 
+#include "Diagnostics/ApduStats.h"
+#include "Diagnostics/FlightRecorder.h"
+#include "Diagnostics/MemoryStats.h"
+
+#include "XFS/Memory.h"
 #include "XFS/Result.h"
+#include "XFS/Vendor.h"
 
 // Для strncpy.
 #include <cstring>
@@ -83,6 +89,7 @@ HRESULT SPI_API WFPOpen(HSERVICE hService, LPSTR lpszLogicalName,
                         DWORD dwSPIVersionsRequired, LPWFSVERSION lpSPIVersion, 
                         DWORD dwSrvcVersionsRequired, LPWFSVERSION lpSrvcVersion
 ) {
+    Diagnostics::flightCall("WFPOpen", hService, ReqID);
     // Возвращаем поддерживаемые версии.
     if (lpSPIVersion != NULL) {
         // Версия XFS менеджера, которая будет использоваться. Т.к. мы поддерживаем все версии,
@@ -105,7 +112,8 @@ HRESULT SPI_API WFPOpen(HSERVICE hService, LPSTR lpszLogicalName,
         safecopy(lpSrvcVersion->szDescription, DLL_VERSION);
     }
 
-    pcsc.create(hService, Settings(lpszLogicalName, dwTraceLevel));
+    // Настройки провайдера читаются из конфигурации только при первом открытии его сервиса.
+    pcsc.create(hService, SettingsCache::instance().get(lpszLogicalName));
     XFS::Result(ReqID, hService, WFS_SUCCESS).send(hWnd, WFS_OPEN_COMPLETE);
 
     // Возможные коды завершения асинхронного запроса (могут возвращаться и другие)
@@ -141,6 +149,7 @@ HRESULT SPI_API WFPOpen(HSERVICE hService, LPSTR lpszLogicalName,
 @param ReqId Идентификатора запроса, который нужно передать окну `hWnd` при завершении операции.
 */
 HRESULT SPI_API WFPClose(HSERVICE hService, HWND hWnd, REQUESTID ReqID) {
+    Diagnostics::flightCall("WFPClose", hService, ReqID);
     if (!pcsc.isValid(hService))
         return WFS_ERR_INVALID_HSERVICE;
     pcsc.remove(hService);
@@ -170,6 +179,7 @@ HRESULT SPI_API WFPClose(HSERVICE hService, HWND hWnd, REQUESTID ReqID) {
 @param ReqID Идентификатора запроса, который нужно передать окну `hWnd` при завершении операции.
 */
 HRESULT SPI_API WFPRegister(HSERVICE hService,  DWORD dwEventClass, HWND hWndReg, HWND hWnd, REQUESTID ReqID) {
+    Diagnostics::flightCall("WFPRegister", hService, ReqID, dwEventClass);
     // Регистрируем событие для окна.
     if (!pcsc.addSubscriber(hService, hWndReg, dwEventClass)) {
         // Если сервиса нет в PC/SC, то он потерян.
@@ -203,6 +213,7 @@ HRESULT SPI_API WFPRegister(HSERVICE hService,  DWORD dwEventClass, HWND hWndReg
 @param ReqID Идентификатора запроса, который нужно передать окну `hWnd` при завершении операции.
 */
 HRESULT SPI_API WFPDeregister(HSERVICE hService, DWORD dwEventClass, HWND hWndReg, HWND hWnd, REQUESTID ReqID) {
+    Diagnostics::flightCall("WFPDeregister", hService, ReqID, dwEventClass);
     // Отписываемся от событий. Если никого не было удалено, то никто не был зарегистрирован.
     if (!pcsc.removeSubscriber(hService, hWndReg, dwEventClass)) {
         // Если сервиса нет в PC/SC, то он потерян.
@@ -235,11 +246,17 @@ HRESULT SPI_API WFPDeregister(HSERVICE hService, DWORD dwEventClass, HWND hWndRe
 @param ReqID Идентификатора запроса, который нужно передать окну `hWnd` при завершении операции.
 */
 HRESULT SPI_API WFPLock(HSERVICE hService, DWORD dwTimeOut, HWND hWnd, REQUESTID ReqID) {
+    Diagnostics::flightCall("WFPLock", hService, ReqID, dwTimeOut);
     if (!pcsc.isValid(hService))
         return WFS_ERR_INVALID_HSERVICE;
+    // Между командами сервис переходит на новый снимок настроек, если конфигурация изменилась.
+    pcsc.get(hService).updateSettings();
+    // Если поток отслеживания изменений простаивал, сервис должен узнать о карте до команды.
+    pcsc.syncReaders(pcsc.get(hService), "WFPLock");
 
-    PCSC::Status st = pcsc.get(hService).lock();
-    XFS::Result(ReqID, hService, st).send(hWnd, WFS_LOCK_COMPLETE);
+    // SCardBeginTransaction ждет, пока карту не освободят другие соединения, в том числе других
+    // процессов, поэтому доступ запрашивается в потоке очереди считывателя, а не в потоке XFS менеджера.
+    pcsc.get(hService).asyncLock(dwTimeOut, hWnd, ReqID);
 
     // Возможные коды завершения асинхронного запроса (могут возвращаться и другие)
     // WFS_ERR_CANCELED        The request was canceled by WFSCancelAsyncRequest.
@@ -264,6 +281,7 @@ HRESULT SPI_API WFPLock(HSERVICE hService, DWORD dwTimeOut, HWND hWnd, REQUESTID
 @param ReqID Идентификатора запроса, который нужно передать окну `hWnd` при завершении операции.
 */
 HRESULT SPI_API WFPUnlock(HSERVICE hService, HWND hWnd, REQUESTID ReqID) {
+    Diagnostics::flightCall("WFPUnlock", hService, ReqID);
     if (!pcsc.isValid(hService))
         return WFS_ERR_INVALID_HSERVICE;
 
@@ -296,19 +314,24 @@ HRESULT SPI_API WFPUnlock(HSERVICE hService, HWND hWnd, REQUESTID ReqID) {
 @param ReqID Идентификатора запроса, который нужно передать окну `hWnd` при завершении операции.
 */
 HRESULT SPI_API WFPGetInfo(HSERVICE hService, DWORD dwCategory, LPVOID lpQueryDetails, DWORD dwTimeOut, HWND hWnd, REQUESTID ReqID) {
+    Diagnostics::flightCall("WFPGetInfo", hService, ReqID, dwCategory);
     if (!pcsc.isValid(hService))
         return WFS_ERR_INVALID_HSERVICE;
+    pcsc.get(hService).updateSettings();
+    pcsc.syncReaders(pcsc.get(hService), "WFPGetInfo");
     // Для IDC могут запрашиваться только эти константы (WFS_INF_IDC_*)
     switch (dwCategory) {
         case WFS_INF_IDC_STATUS: {      // Дополнительных параметров нет
-            std::pair<WFSIDCSTATUS*, PCSC::Status> status = pcsc.get(hService).getStatus();
             // Получение информации о считывателе всегда успешно.
-            XFS::Result(ReqID, hService, WFS_SUCCESS).attach(status.first).send(hWnd, WFS_GETINFO_COMPLETE);
+            XFS::Result result(ReqID, hService, WFS_SUCCESS);
+            pcsc.get(hService).getStatus(result);
+            result.send(hWnd, WFS_GETINFO_COMPLETE);
             break;
         }
         case WFS_INF_IDC_CAPABILITIES: {// Дополнительных параметров нет
-            std::pair<WFSIDCCAPS*, PCSC::Status> caps = pcsc.get(hService).getCaps();
-            XFS::Result(ReqID, hService, caps.second).attach(caps.first).send(hWnd, WFS_GETINFO_COMPLETE);
+            XFS::Result result(ReqID, hService, WFS_SUCCESS);
+            PCSC::Status st = pcsc.get(hService).getCaps(result);
+            result.status(st).send(hWnd, WFS_GETINFO_COMPLETE);
             break;
         }
         case WFS_INF_IDC_FORM_LIST:
@@ -317,6 +340,16 @@ HRESULT SPI_API WFPGetInfo(HSERVICE hService, DWORD dwCategory, LPVOID lpQueryDe
             // Так как треки мы не читаем и не пишем, то формы не поддерживаем.
             return WFS_ERR_UNSUPP_COMMAND;
         }
+        case WFS_INF_IDC_VENDOR_APDU_STATS: {// Дополнительных параметров нет
+            std::string stats = Diagnostics::ApduStats::instance().toJSONString();
+            XFS::Result(ReqID, hService, WFS_SUCCESS).attach(dwCategory, stats, "WFPGetInfo.ApduStats").send(hWnd, WFS_GETINFO_COMPLETE);
+            break;
+        }
+        case WFS_INF_IDC_VENDOR_MEMORY_STATS: {// Дополнительных параметров нет
+            std::string stats = Diagnostics::MemoryStats::instance().toJSONString();
+            XFS::Result(ReqID, hService, WFS_SUCCESS).attach(dwCategory, stats, "WFPGetInfo.MemoryStats").send(hWnd, WFS_GETINFO_COMPLETE);
+            break;
+        }
         default:
             return WFS_ERR_INVALID_CATEGORY;
     }
@@ -361,8 +394,11 @@ HRESULT SPI_API WFPGetInfo(HSERVICE hService, DWORD dwCategory, LPVOID lpQueryDe
 @param ReqID Идентификатора запроса, который нужно передать окну `hWnd` при завершении операции.
 */
 HRESULT SPI_API WFPExecute(HSERVICE hService, DWORD dwCommand, LPVOID lpCmdData, DWORD dwTimeOut, HWND hWnd, REQUESTID ReqID) {
+    Diagnostics::flightCall("WFPExecute", hService, ReqID, dwCommand);
     if (!pcsc.isValid(hService))
         return WFS_ERR_INVALID_HSERVICE;
+    pcsc.get(hService).updateSettings();
+    pcsc.syncReaders(pcsc.get(hService), "WFPExecute");
 
     switch (dwCommand) {
         // Ожидание вставки карты с указанным таймаутом, немедленное чтение треков согласно форме,
@@ -386,7 +422,7 @@ HRESULT SPI_API WFPExecute(HSERVICE hService, DWORD dwCommand, LPVOID lpCmdData,
             // не поддерживается, и падает с Fatal Error, если сообщить ему, что он требует невозможного,
             // хотя по спецификации мы обязаны сообщать о том, что данная возможность не поддерживается
             // кодом ответа WFS_ERR_UNSUPP_COMMAND и имеем право не поддерживать эту возможность.
-            if (pcsc.get(hService).settings().workarounds.canEject) {
+            if (pcsc.get(hService).settings()->workarounds.canEject) {
                 XFS::Result(ReqID, hService, WFS_SUCCESS).eject().send(hWnd, WFS_EXECUTE_COMPLETE);
                 return WFS_SUCCESS;
             }
@@ -435,8 +471,9 @@ HRESULT SPI_API WFPExecute(HSERVICE hService, DWORD dwCommand, LPVOID lpCmdData,
                 return WFS_ERR_INVALID_POINTER;
             }
             const WFSIDCCHIPIO* data = (const WFSIDCCHIPIO*)lpCmdData;
-            std::pair<WFSIDCCHIPIO*, PCSC::Status> result = pcsc.get(hService).transmit(data);
-            XFS::Result(ReqID, hService, result.second).attach(result.first).send(hWnd, WFS_EXECUTE_COMPLETE);
+            XFS::Result result(ReqID, hService, WFS_SUCCESS);
+            PCSC::Status st = pcsc.get(hService).transmit(result, data);
+            result.status(st).send(hWnd, WFS_EXECUTE_COMPLETE);
             return WFS_SUCCESS;
         }
         // Отключает питание чипа.
@@ -451,8 +488,9 @@ HRESULT SPI_API WFPExecute(HSERVICE hService, DWORD dwCommand, LPVOID lpCmdData,
                 return WFS_ERR_INVALID_POINTER;
             }
             WORD wChipPower = *((WORD*)lpCmdData);
-            std::pair<WFSIDCCHIPPOWEROUT*, PCSC::Status> result = pcsc.get(hService).reset(wChipPower);
-            XFS::Result(ReqID, hService, result.second).attach(result.first).send(hWnd, WFS_EXECUTE_COMPLETE);
+            XFS::Result result(ReqID, hService, WFS_SUCCESS);
+            PCSC::Status st = pcsc.get(hService).reset(result, wChipPower);
+            result.status(st).send(hWnd, WFS_EXECUTE_COMPLETE);
             return WFS_SUCCESS;
         }
         // Разбирает результат, ранее возвращенный командой WFS_CMD_IDC_READ_RAW_DATA. Так как мы ее
@@ -461,6 +499,16 @@ HRESULT SPI_API WFPExecute(HSERVICE hService, DWORD dwCommand, LPVOID lpCmdData,
             // WFSIDCPARSEDATA* parseData = (WFSIDCPARSEDATA*)lpCmdData;
             return WFS_ERR_UNSUPP_COMMAND;
         }
+        case WFS_CMD_IDC_VENDOR_DUMP_FLIGHT_RECORDER: {// Входных параметров нет.
+            bool ok = Diagnostics::FlightRecorder::instance().dump("WFS_CMD_IDC_VENDOR_DUMP_FLIGHT_RECORDER", true);
+            XFS::Result(ReqID, hService, ok ? WFS_SUCCESS : WFS_ERR_SOFTWARE_ERROR).send(hWnd, WFS_EXECUTE_COMPLETE);
+            return WFS_SUCCESS;
+        }
+        case WFS_CMD_IDC_VENDOR_REREAD_SETTINGS: {// Входных параметров нет.
+            SettingsCache::instance().invalidate();
+            XFS::Result(ReqID, hService, WFS_SUCCESS).send(hWnd, WFS_EXECUTE_COMPLETE);
+            return WFS_SUCCESS;
+        }
         default: {
             // Все остальные команды недопустимы.
             return WFS_ERR_INVALID_COMMAND;
@@ -497,6 +545,7 @@ HRESULT SPI_API WFPExecute(HSERVICE hService, DWORD dwCommand, LPVOID lpCmdData,
        для указанного сервися `hService`.
 */
 HRESULT SPI_API WFPCancelAsyncRequest(HSERVICE hService, REQUESTID ReqID) {
+    Diagnostics::flightCall("WFPCancelAsyncRequest", hService, ReqID);
     if (!pcsc.isValid(hService))
         return WFS_ERR_INVALID_HSERVICE;
     if (!pcsc.cancelTask(hService, ReqID)) {
@@ -510,6 +559,7 @@ HRESULT SPI_API WFPCancelAsyncRequest(HSERVICE hService, REQUESTID ReqID) {
     return WFS_SUCCESS;
 }
 HRESULT SPI_API WFPSetTraceLevel(HSERVICE hService, DWORD dwTraceLevel) {
+    Diagnostics::flightCall("WFPSetTraceLevel", hService, 0, dwTraceLevel);
     if (!pcsc.isValid(hService))
         return WFS_ERR_INVALID_HSERVICE;
     pcsc.get(hService).setTraceLevel(dwTraceLevel);
@@ -524,12 +574,14 @@ HRESULT SPI_API WFPSetTraceLevel(HSERVICE hService, DWORD dwTraceLevel) {
 }
 /** Вызывается XFS для определения того, можно ли выгрузить DLL с данным сервис-провайдером прямо сейчас. */
 HRESULT SPI_API WFPUnloadService() {
+    Diagnostics::flightCall("WFPUnloadService", 0, 0);
     // Возможные коды завершения функции:
     // WFS_ERR_NOT_OK_TO_UNLOAD
     //     The XFS Manager may not unload the service provider DLL at this time. It will repeat this
     //     request to the service provider until the return is WFS_SUCCESS, or until a new session is
     //     started by an application with this service provider.
 
-    return pcsc.isEmpty() ? WFS_SUCCESS : WFS_ERR_NOT_OK_TO_UNLOAD;
+    // Каждый опрос дожидается потоков, не успевших завершиться при закрытии последнего сервиса.
+    return pcsc.unload() ? WFS_SUCCESS : WFS_ERR_NOT_OK_TO_UNLOAD;
 }
 } // extern "C"
\ No newline at end of file
@@ -1,25 +1,79 @@
 #include "ReaderChangesMonitor.h"
 
 #include "Manager.h"
+#include "Service.h"
+
+#include "Diagnostics/FlightRecorder.h"
+#include "Diagnostics/MemoryStats.h"
+#include "Diagnostics/SessionRecorder.h"
+#include "Diagnostics/Timeline.h"
 
 #include "PCSC/ReaderState.h"
 #include "PCSC/Status.h"
 
 #include "XFS/Logger.h"
 
+// Для std::min
+#include <algorithm>
+// Для std::memset
+#include <cstring>
+
 ReaderChangesMonitor::ReaderChangesMonitor(Manager& manager)
-    : manager(manager), stopRequested(false)
+    : manager(manager), stopRequested(false), active(false), resyncRequested(false)
+    , idle(false), wakeRequested(false), idleTimeout(boost::chrono::steady_clock::duration::zero())
 {
+    // Запись временной шкалы, бортовой самописец, учет памяти и запись сеанса используются
+    // потоком ожидания изменений, поэтому должны быть созданы раньше него, чтобы и разрушиться позже.
+    Diagnostics::Timeline::instance();
+    Diagnostics::FlightRecorder::instance();
+    Diagnostics::MemoryStats::instance();
+    Diagnostics::SessionRecorder::instance();
+}
+ReaderChangesMonitor::~ReaderChangesMonitor() {
+    stop("ReaderChangesMonitor::~ReaderChangesMonitor");
+}
+void ReaderChangesMonitor::start() {
+    {
+        boost::unique_lock<boost::mutex> lock(idleMutex);
+        if (active) {
+            XFS::Logger() << "ReaderChangesMonitor::start: waiting for the detached thread";
+        }
+        // Поток, отсоединенный stop, должен завершиться, пока флаг остановки еще выставлен.
+        while (active) {
+            idleChanged.wait(lock);
+        }
+        active = true;
+    }
+    stopRequested = false;
+    // Новый контекст ничего не знает о считывателях, о них нужно сообщить заново.
+    knownStates.clear();
     // Запускаем поток ожидания изменений.
     waitChangesThread.reset(new boost::thread(&ReaderChangesMonitor::run, this));
 }
-ReaderChangesMonitor::~ReaderChangesMonitor() {
+bool ReaderChangesMonitor::stop(const char* reason, boost::chrono::steady_clock::time_point deadline) {
+    if (!waitChangesThread) {
+        return true;
+    }
     // Запрашиваем остановку потока.
     stopRequested = true;
-    // Сигнализируем о том, что необходимо прервать ожидание
-    cancel("ReaderChangesMonitor::~ReaderChangesMonitor");
-    // Ожидаем, пока дойдет.
-    waitChangesThread->join();
+    // Отмена, пришедшая до того, как поток вошел в SCardGetStatusChange, теряется,
+    // поэтому повторяем ее, пока поток не завершится.
+    for (;;) {
+        cancel(reason);
+        const boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+        if (now >= deadline) {
+            break;
+        }
+        const boost::chrono::steady_clock::time_point retry = now + boost::chrono::milliseconds(100);
+        if (waitChangesThread->try_join_until(std::min(retry, deadline))) {
+            waitChangesThread.reset();
+            return true;
+        }
+    }
+    XFS::Logger() << "ReaderChangesMonitor::stop[" << reason << "]: thread did not stop in time, detached";
+    waitChangesThread->detach();
+    waitChangesThread.reset();
+    return false;
 }
 void ReaderChangesMonitor::run() {
     {XFS::Logger() << "Reader changes dispatch thread runned";}
@@ -28,8 +82,19 @@ void ReaderChangesMonitor::run() {
     while (!stopRequested) {
         // На входе текущее состояние считывателей -- на выходе новое состояние.
         readersState = getReadersAndWaitChanges(readersState);
+        if (park()) {
+            // Пока поток простаивал, считыватели и карты могли меняться как угодно. Забываем
+            // все, что знали, и PC/SC сразу же сообщит о текущем состоянии каждого считывателя.
+            knownStates.clear();
+            readersState = SCARD_STATE_UNAWARE;
+        }
     }
     XFS::Logger() << "Reader changes dispatch thread stopped";
+    {
+        boost::lock_guard<boost::mutex> lock(idleMutex);
+        active = false;
+    }
+    idleChanged.notify_all();
 }
 /// Получаем список имен считывателей из строки со всеми именами, разделенными символом '\0'.
 std::vector<const char*> getReaderNames(const std::vector<char>& readerNames) {
@@ -53,22 +118,26 @@ std::vector<const char*> getReaderNames(const std::vector<char>& readerNames) {
     }
     return names;
 }
-DWORD ReaderChangesMonitor::getReadersAndWaitChanges(DWORD readersState) {
+std::vector<const char*> ReaderChangesMonitor::listReaders(std::vector<char>& readerNames) {
     DWORD readersCount = 0;
     // Определяем доступные считыватели: сначало количество, затем сами считыватели.
-    PCSC::Status st = SCardListReaders(manager.context(), NULL, NULL, &readersCount);
+    PCSC::Status st = manager.backend().listReaders(manager.context(), NULL, &readersCount);
+    Diagnostics::flightPCSC("SCardListReaders", (unsigned long)manager.context(), st.value());
     {XFS::Logger() << "SCardListReaders[count](count=&" << readersCount << "): " << st;}
 
     // Получаем имена доступных считывателей. Все имена расположены в одной строке,
     // разделены символом '\0' в в конце списка также символ '\0' (т.о. в конце массива
     // идет подряд два '\0').
-    std::vector<char> readerNames(readersCount);
+    readerNames.assign(readersCount, '\0');
     if (readersCount != 0) {
-        st = SCardListReaders(manager.context(), NULL, &readerNames[0], &readersCount);
+        st = manager.backend().listReaders(manager.context(), &readerNames[0], &readersCount);
         XFS::Logger() << "SCardListReaders[data](count=&" << readersCount << "): " << st;
     }
-
-    std::vector<const char*> names = getReaderNames(readerNames);
+    return getReaderNames(readerNames);
+}
+DWORD ReaderChangesMonitor::getReadersAndWaitChanges(DWORD readersState) {
+    std::vector<char> readerNames;
+    std::vector<const char*> names = listReaders(readerNames);
 
     // Готовимся к ожиданию событий от всех обнаруженных считывателей и
     // изменению их количества.
@@ -78,10 +147,17 @@ DWORD ReaderChangesMonitor::getReadersAndWaitChanges(DWORD readersState) {
     readers[0].szReader = "\\\\?PnP?\\Notification";
     readers[0].dwCurrentState = readersState;
 
-    // Заполняем структуры для ожидания событий от найденных считывателей.
+    // Заполняем структуры для ожидания событий от найденных считывателей. Известное состояние
+    // переносится из прошлого списка, иначе подключение или отключение любого считывателя
+    // заново сообщало бы сервисам о состоянии всех остальных.
     for (std::size_t i = 0; i < names.size(); ++i) {
         readers[1 + i].szReader = names[i];
+        std::map<std::string, DWORD>::const_iterator known = knownStates.find(names[i]);
+        readers[1 + i].dwCurrentState = known != knownStates.end() ? known->second : SCARD_STATE_UNAWARE;
     }
+    notifyVanished(names);
+    // События об отключении уже разосланы, заготовки для них больше не нужны.
+    manager.forgetReaders(names);
 
     // Ожидаем событий от считывателей. Если их количество обновилось,
     // то прекращаем ожидание. Повторный вход в данную процедуру случится
@@ -91,20 +167,110 @@ DWORD ReaderChangesMonitor::getReadersAndWaitChanges(DWORD readersState) {
             // Не важно, что возвращать, нам лишь бы выйти.
             return 0;
         }
+        // Простаивать будем в run, запомнив состояние считывателей.
+        boost::lock_guard<boost::mutex> lock(idleMutex);
+        if (canIdle()) {
+            break;
+        }
+    }
+    knownStates.clear();
+    for (std::size_t i = 1; i < readers.size(); ++i) {
+        knownStates[readers[i].szReader] = readers[i].dwCurrentState;
     }
     // Возвращаем текущее состояние наблюдателя за считывателями.
     return readers[0].dwCurrentState;
 }
+void ReaderChangesMonitor::notifyVanished(const std::vector<const char*>& names) {
+    for (std::map<std::string, DWORD>::const_iterator it = knownStates.begin(); it != knownStates.end(); ++it) {
+        // Об отключении уже сообщено через SCardGetStatusChange.
+        if (it->second & SCARD_STATE_UNKNOWN) {
+            continue;
+        }
+        bool found = false;
+        for (std::vector<const char*>::const_iterator name = names.begin(); name != names.end(); ++name) {
+            if (it->first == *name) {
+                found = true;
+                break;
+            }
+        }
+        if (found) {
+            continue;
+        }
+        SCARD_READERSTATE state;
+        std::memset(&state, 0, sizeof(state));
+        state.szReader = it->first.c_str();
+        state.dwCurrentState = it->second;
+        state.dwEventState = SCARD_STATE_UNKNOWN | SCARD_STATE_CHANGED;
+        {XFS::Logger() << "[" << it->first << "] vanished, last state = " << PCSC::ReaderState(it->second);}
+        Diagnostics::FlightRecorder::instance().record(Diagnostics::FlightRecorder::State,
+            "vanished", 0, state.dwCurrentState, (long)state.dwEventState
+        );
+        manager.notifyChanges(state, false);
+    }
+}
 bool ReaderChangesMonitor::waitChanges(std::vector<SCARD_READERSTATE>& readers) {
     // Данная функция блокирует выполнение до тех пор, пока не произойдет событие.
     // Ждем его до таймаута ближайшей задачи на ожидание вставки карты.
-    PCSC::Status st = SCardGetStatusChange(manager.context(), manager.getTimeout(), &readers[0], (DWORD)readers.size());
+    DWORD timeout = manager.getTimeout();
+    {
+        boost::lock_guard<boost::mutex> lock(idleMutex);
+        // Пробуждения, запрошенные до этого момента, будут учтены в этом ожидании.
+        wakeRequested = false;
+        // Поток должен проснуться, когда истечет время работы после последней команды. Если
+        // оно истекло уже после проверки в park(), опрашиваем без ожидания, иначе поток
+        // заснет в PC/SC до таймаута задачи вместо того, чтобы перейти в простой.
+        if (idleTimeout != boost::chrono::steady_clock::duration::zero()) {
+            const boost::chrono::steady_clock::duration left = activeUntil - boost::chrono::steady_clock::now();
+            DWORD ms = 0;
+            if (left > boost::chrono::steady_clock::duration::zero()) {
+                ms = (DWORD)boost::chrono::ceil<boost::chrono::milliseconds>(left).count();
+            }
+            timeout = std::min(timeout, ms);
+        }
+    }
+    // Новому сервису нужно узнать о картах, уже находящихся в считывателях. Известное
+    // состояние сообщается только ему, остальные сервисы его уже знают, а PC/SC продолжает
+    // сообщать об изменениях относительно него. О считывателях, состояние которых еще не
+    // известно, PC/SC сообщит всем сам.
+    if (resyncRequested.exchange(false)) {
+        std::vector<SCARD_READERSTATE> snapshot;
+        for (std::size_t i = 1; i < readers.size(); ++i) {
+            if (readers[i].dwCurrentState == SCARD_STATE_UNAWARE) {
+                continue;
+            }
+            SCARD_READERSTATE state = readers[i];
+            state.dwEventState = readers[i].dwCurrentState;
+            state.dwCurrentState = SCARD_STATE_UNAWARE;
+            snapshot.push_back(state);
+        }
+        if (!snapshot.empty()) {
+            manager.notifySnapshot(snapshot);
+        }
+    }
+    {
+        // Остановка или пробуждение, запрошенные, пока готовилось ожидание, прервать его уже
+        // не смогут: SCardCancel действует только на начатое ожидание. Выходим, не начиная его.
+        boost::lock_guard<boost::mutex> lock(idleMutex);
+        if (stopRequested || wakeRequested) {
+            return false;
+        }
+    }
+    PCSC::Status st = SCARD_S_SUCCESS;
+    {
+        Diagnostics::TimelineSpan span("SCardGetStatusChange", "monitor");
+        st = manager.backend().getStatusChange(manager.context(), timeout, &readers[0], (DWORD)readers.size());
+        Diagnostics::flightPCSC("SCardGetStatusChange", (unsigned long)manager.context(), st.value());
+        span.arg("timeout", timeout).arg("readers", readers.size()).arg("status", st.name());
+    }
     {XFS::Logger() << "SCardGetStatusChange: " << st;}
+    // Обработка пробуждения: от него до отправки сообщений и проходит реакция на событие.
+    Diagnostics::TimelineSpan span("wakeup", "monitor");
     // Если изменение вызвано таймаутом операции, выкидываем из очереди ожидания все
     // задачи, чей таймаут уже наступил
     if (st.value() == SCARD_E_TIMEOUT) {
-        manager.processTimeouts(bc::steady_clock::now());
+        manager.processTimeouts();
     }
+    std::size_t changes = 0;
     bool readersChanged = false;
     bool first = true;
     for (std::vector<SCARD_READERSTATE>::iterator it = readers.begin(); it != readers.end(); ++it) {
@@ -124,16 +290,127 @@ bool ReaderChangesMonitor::waitChanges(std::vector<SCARD_READERSTATE>& readers)
             if (first) {
                 readersChanged = true;
             }
+            ++changes;
+            Diagnostics::FlightRecorder::instance().record(Diagnostics::FlightRecorder::State,
+                "reader", (unsigned long)(it - readers.begin()), it->dwCurrentState, (long)it->dwEventState
+            );
             manager.notifyChanges(*it, first);
         }
         // Cообщаем PC/SC, что мы знаем текущее состояние
         it->dwCurrentState = it->dwEventState;
         first = false;
     }
+    span.arg("changes", changes).arg("readersChanged", readersChanged);
     return readersChanged;
 }
-void ReaderChangesMonitor::cancel(const char* reason) const {
+void ReaderChangesMonitor::cancel(const char* reason) {
+    // Без потока прерывать нечего, а контекст PC/SC может быть еще не открыт.
+    if (!waitChangesThread) {
+        return;
+    }
+    {
+        boost::lock_guard<boost::mutex> lock(idleMutex);
+        wakeRequested = true;
+        if (idle) {
+            // Простаивающий поток не ждет изменений, прерывать в PC/SC нечего.
+            idleChanged.notify_all();
+            XFS::Logger() << "ReaderChangesMonitor::cancel[" << reason << "]: wake up";
+            return;
+        }
+    }
     // Сигнализируем о том, что необходимо прервать ожидание
-    PCSC::Status st = SCardCancel(manager.context());
+    PCSC::Status st = manager.backend().cancel(manager.context());
+    Diagnostics::flightPCSC("SCardCancel", (unsigned long)manager.context(), st.value());
+    Diagnostics::TimelineEvent("SCardCancel", "monitor").arg("reason", reason).arg("status", st.name());
     XFS::Logger() << "SCardCancel[" << reason << "](hContext=" << manager.context() << ") = " << st;
+}
+void ReaderChangesMonitor::resync(const char* reason) {
+    resyncRequested = true;
+    cancel(reason);
+}
+void ReaderChangesMonitor::wake(const char* reason) {
+    boost::lock_guard<boost::mutex> lock(idleMutex);
+    wakeRequested = true;
+    if (idle) {
+        idleChanged.notify_all();
+        XFS::Logger() << "ReaderChangesMonitor::wake[" << reason << "]";
+    }
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void ReaderChangesMonitor::setIdleTimeout(unsigned long seconds) {
+    {
+        boost::lock_guard<boost::mutex> lock(idleMutex);
+        const boost::chrono::steady_clock::duration timeout = boost::chrono::seconds(seconds);
+        if (timeout == idleTimeout) {
+            return;
+        }
+        {XFS::Logger() << "ReaderChangesMonitor::setIdleTimeout: " << seconds << " s";}
+        idleTimeout = timeout;
+        activeUntil = boost::chrono::steady_clock::now() + idleTimeout;
+        wakeRequested = true;
+    }
+    // При отключении простоя поток должен проснуться, а при включении -- пересчитать таймаут.
+    cancel("ReaderChangesMonitor::setIdleTimeout");
+}
+void ReaderChangesMonitor::sync(Service& service, const char* reason) {
+    boost::unique_lock<boost::mutex> lock(idleMutex);
+    if (idleTimeout == boost::chrono::steady_clock::duration::zero()) {
+        return;
+    }
+    const boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+    activeUntil = now + idleTimeout;
+    if (!idle) {
+        return;
+    }
+    {XFS::Logger() << "ReaderChangesMonitor::sync[" << reason << "]: wake up";}
+    // Ждать первого витка опроса после простоя нельзя: SPI-функции должны возвращаться сразу.
+    // Пока мьютекс захвачен, поток не проснется, поэтому состояние узнаем сами, без ожидания.
+    // Проснувшийся поток сообщит его всем сервисам еще раз, что для этого сервиса ничего не изменит.
+    notifyCurrent(service);
+    wakeRequested = true;
+    idleChanged.notify_all();
+}
+void ReaderChangesMonitor::notifyCurrent(Service& service) {
+    std::vector<char> readerNames;
+    std::vector<const char*> names = listReaders(readerNames);
+    // Псевдо-считыватель нужен записи сеанса, которая пропускает первый элемент.
+    std::vector<SCARD_READERSTATE> readers(1 + names.size());
+    readers[0].szReader = "\\\\?PnP?\\Notification";
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        readers[1 + i].szReader = names[i];
+    }
+    PCSC::Status st = manager.backend().getStatusChange(manager.context(), 0, &readers[0], (DWORD)readers.size());
+    Diagnostics::flightPCSC("SCardGetStatusChange", (unsigned long)manager.context(), st.value());
+    {XFS::Logger() << "SCardGetStatusChange[current]: " << st;}
+    if (!st) {
+        return;
+    }
+    for (std::size_t i = 1; i < readers.size(); ++i) {
+        service.notify(readers[i], false);
+    }
+}
+bool ReaderChangesMonitor::canIdle() const {
+    if (wakeRequested || idleTimeout == boost::chrono::steady_clock::duration::zero()) {
+        return false;
+    }
+    if (boost::chrono::steady_clock::now() < activeUntil) {
+        return false;
+    }
+    return !manager.hasListeners();
+}
+bool ReaderChangesMonitor::park() {
+    boost::unique_lock<boost::mutex> lock(idleMutex);
+    if (stopRequested || !canIdle()) {
+        return false;
+    }
+    {XFS::Logger() << "Reader changes dispatch thread idle";}
+    Diagnostics::TimelineEvent("idle", "monitor");
+    idle = true;
+    while (!stopRequested && canIdle()) {
+        idleChanged.wait(lock);
+    }
+    idle = false;
+    {XFS::Logger() << "Reader changes dispatch thread resumed";}
+    Diagnostics::TimelineEvent("resume", "monitor");
+    return true;
 }
\ No newline at end of file
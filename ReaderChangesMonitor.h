@@ -3,15 +3,22 @@
 
 #pragma once
 
+#include <map>
+#include <string>
 #include <vector>
 
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 
 // PC/CS API -- для SCARD_READERSTATE
 #include <winscard.h>
 
 class Manager;
+class Service;
 class ReaderChangesMonitor {
     /// Объект для общения с подсистемой PC/SC и для получения величины таймаута
     /// ожидания изменений в считывателях, для возможности корреткно обрабатывать
@@ -21,9 +28,35 @@ class ReaderChangesMonitor {
     boost::shared_ptr<boost::thread> waitChangesThread;
     /// Флаг, выставляемый основным потоком, когда возникнет необходимость остановить
     /// `waitChangesThread`.
-    bool stopRequested;
+    boost::atomic<bool> stopRequested;
+    /// Поток ожидания изменений еще не завершился, в том числе после того, как `stop` не
+    /// дождался его и отсоединил. Сбрасывается самим потоком под `idleMutex`.
+    boost::atomic<bool> active;
+    /// Флаг, выставляемый при добавлении сервиса, когда нужно сообщить новому сервису
+    /// известное состояние всех считывателей.
+    boost::atomic<bool> resyncRequested;
+    /// Последнее известное состояние считывателей по их именам, сохраняется между
+    /// перечитываниями списка считывателей. Используется только потоком ожидания.
+    std::map<std::string, DWORD> knownStates;
+
+    /// Защищает состояние простоя потока ожидания изменений.
+    boost::mutex idleMutex;
+    /// Будит простаивающий поток.
+    boost::condition_variable idleChanged;
+    /// Поток простаивает: изменения в считывателях никому не нужны, и `SCardGetStatusChange`
+    /// не вызывается.
+    bool idle;
+    /// Выставляется `cancel` и `wake`, чтобы пробуждение, запрошенное, пока поток еще только
+    /// собирается простаивать, не потерялось. Сбрасывается перед каждым ожиданием изменений.
+    bool wakeRequested;
+    /// Сколько поток продолжает опрос после последнего обращения сервиса, когда нет ни задач,
+    /// ни подписчиков. Нулевое значение означает, что поток никогда не простаивает.
+    boost::chrono::steady_clock::duration idleTimeout;
+    /// До этого момента поток не уходит в простой, см. `sync`.
+    boost::chrono::steady_clock::time_point activeUntil;
 public:
-    /** Запускает поток ожидания изменений в считывателях.
+    /** Создает монитор. Поток ожидания изменений запускается позже, вызовом `start`,
+        когда менеджер откроет контекст PC/SC для первого сервиса.
     
     @param manager
         Объект, через который осуществляется общение с подсистемой PC/SC для
@@ -33,6 +66,31 @@ public:
     /// Запрашивает останов потока отслеживания изменений и ждет его завершения.
     ~ReaderChangesMonitor();
 
+    /** Запускает поток ожидания изменений. Поток не должен быть запущен. Если прежний поток был
+        отсоединен `stop`, сначала дожидается его завершения: контекст PC/SC, в котором он ждал,
+        к этому моменту уже закрыт, поэтому ждать недолго.
+    */
+    void start();
+    /// Работает ли поток ожидания изменений, в том числе отсоединенный `stop`.
+    inline bool running() const { return active; }
+    /** Запрашивает останов потока отслеживания изменений и ждет его завершения, например,
+        чтобы заменить контекст PC/SC, через который ожидаются изменения. Если поток не
+        запущен, ничего не делает.
+    @par
+        `SCardCancel` прерывает только уже начатое ожидание, поэтому отмена повторяется, пока
+        поток не завершится. Если он не завершился к дедлайну, то отсоединяется, а узнать о его
+        завершении можно через `running`.
+
+    @param reason
+        Причина останова, для журнала.
+    @param deadline
+        Момент, до которого ждать завершения потока.
+
+    @return
+        `true`, если поток завершился или не был запущен, `false`, если он отсоединен.
+    */
+    bool stop(const char* reason, boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::time_point::max());
+
     /** Прерывает ожидание изменений.
 
     @param reason
@@ -40,7 +98,41 @@ public:
         добавление новой задачи (нужно пересчитать таймаут) или сервиса (ему нужно
         доставить сообщения о статусе считывателей).
     */
-    void cancel(const char* reason) const;
+    void cancel(const char* reason);
+    /** Будит поток, если он простаивает, не прерывая ожидание изменений, если он работает.
+        Используется, когда у изменений появляется новый получатель, например, подписчик.
+
+    @param reason
+        Причина пробуждения, для журнала.
+    */
+    void wake(const char* reason);
+    /** Прерывает ожидание изменений и заставляет на следующем витке сообщить известное
+        состояние всех считывателей сервисам, которые его еще не получали (см. `Manager::notifySnapshot`).
+
+    @param reason
+        Причина повторного опроса, для журнала.
+    */
+    void resync(const char* reason);
+public:// Простой
+    /** Задает, сколько поток ожидания продолжает опрос считывателей, когда изменения никому
+        не нужны: нет ни задач, ни подписчиков на события, а сервисы не выполняли команд.
+        После этого поток простаивает и не обращается к подсистеме PC/SC.
+
+    @param seconds
+        Время в секундах. 0 отключает простой.
+    */
+    void setIdleTimeout(unsigned long seconds);
+    /** Сообщает, что сервису сейчас нужно актуальное состояние считывателей, например, перед
+        выполнением команды. Продлевает работу потока на время простоя (см. `setIdleTimeout`),
+        а если поток уже простаивает, сообщает сервису текущее состояние считывателей, опросив
+        их без ожидания, и будит поток. Не блокирует вызывающий поток дольше опроса PC/SC.
+
+    @param service
+        Сервис, которому нужно состояние считывателей.
+    @param reason
+        Причина, для журнала.
+    */
+    void sync(Service& service, const char* reason);
 private:// Опрос изменений
     /** Функция для запуска в другом потоке для ожидания изменений в считывателях.
         Блокирует выполнение потока, пока не будет обнаружено изменение. Данная функция
@@ -58,6 +150,13 @@ private:// Опрос изменений
         Новое состояние, описывающее элемент наблюдения за подключенными считывателями.
     */
     DWORD getReadersAndWaitChanges(DWORD readersState);
+    /** Сообщает об отключении считывателей, которые были известны, но пропали из нового
+        списка, не успев сообщить о своем отключении через `SCardGetStatusChange`.
+
+    @param names
+        Новый список считывателей.
+    */
+    void notifyVanished(const std::vector<const char*>& names);
 
     /** Данная функция блокирует выполнение до тех пор, пока не получит событие об изменении состояния
         физических устройств, поэтому она должна вызываться в отдельном потоке. После наступления
@@ -72,6 +171,23 @@ private:// Опрос изменений
         `true`, если произошли изменения в количестве считывателей, `false` иначе.
     */
     bool waitChanges(std::vector<SCARD_READERSTATE>& readers);
+    /** Получает имена доступных считывателей.
+    @param readerNames
+        Буфер, в котором размещаются имена. Возвращаемые указатели ссылаются на него.
+    */
+    std::vector<const char*> listReaders(std::vector<char>& readerNames);
+    /** Сообщает сервису текущее состояние всех считывателей, опрашивая их с нулевым таймаутом.
+        Вызывается под `idleMutex`, когда поток простаивает и поэтому не обращается ни к PC/SC,
+        ни к сервисам.
+    */
+    void notifyCurrent(Service& service);
+    /// Может ли поток уйти в простой. Вызывается под `idleMutex`.
+    bool canIdle() const;
+    /** Простаивает, пока изменения в считывателях никому не нужны.
+    @return
+        `true`, если поток простаивал и состояние считывателей нужно узнать заново.
+    */
+    bool park();
 };
 
 #endif // PCSC_CENXFS_BRIDGE_ReaderChangesMonitor_H
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "Diagnostics/RecordingBackend.h"
+
+#include "Diagnostics/SessionRecorder.h"
+
+#include <boost/chrono/chrono.hpp>
+
+namespace bc = boost::chrono;
+
+namespace Diagnostics {
+    RecordingBackend& RecordingBackend::instance() {
+        static RecordingBackend* backend = new RecordingBackend();
+        return *backend;
+    }
+    RecordingBackend::RecordingBackend() : mBackend(&PCSC::Backend::native()) {}
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    LONG RecordingBackend::establishContext(LPSCARDCONTEXT phContext) {
+        return mBackend->establishContext(phContext);
+    }
+    LONG RecordingBackend::releaseContext(SCARDCONTEXT hContext) {
+        return mBackend->releaseContext(hContext);
+    }
+    LONG RecordingBackend::listReaders(SCARDCONTEXT hContext, LPSTR mszReaders, LPDWORD pcchReaders) {
+        return mBackend->listReaders(hContext, mszReaders, pcchReaders);
+    }
+    LONG RecordingBackend::getStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout,
+                                           SCARD_READERSTATE* rgReaderStates, DWORD cReaders) {
+        LONG st = mBackend->getStatusChange(hContext, dwTimeout, rgReaderStates, cReaders);
+        SessionRecorder& recorder = SessionRecorder::instance();
+        if (!recorder.enabled()) {
+            return st;
+        }
+        // Список считывателей сверяется при каждом ожидании, а не при его получении, т.к. запись
+        // может начаться в любой момент, а повторно список запрашивается только при изменении.
+        recorder.readers(rgReaderStates, cReaders);
+        for (DWORD i = 1; i < cReaders; ++i) {
+            if (rgReaderStates[i].dwEventState & SCARD_STATE_CHANGED) {
+                recorder.state(rgReaderStates[i]);
+            }
+        }
+        return st;
+    }
+    LONG RecordingBackend::cancel(SCARDCONTEXT hContext) {
+        return mBackend->cancel(hContext);
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    LONG RecordingBackend::connect(SCARDCONTEXT hContext, LPCSTR szReader, DWORD dwShareMode,
+                                   DWORD dwPreferredProtocols, LPSCARDHANDLE phCard, LPDWORD pdwActiveProtocol) {
+        LONG st = mBackend->connect(hContext, szReader, dwShareMode, dwPreferredProtocols, phCard, pdwActiveProtocol);
+        if (st == SCARD_S_SUCCESS) {
+            SessionRecorder::instance().connect(szReader, *phCard, *pdwActiveProtocol);
+        }
+        return st;
+    }
+    LONG RecordingBackend::reconnect(SCARDHANDLE hCard, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                                     DWORD dwInitialization, LPDWORD pdwActiveProtocol) {
+        return mBackend->reconnect(hCard, dwShareMode, dwPreferredProtocols, dwInitialization, pdwActiveProtocol);
+    }
+    LONG RecordingBackend::disconnect(SCARDHANDLE hCard, DWORD dwDisposition) {
+        LONG st = mBackend->disconnect(hCard, dwDisposition);
+        SessionRecorder::instance().disconnect(hCard);
+        return st;
+    }
+    LONG RecordingBackend::beginTransaction(SCARDHANDLE hCard) {
+        return mBackend->beginTransaction(hCard);
+    }
+    LONG RecordingBackend::endTransaction(SCARDHANDLE hCard, DWORD dwDisposition) {
+        return mBackend->endTransaction(hCard, dwDisposition);
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    LONG RecordingBackend::status(SCARDHANDLE hCard, LPSTR szReaderName, LPDWORD pcchReaderLen,
+                                  LPDWORD pdwState, LPDWORD pdwProtocol, LPBYTE pbAtr, LPDWORD pcbAtrLen) {
+        return mBackend->status(hCard, szReaderName, pcchReaderLen, pdwState, pdwProtocol, pbAtr, pcbAtrLen);
+    }
+    LONG RecordingBackend::transmit(SCARDHANDLE hCard, const SCARD_IO_REQUEST* pioSendPci,
+                                    LPCBYTE pbSendBuffer, DWORD cbSendLength,
+                                    LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength) {
+        SessionRecorder& recorder = SessionRecorder::instance();
+        if (!recorder.enabled()) {
+            return mBackend->transmit(hCard, pioSendPci, pbSendBuffer, cbSendLength, pbRecvBuffer, pcbRecvLength);
+        }
+        bc::steady_clock::time_point start = bc::steady_clock::now();
+        LONG st = mBackend->transmit(hCard, pioSendPci, pbSendBuffer, cbSendLength, pbRecvBuffer, pcbRecvLength);
+        recorder.transmit(hCard,
+            pbSendBuffer, cbSendLength,
+            pbRecvBuffer, *pcbRecvLength,
+            bc::steady_clock::now() - start, st
+        );
+        return st;
+    }
+    LONG RecordingBackend::getAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen) {
+        return mBackend->getAttrib(hCard, dwAttrId, pbAttr, pcbAttrLen);
+    }
+} // namespace Diagnostics
@@ -7,9 +7,17 @@
 #include "PCSC/ProtocolTypes.h"
 #include "PCSC/ReaderState.h"
 
+#include "Utils/Hex.h"
+
+#include "Diagnostics/ApduStats.h"
+#include "Diagnostics/FlightRecorder.h"
+
 #include "XFS/Logger.h"
 #include "XFS/Memory.h"
+#include "XFS/Result.h"
 
+// Для std::min
+#include <algorithm>
 #include <cassert>
 // Для std::memcpy
 #include <cstring>
@@ -18,22 +26,6 @@
 // Для работы с текущим временем, для получения времени дедлайна.
 #include <boost/chrono/chrono.hpp>
 
-class Hex {
-    const char* mBegin;
-    const char* mEnd;
-private:
-    friend inline XFS::Logger& operator<<(XFS::Logger& os, const Hex& h) {
-        os << std::hex << std::setfill('0');
-        for (const char* it = h.mBegin; it < h.mEnd; ++it) {
-            unsigned int value = *it & 0xFF;
-            os << std::setw(2) << value << ' ';
-        }
-        return os;
-    }
-public:
-    Hex(LPBYTE begin, ULONG count) : mBegin((const char*)begin), mEnd((const char*)begin + count) {}
-};
-
 class CardReadTask : public Task {
     /// Данные, которые должны быть прочитаны.
     XFS::ReadFlags mFlags;
@@ -53,38 +45,37 @@ public:
         if (added & SCARD_STATE_PRESENT) {
             {XFS::Logger() << "Service " << mService.handle() << ": Card inserted to reader '" << state.szReader << "', read flags: " << mFlags; }
 
-            WFSIDCCARDDATA** result = mService.wrap(translate(state), mFlags);
+            XFS::Result result(ReqID, serviceHandle(), WFS_SUCCESS);
+            mService.wrap(result, translate(state), mFlags);
             // Уведомляем поставщика задачи, что она выполнена.
-            XFS::Result(ReqID, serviceHandle(), WFS_SUCCESS).attach(result).send(hWnd, WFS_EXECUTE_COMPLETE);
+            result.send(hWnd, WFS_EXECUTE_COMPLETE);
             // Задача обработана, можно удалять из списка.
             return true;
         }
         return false;
     }
 private:
-    WFSIDCCARDDATA* translate(const SCARD_READERSTATE& state) const {
-        //TODO: Возможно, необходимо выделять память через WFSAllocateMore
-        WFSIDCCARDDATA* data = XFS::alloc<WFSIDCCARDDATA>();
-        // data->lpbData содержит ATR (Answer To Reset), прочитанный с чипа
-        data->wDataSource = WFS_IDC_CHIP;
-        data->wStatus = WFS_IDC_DATAOK;
-        data->ulDataLength = state.cbAtr;
-        data->lpbData = XFS::allocArr<BYTE>(state.cbAtr);
-        std::memcpy(data->lpbData, state.rgbAtr, state.cbAtr);
-        {XFS::Logger() << "Service " << mService.handle() << ": ATR=" << Hex(data->lpbData, data->ulDataLength);}
-        return data;
+    Service::Atr translate(const SCARD_READERSTATE& state) const {
+        Service::Atr atr;
+        atr.size = std::min(state.cbAtr, (DWORD)sizeof(atr.data));
+        std::memcpy(atr.data, state.rgbAtr, atr.size);
+        {XFS::Logger() << "Service " << mService.handle() << ": ATR=" << Hex(atr.data, atr.size);}
+        return atr;
     }
 };
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-Service::Service(Manager& pcsc, HSERVICE hService, const Settings& settings)
+Service::Service(Manager& pcsc, HSERVICE hService, const Settings::Ptr& settings)
     : pcsc(pcsc)
     , hService(hService)
     , hCard(0)
     , mActiveProtocol(0)
-    , mBindedReaderName(settings.readerName)
+    , mBindedReaderName(settings->readerName)
     , mSettings(settings)
+    , mSettingsGeneration(0)
+    , mTraceLevel(settings->traceLevel)
     , mInited(false)
+    , mCardReported(false)
 {
 }
 Service::~Service() {
@@ -95,13 +86,15 @@ Service::~Service() {
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 PCSC::Status Service::open(const char* readerName) {
     assert(hCard == 0 && "Must open only one card at one service");
-    PCSC::Status st = SCardConnect(pcsc.context(), readerName,
-        mSettings.exclusive ? SCARD_SHARE_EXCLUSIVE : SCARD_SHARE_SHARED,
+    // Вызывается из потока отслеживания изменений, поэтому снимок берется через settings().
+    PCSC::Status st = pcsc.backend().connect(pcsc.context(), readerName,
+        settings()->exclusive ? SCARD_SHARE_EXCLUSIVE : SCARD_SHARE_SHARED,
         // У нас нет предпочитаемого протокола, работаем с тем, что дают
         SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1,
         // Получаем хендл карты и выбранный протокол.
         &hCard, (DWORD*)&mActiveProtocol
     );
+    Diagnostics::flightPCSC("SCardConnect", (unsigned long)hCard, st.value());
     {
         XFS::Logger()
             << "SCardConnect(hContext=" << pcsc.context()
@@ -118,30 +111,86 @@ PCSC::Status Service::open(const char* readerName) {
 PCSC::Status Service::close() {
     assert(hCard != 0 && "Attempt disconnect from non-connected card");
     // При закрытии соединения ничего не делаем с карточкой, оставляем ее в считывателе.
-    PCSC::Status st = SCardDisconnect(hCard, SCARD_LEAVE_CARD);
+    PCSC::Status st = pcsc.backend().disconnect(hCard, SCARD_LEAVE_CARD);
+    Diagnostics::flightPCSC("SCardDisconnect", (unsigned long)hCard, st.value());
     {XFS::Logger() << "SCardDisconnect(hCard=" << hCard << ", SCARD_LEAVE_CARD) = " << st; }
     hCard = 0;
     // Сбрасываем привязку на привязку из настроек. Таким образом, если в настойках
     // не указано конкретного считывателя, то прявязка будет пустая и сервис привяжется
     // к первому считывателю, в котором он обнаружит карточку. Если же конкретный считыватель
     // будет указан, то сервис будет игнорировать все события, кроме как от этого считывателя.
-    mBindedReaderName = mSettings.readerName;
+    mBindedReaderName = settings()->readerName;
     return st;
 }
+void Service::updateSettings() {
+    SettingsCache& cache = SettingsCache::instance();
+    // Поколение читается до снимка: если снимок заменят между ними, следующая
+    // проверка увидит новое поколение и сверит снимок еще раз.
+    const unsigned long generation = cache.generation();
+    if (generation == mSettingsGeneration) {
+        return;
+    }
+    mSettingsGeneration = generation;
+    Settings::Ptr snapshot = cache.snapshot(mSettings->providerName);
+    if (snapshot == mSettings) {
+        return;
+    }
+    if (snapshot->traceLevel != mSettings->traceLevel) {
+        mTraceLevel = snapshot->traceLevel;
+    }
+    {XFS::Logger() << "Service " << handle() << ": settings updated: " << snapshot->toJSONString();}
+    boost::atomic_store(&mSettings, snapshot);
+}
 
 PCSC::Status Service::lock() {
-    PCSC::Status st = SCardBeginTransaction(hCard);
+    PCSC::Status st = pcsc.backend().beginTransaction(hCard);
+    Diagnostics::flightPCSC("SCardBeginTransaction", (unsigned long)hCard, st.value());
     {XFS::Logger() << "SCardBeginTransaction(hCard=" << hCard << ") = " << st; }
 
     return st;
 }
+void Service::asyncLock(DWORD dwTimeOut, HWND hWnd, REQUESTID ReqID) {
+    // Без соединения с картой транзакцию начать нельзя, ошибку PC/SC возвращаем сразу.
+    if (hCard == 0) {
+        XFS::Result(ReqID, handle(), lock()).send(hWnd, WFS_LOCK_COMPLETE);
+        return;
+    }
+    bc::steady_clock::time_point deadline = dwTimeOut == WFS_INDEFINITE_WAIT
+        ? bc::steady_clock::time_point::max()
+        : pcsc.clock().now() + bc::milliseconds(dwTimeOut);
+    pcsc.lock(LockTask::Ptr(new LockTask(deadline, *this, hWnd, ReqID, hCard, mBindedReaderName)));
+}
 PCSC::Status Service::unlock() {
     // Заканчиваем транзакцию, ничего не делаем с картой.
-    PCSC::Status st = SCardEndTransaction(hCard, SCARD_LEAVE_CARD);
+    PCSC::Status st = pcsc.backend().endTransaction(hCard, SCARD_LEAVE_CARD);
+    Diagnostics::flightPCSC("SCardEndTransaction", (unsigned long)hCard, st.value());
     {XFS::Logger() << "SCardEndTransaction(hCard=" << hCard << ", SCARD_LEAVE_CARD) = " << st; }
 
     return st;
 }
+void Service::notifyDeviceState(const SCARD_READERSTATE& state) {
+    const DWORD deviceState = PCSC::ReaderState(state.dwEventState).translate();
+    std::map<std::string, DWORD>::iterator it = mDeviceStates.find(state.szReader);
+    const DWORD reported = it != mDeviceStates.end() ? it->second : WFS_STAT_DEVONLINE;
+    if (deviceState == reported) {
+        return;
+    }
+    // О возвращении считывателя сообщаем всегда, если о его пропаже было сообщено. Об остальных
+    // изменениях -- только для считывателя, который представляет сервис: привязанного или любого,
+    // если привязки нет.
+    const bool represented = mBindedReaderName.empty() || mBindedReaderName == state.szReader;
+    if (it == mDeviceStates.end() && !represented) {
+        return;
+    }
+    if (deviceState == WFS_STAT_DEVONLINE) {
+        mDeviceStates.erase(it);
+    } else if (it != mDeviceStates.end()) {
+        it->second = deviceState;
+    } else {
+        mDeviceStates.insert(std::make_pair(std::string(state.szReader), deviceState));
+    }
+    EventNotifier::notify(WFS_SYSTEM_EVENT, PCSC::DeviceDetected(*this, pcsc.deviceStatus(state.szReader), deviceState));
+}
 bool Service::match(const SCARD_READERSTATE& state, bool deviceChange) {
     // Изменения в количестве считывателей нас не интересуют.
     if (deviceChange) {
@@ -159,6 +208,9 @@ bool Service::match(const SCARD_READERSTATE& state, bool deviceChange) {
 }
 
 void Service::notify(const SCARD_READERSTATE& state, bool deviceChange) {
+    if (!deviceChange) {
+        notifyDeviceState(state);
+    }
     // Если изменения нас не интересуют, выходим.
     if (!match(state, deviceChange)) {
         return;
@@ -178,22 +230,29 @@ void Service::notify(const SCARD_READERSTATE& state, bool deviceChange) {
     DWORD forCheck = mInited ? added : state.dwEventState;
     mInited = true;
     {XFS::Logger() << "Service::notify: reader=" << state.szReader << ", state=" << PCSC::ReaderState(state.dwEventState) << ", added=" << PCSC::ReaderState(added); }
-    /*if (forCheck & SCARD_STATE_) {
-        EventNotifier::notify(WFS_SYSTEM_EVENT, PCSC::DeviceDetected(*this, state));
-    }*/
-    if (forCheck & SCARD_STATE_EMPTY) {
-        EventNotifier::notify(WFS_SERVICE_EVENT, PCSC::CardRemoved(*this));
+    // Отключенный считыватель уносит карту с собой, но SCARD_STATE_EMPTY о нем уже не придет.
+    const bool lost = (forCheck & SCARD_STATE_UNKNOWN) != 0;
+    // Об извлечении сообщаем, только если было о чем: пустой считыватель, заново
+    // опрошенный монитором, ничего не меняет.
+    if (((forCheck & SCARD_STATE_EMPTY) || lost) && (hCard != 0 || mCardReported)) {
+        // Соединение закрываем до уведомления, иначе запрос, выданный приложением сразу
+        // после получения события, еще увидит карту.
         if (hCard != 0) {
             close();
         }
+        mCardReported = false;
+        EventNotifier::notify(WFS_SERVICE_EVENT, PCSC::CardRemoved(*this));
     }
-    if (forCheck & SCARD_STATE_PRESENT) {
+    // Повторное уведомление о той же карте приходит, когда монитор заново опрашивает
+    // считыватели (например, после простоя), соединение уже есть или о карте уже сообщено.
+    if ((forCheck & SCARD_STATE_PRESENT) && hCard == 0 && !mCardReported) {
         open(state.szReader);
+        mCardReported = true;
         EventNotifier::notify(WFS_EXECUTE_EVENT, PCSC::CardInserted(*this));
     }
 }
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-std::pair<WFSIDCSTATUS*, PCSC::Status> Service::getStatus() {
+PCSC::Status Service::getStatus(XFS::Result& result) {
     // Состояние считывателя.
     PCSC::MediaStatus state;
     DWORD nameLen = 0;
@@ -201,7 +260,7 @@ std::pair<WFSIDCSTATUS*, PCSC::Status> Service::getStatus() {
     // Если карточки не будет в считывателе, то вернется ошибка и в ответ мы дадим WFS_IDC_MEDIANOTPRESENT
     PCSC::Status st = SCARD_S_SUCCESS;
     if (hCard != 0) {
-        st = SCardStatus(hCard,
+        st = pcsc.backend().status(hCard,
             // Имя получать не будем, тем не менее длину получить требуется, NULL недопустим.
             NULL, &nameLen,
             // Небольшой хак допустим, у нас прозрачная обертка, ничего лишнего.
@@ -209,11 +268,11 @@ std::pair<WFSIDCSTATUS*, PCSC::Status> Service::getStatus() {
             // ATR получать не будем, тем не менее длину получить требуется, NULL недопустим.
             NULL, &atrLen
         );
+        Diagnostics::flightPCSC("SCardStatus", (unsigned long)hCard, st.value());
         {XFS::Logger() << "SCardStatus(hCard=" << hCard << ", ..., state=&" << state << ", dwActiveProtocol=&" << mActiveProtocol << ", ...) = " << st; }
     }
     bool hasCard = hCard != 0 && st;
-    //TODO: Возможно, необходимо выделять память через WFSAllocateMore
-    WFSIDCSTATUS* lpStatus = XFS::alloc<WFSIDCSTATUS>();
+    WFSIDCSTATUS* lpStatus = result.allocate(XFS::Layout().add<WFSIDCSTATUS>(), "Service::getStatus").take<WFSIDCSTATUS>();
     // Набор флагов, определяющих состояние устройства. Наше устройство всегда на связи,
     // т.к. в противном случае при открытии сессии с PC/SC драйвером будет ошибка.
     lpStatus->fwDevice = WFS_IDC_DEVONLINE;
@@ -228,18 +287,19 @@ std::pair<WFSIDCSTATUS*, PCSC::Status> Service::getStatus() {
     lpStatus->usCards = 0;
     lpStatus->fwChipPower = hasCard ? state.translateChipPower() : WFS_IDC_CHIPNOCARD;
     //TODO: Добавить lpszExtra со всеми параметрами, полученными от PC/SC.
-    return std::make_pair(lpStatus, st);
+    result.attach(lpStatus);
+    return st;
 }
-std::pair<WFSIDCCAPS*, PCSC::Status> Service::getCaps() const {
-    //TODO: Возможно, необходимо выделять память через WFSAllocateMore
-    WFSIDCCAPS* lpCaps = XFS::alloc<WFSIDCCAPS>();
+PCSC::Status Service::getCaps(XFS::Result& result) const {
+    WFSIDCCAPS* lpCaps = result.allocate(XFS::Layout().add<WFSIDCCAPS>(), "Service::getCaps").take<WFSIDCCAPS>();
 
     // Получаем поддерживаемые картой протоколы.
     PCSC::ProtocolTypes types;
     DWORD len = sizeof(DWORD);
     PCSC::Status st = SCARD_S_SUCCESS;
     if (hCard != 0) {
-        st = SCardGetAttrib(hCard, SCARD_ATTR_PROTOCOL_TYPES, (BYTE*)&types, &len);
+        st = pcsc.backend().getAttrib(hCard, SCARD_ATTR_PROTOCOL_TYPES, (BYTE*)&types, &len);
+        Diagnostics::flightPCSC("SCardGetAttrib", (unsigned long)hCard, st.value());
         {XFS::Logger() << "SCardGetAttrib(hCard=" << hCard << ", attr=SCARD_ATTR_PROTOCOL_TYPES, types=&" << types << "...) = " << st; }
     }
     bool hasCard = hCard != 0 && st;
@@ -252,7 +312,7 @@ std::pair<WFSIDCCAPS*, PCSC::Status> Service::getCaps() const {
     // Какие треки могут быть прочитаны -- никакие, только чип.
     // Так как Kalignite не желает работать, если считыватель не умеет читать хоть какой-то
     // трек, то сообщаем, что умеем читать самый востребованный, чтобы удовлетворить Kaliginte.
-    lpCaps->fwReadTracks = mSettings.workarounds.track2.report ? WFS_IDC_TRACK2 : WFS_IDC_NOTSUPP;
+    lpCaps->fwReadTracks = mSettings->workarounds.track2.report ? WFS_IDC_TRACK2 : WFS_IDC_NOTSUPP;
     // Какие треки могут быть записаны -- никакие, только чип.
     lpCaps->fwWriteTracks = WFS_IDC_NOTSUPP;
     // Виды поддерживаемых устройством протоколов -- все возможные.
@@ -277,7 +337,8 @@ std::pair<WFSIDCCAPS*, PCSC::Status> Service::getCaps() const {
     //TODO: Получить реальные возможности считывателя. Пока предполагаем, что все возможности есть.
     lpCaps->fwChipPower = WFS_IDC_CHIPPOWERCOLD | WFS_IDC_CHIPPOWERWARM | WFS_IDC_CHIPPOWEROFF;
     //TODO: Добавить lpszExtra со всеми параметрами, полученными от PC/SC.
-    return std::make_pair(lpCaps, st);
+    result.attach(lpCaps);
+    return st;
 }
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 void Service::asyncRead(DWORD dwTimeOut, HWND hWnd, REQUESTID ReqID, XFS::ReadFlags forRead) {
@@ -285,102 +346,91 @@ void Service::asyncRead(DWORD dwTimeOut, HWND hWnd, REQUESTID ReqID, XFS::ReadFl
     // информацию можно послать сразу.
     if (hCard == 0) {
         namespace bc = boost::chrono;
-        bc::steady_clock::time_point now = bc::steady_clock::now();
+        bc::steady_clock::time_point now = pcsc.clock().now();
         pcsc.addTask(Task::Ptr(new CardReadTask(now + bc::milliseconds(dwTimeOut), *this, hWnd, ReqID, forRead)));
     } else {
-        WFSIDCCARDDATA** result = wrap(readChip(), forRead);
+        Atr atr;
+        readATR(atr);
+        XFS::Result result(ReqID, handle(), WFS_SUCCESS);
+        wrap(result, atr, forRead);
         // Уведомляем поставщика задачи, что она выполнена.
-        XFS::Result(ReqID, handle(), WFS_SUCCESS).attach(result).send(hWnd, WFS_EXECUTE_COMPLETE);
+        result.send(hWnd, WFS_EXECUTE_COMPLETE);
     }
 }
-std::pair<DWORD, BYTE*> Service::readATR() const {
+PCSC::Status Service::readATR(Atr& atr) const {
     assert(hCard != 0 && "Service::readATR: Attempt read ATR when card not in the reader");
 
     {XFS::Logger() << "Read ATR (hCard=" << hCard << ')'; }
-    
-    std::pair<DWORD, BYTE*> result;
 
-    // Получаем ATR (Answer To Reset). Сначала длину, потом сами данные.
-    PCSC::Status st = SCardGetAttrib(hCard, SCARD_ATTR_ATR_STRING, NULL, &result.first);
-    {XFS::Logger() << "SCardGetAttrib(hCard=" << hCard << ", SCARD_ATTR_ATR_STRING, ..., size=&" << result.first << ") = " << st; }
-    //TODO: Возможно, необходимо выделять память через WFSAllocateMore
-    result.second = XFS::allocArr<BYTE>(result.first);
-    st = SCardGetAttrib(hCard, SCARD_ATTR_ATR_STRING, result.second, &result.first);
+    // Получаем ATR (Answer To Reset). Буфера хватает для ATR максимальной длины,
+    // поэтому длину отдельно не запрашиваем.
+    atr.size = sizeof(atr.data);
+    PCSC::Status st = pcsc.backend().getAttrib(hCard, SCARD_ATTR_ATR_STRING, atr.data, &atr.size);
+    Diagnostics::flightPCSC("SCardGetAttrib", (unsigned long)hCard, st.value());
+    if (!st) {
+        atr.size = 0;
+    }
     {
         XFS::Logger l;
         l << "SCardGetAttrib(hCard=" << hCard << ", SCARD_ATTR_ATR_STRING, atr=&["
-          << Hex(result.second, result.first) << "], size=&" << result.first << ") = " << st;
+          << Hex(atr.data, atr.size) << "], size=&" << atr.size << ") = " << st;
     }
-    return result;
-}
-WFSIDCCARDDATA* Service::readChip() const {
-    assert(hCard != 0 && "Service::readChip: Attempt read ATR when card not in the reader");
-
-    {XFS::Logger() << "Read chip (hCard=" << hCard << ')'; }
-    //TODO: Возможно, необходимо выделять память через WFSAllocateMore
-    WFSIDCCARDDATA* data = XFS::alloc<WFSIDCCARDDATA>();
-    // data->lpbData содержит ATR (Answer To Reset), прочитанный с чипа
-    data->wDataSource = WFS_IDC_CHIP;
-    //TODO: Статус прочитанных данных необходимо выставлять в соответствии со статусом,
-    // который вернула SCardGetAttrib.
-    data->wStatus = WFS_IDC_DATAOK;
-
-    std::pair<DWORD, BYTE*> atr = readATR();
-    data->ulDataLength = atr.first;
-    data->lpbData = atr.second;
-    return data;
+    return st;
 }
-WFSIDCCARDDATA* Service::readTrack2() const {
-    assert(hCard != 0 && "Attempt read TRACK2 when card not in the reader");
-    assert(mSettings.workarounds.track2.report == true && "Attempt read TRACK2 when setting Workarounds.Track2.Report is false");
+void Service::wrap(XFS::Result& result, const Atr& atr, XFS::ReadFlags forRead) const {
+    assert((forRead.value() & WFS_IDC_CHIP) && "Service::wrap: Chip data not requested");
+    // Может вызываться из потока отслеживания изменений.
+    const Settings::Ptr snapshot = settings();
+    // Kalignite требует, чтобы track2 мог читаться устройством, иначе он падает.
+    // Поэтому, если такая информация запрошена и у нас в настройках сказано ее отдать,
+    // то эмулируем ее наличие.
+    const bool track2 = (forRead.value() & WFS_IDC_TRACK2) && snapshot->workarounds.track2.report;
+    const std::string& track2Value = snapshot->workarounds.track2.value;
 
-    {XFS::Logger() << "Read track2 (hCard=" << hCard << ')'; }
-    std::size_t size = mSettings.workarounds.track2.value.size();
-    //TODO: Возможно, необходимо выделять память через WFSAllocateMore
-    WFSIDCCARDDATA* data = XFS::alloc<WFSIDCCARDDATA>();
-    data->wDataSource  = WFS_IDC_TRACK2;
-    data->wStatus      = size != 0 ? WFS_IDC_DATAOK : WFS_IDC_DATAMISSING;
-    if (size != 0) {
-        data->ulDataLength = size;
-        data->lpbData      = XFS::allocArr<BYTE>(size);
-        std::memcpy(data->lpbData, mSettings.workarounds.track2.value.c_str(), size);
+    // Массив указателей на WFSIDCCARDDATA, в поледнем элементе NULL -- признак конца массива.
+    // За ним сами структуры и их данные.
+    const std::size_t count = forRead.size();
+    XFS::Layout layout;
+    layout.add<WFSIDCCARDDATA*>(count + 1).add<WFSIDCCARDDATA>(count).add<BYTE>(atr.size);
+    if (track2) {
+        layout.add<BYTE>(track2Value.size());
     }
-    return data;
-}
-
-WFSIDCCARDDATA** Service::wrap(WFSIDCCARDDATA* iccData, XFS::ReadFlags forRead) const {
-    assert((forRead.value() & WFS_IDC_CHIP) && "Service::wrap: Chip data not requested");
-    // Данный вызов вернет заполненный нулями массив под два указателя на WFSIDCCARDDATA.
-    // В поледнем элементе NULL -- признак конца массива.
-    //TODO: Возможно, необходимо выделять память через WFSAllocateMore
-    WFSIDCCARDDATA** result = XFS::allocArr<WFSIDCCARDDATA*>(forRead.size() + 1);
+    XFS::Block block = result.allocate(layout, "Service::wrap");
+    WFSIDCCARDDATA** list = block.take<WFSIDCCARDDATA*>(count + 1);
+    WFSIDCCARDDATA* items = block.take<WFSIDCCARDDATA>(count);
 
     std::size_t j = 0;
     for (std::size_t i = 0; i < XFS::ReadFlags::count; ++i) {
-        XFS::ReadFlags::type flag = (1 << i);
+        XFS::ReadFlags::type flag = ((XFS::ReadFlags::type)1 << i);
         if (forRead.value() & flag) {
             {XFS::Logger() << "Read " << XFS::ReadFlags(flag); }
+            WFSIDCCARDDATA* data = &items[j];
+            data->wDataSource = flag;
             if (flag == WFS_IDC_CHIP) {
-                result[j] = iccData;
+                // data->lpbData содержит ATR (Answer To Reset), прочитанный с чипа
+                //TODO: Статус прочитанных данных необходимо выставлять в соответствии со статусом,
+                // который вернула SCardGetAttrib.
+                data->wStatus = WFS_IDC_DATAOK;
+                data->ulDataLength = atr.size;
+                data->lpbData = block.copy(atr.data, atr.size);
             } else
-            // Kalignite требует, чтобы track2 мог читаться устройством, иначе он падает.
-            // Поэтому, если такая информация запрошена и у нас в настройках сказано ее отдать,
-            // то эмулируем ее наличие.
-            if (flag == WFS_IDC_TRACK2 && mSettings.workarounds.track2.report) {
-                result[j] = readTrack2();
+            if (flag == WFS_IDC_TRACK2 && track2) {
+                const std::size_t size = track2Value.size();
+                data->wStatus = size != 0 ? WFS_IDC_DATAOK : WFS_IDC_DATAMISSING;
+                if (size != 0) {
+                    data->ulDataLength = size;
+                    data->lpbData = block.copy((const BYTE*)track2Value.c_str(), size);
+                }
             } else {
-                //TODO: Возможно, необходимо выделять память через WFSAllocateMore
-                WFSIDCCARDDATA* data = XFS::alloc<WFSIDCCARDDATA>();
-                data->wDataSource = flag;
                 data->wStatus = WFS_IDC_DATASRCNOTSUPP;
-                result[j] = data;
             }
+            list[j] = data;
             ++j;
         }
     }
-    return result;
+    result.attach(list);
 }
-std::pair<WFSIDCCHIPIO*, PCSC::Status> Service::transmit(const WFSIDCCHIPIO* input) const {
+PCSC::Status Service::transmit(XFS::Result& result, const WFSIDCCHIPIO* input) const {
     assert(input != NULL && "Service::transmit: No input from XFS subsystem");
     assert(hCard != 0 && "Service::transmit: No card in reader");
 
@@ -392,12 +442,17 @@ std::pair<WFSIDCCHIPIO*, PCSC::Status> Service::transmit(const WFSIDCCHIPIO* inp
              << ", data=[" << Hex(input->lpbChipData, input->ulChipDataLength)
              << ']';
     }
-    //TODO: Возможно, необходимо выделять память через WFSAllocateMore
-    WFSIDCCHIPIO* result = XFS::alloc<WFSIDCCHIPIO>();
-    result->wChipProtocol = input->wChipProtocol;
+    // 2 байта на код ответа, остальное -- на сам ответ чипа.
+    // TODO: Сколько памяти выделять под буфер? Для протокола T0 нужно минимум 2 под код ответа.
+    const std::size_t outputSize = 256 + 2;
+    XFS::Block block = result.allocate(XFS::Layout().add<WFSIDCCHIPIO>().add<BYTE>(outputSize), "Service::transmit");
+    WFSIDCCHIPIO* output = block.take<WFSIDCCHIPIO>();
+    output->wChipProtocol = input->wChipProtocol;
+    output->ulChipDataLength = outputSize;
+    output->lpbChipData = block.take<BYTE>(outputSize);
 
     std::size_t inputSize = input->ulChipDataLength;
-    if (mSettings.workarounds.correctChipIO && input->wChipProtocol == WFS_IDC_CHIPT0) {
+    if (mSettings->workarounds.correctChipIO && input->wChipProtocol == WFS_IDC_CHIPT0) {
         // Команду получения результата Kalignite передает правильно, без ненужного довеска.
         // Эта комана состоит всего из 4 байт, т.е. даже не содержит поля со своей длиной.
         // Так как он в принципе формирует данную команду, непонятно, зачем же он для других
@@ -408,43 +463,52 @@ std::pair<WFSIDCCHIPIO*, PCSC::Status> Service::transmit(const WFSIDCCHIPIO* inp
             inputSize = sizeof(SCARD_T0_COMMAND) + cmd->bP3;
         }
     }
-    // 2 байта на код ответа, остальное -- на сам ответ чипа.
-    result->ulChipDataLength = 256 + 2;
-    // TODO: Сколько памяти выделять под буфер? Для протокола T0 нужно минимум 2 под код ответа.
-    result->lpbChipData = XFS::allocArr<BYTE>(result->ulChipDataLength);
     //TODO: Убедится в выравнивании! Необходимо выравнивание на двойное слово!
     SCARD_IO_REQUEST ioRq = {input->wChipProtocol, sizeof(SCARD_IO_REQUEST)};
-    PCSC::Status st = SCardTransmit(hCard,
+    bc::steady_clock::time_point start = bc::steady_clock::now();
+    PCSC::Status st = pcsc.backend().transmit(hCard,
         &ioRq, input->lpbChipData, inputSize,
-        NULL, result->lpbChipData, &result->ulChipDataLength
+        output->lpbChipData, &output->ulChipDataLength
+    );
+    const bc::steady_clock::duration duration = bc::steady_clock::now() - start;
+    Diagnostics::ApduStats::instance().record(
+        input->lpbChipData, inputSize,
+        output->lpbChipData, output->ulChipDataLength,
+        duration, st
     );
+    Diagnostics::flightPCSC("SCardTransmit", (unsigned long)hCard, st.value());
     {XFS::Logger() << "SCardTransmit(hCard=" << hCard << ", ...) = " << st; }
     {
         XFS::Logger l;
-        l << "Service::transmit(result): len=" << result->ulChipDataLength
-          << ", data=[" << Hex(result->lpbChipData, result->ulChipDataLength)
+        l << "Service::transmit(result): len=" << output->ulChipDataLength
+          << ", data=[" << Hex(output->lpbChipData, output->ulChipDataLength)
          << ']';
     }
 
-    return std::make_pair(result, st);
+    result.attach(output);
+    return st;
 }
-std::pair<WFSIDCCHIPPOWEROUT*, PCSC::Status> Service::reset(XFS::ResetAction action) const {
+PCSC::Status Service::reset(XFS::Result& result, XFS::ResetAction action) const {
     assert(hCard != 0 && "Service::reset: No card in the reader");
 
-    PCSC::Status st = SCardReconnect(
+    PCSC::Status st = pcsc.backend().reconnect(
         hCard,
-        mSettings.exclusive ? SCARD_SHARE_EXCLUSIVE : SCARD_SHARE_SHARED,
+        mSettings->exclusive ? SCARD_SHARE_EXCLUSIVE : SCARD_SHARE_SHARED,
         // Текущий активный протокол должен быть в числе запрошенных, иначе
         // функция вернет ошибку.
         mActiveProtocol.value() | SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1,
         action.translate(),
         (DWORD*)&mActiveProtocol
     );
+    Diagnostics::flightPCSC("SCardReconnect", (unsigned long)hCard, st.value());
     {XFS::Logger() << "SCardReconnect(hCard=" << hCard << ", ..., dwActiveProtocol=&" << mActiveProtocol << ") = " << st; }
 
-    std::pair<DWORD, BYTE*> atr = readATR();
-    WFSIDCCHIPPOWEROUT* result = XFS::alloc<WFSIDCCHIPPOWEROUT>();
-    result->ulChipDataLength = atr.first;
-    result->lpbChipData = atr.second;
-    return std::make_pair(result, st);
+    Atr atr;
+    readATR(atr);
+    XFS::Block block = result.allocate(XFS::Layout().add<WFSIDCCHIPPOWEROUT>().add<BYTE>(atr.size), "Service::reset");
+    WFSIDCCHIPPOWEROUT* output = block.take<WFSIDCCHIPPOWEROUT>();
+    output->ulChipDataLength = atr.size;
+    output->lpbChipData = block.copy(atr.data, atr.size);
+    result.attach(output);
+    return st;
 }
\ No newline at end of file
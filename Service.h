@@ -15,9 +15,8 @@
 #include "XFS/ReadFlags.h"
 #include "XFS/ResetAction.h"
 
+#include <map>
 #include <string>
-// Для std::pair
-#include <utility>
 // CEN/XFS API -- Должно быть сверху, т.к., если поместить здесь,
 // то начинаются странные ошибки компиляции из winnt.h как минимум в MSVC 2005.
 //#include <xfsapi.h>
@@ -25,6 +24,9 @@
 #include <winscard.h>
 
 class Manager;
+namespace XFS {
+    class Result;
+}
 class Service : public EventNotifier {
     Manager& pcsc;
     /// Хендл XFS-сервиса, который представляет данный объект
@@ -38,12 +40,29 @@ class Service : public EventNotifier {
     /// карточки в любом из доступных считывателей. В последнем случае, до тех пор, пока
     /// карточка не будет вынута, все события от прочих считывателей будут игнорироваться.
     std::string mBindedReaderName;
-    /// Настройки данного сервиса.
-    Settings mSettings;
+    /// Настройки данного сервиса -- снимок, общий для всех сервисов провайдера. Заменяется
+    /// только в потоке XFS менеджера (см. `updateSettings`), в других потоках читается
+    /// через `settings()`.
+    Settings::Ptr mSettings;
+    /// Поколение кэша настроек, с которым последний раз сверялся снимок.
+    unsigned long mSettingsGeneration;
+    /// Уровень трассировки, заданный XFS менеджером. Свой у каждого сервиса, поэтому
+    /// хранится отдельно от общего снимка настроек.
+    DWORD mTraceLevel;
     /// Флаг, отвечающий за то, что после создания сервиса он уже узнал текущее
     /// состояние считывателей. При создании сервиса данный флаг выставлен в `false`,
     /// а при первом уведомлении о считывателях он устанавливается в `true`.
     bool mInited;
+    /// Подписчикам сообщено о вставке карты, а о ее извлечении еще нет. Без этого сервис,
+    /// в считывателе которого никогда не было карты, получал бы `WFS_SRVE_IDC_MEDIAREMOVED`
+    /// при каждом повторном опросе считывателей. Используется только потоком отслеживания изменений.
+    bool mCardReported;
+    /// Состояния считывателей (`WFS_STAT_DEV*`), о которых последний раз сообщалось подписчикам
+    /// событием `WFS_SYSE_DEVICE_STATUS`. Хранятся только состояния, отличные от `WFS_STAT_DEVONLINE`:
+    /// привязка к считывателю меняется при каждом открытии и закрытии карты, а о возвращении
+    /// считывателя нужно сообщить, даже если сервис к тому времени привязан к другому.
+    /// Используется только потоком отслеживания изменений.
+    std::map<std::string, DWORD> mDeviceStates;
     // Данный класс будет создавать объекты данного класса, вызывая конструктор.
     friend class ServiceContainer;
 private:
@@ -52,7 +71,7 @@ private:
     @param hService Хендл, присвоенный сервису XFS-менеджером.
     @param settings Настройки XFS-сервиса.
     */
-    Service(Manager& pcsc, HSERVICE hService, const Settings& settings);
+    Service(Manager& pcsc, HSERVICE hService, const Settings::Ptr& settings);
 public:
     ~Service();
 
@@ -61,18 +80,55 @@ public:
 
     PCSC::Status lock();
     PCSC::Status unlock();
+    /** Начинает операцию получения эксклюзивного доступа к карте. Доступ запрашивается в
+        отдельном потоке в порядке очереди к считывателю (см. `LockQueue`), по завершении
+        генерируется сообщение `WFS_LOCK_COMPLETE` с результатом `SCardBeginTransaction`.
+    @par
+        Если доступ не получен за время `dwTimeOut`, генерируется сообщение `WFS_LOCK_COMPLETE`
+        с результатом `WFS_ERR_TIMEOUT`, а если операция отменена -- с `WFS_ERR_CANCELED`.
+
+    @param dwTimeOut
+        Таймаут получения доступа в миллисекундах или `WFS_INDEFINITE_WAIT`.
+    @param hWnd
+        Окно, которому будет доставлено сообщение `WFS_LOCK_COMPLETE`.
+    @param ReqID
+        Трекинговый номер для отслеживания запроса.
+    */
+    void asyncLock(DWORD dwTimeOut, HWND hWnd, REQUESTID ReqID);
 
-    inline void setTraceLevel(DWORD level) { mSettings.traceLevel = level; }
+    inline void setTraceLevel(DWORD level) { mTraceLevel = level; }
+    /** Переходит на актуальный снимок настроек провайдера, если кэш настроек изменился с
+        прошлой проверки (см. `SettingsCache`). Вызывается в потоке XFS менеджера перед
+        выполнением команды, поэтому команда от начала до конца работает с одним снимком.
+    @par
+        Уровень трассировки заменяется значением из настроек, только если оно изменилось в
+        них, т.е. уровень, заданный `WFPSetTraceLevel`, сохраняется до изменения настроек.
+        Новый `ReaderName` действует с момента, когда карта будет вынута.
+    */
+    void updateSettings();
     /** Данный метод вызывается при любом изменении любого считывателя и при изменении количества считывателей.
     @param state
         Информация о текущем состоянии изменившегося считывателя.
     */
     void notify(const SCARD_READERSTATE& state, bool deviceChange);
+    /// Получил ли сервис состояние считывателей после создания (см. `notify`).
+    inline bool inited() const { return mInited; }
     /** Проверяет, что сервис ожидает сообщения от данного считывателя. */
     bool match(const SCARD_READERSTATE& state, bool deviceChange);
+private:
+    /// Рассылает `WFS_SYSE_DEVICE_STATUS`, если состояние считывателя для подписчиков сервиса изменилось.
+    void notifyDeviceState(const SCARD_READERSTATE& state);
 public:// Функции, вызываемые в WFPGetInfo
-    std::pair<WFSIDCSTATUS*, PCSC::Status> getStatus();
-    std::pair<WFSIDCCAPS*, PCSC::Status> getCaps() const;
+    /** Прикрепляет к результату состояние устройства.
+    @return
+        Статус опроса карты, если она есть в считывателе.
+    */
+    PCSC::Status getStatus(XFS::Result& result);
+    /** Прикрепляет к результату возможности устройства.
+    @return
+        Статус получения поддерживаемых картой протоколов, если она есть в считывателе.
+    */
+    PCSC::Status getCaps(XFS::Result& result) const;
 public:// Функции, вызываемые в WFPExecute
     /** Начинает операцию ожидания вставки карточки в считыватель. Как только карточка
         будет вставлена в считыватель, генерирует сообщение `WFS_EXEE_IDC_MEDIAINSERTED`,
@@ -98,26 +154,39 @@ public:// Функции, вызываемые в WFPExecute
     */
     void asyncRead(DWORD dwTimeOut, HWND hWnd, REQUESTID ReqID, XFS::ReadFlags forRead);
 
-    std::pair<DWORD, BYTE*> readATR() const;
-    WFSIDCCARDDATA* readChip() const;
-    WFSIDCCARDDATA* readTrack2() const;
-    WFSIDCCARDDATA** wrap(WFSIDCCARDDATA* iccData, XFS::ReadFlags forRead) const;
+    /// ATR (Answer To Reset) карты. Буфер того же размера, что и в `SCARD_READERSTATE`.
+    struct Atr {
+        DWORD size;
+        BYTE data[sizeof(((SCARD_READERSTATE*)0)->rgbAtr)];
+    };
+    /// Читает ATR карты. В случае ошибки размер ATR равен 0.
+    PCSC::Status readATR(Atr& atr) const;
+    /** Прикрепляет к результату массив данных, прочитанных командой `WFS_CMD_IDC_READ_RAW_DATA`.
+        Массив указателей, сами структуры и их данные выделяются одним блоком.
+    @param atr
+        Данные чипа.
+    @param forRead
+        Список данных, которые необходимо прочитать. Должен содержать `WFS_IDC_CHIP`.
+    */
+    void wrap(XFS::Result& result, const Atr& atr, XFS::ReadFlags forRead) const;
 
     /** Осуществляет передачу данных из входного параметра чипу и получет от него ответ.
 
+    @param result
+        Результат, к которому прикрепляется ответ чипа.
     @param input
         Буфер, полученный от подсистемы XFS, содержащий параметры протокола и передаваемые данные.
 
     @return
-        Пару, содержащую буфер, который необходимо передать приложению (оно заботится об освобождении
-        памяти) и статус выполнения команды.
+        Статус выполнения команды.
     */
-    std::pair<WFSIDCCHIPIO*, PCSC::Status> transmit(const WFSIDCCHIPIO* input) const;
-    /// Выполняет реинициализацию чипа.
-    std::pair<WFSIDCCHIPPOWEROUT*, PCSC::Status> reset(XFS::ResetAction action) const;
+    PCSC::Status transmit(XFS::Result& result, const WFSIDCCHIPIO* input) const;
+    /// Выполняет реинициализацию чипа и прикрепляет к результату новый ATR.
+    PCSC::Status reset(XFS::Result& result, XFS::ResetAction action) const;
 public:// Служебные функции
     inline HSERVICE handle() const { return hService; }
-    inline const Settings& settings() const { return mSettings; }
+    /// Текущий снимок настроек. Можно вызывать из любого потока.
+    inline Settings::Ptr settings() const { return boost::atomic_load(&mSettings); }
     inline const std::string& bindedReader() const { return mBindedReaderName; }
 };
 
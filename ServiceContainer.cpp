@@ -3,6 +3,8 @@
 #include "Service.h"
 #include "Settings.h"
 
+#include "Diagnostics/Timeline.h"
+
 #include "XFS/Logger.h"
 
 #include <cassert>
@@ -15,20 +17,23 @@ ServiceContainer::~ServiceContainer() {
     services.clear();
 }
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-Service& ServiceContainer::create(Manager& manager, HSERVICE hService, const Settings& settings) {
+Service& ServiceContainer::create(Manager& manager, HSERVICE hService, const Settings::Ptr& settings) {
     assert(!isValid(hService) && "Try to create already registered service");
     Service* service = new Service(manager, hService, settings);
+    boost::lock_guard<boost::mutex> lock(mMutex);
     services.insert(std::make_pair(hService, service));
     return *service;
 }
 Service& ServiceContainer::get(HSERVICE hService) {
     assert(isValid(hService) && "Try to get not registered service");
+    boost::lock_guard<boost::mutex> lock(mMutex);
     Service* service = services.find(hService)->second;
     assert(service != NULL && "Internal error: no service data for valid service handle while get service");
     return *service;
 }
 void ServiceContainer::remove(HSERVICE hService) {
     assert(isValid(hService) && "Try to remove not registered service");
+    boost::lock_guard<boost::mutex> lock(mMutex);
     ServiceMap::iterator it = services.find(hService);
 
     assert(it->second != NULL && "Internal error: no service data for valid service handle while remove service");
@@ -38,6 +43,7 @@ void ServiceContainer::remove(HSERVICE hService) {
 }
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 bool ServiceContainer::addSubscriber(HSERVICE hService, HWND hWndReg, DWORD dwEventClass) {
+    boost::lock_guard<boost::mutex> lock(mMutex);
     ServiceMap::iterator it = services.find(hService);
     if (it == services.end()) {
         return false;
@@ -47,6 +53,7 @@ bool ServiceContainer::addSubscriber(HSERVICE hService, HWND hWndReg, DWORD dwEv
     return true;
 }
 bool ServiceContainer::removeSubscriber(HSERVICE hService, HWND hWndReg, DWORD dwEventClass) {
+    boost::lock_guard<boost::mutex> lock(mMutex);
     ServiceMap::iterator it = services.find(hService);
     if (it == services.end()) {
         return false;
@@ -55,11 +62,38 @@ bool ServiceContainer::removeSubscriber(HSERVICE hService, HWND hWndReg, DWORD d
     it->second->remove(hWndReg, dwEventClass);
     return true;
 }
+bool ServiceContainer::hasSubscribers() const {
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    for (ServiceMap::const_iterator it = services.begin(); it != services.end(); ++it) {
+        if (it->second->hasSubscribers()) {
+            return true;
+        }
+    }
+    return false;
+}
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 void ServiceContainer::notifyChanges(const SCARD_READERSTATE& state, bool deviceChange) {
     {XFS::Logger() << "ServiceContainer::notifyChanges";}
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    Diagnostics::TimelineSpan span("ServiceContainer::notifyChanges", "services");
+    span.arg("reader", state.szReader).arg("services", services.size()).arg("deviceChange", deviceChange);
     for (ServiceMap::const_iterator it = services.begin(); it != services.end(); ++it) {
         assert(it->second != NULL && "Internal error: no service data while do notification");
         it->second->notify(state, deviceChange);
     }
+}
+void ServiceContainer::notifySnapshot(const std::vector<SCARD_READERSTATE>& states) {
+    {XFS::Logger() << "ServiceContainer::notifySnapshot";}
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    Diagnostics::TimelineSpan span("ServiceContainer::notifySnapshot", "services");
+    span.arg("readers", states.size()).arg("services", services.size());
+    for (ServiceMap::const_iterator it = services.begin(); it != services.end(); ++it) {
+        assert(it->second != NULL && "Internal error: no service data while do notification");
+        if (it->second->inited()) {
+            continue;
+        }
+        for (std::vector<SCARD_READERSTATE>::const_iterator state = states.begin(); state != states.end(); ++state) {
+            it->second->notify(*state, false);
+        }
+    }
 }
\ No newline at end of file
@@ -3,7 +3,13 @@
 
 #pragma once
 
+#include "Settings.h"
+
 #include <map>
+#include <vector>
+
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
 
 // PC/CS API -- для SCARD_READERSTATE
 #include <winscard.h>
@@ -12,24 +18,31 @@
 
 class Manager;
 class Service;
-class Settings;
 class ServiceContainer {
     /// Тип для отображения сервисов XFS на карты PC/SC.
     typedef std::map<HSERVICE, Service*> ServiceMap;
 private:
     /// Список карт, открытых для взаимодействия с системой XFS.
     ServiceMap services;
+    /// Защищает список сервисов и их подписчиков: сервисы создаются и удаляются, а подписчики
+    /// меняются в потоках вызова SPI-функций, в то время как уведомления о событиях рассылает
+    /// поток отслеживания изменений.
+    mutable boost::mutex mMutex;
 public:
     ~ServiceContainer();
 public:
     /** Проверяет, что указаный хендл сервиса является корректным хендлом карточки. */
     inline bool isValid(HSERVICE hService) const {
+        boost::lock_guard<boost::mutex> lock(mMutex);
         return services.find(hService) != services.end();
     }
     /** @return true, если в контейнере не зарегистрировано ни одного сервиса. */
-    inline bool isEmpty() const { return services.empty(); }
+    inline bool isEmpty() const {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        return services.empty();
+    }
 
-    Service& create(Manager& manager, HSERVICE hService, const Settings& settings);
+    Service& create(Manager& manager, HSERVICE hService, const Settings::Ptr& settings);
     Service& get(HSERVICE hService);
     void remove(HSERVICE hService);
 public:// Подписка на события и генерация событий
@@ -38,9 +51,18 @@ public:// Подписка на события и генерация событ
     */
     bool addSubscriber(HSERVICE hService, HWND hWndReg, DWORD dwEventClass);
     bool removeSubscriber(HSERVICE hService, HWND hWndReg, DWORD dwEventClass);
+    /// @return `true`, если хоть у одного сервиса есть подписчики на события.
+    bool hasSubscribers() const;
 public:
     /// Уведомляет все сервисы о произошедших изменениях со считывателями.
     void notifyChanges(const SCARD_READERSTATE& state, bool deviceChange);
+    /** Сообщает известное состояние считывателей только тем сервисам, которые его еще не
+        получали (только что открытым). Остальные сервисы это состояние уже знают.
+    @param states
+        Состояния считывателей: в `dwEventState` известное состояние, в `dwCurrentState` --
+        `SCARD_STATE_UNAWARE`.
+    */
+    void notifySnapshot(const std::vector<SCARD_READERSTATE>& states);
 };
 
 #endif // PCSC_CENXFS_BRIDGE_ServiceContainer_H
\ No newline at end of file
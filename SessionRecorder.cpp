@@ -0,0 +1,282 @@
+#include "Diagnostics/SessionRecorder.h"
+
+#include "Utils/Hex.h"
+
+#include "XFS/Logger.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include <boost/thread/lock_guard.hpp>
+
+namespace bc = boost::chrono;
+
+namespace Diagnostics {
+    /// Выводит байты в 16-ричном виде без разделителей, как их принимает сценарий симулятора.
+    static void writeHex(std::ostream& os, const BYTE* data, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i) {
+            char buf[2];
+            os.write(buf, Hex::byte(data[i], buf) - buf);
+        }
+    }
+    /// Выводит название в кавычках, т.к. названия считывателей обычно содержат пробелы.
+    static void writeName(std::ostream& os, const std::string& name) {
+        os << '"' << name << '"';
+    }
+    /// Команды, поле данных которых содержит PIN: `VERIFY`, `CHANGE REFERENCE DATA`, `RESET RETRY COUNTER`.
+    static bool secretCommand(BYTE ins) {
+        switch (ins) {
+            case 0x20: case 0x21: case 0x24: case 0x2C: return true;
+            default: return false;
+        }
+    }
+    /// Команды, ответ на которые может содержать PAN, имя держателя и данные дорожек: `READ BINARY`,
+    /// `READ RECORD`, `GET PROCESSING OPTIONS` и `GET RESPONSE`, продолжающий любую из них.
+    static bool secretResponse(BYTE ins) {
+        switch (ins) {
+            case 0xB0: case 0xB1: case 0xB2: case 0xB3: case 0xA8: case 0xC0: return true;
+            default: return false;
+        }
+    }
+    /** Находит поле данных команды по `Lc`, короткому или расширенному. Если команда не
+        разбирается, полем данных считается все после заголовка.
+    */
+    static void dataField(const BYTE* command, std::size_t size, std::size_t& offset, std::size_t& length) {
+        if (size > 5 && command[4] != 0) {
+            offset = 5;
+            length = command[4];
+        } else if (size > 7 && command[4] == 0) {
+            offset = 7;
+            length = ((std::size_t)command[5] << 8) | command[6];
+        } else {
+            offset = size;
+            length = 0;
+        }
+        if (offset + length > size) {
+            offset = std::min<std::size_t>(4, size);
+            length = size - offset;
+        }
+    }
+    /// Выводит команду, записывая ее поле данных шаблоном `??`, если в нем передается PIN.
+    static void writeCommand(std::ostream& os, const BYTE* command, std::size_t size, bool redact) {
+        if (!redact || size < 2 || !secretCommand(command[1])) {
+            writeHex(os, command, size);
+            return;
+        }
+        std::size_t offset, length;
+        dataField(command, size, offset, length);
+        writeHex(os, command, offset);
+        for (std::size_t i = 0; i < length; ++i) {
+            os << "??";
+        }
+        writeHex(os, command + offset + length, size - offset - length);
+    }
+    /// Выводит ответ, заменяя его данные нулями, если они могут содержать данные держателя карты.
+    static void writeResponse(std::ostream& os, BYTE ins, const BYTE* response, std::size_t size, bool redact) {
+        if (!redact || !secretResponse(ins)) {
+            writeHex(os, response, size);
+            return;
+        }
+        for (std::size_t i = 2; i < size; ++i) {
+            os << "00";
+        }
+        writeHex(os, response + size - 2, 2);
+    }
+    static const char* protocolName(DWORD protocol) {
+        switch (protocol) {
+            case SCARD_PROTOCOL_T0: return "T0";
+            case SCARD_PROTOCOL_T1: return "T1";
+            default: return "T0+T1";
+        }
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    SessionRecorder& SessionRecorder::instance() {
+        static SessionRecorder recorder;
+        return recorder;
+    }
+    SessionRecorder::SessionRecorder() : mEnabled(false), mRedact(true), mListed(false), mCards(0) {}
+    SessionRecorder::~SessionRecorder() {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        if (!mFile.is_open()) {
+            return;
+        }
+        // Карты, с которыми так и не соединились, все равно должны попасть в сценарий.
+        for (std::map<std::string, Reader>::iterator it = mReaders.begin(); it != mReaders.end(); ++it) {
+            if (!it->second.card.empty()) {
+                writeCardLocked(it->first, it->second, 0);
+            }
+        }
+        mFile << "# end at " << elapsed() << "us\n";
+    }
+    bool SessionRecorder::open(const std::string& path, bool redact) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        if (mFile.is_open()) {
+            return true;
+        }
+        mFile.open(path.c_str(), std::ios::out | std::ios::trunc);
+        const bool ok = mFile.is_open();
+        {XFS::Logger() << "SessionRecorder::open(path=" << path << ", redact=" << redact << ") = " << ok;}
+        if (ok) {
+            mRedact = redact;
+            mOrigin = Clock::now();
+            mFile << "# PC/SC session recorded by pcsc-cenxfs-bridge, replay with the PC/SC simulator\n";
+            mFile.flush();
+            mEnabled = true;
+        }
+        return ok;
+    }
+    long long SessionRecorder::elapsed() const {
+        return bc::duration_cast<bc::microseconds>(Clock::now() - mOrigin).count();
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    void SessionRecorder::readers(const SCARD_READERSTATE* states, std::size_t count) {
+        if (!enabled()) {
+            return;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        const long long at = elapsed();
+        // Отключенные считыватели.
+        for (std::map<std::string, Reader>::iterator it = mReaders.begin(); it != mReaders.end();) {
+            bool found = false;
+            for (std::size_t i = 1; i < count; ++i) {
+                if (it->first == states[i].szReader) {
+                    found = true;
+                    break;
+                }
+            }
+            if (found) {
+                ++it;
+                continue;
+            }
+            // Отключение считывателя само вынимает карту в симуляторе, но если она не была
+            // записана, то ее вставку все равно нужно записать.
+            if (!it->second.card.empty()) {
+                writeCardLocked(it->first, it->second, 0);
+            }
+            mFile << "at " << at << "us detach ";
+            writeName(mFile, it->first);
+            mFile << '\n';
+            mReaders.erase(it++);
+        }
+        // Подключенные считыватели. Те, что были с начала записи, подключаются сразу.
+        for (std::size_t i = 1; i < count; ++i) {
+            const char* name = states[i].szReader;
+            if (mReaders.find(name) != mReaders.end()) {
+                continue;
+            }
+            mReaders[name].fresh = !mListed;
+            if (mListed) {
+                mFile << "at " << at << "us attach ";
+            } else {
+                mFile << "reader ";
+            }
+            writeName(mFile, name);
+            mFile << '\n';
+        }
+        mListed = true;
+        mFile.flush();
+    }
+    void SessionRecorder::state(const SCARD_READERSTATE& state) {
+        if (!enabled()) {
+            return;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        std::map<std::string, Reader>::iterator it = mReaders.find(state.szReader);
+        if (it == mReaders.end()) {
+            return;
+        }
+        Reader& r = it->second;
+        const bool initial = r.fresh;
+        r.fresh = false;
+        const bool present = (state.dwEventState & SCARD_STATE_PRESENT) != 0;
+        if (present == !r.card.empty()) {
+            return;
+        }
+        const long long at = elapsed();
+        if (!present) {
+            removeLocked(it->first, r, at);
+            mFile.flush();
+            return;
+        }
+        std::ostringstream name;
+        name << 'c' << ++mCards;
+        r.card = name.str();
+        r.atr.assign(state.rgbAtr, state.rgbAtr + std::min<std::size_t>(state.cbAtr, sizeof(state.rgbAtr)));
+        r.insertedAt = at;
+        // Карта, обнаруженная при первом же опросе, была в считывателе до начала записи.
+        r.initial = initial;
+        r.written = false;
+    }
+    void SessionRecorder::connect(const char* reader, SCARDHANDLE hCard, DWORD protocol) {
+        if (!enabled()) {
+            return;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        std::map<std::string, Reader>::iterator it = mReaders.find(reader);
+        if (it == mReaders.end() || it->second.card.empty()) {
+            return;
+        }
+        writeCardLocked(it->first, it->second, protocol);
+        mConnections[hCard] = it->first;
+        mFile.flush();
+    }
+    void SessionRecorder::disconnect(SCARDHANDLE hCard) {
+        if (!enabled()) {
+            return;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        mConnections.erase(hCard);
+    }
+    void SessionRecorder::transmit(SCARDHANDLE hCard, const BYTE* command, std::size_t commandSize,
+                                   const BYTE* response, std::size_t responseSize,
+                                   Clock::duration duration, LONG status) {
+        // Симулятор не умеет воспроизводить ошибки передачи, а ответ короче SW1 SW2 не примет.
+        if (!enabled() || status != SCARD_S_SUCCESS || commandSize == 0 || responseSize < 2) {
+            return;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        std::map<SCARDHANDLE, std::string>::const_iterator c = mConnections.find(hCard);
+        if (c == mConnections.end()) {
+            return;
+        }
+        std::map<std::string, Reader>::const_iterator it = mReaders.find(c->second);
+        if (it == mReaders.end() || it->second.card.empty()) {
+            return;
+        }
+        mFile << "apdu " << it->second.card << ' ';
+        writeCommand(mFile, command, commandSize, mRedact);
+        mFile << ' ';
+        writeResponse(mFile, commandSize > 1 ? command[1] : 0, response, responseSize, mRedact);
+        mFile << " once latency fixed "
+              << bc::duration_cast<bc::microseconds>(duration).count() << "us\n";
+        mFile.flush();
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    void SessionRecorder::writeCardLocked(const std::string& name, Reader& reader, DWORD protocol) {
+        if (reader.written) {
+            return;
+        }
+        reader.written = true;
+        mFile << "card " << reader.card << ' ' << protocolName(protocol) << ' ';
+        writeHex(mFile, reader.atr.empty() ? NULL : &reader.atr[0], reader.atr.size());
+        mFile << '\n';
+        if (reader.initial) {
+            mFile << "insert ";
+        } else {
+            mFile << "at " << reader.insertedAt << "us insert ";
+        }
+        writeName(mFile, name);
+        mFile << ' ' << reader.card << '\n';
+    }
+    void SessionRecorder::removeLocked(const std::string& name, Reader& reader, long long at) {
+        if (reader.card.empty()) {
+            return;
+        }
+        writeCardLocked(name, reader, 0);
+        mFile << "at " << at << "us remove ";
+        writeName(mFile, name);
+        mFile << '\n';
+        reader.card.clear();
+        reader.atr.clear();
+    }
+} // namespace Diagnostics
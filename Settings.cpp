@@ -1,136 +1,77 @@
 #include "Settings.h"
 
+#include "Config/Source.h"
+
 #include "XFS/Logger.h"
 
+#include <sstream>
 #include <string>
-#include <vector>
-// XFS API для функций доступа к реестру.
-#include <xfsconf.h>
-
-/// Класс для автоматического закрытия открытых ключей реестра, когда они более не нужны.
-class RegKey {
-    HKEY hKey;
-public:
-    inline RegKey(HKEY root, const char* name) {
-        HRESULT r = WFMOpenKey(root, (LPSTR)name, &hKey);
-
-        XFS::Logger() << "RegKey::RegKey(root=" << root << ", name=" << name << ", hKey=&" << hKey << ") = "  << r;
-    }
-    inline ~RegKey() {
-        HRESULT r = WFMCloseKey(hKey);
-
-        XFS::Logger() << "WFMCloseKey(hKey=" << hKey << ") = " << r;
-    }
 
-    inline RegKey child(const char* name) const {
-        return RegKey(hKey, name);
-    }
-    /** Получает значение из ключа реестра с указанным именем.
-    @param name
-        Имя значения в ключе реестра, которое требуется получить. Значение по умолчанию (`NULL`)
-        означает, что необходимо получить значение ключа по умолчанию.
-
-    @return
-        Строка со значением ключа. Если значения не существует, возвращает пустую строку.
-    */
-    inline std::string value(const char* name = NULL) const {
-        // Узнаем размер значения ключа.
-        DWORD dwSize = 0;
-        HRESULT r = WFMQueryValue(hKey, (LPSTR)name, NULL, &dwSize);
-
-        {XFS::Logger() << "RegKey::value[size](name=" << name << ", size=&" << dwSize << ") = " << r;}
-        // Используем вектор, т.к. он гарантирует непрерывность памяти под данные,
-        // чего нельзя сказать в случае со string.
-        // dwSize содержит длину строки без завершающего NULL, но он записывается в выходное значение.
-        std::vector<char> value(dwSize+1);
-        if (dwSize > 0) {
-            dwSize = value.capacity();
-            r = WFMQueryValue(hKey, (LPSTR)name, &value[0], &dwSize);
-            {XFS::Logger() << "RegKey::value[value](name=" << name << ", value=&" << &value[0] << ", size=&" << dwSize << ") = " << r;}
-        }
-        std::string result = std::string(value.begin(), value.end()-1);
-
-        XFS::Logger() << "RegKey::value(name=" << name << ") = " << result;
-        return result;
-    }
-    inline DWORD dwValue(const char* name) const {
-        // Узнаем размер значения ключа.
-        DWORD result = 0;
-        DWORD dwSize = sizeof(DWORD);
-        HRESULT r = WFMQueryValue(hKey, (LPSTR)name, (LPSTR)&result, &dwSize);
-
-        XFS::Logger() << "RegKey::value(name=" << name << ") = " << result;
-        return result;
-    }
-    /// Отладочная функция для вывода в трассу всех дочерных ключей.
-    void keys() const {
-        {XFS::Logger() << "keys";}
-        std::vector<char> keyName(256);
-        for (DWORD i = 0; ; ++i) {
-            DWORD size = keyName.capacity();
-            HRESULT r = WFMEnumKey(hKey, i, &keyName[0], &size, NULL);
-            if (r == WFS_ERR_CFG_NO_MORE_ITEMS) {
-                break;
-            }
-            keyName[size] = '\0';
-
-            XFS::Logger() << &keyName[0];
-        }
-    }
-    /// Отладочная функция для вывода в трассу всех дочерных значений ключа.
-    /// Значение ключа -- это пара (имя=значение).
-    void values() const {
-        {XFS::Logger() << "values";}
-        // К сожалению, узнать конкретные длины заранее невозможно.
-        std::vector<char> name(256);
-        std::vector<char> value(256);
-        for (DWORD i = 0; ; ++i) {
-            DWORD szName = name.capacity();
-            DWORD szValue = value.capacity();
-            HRESULT r = WFMEnumValue(hKey, i, &name[0], &szName, &value[0], &szValue);
-            if (r == WFS_ERR_CFG_NO_MORE_ITEMS) {
-                break;
-            }
-            name[szName] = '\0';
-            value[szValue] = '\0';
-
-            XFS::Logger()
-                << i << ": " << '('<<szName<<','<<szValue<<')' << std::string(name.begin(), name.begin()+szName) << "="
-                << std::string(value.begin(), value.begin()+szValue);
-        }
-    }
-};
+#include <boost/thread/lock_guard.hpp>
 
 Settings::Settings(const char* serviceName, int traceLevel)
     : traceLevel(traceLevel)
     , exclusive(false)
+    , memoryStats(false)
+    , sessionRecordPlaintext(false)
+    , reloadPeriod(0)
+    , idleTimeout(0)
 {
-    // У Калигнайта под данным корнем не появляется провайдера, если он в
-    // HKEY_LOCAL_MACHINE\SOFTWARE\XFS\SERVICE_PROVIDERS\
-    // HKEY root = WFS_CFG_HKEY_XFS_ROOT;
-    HKEY root = WFS_CFG_USER_DEFAULT_XFS_ROOT;// HKEY_USERS\.DEFAULT\XFS
-    providerName = RegKey(root, "LOGICAL_SERVICES").child(serviceName).value("Provider");
+    providerName = providerOf(serviceName);
 
     reread();
 }
+Settings::Settings(const std::string& providerName)
+    : providerName(providerName)
+    , traceLevel(0)
+    , exclusive(false)
+    , memoryStats(false)
+    , sessionRecordPlaintext(false)
+    , reloadPeriod(0)
+    , idleTimeout(0)
+{
+    reread();
+}
+std::string Settings::providerOf(const char* serviceName) {
+    return Config::Source::current()->value(std::string("LOGICAL_SERVICES\\") + serviceName, "Provider");
+}
 void Settings::reread() {
-    HKEY root = WFS_CFG_USER_DEFAULT_XFS_ROOT;// HKEY_USERS\.DEFAULT\XFS
+    Config::Source::Ptr source = Config::Source::current();
 
-    RegKey pcscSettings = RegKey(root, "SERVICE_PROVIDERS").child(providerName.c_str());
-    readerName = pcscSettings.value("ReaderName");
-    traceLevel = pcscSettings.dwValue("TraceLevel");
-    exclusive  = pcscSettings.dwValue("Exclusive") != 0;
+    const std::string pcscSettings = "SERVICE_PROVIDERS\\" + providerName;
+    readerName = source->value(pcscSettings, "ReaderName");
+    traceLevel = source->dwValue(pcscSettings, "TraceLevel");
+    exclusive  = source->dwValue(pcscSettings, "Exclusive") != 0;
 
     // Настройки обходов различных проблем
-    RegKey workaroundSettings = pcscSettings.child("Workarounds");
-    workarounds.correctChipIO = workaroundSettings.dwValue("CorrectChipIO") != 0;
-    workarounds.canEject = workaroundSettings.dwValue("CanEject") != 0;
-
-    RegKey track2Settings = workaroundSettings.child("Track2");
-    workarounds.track2.report = track2Settings.dwValue("Report") != 0;
-    workarounds.track2.value = track2Settings.value();
-
-    XFS::Logger() << "Settings::reread: Readed new settings: " << toJSONString();
+    const std::string workaroundSettings = pcscSettings + "\\Workarounds";
+    workarounds.correctChipIO = source->dwValue(workaroundSettings, "CorrectChipIO") != 0;
+    workarounds.canEject = source->dwValue(workaroundSettings, "CanEject") != 0;
+
+    const std::string track2Settings = workaroundSettings + "\\Track2";
+    workarounds.track2.report = source->dwValue(track2Settings, "Report") != 0;
+    workarounds.track2.value = source->value(track2Settings, NULL);
+
+    const std::string timelineSettings = pcscSettings + "\\Timeline";
+    timeline.file = source->value(timelineSettings, NULL);
+    timeline.maxSize = source->dwValue(timelineSettings, "MaxSize");
+
+    const std::string apduStatsSettings = pcscSettings + "\\ApduStats";
+    apduStats.file = source->value(apduStatsSettings, NULL);
+    apduStats.period = source->dwValue(apduStatsSettings, "Period");
+
+    const std::string backendSettings = pcscSettings + "\\Backend";
+    backend.name = source->value(backendSettings, NULL);
+    backend.script = source->value(backendSettings, "Script");
+
+    flightRecorderFile = source->value(pcscSettings, "FlightRecorderFile");
+    memoryStats = source->dwValue(pcscSettings, "MemoryStats") != 0;
+    sessionRecordFile = source->value(pcscSettings, "SessionRecordFile");
+    sessionRecordPlaintext = source->dwValue(pcscSettings, "SessionRecordPlaintext") != 0;
+    reloadPeriod = source->dwValue(pcscSettings, "ReloadPeriod");
+    idleTimeout = source->dwValue(pcscSettings, "IdleTimeout");
+
+    XFS::Logger() << "Settings::reread: Readed new settings from " << source->name() << ": " << toJSONString();
 }
 std::string Settings::toJSONString() const {
     std::stringstream ss;
@@ -143,6 +84,108 @@ std::string Settings::toJSONString() const {
     ss << "\tWorkarounds.CanEject: " << std::boolalpha << workarounds.canEject << ",\n";
     ss << "\tWorkarounds.Track2.Report: " << std::boolalpha << workarounds.track2.report << ",\n";
     ss << "\tWorkarounds.Track2.Value: " << workarounds.track2.value << ",\n";
+    ss << "\tTimeline.File: " << timeline.file << ",\n";
+    ss << "\tTimeline.MaxSize: " << timeline.maxSize << ",\n";
+    ss << "\tApduStats.File: " << apduStats.file << ",\n";
+    ss << "\tApduStats.Period: " << apduStats.period << ",\n";
+    ss << "\tBackend.Name: " << backend.name << ",\n";
+    ss << "\tBackend.Script: " << backend.script << ",\n";
+    ss << "\tFlightRecorderFile: " << flightRecorderFile << ",\n";
+    ss << "\tMemoryStats: " << std::boolalpha << memoryStats << ",\n";
+    ss << "\tSessionRecordFile: " << sessionRecordFile << ",\n";
+    ss << "\tSessionRecordPlaintext: " << std::boolalpha << sessionRecordPlaintext << ",\n";
+    ss << "\tReloadPeriod: " << reloadPeriod << ",\n";
+    ss << "\tIdleTimeout: " << idleTimeout << ",\n";
     ss << '}';
     return ss.str();
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+SettingsCache& SettingsCache::instance() {
+    // Никогда не разрушается: поток проверки изменений настроек останавливается при
+    // разрушении статических объектов и может обращаться к кэшу до своего останова.
+    static SettingsCache* cache = new SettingsCache();
+    return *cache;
+}
+Settings::Ptr SettingsCache::get(const char* serviceName) {
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    ProviderMap::iterator provider = mProviders.find(serviceName);
+    if (provider == mProviders.end()) {
+        provider = mProviders.insert(std::make_pair(std::string(serviceName), Settings::providerOf(serviceName))).first;
+    }
+    return snapshotLocked(provider->second);
+}
+Settings::Ptr SettingsCache::snapshot(const std::string& providerName) {
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    return snapshotLocked(providerName);
+}
+Settings::Ptr SettingsCache::snapshotLocked(const std::string& providerName) {
+    SnapshotMap::iterator it = mSnapshots.find(providerName);
+    if (it == mSnapshots.end()) {
+        it = mSnapshots.insert(std::make_pair(providerName, Settings::Ptr(new Settings(providerName)))).first;
+    }
+    return it->second;
+}
+Settings::Ptr SettingsCache::reread(const std::string& providerName) {
+    // Читаем вне блокировки, чтобы не задерживать открытие сервисов других провайдеров.
+    Settings::Ptr settings(new Settings(providerName));
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    mSnapshots[providerName] = settings;
+    mGeneration.fetch_add(1, boost::memory_order_release);
+    return settings;
+}
+std::size_t SettingsCache::refresh(std::vector<Settings::Ptr>& changed) {
+    if (!Config::Source::refresh()) {
+        return 0;
+    }
+    SnapshotMap snapshots;
+    unsigned long generation = 0;
+    {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        snapshots = mSnapshots;
+        generation = mGeneration.load(boost::memory_order_relaxed);
+    }
+    std::vector<Settings::Ptr> fresh;
+    for (SnapshotMap::const_iterator it = snapshots.begin(); it != snapshots.end(); ++it) {
+        // Читаем вне блокировки, как и в reread. Снимок неизменяем, поэтому сравнить его с
+        // новым можно по полному текстовому представлению.
+        Settings::Ptr settings(new Settings(it->first));
+        if (settings->toJSONString() != it->second->toJSONString()) {
+            fresh.push_back(settings);
+        }
+    }
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    // Логический сервис мог перейти к другому провайдеру, это подействует на новые сервисы.
+    mProviders.clear();
+    // Пока настройки читались, reread или invalidate могли заменить или сбросить снимки, и
+    // прочитанное здесь может оказаться старее их. Такие результаты отбрасываем: сброшенные
+    // снимки прочитаются заново при обращении, а замененные уже новее. Результаты остальных
+    // провайдеров сохраняем, иначе их изменение потеряется -- источник сообщает о нем один раз.
+    const bool stale = mGeneration.load(boost::memory_order_relaxed) != generation;
+    std::size_t count = 0;
+    for (std::vector<Settings::Ptr>::const_iterator it = fresh.begin(); it != fresh.end(); ++it) {
+        const std::string& providerName = (*it)->providerName;
+        if (stale) {
+            SnapshotMap::const_iterator current = mSnapshots.find(providerName);
+            if (current == mSnapshots.end() || current->second != snapshots[providerName]) {
+                {XFS::Logger() << "SettingsCache::refresh: snapshot of " << providerName << " replaced while reading, discarded";}
+                continue;
+            }
+        }
+        mSnapshots[providerName] = *it;
+        changed.push_back(*it);
+        ++count;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    mGeneration.fetch_add(1, boost::memory_order_release);
+    {XFS::Logger() << "SettingsCache::refresh: " << count << " provider(s) changed";}
+    return count;
+}
+void SettingsCache::invalidate() {
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    {XFS::Logger() << "SettingsCache::invalidate: " << mSnapshots.size() << " provider(s)";}
+    mProviders.clear();
+    mSnapshots.clear();
+    mGeneration.fetch_add(1, boost::memory_order_release);
 }
\ No newline at end of file
@@ -3,7 +3,15 @@
 
 #pragma once
 
+// Для std::size_t
+#include <cstddef>
+#include <map>
 #include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 class Settings
 {
@@ -67,6 +75,61 @@ public:
     public:
         Workarounds() : correctChipIO(false) {}
     };
+    /// Содержит настройки записи временной шкалы активности сервис-провайдера.
+    class Timeline {
+    public:
+        /** Путь к файлу, в который записывается временная шкала в формате Chrome Trace Event.
+            Запись ведется одна на процесс, поэтому используется путь из настроек первого
+            открытого сервиса, в которых он задан.
+        @par Значение по умолчанию
+            По умолчанию содержит пустую строку, что означает, что запись не ведется.
+        */
+        std::string file;
+        /** Максимальный размер файла временной шкалы в байтах. По достижении размера запись
+            прекращается.
+        @par Значение по умолчанию
+            По умолчанию 0, что означает размер в 16 Мб.
+        */
+        std::size_t maxSize;
+    public:
+        Timeline() : maxSize(0) {}
+    };
+    /// Содержит настройки сброса статистики обмена с чипом.
+    class ApduStats {
+    public:
+        /** Путь к файлу, в который периодически сбрасывается статистика обмена с чипом в
+            формате JSON. Статистика одна на процесс, поэтому используется путь из настроек
+            первого открытого сервиса, в которых он задан.
+        @par Значение по умолчанию
+            По умолчанию содержит пустую строку, что означает, что статистика в файл не сбрасывается
+            (но по-прежнему доступна через `WFPGetInfo`).
+        */
+        std::string file;
+        /** Период сброса статистики в файл в секундах.
+        @par Значение по умолчанию
+            По умолчанию 0, что означает период в 60 секунд.
+        */
+        unsigned long period;
+    public:
+        ApduStats() : period(0) {}
+    };
+    /// Содержит настройки выбора реализации PC/SC (см. `PCSC::Backend`).
+    class Backend {
+    public:
+        /** Название реализации PC/SC: `native` -- библиотека PC/SC, с которой собран мост,
+            `simulator` -- симулятор PC/SC, если он собран вместе с мостом. Реализация одна на
+            процесс и выбирается при открытии сервиса, когда других открытых сервисов нет.
+        @par Значение по умолчанию
+            По умолчанию содержит пустую строку, что означает `native`.
+        */
+        std::string name;
+        /** Дополнительный параметр реализации. Для `simulator` -- путь к сценарию, загружаемому
+            в симулятор, например, к сеансу, записанному по `SessionRecordFile`.
+        @par Значение по умолчанию
+            По умолчанию содержит пустую строку, что означает, что параметр не задан.
+        */
+        std::string script;
+    };
 public:// Не перечитываемые настройки.
     /// Название самого провайдера. Не меняется после создания настроек.
     std::string providerName;
@@ -83,12 +146,131 @@ public:// Перечитываемые функцией reread() настрой
     bool exclusive;
     /// Настройки, касающиеся обхода багов реализации XFS подсистемы в Kalignite.
     Workarounds workarounds;
+    /// Настройки записи временной шкалы для анализа производительности.
+    Timeline timeline;
+    /// Настройки сброса статистики обмена с чипом.
+    ApduStats apduStats;
+    /// Настройки выбора реализации PC/SC.
+    Backend backend;
+    /** Путь к файлу, в который дописывается содержимое бортового самописца при ошибках и по
+        вендорской команде. Самописец один на процесс, поэтому используется путь из настроек
+        первого открытого сервиса, в которых он задан.
+    @par Значение по умолчанию
+        По умолчанию содержит пустую строку, что означает файл `pcsc-cenxfs-bridge.flight.log`
+        во временном каталоге (`%TEMP%`).
+    */
+    std::string flightRecorderFile;
+    /** Если `true`, то ведется учет памяти, выделяемой для передачи XFS-менеджеру, по местам
+        выделения. Учет один на процесс и включается первым сервисом, в настройках которого
+        он задан.
+    @par Значение по умолчанию
+        По умолчанию учет не ведется.
+    */
+    bool memoryStats;
+    /** Путь к файлу, в который записывается сеанс работы со считывателями в виде
+        сценария симулятора PC/SC для последующего воспроизведения. Запись одна на процесс
+        и начинается при открытии сервиса, когда других открытых сервисов нет, т.к. для
+        нее вызовы PC/SC переводятся на записывающую обертку (`Diagnostics::RecordingBackend`).
+    @par Значение по умолчанию
+        По умолчанию содержит пустую строку, что означает, что запись не ведется.
+    */
+    std::string sessionRecordFile;
+    /** Записывать сеанс (см. `sessionRecordFile`) без сокрытия PIN и данных карты. Применяется
+        при начале записи.
+    @par Значение по умолчанию
+        По умолчанию `false`: данные команд, передающих PIN, и ответы с данными держателя карты
+        скрываются (см. `Diagnostics::SessionRecorder`).
+    */
+    bool sessionRecordPlaintext;
+    /** Период в секундах, с которым проверяется, не изменилась ли конфигурация. Изменившиеся
+        настройки применяются к открытым сервисам без их переоткрытия (см. `SettingsWatcher`).
+        Проверка одна на процесс и запускается первым сервисом, в настройках которого она задана.
+    @par Значение по умолчанию
+        По умолчанию 0, что означает, что конфигурация не проверяется и настройки перечитываются
+        только по вендорской команде `WFS_CMD_IDC_VENDOR_REREAD_SETTINGS`.
+    */
+    unsigned long reloadPeriod;
+    /** Время в секундах, в течение которого поток отслеживания изменений продолжает опрашивать
+        считыватели после последней команды, если изменения никому не нужны: нет ни задач, ни
+        подписчиков на события. После этого поток простаивает до появления задачи, подписчика
+        или команды (см. `ReaderChangesMonitor::setIdleTimeout`). Настройка одна на процесс,
+        действует значение последнего открытого или перечитанного провайдера.
+    @par Значение по умолчанию
+        По умолчанию 0, что означает, что поток опрашивает считыватели, пока открыт хоть один сервис.
+    */
+    unsigned long idleTimeout;
+public:
+    /// Неизменяемый снимок настроек, разделяемый всеми сервисами одного провайдера.
+    typedef boost::shared_ptr<const Settings> Ptr;
 public:
     Settings(const char* serviceName, int traceLevel);
+    /// Читает настройки указанного провайдера, минуя поиск провайдера логического сервиса.
+    explicit Settings(const std::string& providerName);
 
     /// Перечитывает все настройки сервис-провайдера, кроме названия сервис-провайдера.
     void reread();
     std::string toJSONString() const;
+
+    /// Читает из конфигурации XFS название провайдера логического сервиса.
+    static std::string providerOf(const char* serviceName);
+};
+/** Кэш настроек провайдеров на время жизни процесса. Каждый `WFPOpen` читал настройки заново
+    цепочкой открытий ключей и запросов значений, хотя для одного провайдера они одни и те же.
+    Кэш читает их при первом открытии сервиса провайдера и раздает всем его сервисам один
+    неизменяемый снимок.
+@par
+    Каждая замена снимков увеличивает поколение кэша. Сервис сверяет поколение перед каждой
+    командой и, если оно изменилось, переходит на актуальный снимок своего провайдера
+    (см. `Service::updateSettings`), так что команда от начала до конца видит одни настройки.
+*/
+class SettingsCache {
+    typedef std::map<std::string, std::string> ProviderMap;
+    typedef std::map<std::string, Settings::Ptr> SnapshotMap;
+private:
+    /// Защищает словари от одновременного открытия сервисов из разных потоков.
+    boost::mutex mMutex;
+    /// Названия провайдеров логических сервисов.
+    ProviderMap mProviders;
+    /// Снимки настроек по названиям провайдеров.
+    SnapshotMap mSnapshots;
+    /// Увеличивается при каждой замене или сбросе снимков.
+    boost::atomic<unsigned long> mGeneration;
+public:
+    static SettingsCache& instance();
+    /** Возвращает снимок настроек провайдера логического сервиса, читая их из конфигурации
+        только при первом обращении или после сброса кэша.
+    @param serviceName
+        Название логического сервиса, переданное в `WFPOpen`.
+    */
+    Settings::Ptr get(const char* serviceName);
+    /** Возвращает снимок настроек провайдера, читая их из конфигурации, если снимка нет.
+    @param providerName
+        Название провайдера (`Settings::providerName`).
+    */
+    Settings::Ptr snapshot(const std::string& providerName);
+    /// Поколение кэша. Начинается с 1, поэтому 0 означает, что снимок ни разу не сверялся.
+    inline unsigned long generation() const { return mGeneration.load(boost::memory_order_acquire); }
+    /** Перечитывает настройки провайдера и заменяет ими снимок в кэше.
+    @return
+        Новый снимок.
+    */
+    Settings::Ptr reread(const std::string& providerName);
+    /** Перечитывает настройки всех провайдеров из кэша, если источник конфигурации мог
+        измениться (см. `Config::Source::refresh`), и заменяет снимки тех, что изменились.
+        Снимки, замененные или сброшенные другим потоком во время чтения, не перезаписываются.
+    @param changed
+        Новые снимки изменившихся провайдеров.
+    @return
+        Количество замененных снимков.
+    */
+    std::size_t refresh(std::vector<Settings::Ptr>& changed);
+    /** Сбрасывает кэш, в том числе названия провайдеров логических сервисов. Следующее открытие
+        сервиса и следующая команда открытого сервиса прочитают конфигурацию заново.
+    */
+    void invalidate();
+private:
+    SettingsCache() : mGeneration(1) {}
+    Settings::Ptr snapshotLocked(const std::string& providerName);
 };
 
 #endif // PCSC_CENXFS_BRIDGE_Settings_H
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "SettingsWatcher.h"
+
+#include "Manager.h"
+#include "Settings.h"
+
+#include "XFS/Logger.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/chrono/chrono.hpp>
+
+namespace bc = boost::chrono;
+
+SettingsWatcher::SettingsWatcher(Manager& manager)
+    : manager(manager), mPeriod(0), mStopRequested(false) {}
+SettingsWatcher::~SettingsWatcher() {
+    stop();
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void SettingsWatcher::start(unsigned long period) {
+    boost::lock_guard<boost::mutex> lock(mMutex);
+    if (mThread || period == 0) {
+        return;
+    }
+    mPeriod = period;
+    mStopRequested = false;
+    mThread.reset(new boost::thread(boost::bind(&SettingsWatcher::run, this)));
+}
+void SettingsWatcher::stop() {
+    boost::shared_ptr<boost::thread> thread;
+    {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        mStopRequested = true;
+        thread.swap(mThread);
+    }
+    mChanged.notify_all();
+    if (thread) {
+        thread->join();
+    }
+}
+void SettingsWatcher::run() {
+    {XFS::Logger() << "Settings watcher thread runned, period " << mPeriod << " s";}
+    boost::unique_lock<boost::mutex> lock(mMutex);
+    for (;;) {
+        const bc::steady_clock::time_point deadline = bc::steady_clock::now() + bc::seconds(mPeriod);
+        while (!mStopRequested && mChanged.wait_until(lock, deadline) != boost::cv_status::timeout) {}
+        if (mStopRequested) {
+            break;
+        }
+        lock.unlock();
+        std::vector<Settings::Ptr> changed;
+        if (SettingsCache::instance().refresh(changed) != 0) {
+            for (std::vector<Settings::Ptr>::const_iterator it = changed.begin(); it != changed.end(); ++it) {
+                manager.configure(**it);
+            }
+        }
+        lock.lock();
+    }
+    {XFS::Logger() << "Settings watcher thread stopped";}
+}
@@ -0,0 +1,47 @@
+#ifndef PCSC_CENXFS_BRIDGE_SettingsWatcher_H
+#define PCSC_CENXFS_BRIDGE_SettingsWatcher_H
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class Manager;
+/** Поток, периодически проверяющий, не изменилась ли конфигурация, и публикующий новые
+    снимки настроек (см. `SettingsCache::refresh`). Для `.reg` файла проверка стоит одного
+    запроса времени его изменения, конфигурация XFS отметки версии не имеет, поэтому читается
+    целиком и сравнивается с прежней.
+@par
+    Открытые сервисы переходят на новый снимок сами, перед очередной командой (см.
+    `Service::updateSettings`). Настройки, общие на процесс (запись временной шкалы,
+    статистики обмена с чипом, учет памяти), применяются сразу, так же, как при открытии сервиса.
+*/
+class SettingsWatcher : private boost::noncopyable {
+    Manager& manager;
+    /// Защищает период и флаг остановки.
+    boost::mutex mMutex;
+    /// Сигнализирует об остановке.
+    boost::condition_variable mChanged;
+    /// Период проверки в секундах.
+    unsigned long mPeriod;
+    bool mStopRequested;
+    boost::shared_ptr<boost::thread> mThread;
+public:
+    SettingsWatcher(Manager& manager);
+    /// Останавливает поток проверки и ждет его завершения.
+    ~SettingsWatcher();
+    /** Запускает поток проверки, если он еще не запущен.
+    @param period
+        Период проверки в секундах. Если поток уже запущен, период не меняется.
+    */
+    void start(unsigned long period);
+    /// Останавливает поток проверки и ждет его завершения. Поток можно запустить снова.
+    void stop();
+private:
+    void run();
+};
+
+#endif // PCSC_CENXFS_BRIDGE_SettingsWatcher_H
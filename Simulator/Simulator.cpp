@@ -0,0 +1,965 @@
+#include "Simulator.h"
+
+#include <algorithm>
+#include <cctype>
+// Для std::getenv
+#include <cstdlib>
+// Для std::memcpy
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <boost/random/exponential_distribution.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <boost/thread/lock_types.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace bc = boost::chrono;
+
+namespace Simulator {
+    /// Маска флагов состояния считывателя, изменение которых является событием.
+    static const DWORD stateMask = SCARD_STATE_UNKNOWN | SCARD_STATE_UNAVAILABLE
+                                 | SCARD_STATE_EMPTY | SCARD_STATE_PRESENT
+                                 | SCARD_STATE_EXCLUSIVE | SCARD_STATE_INUSE | SCARD_STATE_MUTE;
+
+    /// Разбивает строку сценария на слова. Слова в кавычках могут содержать пробелы, `#` начинает комментарий.
+    static std::vector<std::string> tokenize(const std::string& line) {
+        std::vector<std::string> result;
+        std::size_t i = 0;
+        while (i < line.size()) {
+            if (std::isspace((unsigned char)line[i])) {
+                ++i;
+                continue;
+            }
+            if (line[i] == '#') {
+                break;
+            }
+            std::string token;
+            if (line[i] == '"') {
+                for (++i; i < line.size() && line[i] != '"'; ++i) {
+                    token += line[i];
+                }
+                ++i;
+            } else {
+                for (; i < line.size() && !std::isspace((unsigned char)line[i]); ++i) {
+                    token += line[i];
+                }
+            }
+            result.push_back(token);
+        }
+        return result;
+    }
+    /** Разбирает длительность вида `250us`, `1.5ms`, `2s`. Без единиц измерения -- миллисекунды.
+    @return `true`, если строка корректна.
+    */
+    static bool parseDuration(const std::string& text, double& us) {
+        std::istringstream ss(text);
+        double value;
+        if (!(ss >> value) || value < 0) {
+            return false;
+        }
+        std::string unit;
+        ss >> unit;
+        if (unit == "us") { us = value; } else
+        if (unit == "ms" || unit.empty()) { us = value * 1000; } else
+        if (unit == "s") { us = value * 1000000; } else {
+            return false;
+        }
+        return true;
+    }
+    static Clock::duration toDuration(double us) {
+        return bc::duration_cast<Clock::duration>(bc::microseconds((long long)us));
+    }
+    /** Разбирает распределение задержки, начиная с токена `i`: `fixed T`, `uniform A B`,
+        `normal MEAN SD`, `exp MEAN` или просто `T`.
+    */
+    static bool parseLatency(const std::vector<std::string>& t, std::size_t i, Latency& result, std::string& error) {
+        if (i >= t.size()) {
+            error = "latency distribution expected";
+            return false;
+        }
+        double a = 0;
+        double b = 0;
+        const std::string& kind = t[i];
+        std::size_t params = kind == "uniform" || kind == "normal" ? 2 : (kind == "fixed" || kind == "exp" ? 1 : 0);
+        if (params == 0) {
+            if (!parseDuration(kind, a)) {
+                error = "unknown latency distribution '" + kind + "'";
+                return false;
+            }
+            result = Latency(Latency::Fixed, a);
+            return i + 1 == t.size() || (error = "unexpected '" + t[i + 1] + "'", false);
+        }
+        if (i + params + 1 != t.size()
+         || !parseDuration(t[i + 1], a)
+         || (params == 2 && !parseDuration(t[i + 2], b))
+        ) {
+            error = "invalid parameters of '" + kind + "' distribution";
+            return false;
+        }
+        if (kind == "fixed")   { result = Latency(Latency::Fixed, a);       } else
+        if (kind == "uniform") { result = Latency(Latency::Uniform, a, b);  } else
+        if (kind == "normal")  { result = Latency(Latency::Normal, a, b);   } else {
+            result = Latency(Latency::Exponential, a);
+        }
+        return true;
+    }
+    static int hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+    /** Разбирает 16-ричную строку. Если `wildcards` равно `true`, то `??` означает любой байт
+        (записывается как `-1`), а `*` в конце -- любое продолжение.
+    */
+    static bool parseHex(const std::string& text, std::vector<int>& out, bool wildcards, bool* prefix) {
+        std::size_t end = text.size();
+        if (wildcards && end != 0 && text[end - 1] == '*') {
+            *prefix = true;
+            --end;
+        }
+        if (end % 2 != 0) {
+            return false;
+        }
+        for (std::size_t i = 0; i < end; i += 2) {
+            if (wildcards && text[i] == '?' && text[i + 1] == '?') {
+                out.push_back(-1);
+                continue;
+            }
+            int hi = hexDigit(text[i]);
+            int lo = hexDigit(text[i + 1]);
+            if (hi < 0 || lo < 0) {
+                return false;
+            }
+            out.push_back(hi << 4 | lo);
+        }
+        return true;
+    }
+    static bool parseBytes(const std::string& text, std::vector<BYTE>& out) {
+        std::vector<int> data;
+        if (!parseHex(text, data, false, NULL)) {
+            return false;
+        }
+        out.insert(out.end(), data.begin(), data.end());
+        return true;
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    Clock::duration Latency::sample(boost::random::mt19937& rng) const {
+        double us = mA;
+        switch (mKind) {
+            case Fixed: break;
+            case Uniform: {
+                us = boost::random::uniform_real_distribution<double>(mA, std::max(mA, mB))(rng);
+                break;
+            }
+            case Normal: {
+                us = mB > 0 ? boost::random::normal_distribution<double>(mA, mB)(rng) : mA;
+                break;
+            }
+            case Exponential: {
+                us = mA > 0 ? boost::random::exponential_distribution<double>(1 / mA)(rng) : 0;
+                break;
+            }
+        }
+        return toDuration(us < 0 ? 0 : us);
+    }
+    bool Response::match(const BYTE* command, std::size_t size) const {
+        if (size < pattern.size() || (!prefix && size != pattern.size())) {
+            return false;
+        }
+        for (std::size_t i = 0; i < pattern.size(); ++i) {
+            if (pattern[i] >= 0 && pattern[i] != command[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    Engine& Engine::instance() {
+        // Не разрушается: контекст моста открывается при первом WFPOpen, т.е. уже после
+        // создания менеджера, и поток монитора может обращаться к симулятору до самого выхода.
+        static Engine* engine = new Engine();
+        return *engine;
+    }
+    Engine::Engine()
+        : mNextEvent(0), mOrigin(Clock::now()), mLoop(Clock::duration::zero()), mSpeed(1), mLastHandle(0)
+    {
+        const char* script = std::getenv("PCSC_SIMULATOR_SCRIPT");
+        if (script != NULL && *script != '\0') {
+            std::string error;
+            if (!load(script, error)) {
+                std::cerr << "PC/SC simulator: " << script << ": " << error << std::endl;
+            }
+        }
+        // Переменная окружения имеет приоритет над командой `speed` сценария.
+        const char* speed = std::getenv("PCSC_SIMULATOR_SPEED");
+        if (speed != NULL && *speed != '\0') {
+            setSpeed(std::strtod(speed, NULL));
+        }
+    }
+    void Engine::reset() {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        mReaders.clear();
+        mCards.clear();
+        mLatencies.clear();
+        mTimeline.clear();
+        mNextEvent = 0;
+        mLoop = Clock::duration::zero();
+        mSpeed = 1;
+        mChanged.notify_all();
+    }
+    bool Engine::load(const std::string& path, std::string& error) {
+        std::ifstream f(path.c_str());
+        if (!f) {
+            error = "cannot open file";
+            return false;
+        }
+        return load(f, error);
+    }
+    bool Engine::load(std::istream& is, std::string& error) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        std::string line;
+        bool ok = true;
+        for (std::size_t n = 1; ok && std::getline(is, line); ++n) {
+            std::vector<std::string> tokens = tokenize(line);
+            if (!tokens.empty() && !parseLine(tokens, error)) {
+                std::ostringstream ss;
+                ss << "line " << n << ": " << error;
+                error = ss.str();
+                ok = false;
+            }
+        }
+        std::stable_sort(mTimeline.begin(), mTimeline.end(), Event::earlier);
+        mNextEvent = 0;
+        mOrigin = Clock::now();
+        mChanged.notify_all();
+        return ok;
+    }
+    bool Engine::parseLine(const std::vector<std::string>& t, std::string& error) {
+        const std::string& cmd = t[0];
+        if (cmd == "seed" && t.size() == 2) {
+            mRng.seed((unsigned int)std::strtoul(t[1].c_str(), NULL, 10));
+            return true;
+        }
+        if (cmd == "reader" && t.size() == 2) {
+            attachLocked(t[1]);
+            return true;
+        }
+        if (cmd == "card" && t.size() >= 4) {
+            Card card;
+            card.protocols = 0;
+            if (t[2].find("T0") != std::string::npos) card.protocols |= SCARD_PROTOCOL_T0;
+            if (t[2].find("T1") != std::string::npos) card.protocols |= SCARD_PROTOCOL_T1;
+            for (std::size_t i = 3; i < t.size(); ++i) {
+                if (!parseBytes(t[i], card.atr)) {
+                    error = "invalid ATR '" + t[i] + "'";
+                    return false;
+                }
+            }
+            if (card.protocols == 0 || card.atr.empty() || card.atr.size() > MAX_ATR_SIZE) {
+                error = "card requires protocols (T0, T1 or T0+T1) and ATR of 1.." + std::string("33 bytes");
+                return false;
+            }
+            mCards[t[1]] = card;
+            return true;
+        }
+        if (cmd == "apdu" && t.size() >= 4) {
+            std::map<std::string, Card>::iterator card = mCards.find(t[1]);
+            if (card == mCards.end()) {
+                error = "unknown card '" + t[1] + "'";
+                return false;
+            }
+            Response r;
+            if (!parseHex(t[2], r.pattern, true, &r.prefix) || !parseBytes(t[3], r.data) || r.data.size() < 2) {
+                error = "invalid command pattern or response";
+                return false;
+            }
+            std::size_t i = 4;
+            if (i < t.size() && t[i] == "once") {
+                r.once = true;
+                ++i;
+            }
+            if (t.size() > i && (t[i] != "latency" || !parseLatency(t, i + 1, r.latency, error))) {
+                if (error.empty()) error = "'latency' expected";
+                return false;
+            }
+            card->second.responses.push_back(r);
+            return true;
+        }
+        if (cmd == "latency" && t.size() >= 3) {
+            Latency latency;
+            if (!parseLatency(t, 2, latency, error)) {
+                return false;
+            }
+            mLatencies[t[1]] = latency;
+            return true;
+        }
+        if (cmd == "insert" && t.size() == 3) {
+            if (!insertLocked(t[1], t[2])) {
+                error = "unknown reader or card";
+                return false;
+            }
+            return true;
+        }
+        if (cmd == "remove" && t.size() == 2) {
+            removeLocked(t[1]);
+            return true;
+        }
+        if (cmd == "speed" && t.size() == 2) {
+            const double factor = std::strtod(t[1].c_str(), NULL);
+            if (factor <= 0) {
+                error = "speed factor must be positive";
+                return false;
+            }
+            mSpeed = factor;
+            return true;
+        }
+        if (cmd == "loop" && t.size() == 2) {
+            double us;
+            if (!parseDuration(t[1], us)) {
+                error = "invalid period";
+                return false;
+            }
+            mLoop = toDuration(us);
+            return true;
+        }
+        if (cmd == "at" && t.size() >= 4) {
+            double us;
+            if (!parseDuration(t[1], us)) {
+                error = "invalid time";
+                return false;
+            }
+            Event e;
+            e.at = toDuration(us);
+            e.reader = t[3];
+            if (t[2] == "insert" && t.size() == 5) {
+                if (mCards.find(t[4]) == mCards.end()) {
+                    error = "unknown card '" + t[4] + "'";
+                    return false;
+                }
+                e.kind = Event::Insert;
+                e.card = t[4];
+            } else
+            if (t[2] == "remove" && t.size() == 4) { e.kind = Event::Remove; } else
+            if (t[2] == "attach" && t.size() == 4) { e.kind = Event::Attach; } else
+            if (t[2] == "detach" && t.size() == 4) { e.kind = Event::Detach; } else {
+                error = "expected 'at <time> insert <reader> <card>|remove|attach|detach <reader>'";
+                return false;
+            }
+            mTimeline.push_back(e);
+            return true;
+        }
+        error = "unknown or malformed command '" + cmd + "'";
+        return false;
+    }
+    void Engine::seed(unsigned int value) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        mRng.seed(value);
+    }
+    void Engine::setSpeed(double factor) {
+        if (factor <= 0) {
+            return;
+        }
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        mSpeed = factor;
+        mChanged.notify_all();
+    }
+    void Engine::setLatency(const std::string& function, const Latency& latency) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        mLatencies[function] = latency;
+    }
+    void Engine::defineCard(const std::string& name, const Card& card) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        mCards[name] = card;
+    }
+    bool Engine::addResponse(const std::string& card, const Response& response) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        std::map<std::string, Card>::iterator it = mCards.find(card);
+        if (it == mCards.end()) {
+            return false;
+        }
+        it->second.responses.push_back(response);
+        return true;
+    }
+    void Engine::attach(const std::string& reader) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        attachLocked(reader);
+    }
+    void Engine::detach(const std::string& reader) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        detachLocked(reader);
+    }
+    bool Engine::insert(const std::string& reader, const std::string& card) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        return insertLocked(reader, card);
+    }
+    void Engine::remove(const std::string& reader) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        removeLocked(reader);
+    }
+    std::size_t Engine::readerCount() {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        return mReaders.size();
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    Engine::Reader* Engine::findLocked(const std::string& name) {
+        for (std::vector<Reader>::iterator it = mReaders.begin(); it != mReaders.end(); ++it) {
+            if (it->name == name) {
+                return &*it;
+            }
+        }
+        return NULL;
+    }
+    void Engine::attachLocked(const std::string& reader) {
+        if (findLocked(reader) == NULL) {
+            Reader r;
+            r.name = reader;
+            mReaders.push_back(r);
+            mChanged.notify_all();
+        }
+    }
+    void Engine::detachLocked(const std::string& reader) {
+        for (std::vector<Reader>::iterator it = mReaders.begin(); it != mReaders.end(); ++it) {
+            if (it->name == reader) {
+                mReaders.erase(it);
+                mChanged.notify_all();
+                return;
+            }
+        }
+    }
+    bool Engine::insertLocked(const std::string& reader, const std::string& card) {
+        Reader* r = findLocked(reader);
+        if (r == NULL || mCards.find(card) == mCards.end()) {
+            return false;
+        }
+        removeLocked(reader);
+        // Новая вставка -- новый сеанс с картой, одноразовые правила снова действуют.
+        std::vector<Response>& responses = mCards[card].responses;
+        for (std::vector<Response>::iterator it = responses.begin(); it != responses.end(); ++it) {
+            it->used = false;
+        }
+        r->card = card;
+        ++r->insertion;
+        ++r->events;
+        mChanged.notify_all();
+        return true;
+    }
+    void Engine::removeLocked(const std::string& reader) {
+        Reader* r = findLocked(reader);
+        if (r == NULL || r->card.empty()) {
+            return;
+        }
+        // Соединения с вынутой картой остаются, но становятся недействительными.
+        r->card.clear();
+        r->connections = 0;
+        r->exclusive = false;
+        r->transaction = 0;
+        ++r->events;
+        mChanged.notify_all();
+    }
+    Clock::duration Engine::scaledLocked(Clock::duration d) const {
+        return mSpeed == 1 ? d : Clock::duration((Clock::rep)(d.count() / mSpeed));
+    }
+    void Engine::advanceLocked(Clock::time_point now) {
+        while (!mTimeline.empty()) {
+            if (mNextEvent >= mTimeline.size()) {
+                if (mLoop <= Clock::duration::zero()) {
+                    return;
+                }
+                mOrigin += scaledLocked(mLoop);
+                mNextEvent = 0;
+            }
+            const Event& e = mTimeline[mNextEvent];
+            if (mOrigin + scaledLocked(e.at) > now) {
+                return;
+            }
+            switch (e.kind) {
+                case Event::Insert: insertLocked(e.reader, e.card); break;
+                case Event::Remove: removeLocked(e.reader); break;
+                case Event::Attach: attachLocked(e.reader); break;
+                case Event::Detach: detachLocked(e.reader); break;
+            }
+            ++mNextEvent;
+        }
+    }
+    Clock::time_point Engine::nextEventLocked() const {
+        if (mTimeline.empty()) {
+            return Clock::time_point::max();
+        }
+        if (mNextEvent < mTimeline.size()) {
+            return mOrigin + scaledLocked(mTimeline[mNextEvent].at);
+        }
+        if (mLoop <= Clock::duration::zero()) {
+            return Clock::time_point::max();
+        }
+        return mOrigin + scaledLocked(mLoop + mTimeline[0].at);
+    }
+    bool Engine::evaluateLocked(SCARD_READERSTATE* rgReaderStates, DWORD cReaders) {
+        bool changed = false;
+        for (DWORD i = 0; i < cReaders; ++i) {
+            SCARD_READERSTATE& s = rgReaderStates[i];
+            const DWORD current = s.dwCurrentState;
+            if (current & SCARD_STATE_IGNORE) {
+                s.dwEventState = SCARD_STATE_IGNORE;
+                continue;
+            }
+            DWORD event;
+            bool ch;
+            if (std::strcmp(s.szReader, pnpNotification()) == 0) {
+                // Количество считывателей сообщается, как и в pcsc-lite, в старшем слове.
+                event = (DWORD)mReaders.size() << 16;
+                ch = (current >> 16) != mReaders.size();
+                s.cbAtr = 0;
+            } else {
+                const Reader* r = findLocked(s.szReader);
+                if (r == NULL) {
+                    event = SCARD_STATE_UNKNOWN | SCARD_STATE_IGNORE;
+                    ch = (current & SCARD_STATE_UNKNOWN) == 0;
+                    s.cbAtr = 0;
+                } else {
+                    event = r->card.empty() ? SCARD_STATE_EMPTY : SCARD_STATE_PRESENT;
+                    if (r->exclusive) {
+                        event |= SCARD_STATE_EXCLUSIVE | SCARD_STATE_INUSE;
+                    } else
+                    if (r->connections != 0) {
+                        event |= SCARD_STATE_INUSE;
+                    }
+                    event |= (DWORD)r->events << 16;
+                    ch = current == SCARD_STATE_UNAWARE
+                      || (current & stateMask) != (event & stateMask)
+                      || ((current & 0xFFFF0000) != 0 && (current >> 16) != r->events);
+                    s.cbAtr = 0;
+                    if (!r->card.empty()) {
+                        const std::vector<BYTE>& atr = mCards[r->card].atr;
+                        s.cbAtr = (DWORD)atr.size();
+                        std::memcpy(s.rgbAtr, &atr[0], atr.size());
+                    }
+                }
+            }
+            s.dwEventState = event | (ch ? SCARD_STATE_CHANGED : 0);
+            changed = changed || ch;
+        }
+        return changed;
+    }
+    LONG Engine::checkLocked(SCARDHANDLE hCard, Connection*& connection, Reader*& reader) {
+        std::map<SCARDHANDLE, Connection>::iterator it = mConnections.find(hCard);
+        if (it == mConnections.end()) {
+            return SCARD_E_INVALID_HANDLE;
+        }
+        connection = &it->second;
+        reader = findLocked(connection->reader);
+        if (reader == NULL) {
+            return SCARD_E_READER_UNAVAILABLE;
+        }
+        if (reader->card.empty() || reader->insertion != connection->insertion) {
+            return SCARD_W_REMOVED_CARD;
+        }
+        return SCARD_S_SUCCESS;
+    }
+    void Engine::delay(const char* function, const Latency& extra) {
+        Clock::duration d = Clock::duration::zero();
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            std::map<std::string, Latency>::const_iterator it = mLatencies.find(function);
+            if (it != mLatencies.end() && !it->second.zero()) {
+                d += it->second.sample(mRng);
+            }
+            if (!extra.zero()) {
+                d += extra.sample(mRng);
+            }
+            d = scaledLocked(d);
+        }
+        if (d > Clock::duration::zero()) {
+            boost::this_thread::sleep_for(d);
+        }
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    LONG Engine::establishContext(LPSCARDCONTEXT phContext) {
+        if (phContext == NULL) {
+            return SCARD_E_INVALID_PARAMETER;
+        }
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            *phContext = ++mLastHandle;
+            mContexts[*phContext] = Context();
+        }
+        delay("SCardEstablishContext");
+        return SCARD_S_SUCCESS;
+    }
+    LONG Engine::releaseContext(SCARDCONTEXT hContext) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        if (mContexts.erase(hContext) == 0) {
+            return SCARD_E_INVALID_HANDLE;
+        }
+        // Ожидающие в SCardGetStatusChange завершатся отменой.
+        mChanged.notify_all();
+        return SCARD_S_SUCCESS;
+    }
+    LONG Engine::isValidContext(SCARDCONTEXT hContext) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        return mContexts.find(hContext) != mContexts.end() ? SCARD_S_SUCCESS : SCARD_E_INVALID_HANDLE;
+    }
+    LONG Engine::listReaders(SCARDCONTEXT hContext, LPSTR mszReaders, LPDWORD pcchReaders) {
+        if (pcchReaders == NULL) {
+            return SCARD_E_INVALID_PARAMETER;
+        }
+        LONG result = SCARD_S_SUCCESS;
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            advanceLocked(Clock::now());
+            if (mContexts.find(hContext) == mContexts.end()) {
+                return SCARD_E_INVALID_HANDLE;
+            }
+            std::string names;
+            for (std::vector<Reader>::const_iterator it = mReaders.begin(); it != mReaders.end(); ++it) {
+                names += it->name;
+                names += '\0';
+            }
+            names += '\0';
+            if (mReaders.empty()) {
+                *pcchReaders = 0;
+                result = SCARD_E_NO_READERS_AVAILABLE;
+            } else
+            if (mszReaders != NULL && *pcchReaders < names.size()) {
+                *pcchReaders = (DWORD)names.size();
+                result = SCARD_E_INSUFFICIENT_BUFFER;
+            } else {
+                if (mszReaders != NULL) {
+                    std::memcpy(mszReaders, names.data(), names.size());
+                }
+                *pcchReaders = (DWORD)names.size();
+            }
+        }
+        delay("SCardListReaders");
+        return result;
+    }
+    LONG Engine::getStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout, SCARD_READERSTATE* rgReaderStates, DWORD cReaders) {
+        if (rgReaderStates == NULL && cReaders != 0) {
+            return SCARD_E_INVALID_PARAMETER;
+        }
+        const Clock::time_point deadline = dwTimeout == INFINITE
+            ? Clock::time_point::max()
+            : Clock::now() + bc::milliseconds(dwTimeout);
+        LONG result;
+        {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            std::map<SCARDCONTEXT, Context>::iterator ctx = mContexts.find(hContext);
+            if (ctx == mContexts.end()) {
+                return SCARD_E_INVALID_HANDLE;
+            }
+            const unsigned long cancels = ctx->second.cancels;
+            ++ctx->second.waiting;
+            for (;;) {
+                const Clock::time_point now = Clock::now();
+                advanceLocked(now);
+                ctx = mContexts.find(hContext);
+                if (ctx == mContexts.end()) {
+                    result = SCARD_E_CANCELLED;
+                    break;
+                }
+                if (evaluateLocked(rgReaderStates, cReaders)) {
+                    result = SCARD_S_SUCCESS;
+                    break;
+                }
+                if (ctx->second.cancels != cancels) {
+                    result = SCARD_E_CANCELLED;
+                    break;
+                }
+                if (now >= deadline) {
+                    result = SCARD_E_TIMEOUT;
+                    break;
+                }
+                const Clock::time_point wake = std::min(deadline, nextEventLocked());
+                if (wake == Clock::time_point::max()) {
+                    mChanged.wait(lock);
+                } else {
+                    mChanged.wait_until(lock, wake);
+                }
+            }
+            if (ctx != mContexts.end()) {
+                --ctx->second.waiting;
+            }
+        }
+        // Задержка доставки события от драйвера до приложения.
+        if (result == SCARD_S_SUCCESS) {
+            delay("SCardGetStatusChange");
+        }
+        return result;
+    }
+    LONG Engine::cancel(SCARDCONTEXT hContext) {
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            std::map<SCARDCONTEXT, Context>::iterator ctx = mContexts.find(hContext);
+            if (ctx == mContexts.end()) {
+                return SCARD_E_INVALID_HANDLE;
+            }
+            // Как и в pcsc-lite, отмена действует только на уже начатое ожидание.
+            if (ctx->second.waiting != 0) {
+                ++ctx->second.cancels;
+                mChanged.notify_all();
+            }
+        }
+        delay("SCardCancel");
+        return SCARD_S_SUCCESS;
+    }
+    LONG Engine::connect(SCARDCONTEXT hContext, LPCSTR szReader, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                         LPSCARDHANDLE phCard, LPDWORD pdwActiveProtocol) {
+        if (szReader == NULL || phCard == NULL || pdwActiveProtocol == NULL) {
+            return SCARD_E_INVALID_PARAMETER;
+        }
+        LONG result = SCARD_S_SUCCESS;
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            advanceLocked(Clock::now());
+            Reader* r = findLocked(szReader);
+            if (mContexts.find(hContext) == mContexts.end()) {
+                result = SCARD_E_INVALID_HANDLE;
+            } else
+            if (r == NULL) {
+                result = SCARD_E_UNKNOWN_READER;
+            } else
+            if (r->card.empty()) {
+                result = SCARD_E_NO_SMARTCARD;
+            } else
+            if (r->exclusive || (dwShareMode == SCARD_SHARE_EXCLUSIVE && r->connections != 0)) {
+                result = SCARD_E_SHARING_VIOLATION;
+            } else {
+                const DWORD protocols = mCards[r->card].protocols & dwPreferredProtocols;
+                if (protocols == 0) {
+                    result = SCARD_E_PROTO_MISMATCH;
+                } else {
+                    Connection c;
+                    c.reader = r->name;
+                    c.insertion = r->insertion;
+                    c.protocol = protocols & SCARD_PROTOCOL_T0 ? SCARD_PROTOCOL_T0 : SCARD_PROTOCOL_T1;
+                    c.exclusive = dwShareMode == SCARD_SHARE_EXCLUSIVE;
+                    *phCard = ++mLastHandle;
+                    *pdwActiveProtocol = c.protocol;
+                    mConnections[*phCard] = c;
+                    ++r->connections;
+                    r->exclusive = c.exclusive;
+                    mChanged.notify_all();
+                }
+            }
+        }
+        delay("SCardConnect");
+        return result;
+    }
+    LONG Engine::reconnect(SCARDHANDLE hCard, DWORD dwShareMode, DWORD dwPreferredProtocols, DWORD dwInitialization,
+                           LPDWORD pdwActiveProtocol) {
+        LONG result;
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            Connection* c;
+            Reader* r;
+            result = checkLocked(hCard, c, r);
+            if (result == SCARD_S_SUCCESS) {
+                const DWORD protocols = mCards[r->card].protocols & dwPreferredProtocols;
+                if (protocols == 0) {
+                    result = SCARD_E_PROTO_MISMATCH;
+                } else
+                if (dwShareMode == SCARD_SHARE_EXCLUSIVE && r->connections > 1) {
+                    result = SCARD_E_SHARING_VIOLATION;
+                } else {
+                    c->protocol = protocols & SCARD_PROTOCOL_T0 ? SCARD_PROTOCOL_T0 : SCARD_PROTOCOL_T1;
+                    c->exclusive = dwShareMode == SCARD_SHARE_EXCLUSIVE;
+                    r->exclusive = c->exclusive;
+                    if (pdwActiveProtocol != NULL) {
+                        *pdwActiveProtocol = c->protocol;
+                    }
+                    mChanged.notify_all();
+                }
+            }
+        }
+        delay("SCardReconnect");
+        return result;
+    }
+    LONG Engine::disconnect(SCARDHANDLE hCard, DWORD dwDisposition) {
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            std::map<SCARDHANDLE, Connection>::iterator it = mConnections.find(hCard);
+            if (it == mConnections.end()) {
+                return SCARD_E_INVALID_HANDLE;
+            }
+            Reader* r = findLocked(it->second.reader);
+            if (r != NULL && !r->card.empty() && r->insertion == it->second.insertion) {
+                --r->connections;
+                if (it->second.exclusive) {
+                    r->exclusive = false;
+                }
+                if (r->transaction == hCard) {
+                    r->transaction = 0;
+                }
+            }
+            mConnections.erase(it);
+            mChanged.notify_all();
+        }
+        delay("SCardDisconnect");
+        return SCARD_S_SUCCESS;
+    }
+    LONG Engine::beginTransaction(SCARDHANDLE hCard) {
+        LONG result;
+        {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            for (;;) {
+                Connection* c;
+                Reader* r;
+                result = checkLocked(hCard, c, r);
+                if (result != SCARD_S_SUCCESS) {
+                    break;
+                }
+                // Как и настоящая подсистема, ждем, пока транзакцию не завершит другое соединение.
+                if (r->transaction == 0 || r->transaction == hCard) {
+                    r->transaction = hCard;
+                    break;
+                }
+                mChanged.wait(lock);
+            }
+        }
+        delay("SCardBeginTransaction");
+        return result;
+    }
+    LONG Engine::endTransaction(SCARDHANDLE hCard, DWORD dwDisposition) {
+        LONG result;
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            Connection* c;
+            Reader* r;
+            result = checkLocked(hCard, c, r);
+            if (result == SCARD_S_SUCCESS) {
+                if (r->transaction != hCard) {
+                    result = SCARD_E_NOT_TRANSACTED;
+                } else {
+                    r->transaction = 0;
+                    mChanged.notify_all();
+                }
+            }
+        }
+        delay("SCardEndTransaction");
+        return result;
+    }
+    LONG Engine::status(SCARDHANDLE hCard, LPSTR szReaderName, LPDWORD pcchReaderLen, LPDWORD pdwState,
+                        LPDWORD pdwProtocol, LPBYTE pbAtr, LPDWORD pcbAtrLen) {
+        LONG result;
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            advanceLocked(Clock::now());
+            Connection* c;
+            Reader* r;
+            result = checkLocked(hCard, c, r);
+            if (result == SCARD_S_SUCCESS) {
+                if (pcchReaderLen != NULL) {
+                    // Имя возвращается как список из одной строки, т.е. с двумя '\0' в конце.
+                    const DWORD size = (DWORD)r->name.size() + 2;
+                    if (szReaderName != NULL) {
+                        if (*pcchReaderLen < size) {
+                            result = SCARD_E_INSUFFICIENT_BUFFER;
+                        } else {
+                            std::memcpy(szReaderName, r->name.c_str(), size - 1);
+                            szReaderName[size - 1] = '\0';
+                        }
+                    }
+                    *pcchReaderLen = size;
+                }
+                if (pdwState != NULL) {
+                    *pdwState = SCARD_SPECIFIC;
+                }
+                if (pdwProtocol != NULL) {
+                    *pdwProtocol = c->protocol;
+                }
+                if (pcbAtrLen != NULL) {
+                    const std::vector<BYTE>& atr = mCards[r->card].atr;
+                    if (pbAtr != NULL) {
+                        if (*pcbAtrLen < atr.size()) {
+                            result = SCARD_E_INSUFFICIENT_BUFFER;
+                        } else {
+                            std::memcpy(pbAtr, &atr[0], atr.size());
+                        }
+                    }
+                    *pcbAtrLen = (DWORD)atr.size();
+                }
+            }
+        }
+        delay("SCardStatus");
+        return result;
+    }
+    LONG Engine::transmit(SCARDHANDLE hCard, LPCBYTE pbSendBuffer, DWORD cbSendLength,
+                          LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength) {
+        if (pbSendBuffer == NULL || pbRecvBuffer == NULL || pcbRecvLength == NULL) {
+            return SCARD_E_INVALID_PARAMETER;
+        }
+        LONG result;
+        Latency extra;
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            advanceLocked(Clock::now());
+            Connection* c;
+            Reader* r;
+            result = checkLocked(hCard, c, r);
+            if (result == SCARD_S_SUCCESS) {
+                // По умолчанию -- INS not supported.
+                static const BYTE notSupported[] = {0x6D, 0x00};
+                const BYTE* data = notSupported;
+                std::size_t size = sizeof(notSupported);
+                std::vector<Response>& responses = mCards[r->card].responses;
+                for (std::vector<Response>::iterator it = responses.begin(); it != responses.end(); ++it) {
+                    if (!it->used && it->match(pbSendBuffer, cbSendLength)) {
+                        it->used = it->once;
+                        data = &it->data[0];
+                        size = it->data.size();
+                        extra = it->latency;
+                        break;
+                    }
+                }
+                if (*pcbRecvLength < size) {
+                    result = SCARD_E_INSUFFICIENT_BUFFER;
+                } else {
+                    std::memcpy(pbRecvBuffer, data, size);
+                }
+                *pcbRecvLength = (DWORD)size;
+            }
+        }
+        delay("SCardTransmit", extra);
+        return result;
+    }
+    LONG Engine::getAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen) {
+        if (pcbAttrLen == NULL) {
+            return SCARD_E_INVALID_PARAMETER;
+        }
+        LONG result;
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            Connection* c;
+            Reader* r;
+            result = checkLocked(hCard, c, r);
+            if (result == SCARD_S_SUCCESS) {
+                const Card& card = mCards[r->card];
+                std::vector<BYTE> value;
+                if (dwAttrId == SCARD_ATTR_ATR_STRING) {
+                    value = card.atr;
+                } else
+                if (dwAttrId == SCARD_ATTR_PROTOCOL_TYPES) {
+                    value.resize(sizeof(DWORD));
+                    std::memcpy(&value[0], &card.protocols, sizeof(DWORD));
+                } else {
+                    result = SCARD_E_UNSUPPORTED_FEATURE;
+                }
+                if (result == SCARD_S_SUCCESS) {
+                    if (pbAttr != NULL) {
+                        if (*pcbAttrLen < value.size()) {
+                            result = SCARD_E_INSUFFICIENT_BUFFER;
+                        } else {
+                            std::memcpy(pbAttr, &value[0], value.size());
+                        }
+                    }
+                    *pcbAttrLen = (DWORD)value.size();
+                }
+            }
+        }
+        delay("SCardGetAttrib");
+        return result;
+    }
+} // namespace Simulator
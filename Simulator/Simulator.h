@@ -0,0 +1,251 @@
+#ifndef PCSC_CENXFS_BRIDGE_Simulator_Simulator_H
+#define PCSC_CENXFS_BRIDGE_Simulator_Simulator_H
+
+#pragma once
+
+// Для std::size_t
+#include <cstddef>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/chrono/chrono.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <winscard.h>
+
+/** Симулятор подсистемы PC/SC. Реализует функции `SCard*` (см. `Simulator/winscard.cpp`) поверх
+    виртуальных считывателей и карт, поэтому может быть слинкован вместо `winscard.lib` или
+    pcsc-lite для нагрузочного тестирования без оборудования.
+@par
+    Состояние симулятора задается сценарием (см. `Engine::load`) или напрямую через методы
+    `Engine`. Сценарий, указанный в переменной окружения `PCSC_SIMULATOR_SCRIPT`, загружается
+    автоматически при первом обращении к симулятору, а переменная `PCSC_SIMULATOR_SPEED` задает
+    ускорение времени (см. `Engine::setSpeed`).
+*/
+namespace Simulator {
+    typedef boost::chrono::steady_clock Clock;
+
+    /** Распределение задержки выполнения функции или ответа карты. */
+    class Latency {
+    public:
+        enum Kind {
+            /// Всегда `a`.
+            Fixed,
+            /// Равномерно в диапазоне [`a`; `b`].
+            Uniform,
+            /// Нормально со средним `a` и отклонением `b`, отрицательные значения отсекаются.
+            Normal,
+            /// Экспоненциально со средним `a`.
+            Exponential,
+        };
+    private:
+        Kind mKind;
+        /// Параметры распределения в микросекундах.
+        double mA;
+        double mB;
+    public:
+        /// Нулевая задержка.
+        Latency() : mKind(Fixed), mA(0), mB(0) {}
+        Latency(Kind kind, double a, double b = 0) : mKind(kind), mA(a), mB(b) {}
+
+        /// @return `true`, если задержка всегда нулевая.
+        inline bool zero() const { return mKind == Fixed && mA <= 0; }
+        /// Выбирает случайное значение задержки.
+        Clock::duration sample(boost::random::mt19937& rng) const;
+    };
+
+    /** Правило ответа карты на команду. */
+    struct Response {
+        /// Шаблон команды, `-1` -- любой байт.
+        std::vector<int> pattern;
+        /// Если `true`, то шаблон сравнивается только с началом команды.
+        bool prefix;
+        /// Ответ, включая SW1 SW2.
+        std::vector<BYTE> data;
+        /// Дополнительная задержка ответа.
+        Latency latency;
+        /// Если `true`, то правило срабатывает один раз за вставку карты.
+        bool once;
+        /// Если `true`, то одноразовое правило уже сработало.
+        bool used;
+    public:
+        Response() : prefix(false), once(false), used(false) {}
+        bool match(const BYTE* command, std::size_t size) const;
+    };
+
+    /** Описание виртуальной карты. */
+    struct Card {
+        std::vector<BYTE> atr;
+        /// Поддерживаемые протоколы, маска `SCARD_PROTOCOL_*`.
+        DWORD protocols;
+        /// Правила ответа на команды, проверяются по порядку.
+        std::vector<Response> responses;
+    public:
+        Card() : protocols(SCARD_PROTOCOL_T0) {}
+    };
+
+    /** Единственный экземпляр симулятора, хранящий состояние всех считывателей, контекстов
+        и соединений. Все методы потокобезопасны.
+    */
+    class Engine : private boost::noncopyable {
+        /// Виртуальный считыватель.
+        struct Reader {
+            std::string name;
+            /// Название вставленной карты, пустое, если карты нет.
+            std::string card;
+            /// Номер вставки карты, по которому определяется, что соединение устарело.
+            unsigned long insertion;
+            /// Счетчик изменений состояния, передается в старших 16 битах `dwEventState`.
+            WORD events;
+            /// Количество соединений с картой.
+            unsigned int connections;
+            bool exclusive;
+            /// Соединение, захватившее транзакцию, или 0.
+            SCARDHANDLE transaction;
+        public:
+            Reader() : insertion(0), events(0), connections(0), exclusive(false), transaction(0) {}
+        };
+        /// Соединение с картой, созданное `SCardConnect`.
+        struct Connection {
+            std::string reader;
+            unsigned long insertion;
+            DWORD protocol;
+            bool exclusive;
+        };
+        /// Контекст, созданный `SCardEstablishContext`.
+        struct Context {
+            /// Количество потоков, ожидающих в `SCardGetStatusChange`.
+            unsigned int waiting;
+            /// Номер отмены, увеличиваемый `SCardCancel`, если кто-то ожидает.
+            unsigned long cancels;
+        public:
+            Context() : waiting(0), cancels(0) {}
+        };
+        /// Событие временной шкалы сценария.
+        struct Event {
+            enum Kind { Insert, Remove, Attach, Detach };
+            /// Время события от начала шкалы.
+            Clock::duration at;
+            Kind kind;
+            std::string reader;
+            std::string card;
+
+            static bool earlier(const Event& l, const Event& r) { return l.at < r.at; }
+        };
+    private:
+        std::vector<Reader> mReaders;
+        std::map<std::string, Card> mCards;
+        std::map<SCARDCONTEXT, Context> mContexts;
+        std::map<SCARDHANDLE, Connection> mConnections;
+        /// Задержки функций PC/SC, ключ -- название функции.
+        std::map<std::string, Latency> mLatencies;
+        /// Временная шкала, упорядоченная по времени.
+        std::vector<Event> mTimeline;
+        /// Индекс следующего события шкалы.
+        std::size_t mNextEvent;
+        /// Начало текущего прохода по шкале.
+        Clock::time_point mOrigin;
+        /// Период повторения шкалы, нулевой, если шкала не повторяется.
+        Clock::duration mLoop;
+        /// Во сколько раз быстрее реального времени проходят шкала и задержки.
+        double mSpeed;
+        /// Последний выданный хендл контекста или соединения.
+        LONG mLastHandle;
+        boost::random::mt19937 mRng;
+        boost::mutex mMutex;
+        /// Сигнализирует об изменении состояния считывателей и об отмене ожидания.
+        boost::condition_variable mChanged;
+    public:
+        /// Название псевдо-считывателя, через который сообщается об изменении списка считывателей.
+        static const char* pnpNotification() { return "\\\\?PnP?\\Notification"; }
+        static Engine& instance();
+    public:// Управление симулятором
+        /// Удаляет все считыватели, карты, задержки и временную шкалу. Контексты и соединения остаются.
+        void reset();
+        /** Загружает сценарий из файла, дополняя текущее состояние. Временная шкала отсчитывается
+            с момента загрузки.
+        @param path
+            Путь к файлу сценария.
+        @param error
+            Описание ошибки, если загрузка не удалась.
+        @return
+            `true`, если сценарий загружен полностью.
+        */
+        bool load(const std::string& path, std::string& error);
+        /// Загружает сценарий из потока. См. `load`.
+        bool load(std::istream& is, std::string& error);
+
+        void seed(unsigned int value);
+        /** Задает ускорение времени: время событий шкалы, период ее повторения и все задержки
+            делятся на `factor`. Позволяет воспроизводить записанные сеансы быстрее, чем
+            они проходили. Неположительные значения игнорируются.
+        */
+        void setSpeed(double factor);
+        /// Задает задержку указанной функции PC/SC, например, `"SCardTransmit"`.
+        void setLatency(const std::string& function, const Latency& latency);
+        /// Определяет или переопределяет карту с указанным названием.
+        void defineCard(const std::string& name, const Card& card);
+        /// Добавляет правило ответа для ранее определенной карты.
+        bool addResponse(const std::string& card, const Response& response);
+
+        /// Подключает считыватель. Если он уже подключен, ничего не делает.
+        void attach(const std::string& reader);
+        /// Отключает считыватель, все соединения с ним становятся недействительными.
+        void detach(const std::string& reader);
+        /// Вставляет карту в считыватель, вынимая предыдущую, если она была.
+        bool insert(const std::string& reader, const std::string& card);
+        /// Вынимает карту из считывателя.
+        void remove(const std::string& reader);
+        /// @return Количество подключенных считывателей.
+        std::size_t readerCount();
+    public:// Реализация функций PC/SC
+        LONG establishContext(LPSCARDCONTEXT phContext);
+        LONG releaseContext(SCARDCONTEXT hContext);
+        LONG isValidContext(SCARDCONTEXT hContext);
+        LONG listReaders(SCARDCONTEXT hContext, LPSTR mszReaders, LPDWORD pcchReaders);
+        LONG getStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout, SCARD_READERSTATE* rgReaderStates, DWORD cReaders);
+        LONG cancel(SCARDCONTEXT hContext);
+        LONG connect(SCARDCONTEXT hContext, LPCSTR szReader, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                     LPSCARDHANDLE phCard, LPDWORD pdwActiveProtocol);
+        LONG reconnect(SCARDHANDLE hCard, DWORD dwShareMode, DWORD dwPreferredProtocols, DWORD dwInitialization,
+                       LPDWORD pdwActiveProtocol);
+        LONG disconnect(SCARDHANDLE hCard, DWORD dwDisposition);
+        LONG beginTransaction(SCARDHANDLE hCard);
+        LONG endTransaction(SCARDHANDLE hCard, DWORD dwDisposition);
+        LONG status(SCARDHANDLE hCard, LPSTR szReaderName, LPDWORD pcchReaderLen, LPDWORD pdwState,
+                    LPDWORD pdwProtocol, LPBYTE pbAtr, LPDWORD pcbAtrLen);
+        LONG transmit(SCARDHANDLE hCard, LPCBYTE pbSendBuffer, DWORD cbSendLength,
+                      LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength);
+        LONG getAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen);
+    private:
+        Engine();
+        /// Выдерживает задержку функции вне мьютекса.
+        void delay(const char* function, const Latency& extra = Latency());
+        /// Переводит время сценария в реальное с учетом ускорения. Мьютекс должен быть захвачен.
+        Clock::duration scaledLocked(Clock::duration d) const;
+        /// Применяет наступившие события временной шкалы. Мьютекс должен быть захвачен.
+        void advanceLocked(Clock::time_point now);
+        /// @return Момент следующего события шкалы или `Clock::time_point::max()`.
+        Clock::time_point nextEventLocked() const;
+        Reader* findLocked(const std::string& name);
+        void attachLocked(const std::string& reader);
+        void detachLocked(const std::string& reader);
+        bool insertLocked(const std::string& reader, const std::string& card);
+        void removeLocked(const std::string& reader);
+        /** Заполняет `dwEventState` для всех запрошенных считывателей.
+        @return `true`, если хотя бы у одного состояние отличается от известного вызывающему.
+        */
+        bool evaluateLocked(SCARD_READERSTATE* rgReaderStates, DWORD cReaders);
+        /** Находит соединение и проверяет, что карта с момента соединения не вынималась.
+        @return Код ошибки или `SCARD_S_SUCCESS`.
+        */
+        LONG checkLocked(SCARDHANDLE hCard, Connection*& connection, Reader*& reader);
+        bool parseLine(const std::vector<std::string>& tokens, std::string& error);
+    };
+} // namespace Simulator
+#endif // PCSC_CENXFS_BRIDGE_Simulator_Simulator_H
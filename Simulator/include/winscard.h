@@ -0,0 +1,157 @@
+#ifndef PCSC_CENXFS_BRIDGE_Simulator_winscard_H
+#define PCSC_CENXFS_BRIDGE_Simulator_winscard_H
+
+#pragma once
+
+/** @file
+    Подмножество PC/SC API, используемое мостом и реализуемое симулятором (`Simulator/winscard.cpp`).
+    Типы и раскладка структур совпадают с pcsc-lite, поэтому симулятор может быть собран как
+    с этим заголовком (на системе без pcsc-lite), так и с заголовками pcsc-lite. Значения
+    `SCARD_ABSENT` ... `SCARD_SPECIFIC` взяты из Windows (перечисление, а не битовая маска),
+    т.к. мост разбирает их как перечисление (см. `PCSC::MediaStatus`).
+*/
+
+#include "wintypes.h"
+
+typedef LONG SCARDCONTEXT;
+typedef SCARDCONTEXT* PSCARDCONTEXT;
+typedef SCARDCONTEXT* LPSCARDCONTEXT;
+typedef LONG SCARDHANDLE;
+typedef SCARDHANDLE* PSCARDHANDLE;
+typedef SCARDHANDLE* LPSCARDHANDLE;
+
+#define MAX_ATR_SIZE 33
+
+typedef struct {
+    const char* szReader;
+    void* pvUserData;
+    DWORD dwCurrentState;
+    DWORD dwEventState;
+    DWORD cbAtr;
+    unsigned char rgbAtr[MAX_ATR_SIZE];
+} SCARD_READERSTATE, *LPSCARD_READERSTATE;
+
+typedef struct {
+    unsigned long dwProtocol;
+    unsigned long cbPciLength;
+} SCARD_IO_REQUEST, *PSCARD_IO_REQUEST, *LPSCARD_IO_REQUEST;
+typedef const SCARD_IO_REQUEST* LPCSCARD_IO_REQUEST;
+
+/// Заголовок команды протокола T0. В pcsc-lite отсутствует, определен в Windows SDK.
+typedef struct {
+    BYTE bCla;
+    BYTE bIns;
+    BYTE bP1;
+    BYTE bP2;
+    BYTE bP3;
+} SCARD_T0_COMMAND, *LPSCARD_T0_COMMAND;
+
+#define SCARD_S_SUCCESS              ((LONG)0x00000000)
+#define SCARD_F_INTERNAL_ERROR       ((LONG)0x80100001)
+#define SCARD_E_CANCELLED            ((LONG)0x80100002)
+#define SCARD_E_INVALID_HANDLE       ((LONG)0x80100003)
+#define SCARD_E_INVALID_PARAMETER    ((LONG)0x80100004)
+#define SCARD_E_INVALID_TARGET       ((LONG)0x80100005)
+#define SCARD_E_NO_MEMORY            ((LONG)0x80100006)
+#define SCARD_F_WAITED_TOO_LONG      ((LONG)0x80100007)
+#define SCARD_E_INSUFFICIENT_BUFFER  ((LONG)0x80100008)
+#define SCARD_E_UNKNOWN_READER       ((LONG)0x80100009)
+#define SCARD_E_TIMEOUT              ((LONG)0x8010000A)
+#define SCARD_E_SHARING_VIOLATION    ((LONG)0x8010000B)
+#define SCARD_E_NO_SMARTCARD         ((LONG)0x8010000C)
+#define SCARD_E_UNKNOWN_CARD         ((LONG)0x8010000D)
+#define SCARD_E_CANT_DISPOSE         ((LONG)0x8010000E)
+#define SCARD_E_PROTO_MISMATCH       ((LONG)0x8010000F)
+#define SCARD_E_NOT_READY            ((LONG)0x80100010)
+#define SCARD_E_INVALID_VALUE        ((LONG)0x80100011)
+#define SCARD_E_SYSTEM_CANCELLED     ((LONG)0x80100012)
+#define SCARD_F_COMM_ERROR           ((LONG)0x80100013)
+#define SCARD_F_UNKNOWN_ERROR        ((LONG)0x80100014)
+#define SCARD_E_INVALID_ATR          ((LONG)0x80100015)
+#define SCARD_E_NOT_TRANSACTED       ((LONG)0x80100016)
+#define SCARD_E_READER_UNAVAILABLE   ((LONG)0x80100017)
+#define SCARD_P_SHUTDOWN             ((LONG)0x80100018)
+#define SCARD_E_PCI_TOO_SMALL        ((LONG)0x80100019)
+#define SCARD_E_READER_UNSUPPORTED   ((LONG)0x8010001A)
+#define SCARD_E_DUPLICATE_READER     ((LONG)0x8010001B)
+#define SCARD_E_CARD_UNSUPPORTED     ((LONG)0x8010001C)
+#define SCARD_E_NO_SERVICE           ((LONG)0x8010001D)
+#define SCARD_E_SERVICE_STOPPED      ((LONG)0x8010001E)
+#define SCARD_E_UNEXPECTED           ((LONG)0x8010001F)
+#define SCARD_E_UNSUPPORTED_FEATURE  ((LONG)0x80100022)
+#define SCARD_E_NO_READERS_AVAILABLE ((LONG)0x8010002E)
+#define SCARD_W_UNRESPONSIVE_CARD    ((LONG)0x80100066)
+#define SCARD_W_UNPOWERED_CARD       ((LONG)0x80100067)
+#define SCARD_W_RESET_CARD           ((LONG)0x80100068)
+#define SCARD_W_REMOVED_CARD         ((LONG)0x80100069)
+
+#define SCARD_SCOPE_USER     0x0000
+#define SCARD_SCOPE_TERMINAL 0x0001
+#define SCARD_SCOPE_SYSTEM   0x0002
+
+#define SCARD_PROTOCOL_UNDEFINED 0x0000
+#define SCARD_PROTOCOL_T0        0x0001
+#define SCARD_PROTOCOL_T1        0x0002
+#define SCARD_PROTOCOL_RAW       0x0004
+
+#define SCARD_SHARE_EXCLUSIVE 0x0001
+#define SCARD_SHARE_SHARED    0x0002
+#define SCARD_SHARE_DIRECT    0x0003
+
+#define SCARD_LEAVE_CARD   0x0000
+#define SCARD_RESET_CARD   0x0001
+#define SCARD_UNPOWER_CARD 0x0002
+#define SCARD_EJECT_CARD   0x0003
+
+#define SCARD_UNKNOWN    0
+#define SCARD_ABSENT     1
+#define SCARD_PRESENT    2
+#define SCARD_SWALLOWED  3
+#define SCARD_POWERED    4
+#define SCARD_NEGOTIABLE 5
+#define SCARD_SPECIFIC   6
+
+#define SCARD_STATE_UNAWARE     0x0000
+#define SCARD_STATE_IGNORE      0x0001
+#define SCARD_STATE_CHANGED     0x0002
+#define SCARD_STATE_UNKNOWN     0x0004
+#define SCARD_STATE_UNAVAILABLE 0x0008
+#define SCARD_STATE_EMPTY       0x0010
+#define SCARD_STATE_PRESENT     0x0020
+#define SCARD_STATE_ATRMATCH    0x0040
+#define SCARD_STATE_EXCLUSIVE   0x0080
+#define SCARD_STATE_INUSE       0x0100
+#define SCARD_STATE_MUTE        0x0200
+#define SCARD_STATE_UNPOWERED   0x0400
+
+#define INFINITE 0xFFFFFFFF
+
+#define SCARD_ATTR_PROTOCOL_TYPES 0x00030120
+#define SCARD_ATTR_ATR_STRING     0x00090303
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+LONG SCardEstablishContext(DWORD dwScope, LPCVOID pvReserved1, LPCVOID pvReserved2, LPSCARDCONTEXT phContext);
+LONG SCardReleaseContext(SCARDCONTEXT hContext);
+LONG SCardIsValidContext(SCARDCONTEXT hContext);
+LONG SCardListReaders(SCARDCONTEXT hContext, LPCSTR mszGroups, LPSTR mszReaders, LPDWORD pcchReaders);
+LONG SCardGetStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout, SCARD_READERSTATE* rgReaderStates, DWORD cReaders);
+LONG SCardCancel(SCARDCONTEXT hContext);
+LONG SCardConnect(SCARDCONTEXT hContext, LPCSTR szReader, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                  LPSCARDHANDLE phCard, LPDWORD pdwActiveProtocol);
+LONG SCardReconnect(SCARDHANDLE hCard, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                    DWORD dwInitialization, LPDWORD pdwActiveProtocol);
+LONG SCardDisconnect(SCARDHANDLE hCard, DWORD dwDisposition);
+LONG SCardBeginTransaction(SCARDHANDLE hCard);
+LONG SCardEndTransaction(SCARDHANDLE hCard, DWORD dwDisposition);
+LONG SCardStatus(SCARDHANDLE hCard, LPSTR szReaderName, LPDWORD pcchReaderLen, LPDWORD pdwState,
+                 LPDWORD pdwProtocol, LPBYTE pbAtr, LPDWORD pcbAtrLen);
+LONG SCardTransmit(SCARDHANDLE hCard, const SCARD_IO_REQUEST* pioSendPci, LPCBYTE pbSendBuffer, DWORD cbSendLength,
+                   SCARD_IO_REQUEST* pioRecvPci, LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength);
+LONG SCardGetAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen);
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PCSC_CENXFS_BRIDGE_Simulator_winscard_H
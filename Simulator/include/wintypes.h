@@ -0,0 +1,37 @@
+#ifndef PCSC_CENXFS_BRIDGE_Simulator_wintypes_H
+#define PCSC_CENXFS_BRIDGE_Simulator_wintypes_H
+
+#pragma once
+
+/** @file
+    Базовые типы Windows в том виде, в каком их определяет pcsc-lite в одноименном файле.
+    Используется симулятором PC/SC вместо pcsc-lite на системах, где тот не установлен,
+    поэтому определения совпадают с ним и по именам, и по размерам.
+*/
+
+typedef unsigned char  BYTE;
+typedef unsigned char  UCHAR;
+typedef char           CHAR;
+typedef unsigned short USHORT;
+typedef unsigned short WORD;
+typedef int            BOOL;
+typedef unsigned long  ULONG;
+typedef unsigned long  DWORD;
+typedef long           LONG;
+
+typedef BYTE*       LPBYTE;
+typedef const BYTE* LPCBYTE;
+typedef DWORD*      LPDWORD;
+typedef void*       LPVOID;
+typedef const void* LPCVOID;
+typedef char*       LPSTR;
+typedef const char* LPCSTR;
+
+#ifndef TRUE
+#  define TRUE 1
+#endif
+#ifndef FALSE
+#  define FALSE 0
+#endif
+
+#endif // PCSC_CENXFS_BRIDGE_Simulator_wintypes_H
@@ -0,0 +1,134 @@
+/** @file
+    Функции PC/SC и реализация PC/SC для моста (`PCSC::Backend`), работающие поверх симулятора.
+    Параметры, которые мост не использует (группы считывателей, PCI), игнорируются.
+*/
+#include "Simulator.h"
+
+#include "PCSC/Backend.h"
+
+#include <iostream>
+
+using Simulator::Engine;
+
+LONG SCardEstablishContext(DWORD dwScope, LPCVOID pvReserved1, LPCVOID pvReserved2, LPSCARDCONTEXT phContext) {
+    return Engine::instance().establishContext(phContext);
+}
+LONG SCardReleaseContext(SCARDCONTEXT hContext) {
+    return Engine::instance().releaseContext(hContext);
+}
+LONG SCardIsValidContext(SCARDCONTEXT hContext) {
+    return Engine::instance().isValidContext(hContext);
+}
+LONG SCardListReaders(SCARDCONTEXT hContext, LPCSTR mszGroups, LPSTR mszReaders, LPDWORD pcchReaders) {
+    return Engine::instance().listReaders(hContext, mszReaders, pcchReaders);
+}
+LONG SCardGetStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout, SCARD_READERSTATE* rgReaderStates, DWORD cReaders) {
+    return Engine::instance().getStatusChange(hContext, dwTimeout, rgReaderStates, cReaders);
+}
+LONG SCardCancel(SCARDCONTEXT hContext) {
+    return Engine::instance().cancel(hContext);
+}
+LONG SCardConnect(SCARDCONTEXT hContext, LPCSTR szReader, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                  LPSCARDHANDLE phCard, LPDWORD pdwActiveProtocol) {
+    return Engine::instance().connect(hContext, szReader, dwShareMode, dwPreferredProtocols, phCard, pdwActiveProtocol);
+}
+LONG SCardReconnect(SCARDHANDLE hCard, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                    DWORD dwInitialization, LPDWORD pdwActiveProtocol) {
+    return Engine::instance().reconnect(hCard, dwShareMode, dwPreferredProtocols, dwInitialization, pdwActiveProtocol);
+}
+LONG SCardDisconnect(SCARDHANDLE hCard, DWORD dwDisposition) {
+    return Engine::instance().disconnect(hCard, dwDisposition);
+}
+LONG SCardBeginTransaction(SCARDHANDLE hCard) {
+    return Engine::instance().beginTransaction(hCard);
+}
+LONG SCardEndTransaction(SCARDHANDLE hCard, DWORD dwDisposition) {
+    return Engine::instance().endTransaction(hCard, dwDisposition);
+}
+LONG SCardStatus(SCARDHANDLE hCard, LPSTR szReaderName, LPDWORD pcchReaderLen, LPDWORD pdwState,
+                 LPDWORD pdwProtocol, LPBYTE pbAtr, LPDWORD pcbAtrLen) {
+    return Engine::instance().status(hCard, szReaderName, pcchReaderLen, pdwState, pdwProtocol, pbAtr, pcbAtrLen);
+}
+LONG SCardTransmit(SCARDHANDLE hCard, const SCARD_IO_REQUEST* pioSendPci, LPCBYTE pbSendBuffer, DWORD cbSendLength,
+                   SCARD_IO_REQUEST* pioRecvPci, LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength) {
+    return Engine::instance().transmit(hCard, pbSendBuffer, cbSendLength, pbRecvBuffer, pcbRecvLength);
+}
+LONG SCardGetAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen) {
+    return Engine::instance().getAttrib(hCard, dwAttrId, pbAttr, pcbAttrLen);
+}
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+namespace Simulator {
+    /** Реализация PC/SC для моста, обращающаяся к симулятору напрямую, а не через функции `SCard*`.
+        Регистрируется под названием `simulator`; параметр реализации -- сценарий, загружаемый
+        в симулятор, например, записанный сеанс.
+    */
+    class EngineBackend : public PCSC::Backend {
+    public:
+        virtual const char* name() const { return "simulator"; }
+
+        virtual LONG establishContext(LPSCARDCONTEXT phContext) {
+            return Engine::instance().establishContext(phContext);
+        }
+        virtual LONG releaseContext(SCARDCONTEXT hContext) {
+            return Engine::instance().releaseContext(hContext);
+        }
+        virtual LONG listReaders(SCARDCONTEXT hContext, LPSTR mszReaders, LPDWORD pcchReaders) {
+            return Engine::instance().listReaders(hContext, mszReaders, pcchReaders);
+        }
+        virtual LONG getStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout,
+                                     SCARD_READERSTATE* rgReaderStates, DWORD cReaders) {
+            return Engine::instance().getStatusChange(hContext, dwTimeout, rgReaderStates, cReaders);
+        }
+        virtual LONG cancel(SCARDCONTEXT hContext) {
+            return Engine::instance().cancel(hContext);
+        }
+
+        virtual LONG connect(SCARDCONTEXT hContext, LPCSTR szReader, DWORD dwShareMode,
+                             DWORD dwPreferredProtocols, LPSCARDHANDLE phCard, LPDWORD pdwActiveProtocol) {
+            return Engine::instance().connect(hContext, szReader, dwShareMode, dwPreferredProtocols, phCard, pdwActiveProtocol);
+        }
+        virtual LONG reconnect(SCARDHANDLE hCard, DWORD dwShareMode, DWORD dwPreferredProtocols,
+                               DWORD dwInitialization, LPDWORD pdwActiveProtocol) {
+            return Engine::instance().reconnect(hCard, dwShareMode, dwPreferredProtocols, dwInitialization, pdwActiveProtocol);
+        }
+        virtual LONG disconnect(SCARDHANDLE hCard, DWORD dwDisposition) {
+            return Engine::instance().disconnect(hCard, dwDisposition);
+        }
+        virtual LONG beginTransaction(SCARDHANDLE hCard) {
+            return Engine::instance().beginTransaction(hCard);
+        }
+        virtual LONG endTransaction(SCARDHANDLE hCard, DWORD dwDisposition) {
+            return Engine::instance().endTransaction(hCard, dwDisposition);
+        }
+
+        virtual LONG status(SCARDHANDLE hCard, LPSTR szReaderName, LPDWORD pcchReaderLen,
+                            LPDWORD pdwState, LPDWORD pdwProtocol, LPBYTE pbAtr, LPDWORD pcbAtrLen) {
+            return Engine::instance().status(hCard, szReaderName, pcchReaderLen, pdwState, pdwProtocol, pbAtr, pcbAtrLen);
+        }
+        virtual LONG transmit(SCARDHANDLE hCard, const SCARD_IO_REQUEST* pioSendPci,
+                              LPCBYTE pbSendBuffer, DWORD cbSendLength,
+                              LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength) {
+            return Engine::instance().transmit(hCard, pbSendBuffer, cbSendLength, pbRecvBuffer, pcbRecvLength);
+        }
+        virtual LONG getAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen) {
+            return Engine::instance().getAttrib(hCard, dwAttrId, pbAttr, pcbAttrLen);
+        }
+    };
+    /// Сценарий загружается только при первом выборе реализации с ним, т.к. загрузка дополняет
+    /// состояние симулятора, а реализация выбирается заново каждый раз, когда нет открытых сервисов.
+    static PCSC::Backend* createBackend(const std::string& script) {
+        static std::string loaded;
+        if (!script.empty() && script != loaded) {
+            std::string error;
+            if (!Engine::instance().load(script, error)) {
+                std::cerr << "PC/SC simulator: " << script << ": " << error << std::endl;
+                return NULL;
+            }
+            loaded = script;
+        }
+        // Не разрушается, т.к. через нее закрывается контекст PC/SC в деструкторе менеджера.
+        static EngineBackend* backend = new EngineBackend();
+        return backend;
+    }
+    static PCSC::Backend::Registrar registrar("simulator", &createBackend);
+} // namespace Simulator
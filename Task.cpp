@@ -2,24 +2,23 @@
 
 #include "Service.h"
 
+#include "Diagnostics/Timeline.h"
+
 #include "XFS/Result.h"
 
 #include <cassert>
 #include <sstream>
 
+#include <boost/chrono/ceil.hpp>
+
+Task::Task(bc::steady_clock::time_point deadline, Service& service, HWND hWnd, REQUESTID ReqID)
+    : deadline(deadline), mService(service), hService(service.handle()), hWnd(hWnd), ReqID(ReqID) {}
 void Task::complete(HRESULT result) const {
     XFS::Result(ReqID, serviceHandle(), result).attach((WFSIDCCARDDATA**)0).send(hWnd, WFS_EXECUTE_COMPLETE);
 }
-HSERVICE Task::serviceHandle() const {
-    return mService.handle();
-}
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 TaskContainer::~TaskContainer() {
-    boost::lock_guard<boost::recursive_mutex> lock(tasksMutex);
-    for (TaskList::iterator it = tasks.begin(); it != tasks.end(); ++it) {
-        (*it)->cancel();
-    }
-    tasks.clear();
+    cancelAll();
 }
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 bool TaskContainer::addTask(const Task::Ptr& task) {
@@ -46,21 +45,77 @@ bool TaskContainer::cancelTask(HSERVICE hService, REQUESTID ReqID) {
     if (it == byID.end()) {
         return false;
     }
+    Diagnostics::TimelineEvent("Task::cancel", "tasks").arg("hService", hService).arg("ReqID", ReqID);
     // Сигнализируем зарегистрированным слушателем о том, что задача отменена.
     (*it)->cancel();
     byID.erase(it);
     return true;
 }
+std::size_t TaskContainer::cancelTasks(HSERVICE hService) {
+    boost::lock_guard<boost::recursive_mutex> lock(tasksMutex);
+
+    typedef TaskList::nth_index<1>::type Index1;
+
+    Index1& byID = tasks.get<1>();
+    // Индекс составной, задачи одного сервиса идут подряд.
+    std::pair<Index1::iterator, Index1::iterator> range = byID.equal_range(boost::make_tuple(hService));
+    std::size_t count = 0;
+    for (Index1::iterator it = range.first; it != range.second; ++it, ++count) {
+        Diagnostics::TimelineEvent("Task::cancel", "tasks").arg("hService", hService).arg("ReqID", (*it)->ReqID);
+        (*it)->cancel();
+    }
+    byID.erase(range.first, range.second);
+    return count;
+}
+std::size_t TaskContainer::cancelAll() {
+    boost::lock_guard<boost::recursive_mutex> lock(tasksMutex);
+    const std::size_t count = tasks.size();
+    for (TaskList::iterator it = tasks.begin(); it != tasks.end(); ++it) {
+        (*it)->cancel();
+    }
+    tasks.clear();
+    return count;
+}
+bool TaskContainer::hasTask(HSERVICE hService, REQUESTID ReqID) const {
+    boost::lock_guard<boost::recursive_mutex> lock(tasksMutex);
+    const TaskList::nth_index<1>::type& byID = tasks.get<1>();
+    return byID.find(boost::make_tuple(hService, ReqID)) != byID.end();
+}
+bool TaskContainer::isEmpty() const {
+    boost::lock_guard<boost::recursive_mutex> lock(tasksMutex);
+    return tasks.empty();
+}
+bool TaskContainer::removeTask(HSERVICE hService, REQUESTID ReqID) {
+    boost::lock_guard<boost::recursive_mutex> lock(tasksMutex);
+    typedef TaskList::nth_index<1>::type Index1;
+
+    Index1& byID = tasks.get<1>();
+    Index1::iterator it = byID.find(boost::make_tuple(hService, ReqID));
+    if (it == byID.end()) {
+        return false;
+    }
+    byID.erase(it);
+    return true;
+}
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-DWORD TaskContainer::getTimeout() const {
+DWORD TaskContainer::getTimeout(bc::steady_clock::time_point now) const {
     boost::lock_guard<boost::recursive_mutex> lock(tasksMutex);
 
     // Если имеются задачи, то ожидаем до их таймаута, в противном случае до бесконечности.
     if (!tasks.empty()) {
-        // Время до ближайшего таймаута.
-        bc::steady_clock::duration dur = (*tasks.begin())->deadline - bc::steady_clock::now();
-        // Преобразуем его в миллисекунды
-        return (DWORD)bc::duration_cast<bc::milliseconds>(dur).count();
+        // Время до ближайшего таймаута. Если он уже прошел, то не ждем вовсе, иначе
+        // отрицательное значение превратилось бы в почти бесконечное ожидание.
+        bc::steady_clock::duration dur = (*tasks.begin())->deadline - now;
+        if (dur <= bc::steady_clock::duration::zero()) {
+            return 0;
+        }
+        // Преобразуем его в миллисекунды с округлением вверх, чтобы не проснуться раньше дедлайна.
+        // Задачи без таймаута имеют максимальный дедлайн, такое ожидание не влезает в DWORD.
+        bc::milliseconds ms = bc::ceil<bc::milliseconds>(dur);
+        if (ms.count() >= (bc::milliseconds::rep)INFINITE) {
+            return INFINITE;
+        }
+        return (DWORD)ms.count();
     }
     return INFINITE;
 }
@@ -80,6 +135,7 @@ void TaskContainer::processTimeouts(bc::steady_clock::time_point now) {
         if ((*it)->deadline > now) {
             break;
         }
+        Diagnostics::TimelineEvent("Task::timeout", "tasks").arg("hService", (*it)->serviceHandle()).arg("ReqID", (*it)->ReqID);
         // Сигнализируем зарегистрированным слушателем о том, что произошел таймаут.
         (*it)->timeout();
     }
@@ -90,9 +146,12 @@ void TaskContainer::processTimeouts(bc::steady_clock::time_point now) {
 void TaskContainer::notifyChanges(const SCARD_READERSTATE& state, bool deviceChange) {
     {XFS::Logger() << "TaskContainer::notifyChanges";}
     boost::lock_guard<boost::recursive_mutex> lock(tasksMutex);
+    Diagnostics::TimelineSpan span("TaskContainer::notifyChanges", "tasks");
+    span.arg("reader", state.szReader).arg("tasks", tasks.size());
     for (TaskList::iterator it = tasks.begin(); it != tasks.end();) {
         // Если задача ожидала этого события, то удаляем ее из списка.
         if ((*it)->match(state, deviceChange)) {
+            Diagnostics::TimelineEvent("Task::match", "tasks").arg("hService", (*it)->serviceHandle()).arg("ReqID", (*it)->ReqID);
             it = tasks.erase(it);
             continue;
         }
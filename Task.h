@@ -38,6 +38,8 @@ public:
     bc::steady_clock::time_point deadline;
     /// Сервис, который создал эту задачу.
     Service& mService;
+    /// Хендл сервиса, создавшего задачу. Запоминается, т.к. используется в индексе контейнера задач.
+    HSERVICE hService;
     /// Окно, которое получит уведомление о завершении задачи.
     HWND hWnd;
     /// Трекинговый номер данной задачи, который будет предоставлен в уведомлении окну `hWnd`.
@@ -46,8 +48,8 @@ public:
 public:
     typedef boost::shared_ptr<Task> Ptr;
 public:
-    Task(bc::steady_clock::time_point deadline, Service& service, HWND hWnd, REQUESTID ReqID)
-        : deadline(deadline), mService(service), hWnd(hWnd), ReqID(ReqID) {}
+    Task(bc::steady_clock::time_point deadline, Service& service, HWND hWnd, REQUESTID ReqID);
+    virtual ~Task() {}
     inline bool operator<(const Task& other) const {
         return deadline < other.deadline;
     }
@@ -72,13 +74,13 @@ public:
         из очереди задач, иначе `false`.
     */
     virtual bool match(const SCARD_READERSTATE& state, bool deviceChange) const = 0;
-    /// Уведомляет XFS-слушателя о завершении ожидания.
+    /// Уведомляет XFS-слушателя о завершении ожидания сообщением `WFS_EXECUTE_COMPLETE`.
     /// @param result Код ответа для завершения.
-    void complete(HRESULT result) const;
+    virtual void complete(HRESULT result) const;
     /// Вызывается, если запрос был отменен вызовом WFPCancelAsyncRequest.
     inline void cancel() const { complete(WFS_ERR_CANCELED); }
     inline void timeout() const { complete(WFS_ERR_TIMEOUT); }
-    HSERVICE serviceHandle() const;
+    inline HSERVICE serviceHandle() const { return hService; }
 };
 /// Содержит список задач и методы для их потокобезопасного добавления, отмены и обработки.
 class TaskContainer {
@@ -132,9 +134,36 @@ public:
         что означает, что задачи с такими параметрами не существует в очереди задач.
     */
     bool cancelTask(HSERVICE hService, REQUESTID ReqID);
+    /** Отменяет все задачи указанного сервиса, например, при его закрытии.
+    @return
+        Количество отмененных задач.
+    */
+    std::size_t cancelTasks(HSERVICE hService);
+    /** Отменяет все задачи, например, при остановке менеджера.
+    @return
+        Количество отмененных задач.
+    */
+    std::size_t cancelAll();
+    /// Проверяет, что задача с указанным трекинговым номером еще не завершена.
+    bool hasTask(HSERVICE hService, REQUESTID ReqID) const;
+    /// @return `true`, если в очереди нет ни одной задачи.
+    bool isEmpty() const;
+    /** Исключает задачу из очереди, не уведомляя слушателя. Используется теми, кто завершает
+        задачу сам, вне потока опроса изменений.
+    @return
+        `true`, если задача была в очереди и теперь ее завершение -- забота вызывающего, иначе
+        `false`: задача уже завершена таймаутом или отменой.
+    */
+    bool removeTask(HSERVICE hService, REQUESTID ReqID);
 
-    /// Вычисляет таймаут до ближайшего дедлайна потокобезопасным способом.
-    DWORD getTimeout() const;
+    /** Вычисляет таймаут до ближайшего дедлайна потокобезопасным способом.
+    @param now
+        Текущее время по часам, по которым отсчитываются дедлайны.
+    @return
+        Время до ближайшего дедлайна в миллисекундах, 0, если он уже наступил, или `INFINITE`,
+        если задач нет.
+    */
+    DWORD getTimeout(bc::steady_clock::time_point now) const;
     /** Удаляет из списка все задачи, чье время дедлайна раньше или равно указанному
         и сигнализирует зарегистрированным в задаче слушателем о наступлении таймаута.
     @param now
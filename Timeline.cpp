@@ -0,0 +1,158 @@
+#include "Diagnostics/Timeline.h"
+
+#include "XFS/Logger.h"
+
+#include <cstdio>
+
+#include <boost/thread/lock_guard.hpp>
+
+// Для GetCurrentProcessId и GetCurrentThreadId
+#include <windows.h>
+
+namespace bc = boost::chrono;
+
+namespace Diagnostics {
+    /// Дописывает к `out` строку `value` в виде JSON-строки, экранируя спецсимволы.
+    static void appendString(std::string& out, const char* value) {
+        out += '"';
+        for (const char* it = value; it != NULL && *it != '\0'; ++it) {
+            switch (*it) {
+                case '"':  out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n";  break;
+                case '\r': out += "\\r";  break;
+                case '\t': out += "\\t";  break;
+                default: {
+                    if ((unsigned char)*it < 0x20) {
+                        char buf[8];
+                        std::sprintf(buf, "\\u%04x", (unsigned int)(unsigned char)*it);
+                        out += buf;
+                    } else {
+                        out += *it;
+                    }
+                }
+            }
+        }
+        out += '"';
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    const std::size_t Timeline::defaultLimit;
+
+    Timeline& Timeline::instance() {
+        static Timeline timeline;
+        return timeline;
+    }
+    Timeline::Timeline() : mFile(NULL), mWritten(0), mLimit(defaultLimit), mEmpty(true), mEnabled(false) {}
+    Timeline::~Timeline() {
+        close();
+    }
+    void Timeline::open(const std::string& path, std::size_t limit) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        if (mFile != NULL) {
+            return;
+        }
+        mFile = std::fopen(path.c_str(), "wb");
+        {XFS::Logger() << "Timeline::open(path=" << path << ", limit=" << limit << ") = " << (mFile != NULL);}
+        if (mFile == NULL) {
+            return;
+        }
+        // Формат JSON Array допускает отсутствие закрывающей скобки, поэтому файл остается
+        // корректным, даже если процесс завершится аварийно.
+        mWritten = std::fwrite("[", 1, 1, mFile);
+        mEmpty = true;
+        mLimit = limit != 0 ? limit : defaultLimit;
+        mOrigin = bc::steady_clock::now();
+        mEnabled = true;
+    }
+    void Timeline::close() {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        closeLocked();
+    }
+    void Timeline::closeLocked() {
+        mEnabled = false;
+        if (mFile != NULL) {
+            std::fputs("\n]\n", mFile);
+            std::fclose(mFile);
+            mFile = NULL;
+        }
+    }
+    void Timeline::write(char phase, const char* name, const char* category, const std::string& args) {
+        // Время и поток определяем до захвата мьютекса, чтобы ожидание на нем не искажало шкалу.
+        long long ts = bc::duration_cast<bc::microseconds>(bc::steady_clock::now() - mOrigin).count();
+        DWORD tid = GetCurrentThreadId();
+
+        std::string event;
+        event.reserve(128 + args.size());
+        event += ",\n{\"name\":";
+        appendString(event, name);
+        event += ",\"cat\":";
+        appendString(event, category);
+        char buf[96];
+        std::sprintf(buf, ",\"ph\":\"%c\",\"ts\":%lld,\"pid\":%lu,\"tid\":%lu",
+            phase, ts, (unsigned long)GetCurrentProcessId(), (unsigned long)tid
+        );
+        event += buf;
+        if (phase == 'i') {
+            // Мгновенные события отображаем в рамках потока, а не всего процесса.
+            event += ",\"s\":\"t\"";
+        }
+        if (!args.empty()) {
+            event += ",\"args\":{";
+            event += args;
+            event += '}';
+        }
+        event += '}';
+
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        if (mFile == NULL) {
+            return;
+        }
+        // Разделитель нужен только между событиями.
+        const std::size_t skip = mEmpty ? 1 : 0;
+        if (mWritten + event.size() > mLimit) {
+            std::string truncated = ",\n{\"name\":\"Timeline truncated\",\"cat\":\"timeline\",\"ph\":\"i\",\"s\":\"g\"";
+            std::sprintf(buf, ",\"ts\":%lld,\"pid\":%lu,\"tid\":%lu}", ts, (unsigned long)GetCurrentProcessId(), (unsigned long)tid);
+            truncated += buf;
+            std::fwrite(truncated.data() + skip, 1, truncated.size() - skip, mFile);
+            closeLocked();
+            return;
+        }
+        mWritten += std::fwrite(event.data() + skip, 1, event.size() - skip, mFile);
+        mEmpty = false;
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    TimelineEvent::TimelineEvent(const char* name, const char* category, char phase)
+        : mName(name), mCategory(category), mPhase(phase), mEnabled(Timeline::instance().enabled()) {}
+    TimelineEvent::~TimelineEvent() {
+        if (mEnabled) {
+            Timeline::instance().write(mPhase, mName, mCategory, mArgs);
+        }
+    }
+    TimelineEvent& TimelineEvent::arg(const char* name, const char* value) {
+        if (mEnabled) {
+            if (!mArgs.empty()) {
+                mArgs += ',';
+            }
+            appendString(mArgs, name);
+            mArgs += ':';
+            appendString(mArgs, value);
+        }
+        return *this;
+    }
+    TimelineEvent& TimelineEvent::number(const char* name, long value) {
+        if (mEnabled) {
+            if (!mArgs.empty()) {
+                mArgs += ',';
+            }
+            appendString(mArgs, name);
+            char buf[24];
+            std::sprintf(buf, ":%ld", value);
+            mArgs += buf;
+        }
+        return *this;
+    }
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    TimelineSpan::TimelineSpan(const char* name, const char* category) : mEnd(name, category, 'E') {
+        TimelineEvent(name, category, 'B');
+    }
+} // namespace Diagnostics
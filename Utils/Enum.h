@@ -4,10 +4,10 @@
 #pragma once
 
 #include "Utils/CTString.h"
+#include "Utils/Hex.h"
 
 // Для std::size_t
 #include <cstddef>
-#include <iomanip>
 
 /** Класс для типобезопасного представления перечислений.
 @tparam T Тип для хранения значений перечисления.
@@ -21,10 +21,11 @@ protected:
     T mValue;
     template<class OS>
     friend inline OS& operator<<(OS& os, Enum<T, Derived> e) {
-        os << e.derived().name() << " (0x"
-           // На каждый байт требуется 2 символа.
-           << std::hex << std::setw(2*sizeof(e.mValue)) << std::setfill('0')
-           << e.mValue << ")";
+        // На каждый байт требуется 2 символа.
+        char buf[4 + 2*sizeof(T) + 2] = {' ', '(', '0', 'x'};
+        char* end = Hex::number(e.mValue, buf + 4);
+        end[0] = ')'; end[1] = '\0';
+        os << e.derived().name() << (const char*)buf;
         return os;
     }
 protected:
@@ -4,12 +4,29 @@
 #pragma once
 
 #include "Utils/CTString.h"
+#include "Utils/Hex.h"
 
 #include <cassert>
 // Для std::size_t
 #include <cstddef>
-#include <iomanip>
-#include <vector>
+
+/** Таблица названий флагов. Нулевой элемент таблицы содержит название для случая, когда
+    ни один флаг не установлен, последующие элементы -- названия для каждого флага, начиная
+    с младшего. Отсутствующие флаги обозначаются пустыми (`CTString()`) элементами.
+@par
+    Таблица лишь ссылается на статический массив с названиями, поэтому ее получение и
+    перебор не требуют выделения памяти.
+*/
+class FlagNames {
+    const CTString* mNames;
+    std::size_t mSize;
+public:
+    template<std::size_t N>
+    inline FlagNames(const CTString (&names)[N]) : mNames(names), mSize(N) {}
+
+    inline std::size_t size() const { return mSize; }
+    inline const CTString& operator[](std::size_t i) const { return mNames[i]; }
+};
 
 /** Класс для типобезопасного представления флагов, с возможностью преобразования флагов в
     текстовый вид.
@@ -29,25 +46,29 @@ protected:
     T mValue;
     template<class OS>
     friend inline OS& operator<<(OS& os, Flags<T, Derived, Count> f) {
-        // Сначала сохраняем флаги форматирования, т.к. сейчас будем их менять.
-        std::ios_base::fmtflags ff = os.flags();
         // Каждый байт представляется двумя 16-ричными цифрами. sizeof дает размер в байтах.
-        os << "0x" << std::hex << std::setfill('0') << std::setw(2*sizeof(f.mValue)) << f.mValue << " (";
-        std::vector<CTString> names = f.derived().flagNames();
+        char buf[2 + 2*sizeof(T) + 3] = {'0', 'x'};
+        char* end = Hex::number(f.mValue, buf + 2);
+        end[0] = ' '; end[1] = '('; end[2] = '\0';
+        os << (const char*)buf;
+
+        const FlagNames names = Derived::flagNames();
         bool first = true;
-        for (std::vector<CTString>::const_iterator it = names.begin(); it != names.end(); ++it) {
+        if (f.mValue == (T)0 && names.size() > 0 && names[0].isValid()) {
+            os << names[0];
+        }
+        const std::size_t size = names.size()-1 < Count ? names.size()-1 : Count;
+        for (std::size_t i = 0; i < size; ++i) {
             // Пустые значения не добавляем в список.
-            if (!it->isValid())
+            if (!(f.mValue & ((T)1 << i)) || !names[i+1].isValid())
                 continue;
             if (!first) {
                 os << " | ";
             }
-            os << *it;
+            os << names[i+1];
             first = false;
         }
         os << ")";
-        // Восстанавливаем флаги форматирования
-        os.flags(ff);
         return os;
     }
 protected:
@@ -65,39 +86,6 @@ public:
         }
         return r;
     }
-protected:
-    /** Получает список названий флагов, установленных в данный момент.
-    @tparam N
-        Размер массива с названиями флагов. Если его размер превышает количество битов,
-        которое может хранится в типе `T` (`sizeof(T)*8`), то лишние (с конца) элементы
-        массива не используются.
-
-    @param names
-        Массив с названиями флагов. Первый элемент массива содержит название для случая, когда
-        ни один флаг не установлен. Последующие элементы содержат названия для каждого флага,
-        начиная с младшего.
-
-    @return
-        Массив названий установленных флагов. Размер массива равен количеству битов,
-        которое содержится в типе `T` (`sizeof(T)*8`).
-    */
-    template<std::size_t N>
-    inline std::vector<CTString> flagNames(const CTString (&names)[N]) const {
-        const std::size_t size = N-1 < sizeof(T)*8 ? N-1 : sizeof(T)*8;
-
-        std::vector<CTString> result(sizeof(T)*8);
-        if (this->mValue == (T)0) {
-            result[0] = names[0];
-        }
-        for (std::size_t i = 0; i < size; ++i) {
-            if (this->mValue & (1 << i)) {
-                result[i+1] = names[i+1];
-            }
-        }
-        return result;
-    }
-private:
-    inline const Derived& derived() const { return *((Derived*)this); }
 };
 
 #endif // PCSC_CENXFS_BRIDGE_Utils_Flags_H
\ No newline at end of file
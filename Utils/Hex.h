@@ -0,0 +1,66 @@
+#ifndef PCSC_CENXFS_BRIDGE_Utils_Hex_H
+#define PCSC_CENXFS_BRIDGE_Utils_Hex_H
+
+#pragma once
+
+// Для std::size_t
+#include <cstddef>
+#include <ostream>
+
+/** Класс для вывода двоичных данных в 16-ричном виде, по байтам, разделенным пробелами.
+    Кодирование выполняется по таблице в буфер на стеке, который затем целиком передается
+    в поток, поэтому вывод не требует выделения памяти и не трогает флаги форматирования потока.
+*/
+class Hex {
+    const unsigned char* mBegin;
+    const unsigned char* mEnd;
+    /// Количество байт, кодируемых в буфер на стеке за один раз.
+    static const std::size_t chunk = 64;
+public:
+    Hex(const void* begin, std::size_t count)
+        : mBegin((const unsigned char*)begin), mEnd((const unsigned char*)begin + count) {}
+public:
+    /// Таблица 16-ричных цифр.
+    static inline const char* digits() { return "0123456789abcdef"; }
+    /** Записывает в буфер две 16-ричные цифры указанного байта.
+    @return Указатель на символ, следующий за последним записанным.
+    */
+    static inline char* byte(unsigned char value, char* out) {
+        out[0] = digits()[value >> 4];
+        out[1] = digits()[value & 0x0F];
+        return out + 2;
+    }
+    /** Записывает в буфер число в 16-ричном виде с ведущими нулями, по две цифры на каждый
+        байт его типа.
+    @return Указатель на символ, следующий за последним записанным.
+    */
+    template<typename T>
+    static inline char* number(T value, char* out) {
+        for (std::size_t i = sizeof(T); i > 0; --i) {
+            out = byte((unsigned char)(value >> (8 * (i - 1))), out);
+        }
+        return out;
+    }
+    /// Выводит число в 16-ричном виде с ведущими нулями, по две цифры на каждый байт его типа.
+    template<typename T>
+    static inline std::ostream& number(std::ostream& os, T value) {
+        char buf[2*sizeof(T)];
+        return os.write(buf, number(value, buf) - buf);
+    }
+private:
+    friend inline std::ostream& operator<<(std::ostream& os, const Hex& h) {
+        // На каждый байт приходится две цифры и пробел.
+        char buf[3*chunk];
+        for (const unsigned char* it = h.mBegin; it < h.mEnd;) {
+            char* out = buf;
+            const unsigned char* end = (std::size_t)(h.mEnd - it) > chunk ? it + chunk : h.mEnd;
+            for (; it < end; ++it) {
+                out = byte(*it, out);
+                *out++ = ' ';
+            }
+            os.write(buf, out - buf);
+        }
+        return os;
+    }
+};
+#endif // PCSC_CENXFS_BRIDGE_Utils_Hex_H
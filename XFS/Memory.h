@@ -3,65 +3,102 @@
 
 #pragma once
 
+#include "Diagnostics/MemoryStats.h"
+
 #include <cassert>
 // Для std::size_t
 #include <cstddef>
-// Для strlen и strncpy
+// Для std::strlen и std::memcpy
 #include <cstring>
-// Для WFMAllocateBuffer
+// Для WFMAllocateBuffer и WFMAllocateMore
 #include <xfsadmin.h>
 
 namespace XFS {
-    /** Функция, выделяющая память под структуру указанного типа менеджером памяти XFS.
-        Память, выделенная данной функцией, должна быть освобождена вызовом функции
-        `WFMFreeBuffer` (если указатель отдается вызывающему, это делает клиент DLL).
-    @tparam T Тип структуры, для которой выделяется память. Конструктор не вызывается.
+    /** Выделяет память под результат выполнения SPI-функции. Результат освобождается приложением
+        вызовом `WFSFreeResult` вместе со всеми данными, привязанными к нему (см. `Block`).
     */
-    template<typename T>
-    static T* alloc() {
-        T* result = 0;
-        HRESULT h = WFMAllocateBuffer((ULONG)sizeof(T), WFS_MEM_ZEROINIT, (void**)&result);
-        assert(h >= 0 && "Cannot allocate memory");
-        return result;
-    }
-    template<typename T>
-    static T* alloc(const T& value) {
-        T* result = 0;
-        HRESULT h = WFMAllocateBuffer((ULONG)sizeof(T), WFS_MEM_ZEROINIT, (void**)&result);
-        assert(h >= 0 && "Cannot allocate memory");
-        *result = value;
-        return result;
-    }
-    /** Функция, выделяющая память под массив структур указанного типа менеджером памяти XFS.
-        Память, выделенная данной функцией, должна быть освобождена вызовом функции
-        `WFMFreeBuffer` (если указатель отдается вызывающему, это делает клиент DLL).
-    @tparam T Тип структуры, для которой выделяется память. Конструктор не вызывается.
-    */
-    template<typename T>
-    static T* allocArr(std::size_t size) {
-        T* result = 0;
-        HRESULT h = WFMAllocateBuffer((ULONG)(sizeof(T) * size), WFS_MEM_ZEROINIT, (void**)&result);
+    static WFSRESULT* allocResult() {
+        WFSRESULT* result = 0;
+        HRESULT h = WFMAllocateBuffer((ULONG)sizeof(WFSRESULT), WFS_MEM_ZEROINIT, (void**)&result);
         assert(h >= 0 && "Cannot allocate memory");
+        Diagnostics::MemoryStats::instance().allocated("WFSRESULT", sizeof(WFSRESULT), Diagnostics::MemoryStats::Root);
         return result;
     }
 
-    class Str {
-        const char* mBegin;
-        const char* mEnd;
+    /** Размер данных результата, подсчитываемый до их выделения. Данные описываются частями в
+        том же порядке и тех же размеров, в каких потом будут получены из `Block`. Каждая часть
+        выравнивается, чтобы следующая за ней структура тоже была выровнена.
+    */
+    class Layout {
+        std::size_t mSize;
     public:
-        explicit Str(const char* str) {
-            std::size_t len = std::strlen(str) + 1;
-            char* data = allocArr<char>(len);
-            std::strncpy(data, str, len);
-            mBegin = data;
-            mEnd = data + len;
+        /// Выравнивание частей, достаточное для любых структур XFS.
+        enum { Alignment = 8 };
+    public:
+        Layout() : mSize(0) {}
+        /// Добавляет часть под `count` объектов типа `T`.
+        template<typename T>
+        inline Layout& add(std::size_t count = 1) {
+            mSize += aligned(sizeof(T) * count);
+            return *this;
         }
+        inline std::size_t size() const { return mSize; }
 
-        inline std::size_t size() const { return mEnd - mBegin; }
-        inline bool empty() const { return size() == 0; }
-        inline bool isValid() const { return mBegin != 0; }
-        inline const char* begin() const { return mBegin; }
-        inline const char* end() const { return mEnd; }
+        static inline std::size_t aligned(std::size_t size) {
+            return (size + Alignment - 1) / Alignment * Alignment;
+        }
+    };
+    /** Данные результата, выделенные одним вызовом `WFMAllocateMore` и привязанные к `WFSRESULT`.
+        Освобождаются вместе с результатом, поэтому все указатели внутри данных (массивы указателей,
+        вложенные структуры, буферы байт) должны указывать внутрь того же блока.
+    @par
+        Память выделяется обнуленной, конструкторы не вызываются.
+    */
+    class Block {
+        char* mBegin;
+        char* mNext;
+        char* mEnd;
+    public:
+        /**
+        @param original
+            Результат (или уже привязанный к нему буфер), к которому привязывается блок.
+        @param layout
+            Размер блока.
+        @param site
+            Место выделения для учета памяти (см. `Diagnostics::MemoryStats`), строковый литерал.
+        */
+        Block(LPVOID original, const Layout& layout, const char* site) : mBegin(0), mNext(0), mEnd(0) {
+            if (layout.size() == 0) {
+                return;
+            }
+            HRESULT h = WFMAllocateMore((ULONG)layout.size(), original, (void**)&mBegin);
+            assert(h >= 0 && "Cannot allocate memory");
+            Diagnostics::MemoryStats::instance().allocated(site, layout.size(), Diagnostics::MemoryStats::Linked);
+            mNext = mBegin;
+            mEnd = mBegin + layout.size();
+        }
+        /// Начало блока, `NULL`, если блок пуст.
+        inline char* begin() const { return mBegin; }
+        /// Возвращает следующую часть блока под `count` объектов типа `T`.
+        template<typename T>
+        inline T* take(std::size_t count = 1) {
+            const std::size_t size = Layout::aligned(sizeof(T) * count);
+            assert(mNext + size <= mEnd && "Block: data does not match its layout");
+            T* result = (T*)mNext;
+            mNext += size;
+            return result;
+        }
+        /// Возвращает следующую часть блока, заполненную копией `count` объектов из `data`.
+        template<typename T>
+        inline T* copy(const T* data, std::size_t count) {
+            T* result = take<T>(count);
+            std::memcpy(result, data, sizeof(T) * count);
+            return result;
+        }
+        /// Возвращает следующую часть блока с копией строки, включая завершающий 0.
+        inline LPSTR copy(const char* str) {
+            return copy(str, std::strlen(str) + 1);
+        }
     };
 } // namespace XFS
 #endif // PCSC_CENXFS_BRIDGE_XFS_Memory_H
\ No newline at end of file
@@ -6,7 +6,6 @@
 #include "Utils/CTString.h"
 #include "Utils/Flags.h"
 
-#include <vector>
 // Для DWORD
 #include <windef.h>
 // PC/CS API
@@ -23,9 +22,10 @@ namespace XFS {
     public:
         ReadFlags(DWORD value) : _Base(value) {}
 
-        const std::vector<CTString> flagNames() const {
-            static CTString names[] = {
-                // CTString("WFS_IDC_NOTSUPP"     ), // 0x0000
+        static FlagNames flagNames() {
+            static const CTString null;
+            static const CTString names[] = {
+                null,                                // 0x0000
                 CTString("WFS_IDC_TRACK1"      ), // 0x0001 Track 1 of the magnetic stripe will be read.
                 CTString("WFS_IDC_TRACK2"      ), // 0x0002 Track 2 of the magnetic stripe will be read.
                 CTString("WFS_IDC_TRACK3"      ), // 0x0004 Track 3 of the magnetic stripe will be read.
@@ -34,18 +34,12 @@ namespace XFS {
                 // If the IDC Flux Sensor is programmable it will be disabled in order
                 // to allow chip data to be read on cards which have no magnetic stripes.
                 CTString("WFS_IDC_FLUXINACTIVE"), // 0x0020
+                null, null,                          // 0x0040, 0x0080
+                null, null, null, null,              // 0x0100 - 0x0800
+                null, null, null,                    // 0x1000 - 0x4000
                 CTString("WFS_IDC_TRACK_WM"    ), // 0x8000
             };
-            std::vector<CTString> result;
-            int i = -1;
-            ++i; if (value() & WFS_IDC_TRACK1      ) result.push_back(names[i]);
-            ++i; if (value() & WFS_IDC_TRACK2      ) result.push_back(names[i]);
-            ++i; if (value() & WFS_IDC_TRACK3      ) result.push_back(names[i]);
-            ++i; if (value() & WFS_IDC_CHIP        ) result.push_back(names[i]);
-            ++i; if (value() & WFS_IDC_SECURITY    ) result.push_back(names[i]);
-            ++i; if (value() & WFS_IDC_FLUXINACTIVE) result.push_back(names[i]);
-            ++i; if (value() & WFS_IDC_TRACK_WM    ) result.push_back(names[i]);
-            return result;
+            return names;
         }
     };
 } // namespace XFS
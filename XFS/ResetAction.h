@@ -6,7 +6,6 @@
 #include "Utils/CTString.h"
 #include "Utils/Flags.h"
 
-#include <vector>
 // Для WORD
 #include <windef.h>
 // PC/CS API
@@ -33,18 +32,15 @@ namespace XFS {
             return SCARD_LEAVE_CARD;
         }
 
-        const std::vector<CTString> flagNames() const {
-            static CTString names[] = {
+        static FlagNames flagNames() {
+            static const CTString names[] = {
+                CTString(),                       // 0x0000
+                CTString(),                       // 0x0001
                 CTString("WFS_IDC_CHIPPOWERCOLD"),// 0x0002
                 CTString("WFS_IDC_CHIPPOWERWARM"),// 0x0004
                 CTString("WFS_IDC_CHIPPOWEROFF" ),// 0x0008
             };
-            std::vector<CTString> result;
-            int i = -1;
-            ++i; if (value() & WFS_IDC_CHIPPOWERCOLD) result.push_back(names[i]);
-            ++i; if (value() & WFS_IDC_CHIPPOWERWARM) result.push_back(names[i]);
-            ++i; if (value() & WFS_IDC_CHIPPOWEROFF ) result.push_back(names[i]);
-            return result;
+            return names;
         }
     };
 } // namespace XFS
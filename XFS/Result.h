@@ -6,6 +6,9 @@
 #include "Utils/CTString.h"
 #include "Utils/Enum.h"
 
+#include "Diagnostics/FlightRecorder.h"
+#include "Diagnostics/Timeline.h"
+
 #include "PCSC/Status.h"
 
 #include "XFS/Logger.h"
@@ -62,9 +65,19 @@ namespace XFS {
         }
     };
 
-    /** Класс для представления результата выполнения XFS SPI-метода. */
+    /** Класс для представления результата выполнения XFS SPI-метода. Данные результата
+        выделяются через `allocate` и освобождаются приложением вместе с ним.
+    */
     class Result {
+        /// Функция, переносящая указатели внутри данных на копию блока (см. `clone`).
+        typedef void (*Relocate)(LPVOID data, const char* from, char* to);
+    private:
         WFSRESULT* pResult;
+        /// Первый блок данных результата и его размер, `NULL`, если данных нет.
+        char* mData;
+        std::size_t mDataSize;
+        /// Перенос указателей для прикрепленных данных, `NULL`, если в них нет указателей.
+        Relocate mRelocate;
     public:
         Result(REQUESTID ReqID, HSERVICE hService, PCSC::Status result) {
             init(ReqID, hService, result.translate());
@@ -72,6 +85,51 @@ namespace XFS {
         Result(REQUESTID ReqID, HSERVICE hService, HRESULT result) {
             init(ReqID, hService, result);
         }
+    public:
+        /** Выделяет память под данные результата одним блоком, привязанным к результату.
+        @param site
+            Место выделения для учета памяти (см. `Diagnostics::MemoryStats`), строковый литерал.
+        */
+        inline Block allocate(const Layout& layout, const char* site) {
+            assert(pResult != NULL);
+            Block block(pResult, layout, site);
+            if (mData == NULL) {
+                mData = block.begin();
+                mDataSize = layout.size();
+            }
+            return block;
+        }
+        /** Создает копию результата для еще одного получателя события: время и данные остаются
+            теми же, копируется только заголовок и блок данных, без повторного их построения.
+            Каждый получатель освобождает свою копию сам.
+        @par
+            Копия должна быть сделана до отправки исходного результата, т.к. после нее он
+            принадлежит приложению. Данные должны быть выделены одним вызовом `allocate`.
+        */
+        Result clone() const {
+            assert(pResult != NULL);
+            Result result(*this);
+            result.pResult = XFS::allocResult();
+            *result.pResult = *pResult;
+            if (mData != NULL) {
+                assert((char*)pResult->lpBuffer >= mData && (char*)pResult->lpBuffer < mData + mDataSize
+                    && "Result::clone: data must be allocated in one block"
+                );
+                result.mData = NULL;
+                char* data = result.allocate(Layout().add<char>(mDataSize), "Result::clone").copy(mData, mDataSize);
+                result.pResult->lpBuffer = data + ((char*)pResult->lpBuffer - mData);
+                if (mRelocate != NULL) {
+                    mRelocate(result.pResult->lpBuffer, mData, data);
+                }
+            }
+            return result;
+        }
+        /// Заменяет код завершения, если он стал известен только после заполнения данных.
+        inline Result& status(PCSC::Status result) {
+            assert(pResult != NULL);
+            pResult->hResult = result.translate();
+            return *this;
+        }
     public:// Заполнение результатов команд WFPGetInfo
         /// Прикрепляет к результату указанные данные статуса.
         inline Result& attach(WFSIDCSTATUS* data) {
@@ -87,6 +145,21 @@ namespace XFS {
             pResult->lpBuffer = data;
             return *this;
         }
+        /** Прикрепляет к результату копию строки с данными вендорской категории.
+        @param dwCategory
+            Вендорская категория `WFPGetInfo`, данные которой возвращаются.
+        @param text
+            Возвращаемые данные.
+        @param site
+            Место выделения для учета памяти (см. `Diagnostics::MemoryStats`), строковый литерал.
+        */
+        inline Result& attach(DWORD dwCategory, const std::string& text, const char* site) {
+            assert(pResult != NULL);
+            assert(pResult->lpBuffer == NULL && "Result already has data!");
+            pResult->u.dwCommandCode = dwCategory;
+            pResult->lpBuffer = allocate(Layout().add<CHAR>(text.size() + 1), site).copy(text.c_str(), text.size() + 1);
+            return *this;
+        }
     public:// Заполнение результатов команд WFPExecute
         /// Прикрепляет к результату указанные данные чтения карточки.
         inline Result& attach(WFSIDCCARDDATA** data) {
@@ -112,12 +185,13 @@ namespace XFS {
             return *this;
         }
     public:
-        /// Прикрепляет к результату указанные данные возможностей устройства.
+        /// Прикрепляет к результату указанные данные состояния устройства.
         inline Result& attach(WFSDEVSTATUS* data) {
             assert(pResult != NULL);
             assert(pResult->lpBuffer == NULL && "Result already has data!");
             pResult->u.dwEventID = WFS_SYSE_DEVICE_STATUS;
             pResult->lpBuffer = data;
+            mRelocate = &relocateDevStatus;
             return *this;
         }
     public:// События доступности карты в считывателе.
@@ -143,8 +217,9 @@ namespace XFS {
             assert(pResult != NULL);
             assert(pResult->lpBuffer == NULL && "Result already has data!");
             pResult->u.dwEventID = WFS_SRVE_IDC_MEDIADETECTED;
-            //TODO: Возможно, необходимо выделять память через WFSAllocateMore
-            pResult->lpBuffer = XFS::alloc<DWORD>(WFS_IDC_CARDREADPOSITION);
+            DWORD* position = allocate(Layout().add<DWORD>(), "Result::cardDetected").take<DWORD>();
+            *position = WFS_IDC_CARDREADPOSITION;
+            pResult->lpBuffer = position;
             return *this;
         }
     public:
@@ -158,11 +233,27 @@ namespace XFS {
             assert(pResult != NULL);
             Logger() << "Result::send(hWnd=" << hWnd << ", type=" << MsgType(messageType)
                      << ") with result " << Status(pResult->hResult) << " for ReqID=" << pResult->RequestID;
+            Diagnostics::TimelineEvent("Result::send", "xfs")
+                .arg("type", MsgType(messageType).name())
+                .arg("hService", pResult->hService)
+                .arg("ReqID", pResult->RequestID)
+                .arg("hResult", pResult->hResult);
+            Diagnostics::FlightRecorder& recorder = Diagnostics::FlightRecorder::instance();
+            recorder.record(Diagnostics::FlightRecorder::Post,
+                MsgType(messageType).name().begin(), pResult->hService, pResult->RequestID, pResult->hResult
+            );
+            // Содержимое самописца интересно в первую очередь тогда, когда что-то пошло не так.
+            if (pResult->hResult == WFS_ERR_INTERNAL_ERROR || pResult->hResult == WFS_ERR_HARDWARE_ERROR) {
+                recorder.dump(pResult->hResult == WFS_ERR_INTERNAL_ERROR ? "WFS_ERR_INTERNAL_ERROR" : "WFS_ERR_HARDWARE_ERROR");
+            }
             PostMessage(hWnd, messageType, NULL, (LPARAM)pResult);
         }
     private:
         inline void init(REQUESTID ReqID, HSERVICE hService, HRESULT result) {
-            pResult = XFS::alloc<WFSRESULT>();
+            mData = NULL;
+            mDataSize = 0;
+            mRelocate = NULL;
+            pResult = XFS::allocResult();
             pResult->RequestID = ReqID;
             pResult->hService = hService;
             pResult->hResult = result;
@@ -170,6 +261,16 @@ namespace XFS {
 
             assert(pResult->lpBuffer == NULL);
         }
+        /// Строки `WFSDEVSTATUS` расположены в том же блоке, что и сама структура.
+        static void relocateDevStatus(LPVOID data, const char* from, char* to) {
+            WFSDEVSTATUS* status = (WFSDEVSTATUS*)data;
+            if (status->lpszPhysicalName != NULL) {
+                status->lpszPhysicalName = to + (status->lpszPhysicalName - from);
+            }
+            if (status->lpszWorkstationName != NULL) {
+                status->lpszWorkstationName = to + (status->lpszWorkstationName - from);
+            }
+        }
     };
 } // namespace XFS
 #endif // PCSC_CENXFS_BRIDGE_XFS_Result_H
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef PCSC_CENXFS_BRIDGE_XFS_Vendor_H
+#define PCSC_CENXFS_BRIDGE_XFS_Vendor_H
+
+#pragma once
+
+// Определения для ридеров карт (Identification card unit (IDC))
+#include <XFSIDC.h>
+
+/** @file
+    Вендорские расширения класса IDC, не описанные в стандарте CEN/XFS. Номера выбраны
+    вдали от стандартных, чтобы не пересекаться с категориями и командами будущих версий.
+*/
+
+/** Категория `WFPGetInfo`: статистика обмена с чипом по командам (CLA/INS). Дополнительных
+    параметров нет. В `lpBuffer` результата возвращается строка `LPSTR` с JSON-объектом.
+*/
+#define WFS_INF_IDC_VENDOR_APDU_STATS (IDC_SERVICE_OFFSET + 90)
+/** Категория `WFPGetInfo`: счетчики выделений памяти XFS по местам выделения. Дополнительных
+    параметров нет. В `lpBuffer` результата возвращается строка `LPSTR` с JSON-объектом.
+    Счетчики ведутся, только если включена настройка `MemoryStats`.
+*/
+#define WFS_INF_IDC_VENDOR_MEMORY_STATS (IDC_SERVICE_OFFSET + 91)
+
+/** Команда `WFPExecute`: сбросить содержимое бортового самописца в файл. Входных и выходных
+    параметров нет. Завершается с `WFS_ERR_SOFTWARE_ERROR`, если файл записать не удалось.
+*/
+#define WFS_CMD_IDC_VENDOR_DUMP_FLIGHT_RECORDER (IDC_SERVICE_OFFSET + 90)
+/** Команда `WFPExecute`: сбросить кэш настроек провайдеров (см. `SettingsCache`), чтобы сервисы,
+    открываемые после нее, прочитали конфигурацию заново. Входных и выходных параметров нет.
+*/
+#define WFS_CMD_IDC_VENDOR_REREAD_SETTINGS (IDC_SERVICE_OFFSET + 91)
+
+#endif // PCSC_CENXFS_BRIDGE_XFS_Vendor_H